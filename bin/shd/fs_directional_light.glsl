@@ -88,11 +88,13 @@ vec4 PixelToWorld(vec2 screenCoord, float depth, mat4 invView, mat4 invProjectio
 
 void main()
 {
-	vec4 baseColor = texture(BaseColorTexture,in_TexCoords).rgba;
-    vec3 normal = texture(NormalTexture, in_TexCoords).xyz;
-	vec2 metallicRoughness = texture(MetallicRoughnessTexture, in_TexCoords).xy;
-    vec3 emissive = texture(EmissiveTexture, in_TexCoords).rgb;
-    float depth = texture(DepthStencil, in_TexCoords).r;
+    // the frame might only cover a sub-rect of the geometry buffer
+    vec2 sampleCoords = gl_FragCoord.xy / vec2(textureSize(DepthStencil, 0));
+	vec4 baseColor = texture(BaseColorTexture,sampleCoords).rgba;
+    vec3 normal = texture(NormalTexture, sampleCoords).xyz;
+	vec2 metallicRoughness = texture(MetallicRoughnessTexture, sampleCoords).xy;
+    vec3 emissive = texture(EmissiveTexture, sampleCoords).rgb;
+    float depth = texture(DepthStencil, sampleCoords).r;
     
     vec3 worldSpacePos = PixelToWorld(in_TexCoords, depth, InvView, InvProjection).xyz;
 
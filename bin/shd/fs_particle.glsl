@@ -0,0 +1,16 @@
+#version 430
+layout(location=0) in vec2 in_Corner;
+layout(location=1) in vec4 in_Color;
+
+out vec4 out_Color;
+
+void main()
+{
+	// soft round sprite
+	float distance = length(in_Corner);
+	if (distance >= 1.0f)
+		discard;
+	float alpha = in_Color.a * (1.0f - smoothstep(0.5f, 1.0f, distance));
+	// premultiplied, blended with GL_ONE and either GL_ONE_MINUS_SRC_ALPHA or GL_ONE
+	out_Color = vec4(in_Color.rgb * alpha, alpha);
+}
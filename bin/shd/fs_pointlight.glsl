@@ -21,10 +21,12 @@ uniform float LightRadius;
 void main()
 {
     vec2 texCoords = ((in_NDC.xy / in_NDC.w) + 1.0f) * 0.5f;
-	vec4 baseColor = texture(BaseColorTexture,texCoords).rgba;
-    vec3 normal = texture(NormalTexture, texCoords).xyz;
-	vec2 metallicRoughness = texture(MetallicRoughnessTexture, texCoords).xy;
-    float depth = texture(DepthStencil, texCoords).r;
+    // the frame might only cover a sub-rect of the geometry buffer
+    vec2 sampleCoords = gl_FragCoord.xy / vec2(textureSize(DepthStencil, 0));
+	vec4 baseColor = texture(BaseColorTexture,sampleCoords).rgba;
+    vec3 normal = texture(NormalTexture, sampleCoords).xyz;
+	vec2 metallicRoughness = texture(MetallicRoughnessTexture, sampleCoords).xy;
+    float depth = texture(DepthStencil, sampleCoords).r;
 
     vec3 worldSpacePos = PixelToWorld(texCoords, depth, InvView, InvProjection).xyz;
 
@@ -9,12 +9,14 @@ layout(location=1) out vec3 out_Normal;
 layout(location=2) out vec2 out_Properties;
 layout(location=3) out vec3 out_Emissive;
 
-layout(location=0) uniform sampler2D BaseColorTexture;
-layout(location=1) uniform sampler2D NormalTexture;
+layout(location=0) uniform sampler2DArray BaseColorTexture;
+layout(location=1) uniform sampler2DArray NormalTexture;
 // GLTF 2.0 spec: metallicRoughness = Its green channel contains roughness values and its blue channel contains metalness values.
-layout(location=2) uniform sampler2D MetallicRoughnessTexture;
-layout(location=3) uniform sampler2D EmissiveTexture;
-layout(location=4) uniform sampler2D OcclusionTexture;
+layout(location=2) uniform sampler2DArray MetallicRoughnessTexture;
+layout(location=3) uniform sampler2DArray EmissiveTexture;
+layout(location=4) uniform sampler2DArray OcclusionTexture;
+// layer of each texture in its array, in the same order as the samplers
+uniform int TextureLayers[5];
 
 uniform vec4 BaseColorFactor;
 uniform vec4 EmissiveFactor;
@@ -25,23 +27,32 @@ uniform float AlphaCutoff;
 vec3 CalcNormal(in vec4 tangent, in vec3 binormal, in vec3 normal, in vec3 bumpData)
 {
     mat3 tangentViewMatrix = mat3(tangent.xyz, binormal.xyz, normal.xyz);
-    return tangentViewMatrix * ((bumpData.xyz * 2.0f) - 1.0f);
+    // z is reconstructed, since compressed normal maps only store x and y
+    vec2 xy = (bumpData.xy * 2.0f) - 1.0f;
+    return tangentViewMatrix * vec3(xy, sqrt(max(0.0f, 1.0f - dot(xy, xy))));
 }
 
 void main()
 {
-	vec4 baseColor = texture(BaseColorTexture,in_TexCoords).rgba * BaseColorFactor;
+	vec4 baseColor = texture(BaseColorTexture, vec3(in_TexCoords, TextureLayers[0])).rgba * BaseColorFactor;
 	
+#ifdef ALPHA_MASK
 	if (baseColor.a <= AlphaCutoff)
 		discard;
+#endif
 
-    vec4 metallicRoughness = texture(MetallicRoughnessTexture, in_TexCoords) * vec4(1.0f, RoughnessFactor, MetallicFactor, 1.0f);
-    vec4 emissive = texture(EmissiveTexture, in_TexCoords) * EmissiveFactor;
-    vec4 occlusion = texture(OcclusionTexture, in_TexCoords);
-    vec4 normal = texture(NormalTexture, in_TexCoords);
+    vec4 metallicRoughness = texture(MetallicRoughnessTexture, vec3(in_TexCoords, TextureLayers[2])) * vec4(1.0f, RoughnessFactor, MetallicFactor, 1.0f);
+    vec4 emissive = texture(EmissiveTexture, vec3(in_TexCoords, TextureLayers[3])) * EmissiveFactor;
+    vec4 occlusion = texture(OcclusionTexture, vec3(in_TexCoords, TextureLayers[4]));
+    vec4 normal = texture(NormalTexture, vec3(in_TexCoords, TextureLayers[1]));
 
     vec3 binormal = cross(in_Normal, in_Tangent.xyz) * in_Tangent.w;
     vec3 N = (CalcNormal(in_Tangent, binormal, in_Normal, normal.xyz));
+#ifdef DOUBLE_SIDED
+    // back faces are lit from their own side
+    if (!gl_FrontFacing)
+        N = -N;
+#endif
     
     // TODO: Occlusion should be multiplied with the diffuse term
     //       Maybe bake occlusion into alpha of albedo?
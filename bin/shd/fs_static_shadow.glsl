@@ -1,14 +1,17 @@
 #version 430
 layout(location=3) in vec2 in_TexCoords;
 
-layout(location=0) uniform sampler2D BaseColorTexture;
+layout(location=0) uniform sampler2DArray BaseColorTexture;
+uniform int BaseColorLayer;
 uniform vec4 BaseColorFactor;
 uniform float AlphaCutoff;
 
 void main()
 {
-	vec4 diffuseColor = texture(BaseColorTexture, in_TexCoords).rgba * BaseColorFactor;
+#ifdef ALPHA_MASK
+	vec4 diffuseColor = texture(BaseColorTexture, vec3(in_TexCoords, BaseColorLayer)).rgba * BaseColorFactor;
 	if (diffuseColor.a <= AlphaCutoff)
 		discard; // do not write depth
+#endif
     return;
 }
\ No newline at end of file
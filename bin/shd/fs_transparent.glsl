@@ -0,0 +1,54 @@
+#version 430
+layout(location=0) in vec3 in_WorldSpacePos;
+layout(location=1) in vec3 in_Normal;
+layout(location=2) in vec4 in_Tangent;
+layout(location=3) in vec2 in_TexCoords;
+
+// weighted blended order-independent transparency, McGuire and Bavoil 2013
+layout(location=0) out vec4 out_Accumulation;
+layout(location=1) out float out_Revealage;
+
+layout(location=0) uniform sampler2DArray BaseColorTexture;
+layout(location=1) uniform sampler2DArray NormalTexture;
+layout(location=3) uniform sampler2DArray EmissiveTexture;
+// layer of each texture in its array, in the same order as the samplers
+uniform int TextureLayers[5];
+
+uniform vec4 BaseColorFactor;
+uniform vec4 EmissiveFactor;
+
+uniform vec3 GlobalLightDirection;
+uniform vec3 GlobalLightColor;
+
+vec3 CalcNormal(in vec4 tangent, in vec3 binormal, in vec3 normal, in vec3 bumpData)
+{
+    mat3 tangentViewMatrix = mat3(tangent.xyz, binormal.xyz, normal.xyz);
+    vec2 xy = (bumpData.xy * 2.0f) - 1.0f;
+    return tangentViewMatrix * vec3(xy, sqrt(max(0.0f, 1.0f - dot(xy, xy))));
+}
+
+void main()
+{
+    vec4 baseColor = texture(BaseColorTexture, vec3(in_TexCoords, TextureLayers[0])) * BaseColorFactor;
+    vec4 emissive = texture(EmissiveTexture, vec3(in_TexCoords, TextureLayers[3])) * EmissiveFactor;
+    vec4 normal = texture(NormalTexture, vec3(in_TexCoords, TextureLayers[1]));
+
+    vec3 binormal = cross(in_Normal, in_Tangent.xyz) * in_Tangent.w;
+    vec3 N = normalize(CalcNormal(in_Tangent, binormal, in_Normal, normal.xyz));
+    if (!gl_FrontFacing)
+        N = -N;
+
+    // same unshadowed terms as the deferred directional light
+    float diffuse = max(dot(GlobalLightDirection, N), 0.0);
+    vec3 light = (GlobalLightColor * 8.0f) * (baseColor.rgb * diffuse);
+    light += emissive.rgb;
+    light += baseColor.rgb * 0.002f;
+    // the light target holds gamma encoded colors
+    vec3 color = pow(light, vec3(0.45454545f));
+
+    // favour close and opaque surfaces, since there is no sorting
+    float alpha = baseColor.a;
+    float weight = clamp(pow(min(1.0f, alpha * 10.0f) + 0.01f, 3.0f) * 1e8 * pow(1.0f - gl_FragCoord.z * 0.9f, 3.0f), 1e-2, 3e3);
+    out_Accumulation = vec4(color * alpha, alpha) * weight;
+    out_Revealage = alpha;
+}
@@ -0,0 +1,19 @@
+#version 430
+layout(location=0) uniform sampler2D AccumulationTexture;
+layout(location=1) uniform sampler2D RevealageTexture;
+
+out vec4 out_Color;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    // product of (1 - alpha) of all transparent surfaces covering the pixel
+    float revealage = texelFetch(RevealageTexture, texel, 0).r;
+    if (revealage >= 1.0f)
+        discard;
+
+    vec4 accumulation = texelFetch(AccumulationTexture, texel, 0);
+    vec3 averageColor = accumulation.rgb / max(accumulation.a, 1e-5);
+    // blended with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+    out_Color = vec4(averageColor, 1.0f - revealage);
+}
@@ -0,0 +1,16 @@
+#version 430
+layout(location=0) in vec2 in_TexCoords;
+
+layout(location=0) uniform sampler2D SourceTexture;
+// size of the rendered sub-rect relative to the full source texture
+layout(location=1) uniform vec2 SourceScale;
+
+out vec4 out_Color;
+
+void main()
+{
+    // keep the bilinear footprint inside the rendered sub-rect
+    vec2 halfTexel = 0.5f / vec2(textureSize(SourceTexture, 0));
+    vec2 sampleCoords = clamp(in_TexCoords * SourceScale, halfTexel, SourceScale - halfTexel);
+	out_Color = vec4(texture(SourceTexture, sampleCoords).rgb, 1.0f);
+}
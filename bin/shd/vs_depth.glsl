@@ -0,0 +1,14 @@
+#version 430
+layout(location=0) in vec3 in_Position;
+
+uniform mat4 ViewProjection;
+uniform mat4 Model;
+
+// must match vs_static.glsl exactly, the geometry pass tests depth for equality
+invariant gl_Position;
+
+void main()
+{
+	vec4 wPos = (Model * vec4(in_Position, 1.0f));
+	gl_Position = ViewProjection * wPos;
+}
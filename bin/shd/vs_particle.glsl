@@ -0,0 +1,31 @@
+#version 430
+layout(location=0) out vec2 out_Corner;
+layout(location=1) out vec4 out_Color;
+
+// all particles of the frame, the particles of a batch are consecutive
+layout(std430, binding=0) readonly buffer ParticlePositions
+{
+	vec4 PositionSizes[];
+};
+layout(std430, binding=2) readonly buffer ParticleColors
+{
+	uint Colors[];
+};
+
+uniform mat4 ViewProjection;
+uniform vec3 CameraRight;
+uniform vec3 CameraUp;
+uniform int FirstParticle;
+
+void main()
+{
+	int particle = FirstParticle + gl_InstanceID;
+	vec4 positionSize = PositionSizes[particle];
+	// triangle strip of the quad corners
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0f - 1.0f;
+	vec3 wPos = positionSize.xyz + (CameraRight * corner.x + CameraUp * corner.y) * (positionSize.w * 0.5f);
+
+	out_Corner = corner;
+	out_Color = unpackUnorm4x8(Colors[particle]);
+	gl_Position = ViewProjection * vec4(wPos, 1.0f);
+}
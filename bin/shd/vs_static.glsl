@@ -4,6 +4,17 @@ layout(location=0) in vec3 in_Position;
 layout(location=1) in vec3 in_Normal;
 layout(location=2) in vec4 in_Tangent;
 layout(location=3) in vec2 in_TexCoord_0;
+#ifdef SKINNED
+layout(location=5) in vec4 in_Joints;
+layout(location=6) in vec4 in_Weights;
+
+// skinning matrices of all animation instances
+layout(std430, binding=1) readonly buffer JointPalettes
+{
+	mat4 Joints[];
+};
+uniform int FirstJoint;
+#endif
 
 layout(location=0) out vec3 out_WorldSpacePos;
 layout(location=1) out vec3 out_Normal;
@@ -13,15 +24,28 @@ layout(location=3) out vec2 out_TexCoords;
 uniform mat4 ViewProjection;
 uniform mat4 Model;
 
+// the depth pre-pass in vs_depth.glsl has to produce the same positions
+invariant gl_Position;
+
 void main()
 {
+#ifdef SKINNED
+	mat4 skin = in_Weights.x * Joints[FirstJoint + int(in_Joints.x)]
+		+ in_Weights.y * Joints[FirstJoint + int(in_Joints.y)]
+		+ in_Weights.z * Joints[FirstJoint + int(in_Joints.z)]
+		+ in_Weights.w * Joints[FirstJoint + int(in_Joints.w)];
+	mat4 model = Model * skin;
+	vec4 wPos = (model * vec4(in_Position, 1.0f));
+#else
+	mat4 model = Model;
 	vec4 wPos = (Model * vec4(in_Position, 1.0f));
+#endif
 
 	out_WorldSpacePos = wPos.xyz;
 	out_TexCoords = in_TexCoord_0;
-	out_Tangent = vec4(normalize((Model * vec4(in_Tangent.xyz, 0)).xyz), in_Tangent.w);
+	out_Tangent = vec4(normalize((model * vec4(in_Tangent.xyz, 0)).xyz), in_Tangent.w);
     //out_Normal = normalize((Model * vec4(in_Normal, 0)).xyz);
-    out_Normal = normalize((Model * vec4(in_Normal, 0)).xyz);
+    out_Normal = normalize((model * vec4(in_Normal, 0)).xyz);
     
 	gl_Position = ViewProjection * wPos;
 }
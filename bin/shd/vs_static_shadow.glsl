@@ -1,6 +1,17 @@
 #version 430
 layout(location=0) in vec3 in_Position;
 layout(location=3) in vec2 in_TexCoord_0;
+#ifdef SKINNED
+layout(location=5) in vec4 in_Joints;
+layout(location=6) in vec4 in_Weights;
+
+// skinning matrices of all animation instances
+layout(std430, binding=1) readonly buffer JointPalettes
+{
+	mat4 Joints[];
+};
+uniform int FirstJoint;
+#endif
 
 layout(location=3) out vec2 out_TexCoords;
 
@@ -11,5 +22,13 @@ uniform mat4 Model;
 void main()
 {
 	out_TexCoords = in_TexCoord_0;
+#ifdef SKINNED
+	mat4 skin = in_Weights.x * Joints[FirstJoint + int(in_Joints.x)]
+		+ in_Weights.y * Joints[FirstJoint + int(in_Joints.y)]
+		+ in_Weights.z * Joints[FirstJoint + int(in_Joints.z)]
+		+ in_Weights.w * Joints[FirstJoint + int(in_Joints.w)];
+	gl_Position = Projection * View * Model * skin * vec4(in_Position, 1.0f);
+#else
 	gl_Position = Projection * View * Model * vec4(in_Position, 1.0f);
+#endif
 }
@@ -32,6 +32,8 @@ constexpr uint16_t MAX_CVARS = 1024;
 uint16_t cVarOffset = 0;
 CVar cVars[MAX_CVARS];
 std::unordered_map<std::string, uint16_t> cVarTable;
+/// command line values of cvars that haven't been created yet
+std::unordered_map<std::string, std::string> cVarOverrides;
 
 //------------------------------------------------------------------------------
 /**
@@ -59,7 +61,16 @@ CVarCreate(CVarCreateInfo const& info)
     ptr->modified = false;
     if (info.description != nullptr)
         ptr->description = info.description;
-    CVarParseWrite(ptr, info.defaultValue);
+    auto it = cVarOverrides.find(name);
+    if (it != cVarOverrides.end())
+    {
+        CVarParseWrite(ptr, it->second.c_str());
+        cVarOverrides.erase(it);
+    }
+    else
+    {
+        CVarParseWrite(ptr, info.defaultValue);
+    }
     cVarTable.insert_or_assign(info.name, varIndex);
     return ptr;
 }
@@ -116,6 +127,33 @@ CVarParseWrite(CVar* cVar, const char* value)
     }
 }
 
+//------------------------------------------------------------------------------
+/**
+    Arguments look like `+r_headless 1 +cl_frames 600`. Anything not starting
+    with a plus is left for the application.
+*/
+void
+CVarParseCommandLine(int argc, const char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '+' || argv[i][1] == '\0')
+            continue;
+        if (i + 1 >= argc)
+        {
+            printf("CVar '%s' is missing a value\n", argv[i] + 1);
+            break;
+        }
+        const char* name = argv[i] + 1;
+        const char* value = argv[++i];
+        CVar* cVar = CVarGet(name);
+        if (cVar != nullptr)
+            CVarParseWrite(cVar, value);
+        else
+            cVarOverrides.insert_or_assign(name, value);
+    }
+}
+
 //------------------------------------------------------------------------------
 /**
 */
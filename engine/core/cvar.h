@@ -52,6 +52,8 @@ CVar* CVarCreate(CVarType type, const char* name, const char* defaultValue, cons
 CVar* CVarGet(const char* name);
 /// Parse value from c string and assign to cvar
 void CVarParseWrite(CVar*, const char* value);
+/// Apply `+name value` pairs from the command line. Values for cvars that don't exist yet replace their default when they are created.
+void CVarParseCommandLine(int argc, const char** argv);
 /// Write float value to cvar
 void CVarWriteFloat(CVar*, float value);
 /// Write int value to cvar
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+//  hash.cc
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "hash.h"
+#include <cstring>
+
+namespace Core
+{
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline uint64_t
+RotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline uint64_t
+Read64(uint8_t const* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline uint32_t
+Read32(uint8_t const* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline uint64_t
+Round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = RotateLeft(acc, 31);
+    return acc * PRIME1;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static inline uint64_t
+MergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= Round(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Four independent lanes consume 32 bytes per iteration, the tail is mixed in
+    8, 4 and 1 bytes at a time. Assumes a little endian machine.
+*/
+uint64_t
+Hash64(void const* data, size_t bytes, uint64_t seed)
+{
+    uint8_t const* p = (uint8_t const*)data;
+    uint8_t const* const end = p + bytes;
+    uint64_t hash;
+
+    if (bytes >= 32)
+    {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        uint8_t const* const limit = end - 32;
+        do
+        {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        hash = MergeRound(hash, v1);
+        hash = MergeRound(hash, v2);
+        hash = MergeRound(hash, v3);
+        hash = MergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + PRIME5;
+    }
+
+    hash += (uint64_t)bytes;
+    for (; p + 8 <= end; p += 8)
+        hash = RotateLeft(hash ^ Round(0, Read64(p)), 27) * PRIME1 + PRIME4;
+    if (p + 4 <= end)
+    {
+        hash = RotateLeft(hash ^ (Read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        hash = RotateLeft(hash ^ (*p * PRIME5), 11) * PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+} // namespace Core
@@ -0,0 +1,21 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+    @file hash.h
+
+    Contains hash functions for content addressing
+
+    @copyright
+    (C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <cstdint>
+#include <cstddef>
+
+namespace Core
+{
+
+/// 64 bit hash of a block of memory, XXH64. Fast enough to hash whole files and vertex buffers.
+uint64_t Hash64(void const* data, size_t bytes, uint64_t seed = 0);
+
+} // namespace Core
@@ -86,9 +86,10 @@ namespace Util
         this->freeIds.push(i.index);
 #if _DEBUG
         // if you get this warning, you might want to consider reserving more bits for the generation.
-        if (this->generations[i.index] <= 0x3FF) printf("WARNING: Id generation overflow!");
+        if (this->generations[i.index] == 0x3FF) printf("WARNING: Id generation overflow!");
 #endif
-        this->generations[i.index]++;
+        // wrap like the 10 bit generation of the ids, or recycled ids would never be valid again
+        this->generations[i.index] = (this->generations[i.index] + 1) & 0x3FF;
 
     }
 
@@ -0,0 +1,258 @@
+//------------------------------------------------------------------------------
+//  @file jobsystem.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "jobsystem.h"
+#include "profiler.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+namespace Core
+{
+namespace JobSystem
+{
+
+/// a ParallelFor call in progress, lives on the stack of the caller
+struct Batch
+{
+    RangeFunc const* func;
+    uint32_t count;
+    uint32_t grainSize;
+    uint32_t numChunks;
+    std::atomic<uint32_t> nextChunk{ 0 };
+    std::atomic<uint32_t> finishedChunks{ 0 };
+    // number of workers currently holding a pointer to the batch
+    std::atomic<uint32_t> users{ 0 };
+};
+
+/// job system singleton state
+struct State
+{
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable workAvailable;
+    // a batch is queued once per worker that should help with it
+    std::deque<Batch*> queue;
+    // background jobs, only picked up when there are no batches, since someone is waiting for those
+    std::deque<Job> jobs;
+    // jobs submitted but not finished
+    uint32_t pendingJobs = 0;
+    std::condition_variable jobsDone;
+    bool stopRequested = false;
+};
+
+static State* state = nullptr;
+static thread_local uint32_t threadIndex = 0;
+
+//------------------------------------------------------------------------------
+/**
+    Executes chunks of a batch until none are left.
+*/
+static void
+ExecuteChunks(Batch& batch)
+{
+    for (;;)
+    {
+        uint32_t const chunk = batch.nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= batch.numChunks)
+            break;
+
+        uint32_t const begin = chunk * batch.grainSize;
+        uint32_t const end = std::min(begin + batch.grainSize, batch.count);
+        (*batch.func)(begin, end, threadIndex);
+        batch.finishedChunks.fetch_add(1, std::memory_order_release);
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+WorkerMain(uint32_t index)
+{
+    threadIndex = index;
+    N_PROFILE_THREAD("Worker");
+
+    for (;;)
+    {
+        Batch* batch = nullptr;
+        Job job;
+        {
+            std::unique_lock<std::mutex> guard(state->lock);
+            state->workAvailable.wait(guard, []() { return state->stopRequested || !state->queue.empty() || !state->jobs.empty(); });
+            if (state->stopRequested)
+                return;
+
+            if (!state->queue.empty())
+            {
+                batch = state->queue.front();
+                state->queue.pop_front();
+                batch->users.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                job = std::move(state->jobs.front());
+                state->jobs.pop_front();
+            }
+        }
+
+        if (batch != nullptr)
+        {
+            {
+                N_PROFILE_SCOPE("ParallelFor");
+                ExecuteChunks(*batch);
+            }
+            batch->users.fetch_sub(1, std::memory_order_release);
+        }
+        else
+        {
+            {
+                N_PROFILE_SCOPE("Job");
+                job();
+            }
+            std::lock_guard<std::mutex> guard(state->lock);
+            if (--state->pendingJobs == 0)
+                state->jobsDone.notify_all();
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Create(int numWorkers)
+{
+    n_assert(state == nullptr);
+    state = new State();
+
+    if (numWorkers < 0)
+        numWorkers = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+
+    for (int i = 0; i < numWorkers; i++)
+        state->workers.emplace_back(WorkerMain, (uint32_t)i + 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Destroy()
+{
+    if (state == nullptr)
+        return;
+    WaitForJobs();
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stopRequested = true;
+    }
+    state->workAvailable.notify_all();
+    for (std::thread& worker : state->workers)
+        worker.join();
+
+    delete state;
+    state = nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t
+GetNumThreads()
+{
+    return state != nullptr ? (uint32_t)state->workers.size() + 1 : 1;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+ParallelFor(uint32_t count, uint32_t grainSize, RangeFunc const& func)
+{
+    if (count == 0)
+        return;
+
+    grainSize = std::max(grainSize, 1u);
+    uint32_t const numChunks = (count + grainSize - 1) / grainSize;
+
+    // run inline if there is nobody to help, or nothing to split
+    if (state == nullptr || state->workers.empty() || numChunks == 1)
+    {
+        for (uint32_t begin = 0; begin < count; begin += grainSize)
+            func(begin, std::min(begin + grainSize, count), threadIndex);
+        return;
+    }
+
+    Batch batch;
+    batch.func = &func;
+    batch.count = count;
+    batch.grainSize = grainSize;
+    batch.numChunks = numChunks;
+
+    // the caller takes chunks too, so only wake as many workers as there are chunks left for them
+    uint32_t const numHelpers = std::min((uint32_t)state->workers.size(), numChunks - 1);
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        for (uint32_t i = 0; i < numHelpers; i++)
+            state->queue.push_back(&batch);
+    }
+    if (numHelpers == state->workers.size())
+        state->workAvailable.notify_all();
+    else
+        for (uint32_t i = 0; i < numHelpers; i++)
+            state->workAvailable.notify_one();
+
+    ExecuteChunks(batch);
+
+    // workers that have not picked up the batch yet are not needed anymore
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->queue.erase(std::remove(state->queue.begin(), state->queue.end(), &batch), state->queue.end());
+    }
+
+    // wait for chunks still running on workers, and for the workers to let go of the batch
+    while (batch.finishedChunks.load(std::memory_order_acquire) < numChunks || batch.users.load(std::memory_order_acquire) != 0)
+        std::this_thread::yield();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Submit(Job const& job)
+{
+    if (state == nullptr || state->workers.empty())
+    {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->jobs.push_back(job);
+        state->pendingJobs++;
+    }
+    state->workAvailable.notify_one();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+WaitForJobs()
+{
+    if (state == nullptr)
+        return;
+
+    std::unique_lock<std::mutex> guard(state->lock);
+    state->jobsDone.wait(guard, []() { return state->pendingJobs == 0; });
+}
+
+} // namespace JobSystem
+} // namespace Core
@@ -0,0 +1,50 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+    @file jobsystem.h
+
+    A pool of worker threads for data parallel work.
+
+    ParallelFor splits a range into chunks that are picked up by the workers
+    and by the calling thread, and returns once all chunks are done. Several
+    threads may run ParallelFor at the same time. Submit queues a job that runs
+    in the background, for work like decoding files while the game goes on.
+
+    Every thread that executes chunks has a thread index, the caller is always
+    index 0 and the workers are 1 to GetNumThreads() - 1. Use it to write into
+    per-thread buffers without locking.
+
+    Without Create, or with zero workers, all work runs inline on the caller.
+
+    @copyright
+    (C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <functional>
+
+namespace Core
+{
+
+namespace JobSystem
+{
+    /// called with the range [begin, end) of a chunk and the index of the executing thread
+    typedef std::function<void(uint32_t begin, uint32_t end, uint32_t threadIndex)> RangeFunc;
+    typedef std::function<void()> Job;
+
+    /// start the worker threads. Uses one worker less than the number of hardware threads by default.
+    void Create(int numWorkers = -1);
+    /// join all worker threads. Does nothing if the job system isn't running.
+    void Destroy();
+
+    /// number of threads that can execute chunks, including the calling thread
+    uint32_t GetNumThreads();
+
+    /// run func over [0, count) in chunks of grainSize and wait until all chunks are done
+    void ParallelFor(uint32_t count, uint32_t grainSize, RangeFunc const& func);
+    /// run a job on a worker without waiting for it. Runs inline if there are no workers.
+    void Submit(Job const& job);
+    /// wait until all submitted jobs have finished
+    void WaitForJobs();
+} // namespace JobSystem
+
+} // namespace Core
@@ -0,0 +1,98 @@
+//------------------------------------------------------------------------------
+//  mappedfile.cc
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "mappedfile.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Core
+{
+
+//------------------------------------------------------------------------------
+/**
+*/
+MappedFile::~MappedFile()
+{
+    this->Close();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+MappedFile::Open(const char* path)
+{
+    this->Close();
+#ifdef _WIN32
+    HANDLE const file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    HANDLE const mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    void const* const view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr)
+    {
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    this->file = file;
+    this->mapping = mapping;
+    this->data = (uint8_t const*)view;
+    this->size = (size_t)size.QuadPart;
+#else
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+
+    // the whole file is about to be read, so start reading it in right away
+    madvise(view, (size_t)info.st_size, MADV_WILLNEED);
+    this->data = (uint8_t const*)view;
+    this->size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+MappedFile::Close()
+{
+    if (this->data == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(this->data);
+    CloseHandle((HANDLE)this->mapping);
+    CloseHandle((HANDLE)this->file);
+    this->file = nullptr;
+    this->mapping = nullptr;
+#else
+    munmap((void*)this->data, this->size);
+#endif
+    this->data = nullptr;
+    this->size = 0;
+}
+
+} // namespace Core
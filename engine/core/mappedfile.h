@@ -0,0 +1,44 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+    @file mappedfile.h
+
+    Read only memory mapping of a whole file
+
+    @copyright
+    (C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <cstdint>
+#include <cstddef>
+
+namespace Core
+{
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    void operator=(MappedFile const&) = delete;
+
+    /// map a file, returns false if it does not exist or can not be mapped
+    bool Open(const char* path);
+    /// unmap the file
+    void Close();
+
+    /// mapped contents, only valid while the file is open
+    uint8_t const* GetData() const { return this->data; }
+    size_t GetSize() const { return this->size; }
+
+private:
+    uint8_t const* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+} // namespace Core
@@ -0,0 +1,244 @@
+//------------------------------------------------------------------------------
+//  @file profiler.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "profiler.h"
+#include <mutex>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+
+namespace Core
+{
+namespace Profiler
+{
+
+/// maximum number of zones a single thread can record during one capture
+static const uint32 EVENTS_PER_THREAD = 1 << 16;
+
+struct Event
+{
+    const char* name;
+    uint64 begin;
+    uint64 end;
+};
+
+/// written only by the owning thread, read by the main thread when exporting
+struct ThreadBuffer
+{
+    Event events[EVENTS_PER_THREAD];
+    std::atomic<uint32> count = { 0 };
+    // capture this buffer was last written for, stale buffers are reset on first write
+    std::atomic<uint32> generation = { 0 };
+    std::atomic<uint32> dropped = { 0 };
+    uint32 threadId = 0;
+    const char* name = nullptr;
+};
+
+std::atomic<bool> capturing = { false };
+
+static std::atomic<uint32> captureGeneration = { 0 };
+static thread_local ThreadBuffer* threadBuffer = nullptr;
+
+// only touched when a thread records its first zone and when exporting
+static std::mutex bufferLock;
+static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+// capture state, owned by the main thread
+static int requestedFrames = 0;
+static int remainingFrames = 0;
+static std::string capturePath;
+static std::vector<uint64> frameMarks;
+// clock at the first and last frame mark, used to convert ticks to time
+static std::chrono::steady_clock::time_point captureStart;
+static std::chrono::steady_clock::time_point captureEnd;
+static uint32 mainThreadId = 0;
+
+//------------------------------------------------------------------------------
+/**
+*/
+static ThreadBuffer*
+GetThreadBuffer()
+{
+    if (threadBuffer == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(bufferLock);
+        buffers.emplace_back(new ThreadBuffer());
+        threadBuffer = buffers.back().get();
+        threadBuffer->threadId = (uint32)buffers.size() - 1;
+    }
+    return threadBuffer;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+RecordZone(const char* name, uint64 begin, uint64 end)
+{
+    ThreadBuffer* buffer = GetThreadBuffer();
+    uint32 const generation = captureGeneration.load(std::memory_order_relaxed);
+    if (buffer->generation.load(std::memory_order_relaxed) != generation)
+    {
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->generation.store(generation, std::memory_order_release);
+    }
+
+    uint32 const index = buffer->count.load(std::memory_order_relaxed);
+    if (index >= EVENTS_PER_THREAD)
+    {
+        // only the owning thread writes, so no read-modify-write is needed
+        buffer->dropped.store(buffer->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    Event& event = buffer->events[index];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    // publish the event to the exporting thread
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SetThreadName(const char* name)
+{
+    GetThreadBuffer()->name = name;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+CaptureFrames(int numFrames, const char* path)
+{
+#ifndef N_PROFILER_ENABLED
+    n_warning("Profiler is disabled, build with N_PROFILER_ENABLED to capture frames.\n");
+    return;
+#endif
+    n_assert(numFrames > 0);
+    if (IsCaptureActive())
+    {
+        n_warning("A profiler capture is already running!\n");
+        return;
+    }
+    requestedFrames = numFrames;
+    capturePath = path;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+IsCaptureActive()
+{
+    return requestedFrames > 0 || remainingFrames > 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+WriteTrace()
+{
+    FILE* file = fopen(capturePath.c_str(), "w");
+    if (file == nullptr)
+    {
+        n_warning("Could not open profiler trace '%s' for writing!\n", capturePath.c_str());
+        return;
+    }
+
+    uint64 const origin = frameMarks.front();
+    double const elapsedUs = std::chrono::duration<double, std::micro>(captureEnd - captureStart).count();
+    double const usPerTick = elapsedUs / std::max(double(frameMarks.back() - origin), 1.0);
+    uint32 const generation = captureGeneration.load(std::memory_order_relaxed);
+    uint32 numEvents = 0;
+    uint32 numDropped = 0;
+    bool first = true;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    std::lock_guard<std::mutex> lock(bufferLock);
+    for (auto const& buffer : buffers)
+    {
+        if (buffer->name != nullptr)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", buffer->threadId, buffer->name);
+            first = false;
+        }
+
+        if (buffer->generation.load(std::memory_order_acquire) != generation)
+            continue;
+
+        uint32 const count = buffer->count.load(std::memory_order_acquire);
+        for (uint32 i = 0; i < count; i++)
+        {
+            Event const& event = buffer->events[i];
+            // zones that began before the first frame mark are cut off
+            if (event.end < origin)
+                continue;
+            uint64 const begin = std::max(event.begin, origin);
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+                event.name, buffer->threadId, (begin - origin) * usPerTick, (event.end - begin) * usPerTick);
+            first = false;
+            numEvents++;
+        }
+        numDropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+
+    // frames as top level zones on the main thread
+    for (size_t i = 0; i + 1 < frameMarks.size(); i++)
+    {
+        fprintf(file, "%s{\"name\":\"Frame %u\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+            (uint32)i, mainThreadId, (frameMarks[i] - origin) * usPerTick, (frameMarks[i + 1] - frameMarks[i]) * usPerTick);
+        first = false;
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    n_printf("Profiler: wrote %u zones over %u frames to '%s'\n", numEvents, (uint32)frameMarks.size() - 1, capturePath.c_str());
+    if (numDropped > 0)
+        n_warning("Profiler: %u zones were dropped, the capture is incomplete.\n", numDropped);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameMark()
+{
+    uint64 const now = Timestamp();
+
+    if (remainingFrames > 0)
+    {
+        frameMarks.push_back(now);
+        if (--remainingFrames == 0)
+        {
+            captureEnd = std::chrono::steady_clock::now();
+            capturing.store(false, std::memory_order_relaxed);
+            WriteTrace();
+        }
+    }
+
+    if (requestedFrames > 0)
+    {
+        mainThreadId = GetThreadBuffer()->threadId;
+        frameMarks.clear();
+        frameMarks.push_back(now);
+        captureStart = std::chrono::steady_clock::now();
+        remainingFrames = requestedFrames;
+        requestedFrames = 0;
+        captureGeneration.fetch_add(1, std::memory_order_relaxed);
+        capturing.store(true, std::memory_order_relaxed);
+    }
+}
+
+} // namespace Profiler
+} // namespace Core
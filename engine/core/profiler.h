@@ -0,0 +1,94 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+    @file profiler.h
+
+    Hierarchical CPU profiler.
+
+    Zones are recorded with the N_PROFILE_SCOPE macro and only while a capture
+    is running. Each thread writes into its own event buffer, so recording a
+    zone never takes a lock. A capture spans a number of frames, delimited by
+    N_PROFILE_FRAME, and is written as a Chrome trace (chrome://tracing or
+    ui.perfetto.dev) once the last frame has finished.
+
+    All macros compile to nothing unless N_PROFILER_ENABLED is defined.
+
+    @copyright
+    (C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <atomic>
+#include <chrono>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace Core
+{
+
+namespace Profiler
+{
+    /// capture the next numFrames frames and write them as a Chrome trace to path
+    void CaptureFrames(int numFrames, const char* path);
+    /// returns true while frames are being captured, or a capture is waiting for the next frame
+    bool IsCaptureActive();
+    /// mark the beginning of a new frame. Must be called from the main thread.
+    void FrameMark();
+    /// name the calling thread in the exported trace. Name must have static lifetime.
+    void SetThreadName(const char* name);
+
+    /// store a finished zone in the calling thread's event buffer
+    void RecordZone(const char* name, uint64 begin, uint64 end);
+
+    /// set while a capture is running, zones are not recorded otherwise
+    extern std::atomic<bool> capturing;
+
+    /// current time in profiler ticks. Uses the cpu time stamp counter where available, since it is a lot cheaper than the system clock.
+    inline uint64
+    Timestamp()
+    {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /// scoped zone helper
+    struct ScopedZone
+    {
+        ScopedZone(const char* name) : name(name)
+        {
+            this->begin = capturing.load(std::memory_order_relaxed) ? Timestamp() : 0;
+        }
+        ~ScopedZone()
+        {
+            if (this->begin != 0)
+                RecordZone(this->name, this->begin, Timestamp());
+        }
+        const char* name;
+        uint64 begin;
+    };
+};
+
+} // namespace Core
+
+#ifdef N_PROFILER_ENABLED
+#define N_PROFILE_CONCAT_IMPL(a, b) a##b
+#define N_PROFILE_CONCAT(a, b) N_PROFILE_CONCAT_IMPL(a, b)
+/// profile from this point until the end of the scope. Name must have static lifetime.
+#define N_PROFILE_SCOPE(name) Core::Profiler::ScopedZone N_PROFILE_CONCAT(__profileZone, __LINE__)(name)
+/// profile the enclosing function
+#define N_PROFILE_FUNCTION() N_PROFILE_SCOPE(__FUNCTION__)
+/// mark the beginning of a frame
+#define N_PROFILE_FRAME() Core::Profiler::FrameMark()
+/// name the current thread
+#define N_PROFILE_THREAD(name) Core::Profiler::SetThreadName(name)
+#else
+#define N_PROFILE_SCOPE(name)
+#define N_PROFILE_FUNCTION()
+#define N_PROFILE_FRAME()
+#define N_PROFILE_THREAD(name)
+#endif
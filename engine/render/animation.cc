@@ -0,0 +1,936 @@
+//------------------------------------------------------------------------------
+//  @file animation.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "animation.h"
+#include "gltf.h"
+#include "core/jobsystem.h"
+#include "core/profiler.h"
+#include "gtc/type_ptr.hpp"
+#include "gtx/matrix_decompose.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace Render
+{
+namespace Animation
+{
+
+// instances per job
+static const uint32_t INSTANCE_GRAIN_SIZE = 16;
+// largest error key reduction may introduce
+static const float TRANSLATION_TOLERANCE = 0.0001f;
+static const float SCALE_TOLERANCE = 0.0001f;
+// distance between unit quaternions, about half the angle in radians
+static const float ROTATION_TOLERANCE = 0.0002f;
+static const float SQRT_HALF = 0.70710678f;
+
+/// translation, rotation and scale of four joints, one joint per lane
+struct alignas(16) JointSoA
+{
+	__m128 translation[3];
+	__m128 rotation[4];
+	__m128 scale[3];
+};
+
+struct Skeleton
+{
+	std::string uri;
+	uint32_t numJoints;
+	// parent joint in skin order, -1 for roots
+	std::vector<int32_t> parents;
+	// joints with parents before children
+	std::vector<uint32_t> order;
+	// transform of the nodes above a root joint, identity for other joints
+	std::vector<glm::mat4> rootTransforms;
+	std::vector<glm::mat4> inverseBindMatrices;
+	// (numJoints + 3) / 4 blocks, unused lanes hold the identity
+	std::vector<JointSoA> restPose;
+	// joint of every node of the file, -1 for nodes outside the skin
+	std::vector<int32_t> nodeJoints;
+};
+
+enum class TrackType : uint8_t
+{
+	Translation,
+	Rotation,
+	Scale
+};
+
+struct Track
+{
+	uint32_t joint;
+	TrackType type;
+	bool step;
+	uint32_t firstKey;
+	uint32_t numKeys;
+	// dequantization of translations and scales
+	float rangeMin[3];
+	float rangeScale[3];
+};
+
+struct Clip
+{
+	SkeletonId skeleton;
+	float duration;
+	std::vector<Track> tracks;
+	// key times in 1/65535 of the duration
+	std::vector<uint16_t> times;
+	// three quantized components per key
+	std::vector<uint16_t> values;
+	uint32_t sourceKeys;
+};
+
+struct Layer
+{
+	ClipId clip = InvalidResourceId;
+	float time = 0.0f;
+	float weight = 0.0f;
+};
+
+struct Instance
+{
+	SkeletonId skeleton;
+	Layer layers[MAX_LAYERS];
+	uint32_t firstJoint = NO_JOINTS;
+	bool active = false;
+};
+
+/// per thread working memory of Update
+struct Scratch
+{
+	std::vector<JointSoA> pose;
+	std::vector<JointSoA> blended;
+	std::vector<glm::mat4> local;
+	std::vector<glm::mat4> model;
+};
+
+static std::vector<Skeleton> skeletons;
+static std::vector<Clip> clips;
+static std::vector<Instance> instances;
+static std::vector<InstanceId> freeInstances;
+static std::vector<glm::mat4> palettes;
+static std::vector<Scratch> scratches;
+
+//------------------------------------------------------------------------------
+/**
+*/
+static bool
+LoadDocument(std::string const& uri, fx::gltf::Document& doc)
+{
+	try
+	{
+		if (uri.substr(uri.find_last_of(".") + 1) == "glb")
+			doc = fx::gltf::LoadFromBinary(uri);
+		else
+			doc = fx::gltf::LoadFromText(uri);
+	}
+	catch (const std::exception& err)
+	{
+		n_warning("Could not load '%s': %s\n", uri.c_str(), err.what());
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Reads an accessor as floats, converting normalized integers.
+*/
+static std::vector<float>
+ReadFloats(fx::gltf::Document const& doc, int32_t index, uint32_t components)
+{
+	fx::gltf::Accessor const& accessor = doc.accessors[index];
+	fx::gltf::BufferView const& view = doc.bufferViews[accessor.bufferView];
+	uint8_t const* const data = doc.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+
+	uint32_t componentSize = 4;
+	switch (accessor.componentType)
+	{
+	case fx::gltf::Accessor::ComponentType::Byte:
+	case fx::gltf::Accessor::ComponentType::UnsignedByte:
+		componentSize = 1;
+		break;
+	case fx::gltf::Accessor::ComponentType::Short:
+	case fx::gltf::Accessor::ComponentType::UnsignedShort:
+		componentSize = 2;
+		break;
+	default:
+		break;
+	}
+	uint32_t const stride = view.byteStride != 0 ? view.byteStride : componentSize * components;
+
+	std::vector<float> values((size_t)accessor.count * components);
+	for (uint32_t i = 0; i < accessor.count; i++)
+	{
+		uint8_t const* const element = data + (size_t)i * stride;
+		for (uint32_t c = 0; c < components; c++)
+		{
+			float value = 0.0f;
+			switch (accessor.componentType)
+			{
+			case fx::gltf::Accessor::ComponentType::Float:
+				memcpy(&value, element + c * 4, 4);
+				break;
+			case fx::gltf::Accessor::ComponentType::Byte:
+				value = std::max(((int8_t const*)element)[c] / 127.0f, -1.0f);
+				break;
+			case fx::gltf::Accessor::ComponentType::UnsignedByte:
+				value = element[c] / 255.0f;
+				break;
+			case fx::gltf::Accessor::ComponentType::Short:
+				value = std::max(((int16_t const*)element)[c] / 32767.0f, -1.0f);
+				break;
+			case fx::gltf::Accessor::ComponentType::UnsignedShort:
+				value = ((uint16_t const*)element)[c] / 65535.0f;
+				break;
+			default:
+				break;
+			}
+			values[(size_t)i * components + c] = value;
+		}
+	}
+	return values;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+GetNodeTransform(fx::gltf::Node const& node, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale)
+{
+	glm::mat4 matrix;
+	memcpy(&matrix[0][0], node.matrix.data(), sizeof(matrix));
+	if (matrix != glm::mat4(1.0f))
+	{
+		glm::vec3 skew;
+		glm::vec4 perspective;
+		glm::decompose(matrix, scale, rotation, translation, skew, perspective);
+		return;
+	}
+	translation = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+	rotation = glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+	scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+SetLane(__m128& v, uint32_t lane, float value)
+{
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, v);
+	lanes[lane] = value;
+	v = _mm_load_ps(lanes);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+SkeletonId
+LoadSkeleton(std::string const& uri, uint32_t skin)
+{
+	N_PROFILE_SCOPE("Animation::LoadSkeleton");
+	fx::gltf::Document doc;
+	if (!LoadDocument(uri, doc) || skin >= doc.skins.size())
+		return InvalidResourceId;
+	fx::gltf::Skin const& gltfSkin = doc.skins[skin];
+
+	Skeleton skeleton;
+	skeleton.uri = uri;
+	skeleton.numJoints = (uint32_t)gltfSkin.joints.size();
+	skeleton.nodeJoints.assign(doc.nodes.size(), -1);
+	for (uint32_t j = 0; j < skeleton.numJoints; j++)
+		skeleton.nodeJoints[gltfSkin.joints[j]] = (int32_t)j;
+
+	std::vector<int32_t> nodeParents(doc.nodes.size(), -1);
+	for (size_t n = 0; n < doc.nodes.size(); n++)
+	{
+		for (int32_t const child : doc.nodes[n].children)
+			nodeParents[child] = (int32_t)n;
+	}
+
+	skeleton.parents.assign(skeleton.numJoints, -1);
+	skeleton.rootTransforms.assign(skeleton.numJoints, glm::mat4(1.0f));
+	std::vector<uint32_t> depths(skeleton.numJoints, 0);
+	for (uint32_t j = 0; j < skeleton.numJoints; j++)
+	{
+		int32_t const parentNode = nodeParents[gltfSkin.joints[j]];
+		if (parentNode != -1 && skeleton.nodeJoints[parentNode] != -1)
+		{
+			skeleton.parents[j] = skeleton.nodeJoints[parentNode];
+			continue;
+		}
+		// roots keep the transform of the nodes above them
+		for (int32_t node = parentNode; node != -1; node = nodeParents[node])
+		{
+			glm::vec3 translation, scale;
+			glm::quat rotation;
+			GetNodeTransform(doc.nodes[node], translation, rotation, scale);
+			skeleton.rootTransforms[j] = glm::translate(translation) * glm::mat4_cast(rotation) * glm::scale(scale) * skeleton.rootTransforms[j];
+		}
+	}
+	for (uint32_t j = 0; j < skeleton.numJoints; j++)
+	{
+		for (int32_t p = skeleton.parents[j]; p != -1; p = skeleton.parents[p])
+			depths[j]++;
+		skeleton.order.push_back(j);
+	}
+	std::stable_sort(skeleton.order.begin(), skeleton.order.end(), [&depths](uint32_t a, uint32_t b) { return depths[a] < depths[b]; });
+
+	skeleton.inverseBindMatrices.assign(skeleton.numJoints, glm::mat4(1.0f));
+	if (gltfSkin.inverseBindMatrices != -1)
+	{
+		std::vector<float> const matrices = ReadFloats(doc, gltfSkin.inverseBindMatrices, 16);
+		size_t const numMatrices = std::min(matrices.size() / 16, (size_t)skeleton.numJoints);
+		for (size_t j = 0; j < numMatrices; j++)
+			skeleton.inverseBindMatrices[j] = glm::make_mat4(&matrices[j * 16]);
+	}
+
+	JointSoA identity;
+	for (int i = 0; i < 3; i++)
+	{
+		identity.translation[i] = _mm_setzero_ps();
+		identity.rotation[i] = _mm_setzero_ps();
+		identity.scale[i] = _mm_set1_ps(1.0f);
+	}
+	identity.rotation[3] = _mm_set1_ps(1.0f);
+	skeleton.restPose.assign((skeleton.numJoints + 3) / 4, identity);
+	for (uint32_t j = 0; j < skeleton.numJoints; j++)
+	{
+		glm::vec3 translation, scale;
+		glm::quat rotation;
+		GetNodeTransform(doc.nodes[gltfSkin.joints[j]], translation, rotation, scale);
+		JointSoA& block = skeleton.restPose[j / 4];
+		for (int i = 0; i < 3; i++)
+		{
+			SetLane(block.translation[i], j % 4, translation[i]);
+			SetLane(block.scale[i], j % 4, scale[i]);
+		}
+		SetLane(block.rotation[0], j % 4, rotation.x);
+		SetLane(block.rotation[1], j % 4, rotation.y);
+		SetLane(block.rotation[2], j % 4, rotation.z);
+		SetLane(block.rotation[3], j % 4, rotation.w);
+	}
+
+	skeletons.push_back(std::move(skeleton));
+	return (SkeletonId)(skeletons.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+EncodeRotation(float const* q, uint16_t* out)
+{
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		if (fabsf(q[i]) > fabsf(q[largest]))
+			largest = i;
+	}
+	// q and -q are the same rotation, so the largest component is always positive
+	float const sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+	uint32_t c = 0;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float const normalized = glm::clamp(q[i] * sign / SQRT_HALF * 0.5f + 0.5f, 0.0f, 1.0f);
+		out[c++] = (uint16_t)lroundf(normalized * 32767.0f);
+	}
+	out[0] |= (uint16_t)((largest >> 1) << 15);
+	out[1] |= (uint16_t)((largest & 1) << 15);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+DecodeRotation(uint16_t const* in, float* q)
+{
+	uint32_t const largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+	float sum = 0.0f;
+	uint32_t c = 0;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		q[i] = ((in[c++] & 0x7FFF) / 32767.0f * 2.0f - 1.0f) * SQRT_HALF;
+		sum += q[i] * q[i];
+	}
+	q[largest] = sqrtf(std::max(0.0f, 1.0f - sum));
+}
+
+//------------------------------------------------------------------------------
+/**
+	Interpolates between two keys, with normalized linear interpolation for
+	rotations.
+*/
+static void
+Interpolate(float const* a, float const* b, float t, bool rotation, float* out)
+{
+	uint32_t const components = rotation ? 4 : 3;
+	float sign = 1.0f;
+	if (rotation && a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.0f)
+		sign = -1.0f;
+	float length = 0.0f;
+	for (uint32_t c = 0; c < components; c++)
+	{
+		out[c] = a[c] + (b[c] * sign - a[c]) * t;
+		length += out[c] * out[c];
+	}
+	if (rotation)
+	{
+		float const scale = length > 0.0f ? 1.0f / sqrtf(length) : 0.0f;
+		for (uint32_t c = 0; c < 4; c++)
+			out[c] *= scale;
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static float
+KeyError(float const* a, float const* b, bool rotation)
+{
+	uint32_t const components = rotation ? 4 : 3;
+	float sign = 1.0f;
+	if (rotation && a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.0f)
+		sign = -1.0f;
+	float error = 0.0f;
+	for (uint32_t c = 0; c < components; c++)
+		error += (a[c] - b[c] * sign) * (a[c] - b[c] * sign);
+	return sqrtf(error);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Returns the keys to keep. Constant tracks keep one key, and a key is
+	dropped while interpolating between the last kept key and the one after it
+	reproduces all keys in between within the tolerance.
+*/
+static std::vector<uint32_t>
+ReduceKeys(std::vector<float> const& times, std::vector<float> const& values, uint32_t components, bool step, float tolerance)
+{
+	uint32_t const numKeys = (uint32_t)times.size();
+	bool const rotation = components == 4;
+	std::vector<uint32_t> kept = { 0 };
+
+	bool constant = true;
+	for (uint32_t k = 1; k < numKeys && constant; k++)
+		constant = KeyError(&values[0], &values[k * components], rotation) <= tolerance;
+	if (constant)
+		return kept;
+
+	uint32_t last = 0;
+	for (uint32_t k = 1; k + 1 < numKeys; k++)
+	{
+		bool redundant = true;
+		if (step)
+			redundant = KeyError(&values[last * components], &values[k * components], rotation) <= tolerance;
+		for (uint32_t s = last + 1; s <= k && redundant && !step; s++)
+		{
+			float const t = (times[s] - times[last]) / std::max(times[k + 1] - times[last], 1e-6f);
+			float interpolated[4];
+			Interpolate(&values[last * components], &values[(k + 1) * components], t, rotation, interpolated);
+			redundant = KeyError(interpolated, &values[s * components], rotation) <= tolerance;
+		}
+		if (!redundant)
+		{
+			kept.push_back(k);
+			last = k;
+		}
+	}
+	if (numKeys > 1)
+		kept.push_back(numKeys - 1);
+	return kept;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Cubic spline channels keep their values and are interpolated linearly.
+*/
+ClipId
+LoadClip(std::string const& uri, SkeletonId skeletonId, uint32_t animation)
+{
+	N_PROFILE_SCOPE("Animation::LoadClip");
+	fx::gltf::Document doc;
+	if (skeletonId >= skeletons.size() || !LoadDocument(uri, doc) || animation >= doc.animations.size())
+		return InvalidResourceId;
+	Skeleton const& skeleton = skeletons[skeletonId];
+	fx::gltf::Animation const& gltfAnimation = doc.animations[animation];
+	if (skeleton.nodeJoints.size() != doc.nodes.size())
+	{
+		n_warning("'%s' does not match the skeleton loaded from '%s'\n", uri.c_str(), skeleton.uri.c_str());
+		return InvalidResourceId;
+	}
+
+	Clip clip;
+	clip.skeleton = skeletonId;
+	clip.duration = 0.0f;
+	clip.sourceKeys = 0;
+	for (fx::gltf::Animation::Channel const& channel : gltfAnimation.channels)
+	{
+		fx::gltf::Animation::Sampler const& sampler = gltfAnimation.samplers[channel.sampler];
+		std::vector<float> const times = ReadFloats(doc, sampler.input, 1);
+		if (!times.empty())
+			clip.duration = std::max(clip.duration, times.back());
+	}
+	float const timeScale = clip.duration > 0.0f ? 65535.0f / clip.duration : 0.0f;
+
+	for (fx::gltf::Animation::Channel const& channel : gltfAnimation.channels)
+	{
+		if (channel.target.node < 0 || skeleton.nodeJoints[channel.target.node] == -1)
+			continue;
+
+		Track track = {};
+		track.joint = (uint32_t)skeleton.nodeJoints[channel.target.node];
+		if (channel.target.path == "translation")
+			track.type = TrackType::Translation;
+		else if (channel.target.path == "rotation")
+			track.type = TrackType::Rotation;
+		else if (channel.target.path == "scale")
+			track.type = TrackType::Scale;
+		else
+			continue;
+
+		fx::gltf::Animation::Sampler const& sampler = gltfAnimation.samplers[channel.sampler];
+		uint32_t const components = track.type == TrackType::Rotation ? 4 : 3;
+		std::vector<float> const times = ReadFloats(doc, sampler.input, 1);
+		std::vector<float> values = ReadFloats(doc, sampler.output, components);
+		if (times.empty())
+			continue;
+		if (sampler.interpolation == fx::gltf::Animation::Sampler::Type::CubicSpline)
+		{
+			// drop the tangents
+			std::vector<float> points(times.size() * components);
+			for (size_t k = 0; k < times.size(); k++)
+				std::copy_n(&values[(k * 3 + 1) * components], components, &points[k * components]);
+			values = std::move(points);
+		}
+		track.step = sampler.interpolation == fx::gltf::Animation::Sampler::Type::Step;
+		clip.sourceKeys += (uint32_t)times.size();
+
+		float const tolerance = track.type == TrackType::Rotation ? ROTATION_TOLERANCE : (track.type == TrackType::Scale ? SCALE_TOLERANCE : TRANSLATION_TOLERANCE);
+		std::vector<uint32_t> const keys = ReduceKeys(times, values, components, track.step, tolerance);
+
+		if (track.type != TrackType::Rotation)
+		{
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				float minimum = values[c];
+				float maximum = values[c];
+				for (uint32_t const k : keys)
+				{
+					minimum = std::min(minimum, values[k * 3 + c]);
+					maximum = std::max(maximum, values[k * 3 + c]);
+				}
+				track.rangeMin[c] = minimum;
+				track.rangeScale[c] = (maximum - minimum) / 65535.0f;
+			}
+		}
+
+		track.firstKey = (uint32_t)clip.times.size();
+		track.numKeys = (uint32_t)keys.size();
+		for (uint32_t const k : keys)
+		{
+			clip.times.push_back((uint16_t)lroundf(glm::clamp(times[k] * timeScale, 0.0f, 65535.0f)));
+			uint16_t encoded[3];
+			if (track.type == TrackType::Rotation)
+			{
+				EncodeRotation(&values[k * 4], encoded);
+			}
+			else
+			{
+				for (uint32_t c = 0; c < 3; c++)
+					encoded[c] = track.rangeScale[c] > 0.0f ? (uint16_t)lroundf((values[k * 3 + c] - track.rangeMin[c]) / track.rangeScale[c]) : 0;
+			}
+			clip.values.insert(clip.values.end(), encoded, encoded + 3);
+		}
+		clip.tracks.push_back(track);
+	}
+
+	clips.push_back(std::move(clip));
+	return (ClipId)(clips.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+float
+GetClipDuration(ClipId clip)
+{
+	return clips[clip].duration;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+GetClipKeyCounts(ClipId clip, uint32_t& sourceKeys, uint32_t& keys)
+{
+	sourceKeys = clips[clip].sourceKeys;
+	keys = (uint32_t)clips[clip].times.size();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+DecodeKey(Clip const& clip, Track const& track, uint32_t key, float* out)
+{
+	uint16_t const* const encoded = &clip.values[(size_t)(track.firstKey + key) * 3];
+	if (track.type == TrackType::Rotation)
+	{
+		DecodeRotation(encoded, out);
+		return;
+	}
+	for (uint32_t c = 0; c < 3; c++)
+		out[c] = track.rangeMin[c] + encoded[c] * track.rangeScale[c];
+}
+
+//------------------------------------------------------------------------------
+/**
+	Samples all tracks of a clip into a pose, at a time in 1/65535 of the
+	clip. Joints without tracks keep what the pose holds.
+*/
+static void
+SampleClip(Clip const& clip, float time, JointSoA* pose)
+{
+	for (Track const& track : clip.tracks)
+	{
+		uint16_t const* const times = &clip.times[track.firstKey];
+		uint32_t const next = (uint32_t)(std::upper_bound(times, times + track.numKeys, time, [](float t, uint16_t key) { return t < (float)key; }) - times);
+
+		float value[4];
+		if (next == 0 || next == track.numKeys)
+		{
+			DecodeKey(clip, track, next == 0 ? 0 : track.numKeys - 1, value);
+		}
+		else if (track.step)
+		{
+			DecodeKey(clip, track, next - 1, value);
+		}
+		else
+		{
+			float a[4], b[4];
+			DecodeKey(clip, track, next - 1, a);
+			DecodeKey(clip, track, next, b);
+			float const t = (time - times[next - 1]) / (float)(times[next] - times[next - 1]);
+			Interpolate(a, b, t, track.type == TrackType::Rotation, value);
+		}
+
+		JointSoA& block = pose[track.joint / 4];
+		uint32_t const lane = track.joint % 4;
+		switch (track.type)
+		{
+		case TrackType::Translation:
+			for (int c = 0; c < 3; c++)
+				SetLane(block.translation[c], lane, value[c]);
+			break;
+		case TrackType::Rotation:
+			for (int c = 0; c < 4; c++)
+				SetLane(block.rotation[c], lane, value[c]);
+			break;
+		case TrackType::Scale:
+			for (int c = 0; c < 3; c++)
+				SetLane(block.scale[c], lane, value[c]);
+			break;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Adds a weighted pose to the blended one, flipping rotations into the
+	hemisphere of what is already there.
+*/
+static void
+AccumulatePose(JointSoA const* pose, __m128 weight, JointSoA* blended, uint32_t numBlocks)
+{
+	__m128 const signMask = _mm_set1_ps(-0.0f);
+	for (uint32_t b = 0; b < numBlocks; b++)
+	{
+		JointSoA const& in = pose[b];
+		JointSoA& out = blended[b];
+		__m128 dot = _mm_mul_ps(in.rotation[0], out.rotation[0]);
+		for (int c = 1; c < 4; c++)
+			dot = _mm_add_ps(dot, _mm_mul_ps(in.rotation[c], out.rotation[c]));
+		__m128 const rotationWeight = _mm_xor_ps(weight, _mm_and_ps(dot, signMask));
+		for (int c = 0; c < 3; c++)
+		{
+			out.translation[c] = _mm_add_ps(out.translation[c], _mm_mul_ps(in.translation[c], weight));
+			out.scale[c] = _mm_add_ps(out.scale[c], _mm_mul_ps(in.scale[c], weight));
+		}
+		for (int c = 0; c < 4; c++)
+			out.rotation[c] = _mm_add_ps(out.rotation[c], _mm_mul_ps(in.rotation[c], rotationWeight));
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Divides an accumulated pose by the total weight and normalizes its
+	rotations.
+*/
+static void
+NormalizePose(JointSoA* blended, __m128 inverseWeight, uint32_t numBlocks)
+{
+	__m128 const epsilon = _mm_set1_ps(1e-12f);
+	for (uint32_t b = 0; b < numBlocks; b++)
+	{
+		JointSoA& pose = blended[b];
+		for (int c = 0; c < 3; c++)
+		{
+			pose.translation[c] = _mm_mul_ps(pose.translation[c], inverseWeight);
+			pose.scale[c] = _mm_mul_ps(pose.scale[c], inverseWeight);
+		}
+		__m128 length = _mm_mul_ps(pose.rotation[0], pose.rotation[0]);
+		for (int c = 1; c < 4; c++)
+			length = _mm_add_ps(length, _mm_mul_ps(pose.rotation[c], pose.rotation[c]));
+		__m128 const inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(length, epsilon)));
+		for (int c = 0; c < 4; c++)
+			pose.rotation[c] = _mm_mul_ps(pose.rotation[c], inverseLength);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Builds the local matrices of four joints at a time.
+*/
+static void
+ComposeMatrices(JointSoA const* pose, uint32_t numJoints, glm::mat4* local)
+{
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	for (uint32_t b = 0; b * 4 < numJoints; b++)
+	{
+		JointSoA const& joint = pose[b];
+		__m128 const x = joint.rotation[0];
+		__m128 const y = joint.rotation[1];
+		__m128 const z = joint.rotation[2];
+		__m128 const w = joint.rotation[3];
+		__m128 const xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 const xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 const wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		// columns of the rotation matrix, scaled
+		__m128 columns[4][4];
+		columns[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), joint.scale[0]);
+		columns[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), joint.scale[0]);
+		columns[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), joint.scale[0]);
+		columns[0][3] = _mm_setzero_ps();
+		columns[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), joint.scale[1]);
+		columns[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), joint.scale[1]);
+		columns[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), joint.scale[1]);
+		columns[1][3] = _mm_setzero_ps();
+		columns[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), joint.scale[2]);
+		columns[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), joint.scale[2]);
+		columns[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), joint.scale[2]);
+		columns[2][3] = _mm_setzero_ps();
+		columns[3][0] = joint.translation[0];
+		columns[3][1] = joint.translation[1];
+		columns[3][2] = joint.translation[2];
+		columns[3][3] = one;
+
+		// transpose from one joint per lane to one matrix column per register
+		uint32_t const count = std::min(4u, numJoints - b * 4);
+		for (int c = 0; c < 4; c++)
+		{
+			_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+			for (uint32_t j = 0; j < count; j++)
+				_mm_storeu_ps(&local[b * 4 + j][c][0], columns[c][j]);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+MultiplyMatrices(glm::mat4 const& a, glm::mat4 const& b, glm::mat4& out)
+{
+	__m128 const a0 = _mm_loadu_ps(&a[0][0]);
+	__m128 const a1 = _mm_loadu_ps(&a[1][0]);
+	__m128 const a2 = _mm_loadu_ps(&a[2][0]);
+	__m128 const a3 = _mm_loadu_ps(&a[3][0]);
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[c][0]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[c][1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[c][2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[c][3])));
+		_mm_storeu_ps(&out[c][0], column);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Wraps a time in seconds around a clip and converts it to the units of
+	the key times.
+*/
+static float
+GetClipTime(Clip const& clip, float seconds)
+{
+	if (clip.duration <= 0.0f)
+		return 0.0f;
+	float const wrapped = fmodf(fmodf(seconds, clip.duration) + clip.duration, clip.duration);
+	return wrapped / clip.duration * 65535.0f;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+EvaluateInstance(Instance const& instance, Scratch& scratch)
+{
+	Skeleton const& skeleton = skeletons[instance.skeleton];
+	uint32_t const numBlocks = (uint32_t)skeleton.restPose.size();
+	scratch.pose.resize(numBlocks);
+	scratch.blended.resize(numBlocks);
+	scratch.local.resize(skeleton.numJoints);
+	scratch.model.resize(skeleton.numJoints);
+
+	Layer const* active[MAX_LAYERS];
+	uint32_t numLayers = 0;
+	float totalWeight = 0.0f;
+	for (Layer const& layer : instance.layers)
+	{
+		if (layer.weight <= 0.0f || layer.clip == InvalidResourceId)
+			continue;
+		active[numLayers++] = &layer;
+		totalWeight += layer.weight;
+	}
+
+	std::copy(skeleton.restPose.begin(), skeleton.restPose.end(), scratch.blended.begin());
+	if (numLayers == 1)
+	{
+		// a single layer is sampled straight into the result
+		SampleClip(clips[active[0]->clip], GetClipTime(clips[active[0]->clip], active[0]->time), scratch.blended.data());
+	}
+	else if (numLayers > 1)
+	{
+		JointSoA zero;
+		memset(&zero, 0, sizeof(zero));
+		std::fill(scratch.blended.begin(), scratch.blended.end(), zero);
+		for (uint32_t l = 0; l < numLayers; l++)
+		{
+			Clip const& clip = clips[active[l]->clip];
+			std::copy(skeleton.restPose.begin(), skeleton.restPose.end(), scratch.pose.begin());
+			SampleClip(clip, GetClipTime(clip, active[l]->time), scratch.pose.data());
+			AccumulatePose(scratch.pose.data(), _mm_set1_ps(active[l]->weight), scratch.blended.data(), numBlocks);
+		}
+		NormalizePose(scratch.blended.data(), _mm_set1_ps(1.0f / totalWeight), numBlocks);
+	}
+
+	ComposeMatrices(scratch.blended.data(), skeleton.numJoints, scratch.local.data());
+	for (uint32_t const j : skeleton.order)
+	{
+		int32_t const parent = skeleton.parents[j];
+		MultiplyMatrices(parent == -1 ? skeleton.rootTransforms[j] : scratch.model[parent], scratch.local[j], scratch.model[j]);
+	}
+	glm::mat4* const palette = &palettes[instance.firstJoint];
+	for (uint32_t j = 0; j < skeleton.numJoints; j++)
+		MultiplyMatrices(scratch.model[j], skeleton.inverseBindMatrices[j], palette[j]);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+InstanceId
+CreateInstance(SkeletonId skeleton)
+{
+	n_assert(skeleton < skeletons.size());
+	InstanceId id;
+	if (!freeInstances.empty())
+	{
+		id = freeInstances.back();
+		freeInstances.pop_back();
+	}
+	else
+	{
+		id = (InstanceId)instances.size();
+		instances.emplace_back();
+	}
+	instances[id] = Instance();
+	instances[id].skeleton = skeleton;
+	instances[id].active = true;
+	return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+DestroyInstance(InstanceId instance)
+{
+	n_assert(instances[instance].active);
+	instances[instance].active = false;
+	freeInstances.push_back(instance);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SetLayer(InstanceId instance, uint32_t layer, ClipId clip, float time, float weight)
+{
+	n_assert(layer < MAX_LAYERS);
+	n_assert(clip == InvalidResourceId || clips[clip].skeleton == instances[instance].skeleton);
+	Layer& l = instances[instance].layers[layer];
+	l.clip = clip;
+	l.time = time;
+	l.weight = weight;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Update()
+{
+	N_PROFILE_SCOPE("Animation::Update");
+	uint32_t numJoints = 0;
+	for (Instance& instance : instances)
+	{
+		if (!instance.active)
+			continue;
+		instance.firstJoint = numJoints;
+		numJoints += skeletons[instance.skeleton].numJoints;
+	}
+	palettes.resize(numJoints);
+	scratches.resize(Core::JobSystem::GetNumThreads());
+
+	Core::JobSystem::ParallelFor((uint32_t)instances.size(), INSTANCE_GRAIN_SIZE, [](uint32_t begin, uint32_t end, uint32_t threadIndex)
+	{
+		Scratch& scratch = scratches[threadIndex];
+		for (uint32_t i = begin; i < end; i++)
+		{
+			if (instances[i].active)
+				EvaluateInstance(instances[i], scratch);
+		}
+	});
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t
+GetFirstJoint(InstanceId instance)
+{
+	return instances[instance].firstJoint;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::vector<glm::mat4> const&
+GetPalettes()
+{
+	return palettes;
+}
+
+} // namespace Animation
+} // namespace Render
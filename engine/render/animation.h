@@ -0,0 +1,68 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file animation.h
+
+	Skeletal animation.
+
+	Skeletons and clips are loaded from the skins and animations of glTF files.
+	Clips are compressed when they are loaded: keys that linear interpolation
+	of their neighbours reproduces are dropped, key times are quantized to 16
+	bits of the clip duration, rotations to the smallest three components of
+	the quaternion in 48 bits and translations and scales to 16 bits per
+	component within the range of their track. A key takes 8 bytes.
+
+	Animated instances play up to MAX_LAYERS clips at a time, blended by weight.
+	Update samples and blends the poses of all instances in parallel on the job
+	system, four joints at a time in SSE registers, and builds one palette of
+	skinning matrices per instance. The palettes of a frame are contiguous, and
+	draw with RenderDevice::Draw and the first joint of the instance.
+
+	Call everything from the game thread.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include "renderdevice.h"
+#include <string>
+#include <vector>
+
+namespace Render
+{
+
+namespace Animation
+{
+	typedef ResourceId SkeletonId;
+	typedef ResourceId ClipId;
+	typedef ResourceId InstanceId;
+
+	/// number of clips an instance can blend
+	static const uint32_t MAX_LAYERS = 4;
+	/// first joint of draws that are not skinned
+	static const uint32_t NO_JOINTS = UINT32_MAX;
+
+	/// load a skin of a glTF file. Returns InvalidResourceId if there is none.
+	SkeletonId LoadSkeleton(std::string const& uri, uint32_t skin = 0);
+	/// load and compress an animation of a glTF file for a skeleton loaded from the same file. Returns InvalidResourceId if there is none.
+	ClipId LoadClip(std::string const& uri, SkeletonId skeleton, uint32_t animation = 0);
+	/// length of a clip in seconds
+	float GetClipDuration(ClipId clip);
+	/// number of keys the clip had before compression and after
+	void GetClipKeyCounts(ClipId clip, uint32_t& sourceKeys, uint32_t& keys);
+
+	/// create an instance in the rest pose of its skeleton
+	InstanceId CreateInstance(SkeletonId skeleton);
+	void DestroyInstance(InstanceId instance);
+	/// play a clip on a layer at a time in seconds, which wraps around the clip. A weight of zero turns the layer off.
+	void SetLayer(InstanceId instance, uint32_t layer, ClipId clip, float time, float weight);
+
+	/// sample, blend and build the palettes of all instances
+	void Update();
+	/// first joint of the palette of an instance in the palettes of the last update
+	uint32_t GetFirstJoint(InstanceId instance);
+	/// skinning matrices of all instances after the last update
+	std::vector<glm::mat4> const& GetPalettes();
+} // namespace Animation
+
+} // namespace Render
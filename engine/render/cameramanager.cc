@@ -28,10 +28,15 @@ namespace CameraManager
 	/// cameramanager singleton state
 	struct State
 	{
-		CameraState cameras[32];
+		CameraState cameras[MAX_CAMERAS];
 		unsigned char numCameras = 0;
 
 		std::unordered_map<uint32_t, uint32_t> cameraTable;
+
+		// cameras of the frame being rendered, only touched by the render thread
+		CameraState renderCameras[MAX_CAMERAS];
+		uint32_t renderHashes[MAX_CAMERAS];
+		unsigned char numRenderCameras = 0;
 	};
 
 	static State* state = nullptr;
@@ -71,7 +76,7 @@ Camera* const
 CameraManager::CreateCamera(CameraCreateInfo const& info)
 {
 	state->cameraTable.emplace(info.hash, state->numCameras);
-	assert(state->numCameras + 1 < 32);
+	assert(state->numCameras + 1 < MAX_CAMERAS);
 	CameraState& camera = state->cameras[state->numCameras++];
 	camera = DeriveCameraState(info.view, info.projection);
 	return reinterpret_cast<Camera*>(&camera);
@@ -121,4 +126,48 @@ CameraManager::OnBeforeRender()
 	}
 }
 
+//------------------------------------------------------------------------------
+/**
+*/
+void
+CameraManager::CaptureSnapshot(Snapshot& snapshot)
+{
+	for (auto const& entry : state->cameraTable)
+	{
+		snapshot.hashes[entry.second] = entry.first;
+		snapshot.views[entry.second] = state->cameras[entry.second].view;
+		snapshot.projections[entry.second] = state->cameras[entry.second].projection;
+	}
+	snapshot.numCameras = state->numCameras;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+CameraManager::ApplySnapshot(Snapshot const& snapshot)
+{
+	for (index_t i = 0; i < snapshot.numCameras; i++)
+	{
+		state->renderHashes[i] = snapshot.hashes[i];
+		state->renderCameras[i] = DeriveCameraState(snapshot.views[i], snapshot.projections[i]);
+	}
+	state->numRenderCameras = snapshot.numCameras;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+Camera* const
+CameraManager::GetRenderCamera(uint32_t CAMERA_HASH)
+{
+	for (index_t i = 0; i < state->numRenderCameras; i++)
+	{
+		if (state->renderHashes[i] == CAMERA_HASH)
+			return reinterpret_cast<Camera*>(&state->renderCameras[i]);
+	}
+	n_error("Render camera '%.4s' does not exist!\n", (const char*)&CAMERA_HASH);
+	return nullptr;
+}
+
 } // namespace Game
@@ -42,6 +42,17 @@ struct Camera
 */
 namespace CameraManager
 {
+	static const int MAX_CAMERAS = 32;
+
+	/// copy of all cameras, handed from the game thread to the render thread
+	struct Snapshot
+	{
+		uint32_t hashes[MAX_CAMERAS];
+		glm::mat4 views[MAX_CAMERAS];
+		glm::mat4 projections[MAX_CAMERAS];
+		unsigned char numCameras = 0;
+	};
+
 	/// create the singleton
 	void Create();
 
@@ -55,6 +66,13 @@ namespace CameraManager
 
 	void Destroy();
 	void OnBeforeRender();
+
+	/// copy all cameras into a snapshot. Called on the game thread.
+	void CaptureSnapshot(Snapshot& snapshot);
+	/// make the cameras of a snapshot the ones returned by GetRenderCamera. Called on the render thread.
+	void ApplySnapshot(Snapshot const& snapshot);
+	/// get a camera of the frame being rendered, by hash
+	Camera* const GetRenderCamera(uint32_t CAMERA_HASH);
 };
 
 } // namespace Game
@@ -53,7 +53,7 @@ struct TextCommand
 	std::string text;
 };
 
-static std::queue<RenderCommand*> cmds;
+static CommandList cmds;
 static std::queue<TextCommand> textcmds;
 static GLuint shaders[NUM_DEBUG_SHAPES];
 static GLuint vao[NUM_DEBUG_SHAPES];
@@ -79,7 +79,7 @@ void DrawLine(const glm::vec3& startPoint, const glm::vec3& endPoint, const floa
 	cmd->rendermode = renderModes;
 	cmd->startcolor = startColor;
 	cmd->endcolor = endColor;
-	cmds.push(cmd);
+	cmds.push_back(cmd);
 }
 
 void DrawBox(const glm::vec3& position, const glm::quat& rotation, const float scale, const glm::vec4& color, const RenderMode renderModes, const float lineWidth)
@@ -94,7 +94,7 @@ void DrawBox(const glm::vec3& position, const glm::quat& rotation, const float s
 	cmd->linewidth = lineWidth;
 	cmd->color = color;
 	cmd->rendermode = renderModes;
-	cmds.push(cmd);
+	cmds.push_back(cmd);
 }
 
 void DrawBox(const glm::vec3& position, const glm::quat& rotation, const float width, const float height, const float length, const glm::vec4& color, const RenderMode renderModes, const float lineWidth)
@@ -108,7 +108,7 @@ void DrawBox(const glm::vec3& position, const glm::quat& rotation, const float w
 	cmd->linewidth = lineWidth;
 	cmd->color = color;
 	cmd->rendermode = renderModes;
-	cmds.push(cmd);
+	cmds.push_back(cmd);
 }
 
 void DrawBox(const glm::mat4& transform, const glm::vec4& color, const RenderMode renderModes, const float lineWidth)
@@ -119,7 +119,7 @@ void DrawBox(const glm::mat4& transform, const glm::vec4& color, const RenderMod
 	cmd->linewidth = lineWidth;
 	cmd->color = color;
 	cmd->rendermode = renderModes;
-	cmds.push(cmd);
+	cmds.push_back(cmd);
 }
 
 void SetupShaders()
@@ -258,7 +258,7 @@ void RenderLine(RenderCommand* command)
 	glUniform4fv(v0color, 1, &lineCommand->startcolor[0]);
 	glUniform4fv(v1color, 1, &lineCommand->endcolor[0]);
 
-	Render::Camera* const mainCamera = Render::CameraManager::GetCamera(CAMERA_MAIN);
+	Render::Camera* const mainCamera = Render::CameraManager::GetRenderCamera(CAMERA_MAIN);
 	glUniformMatrix4fv(viewProjection, 1, GL_FALSE, &mainCamera->viewProjection[0][0]);
 
 	glDrawArrays(GL_LINES, 0, 2);
@@ -288,7 +288,7 @@ void RenderBox(RenderCommand* command)
 
 	static GLuint model = glGetUniformLocation(shaders[DebugShape::BOX], "model");
 	static GLuint viewProjection = glGetUniformLocation(shaders[DebugShape::BOX], "viewProjection");
-	Render::Camera* const mainCamera = Render::CameraManager::GetCamera(CAMERA_MAIN);
+	Render::Camera* const mainCamera = Render::CameraManager::GetRenderCamera(CAMERA_MAIN);
 	glUniformMatrix4fv(model, 1, GL_FALSE, &cmd->transform[0][0]);
 	glUniformMatrix4fv(viewProjection, 1, GL_FALSE, &mainCamera->viewProjection[0][0]);
 
@@ -320,12 +320,16 @@ void RenderBox(RenderCommand* command)
 	glBindVertexArray(0);
 }
 
-void DispatchDebugDrawing()
+void CaptureDebugCommands(CommandList& list)
 {
-	while (!cmds.empty())
+	list.insert(list.end(), cmds.begin(), cmds.end());
+	cmds.clear();
+}
+
+void DispatchDebugDrawing(CommandList& list)
+{
+	for (RenderCommand* currentCommand : list)
 	{
-		RenderCommand* currentCommand = cmds.front();
-		cmds.pop();
 		switch (currentCommand->shape)
 		{
 		case DebugShape::LINE:
@@ -347,6 +351,7 @@ void DispatchDebugDrawing()
 
 		delete currentCommand;
 	}
+	list.clear();
 }
 
 void DispatchDebugTextDrawing()
@@ -10,9 +10,15 @@
 */
 //------------------------------------------------------------------------------
 
+#include <vector>
+
 namespace Debug
 {
 
+struct RenderCommand;
+/// debug shapes recorded during one frame
+typedef std::vector<RenderCommand*> CommandList;
+
 enum RenderMode
 {
 	Normal = 1,
@@ -32,7 +38,10 @@ void DrawBox(const glm::vec3& position, const glm::quat& rotation, const float w
 void DrawBox(const glm::mat4& transform, const glm::vec4& color, const RenderMode renderModes = RenderMode::Normal, const float lineWidth = 1.0f);
 
 void InitDebugRendering();
-void DispatchDebugDrawing();
+/// move all recorded shapes into a list. Called on the game thread when a frame is submitted.
+void CaptureDebugCommands(CommandList& list);
+/// draw and free all shapes in a list. Called on the render thread.
+void DispatchDebugDrawing(CommandList& list);
 void DispatchDebugTextDrawing();
 
 } // namespace Debug
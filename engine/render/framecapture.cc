@@ -0,0 +1,292 @@
+//------------------------------------------------------------------------------
+//  @file framecapture.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "framecapture.h"
+#include "GL/glew.h"
+#include "stb_image_write.h"
+#include "core/jobsystem.h"
+#include "core/profiler.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Render
+{
+namespace FrameCapture
+{
+
+// read backs in flight, the GPU has this many frames to finish one
+static const uint32_t NUM_SLOTS = 3;
+// copied frames waiting for or being encoded, bounds the memory held by captures
+static const uint32_t MAX_ENCODING = 8;
+
+struct Slot
+{
+	GLuint buffer = 0;
+	GLsizeiptr size = 0;
+	GLsync fence = 0;
+	int width = 0;
+	int height = 0;
+	std::string path;
+	Format format = Format::Png;
+};
+
+// only touched on the GL thread
+static Slot slots[NUM_SLOTS];
+static uint32_t nextSlot = 0;
+static uint32_t numPending = 0;
+
+// requests, set from any thread
+static std::mutex requestLock;
+static std::string screenshotPath;
+static bool recording = false;
+static std::string recordDirectory;
+static Format recordFormat = Format::Png;
+static uint32_t recordFrame = 0;
+static uint32_t recordMaxFrames = 0;
+
+static std::atomic<uint32_t> numCaptured(0);
+static std::atomic<uint32_t> numWritten(0);
+static std::atomic<uint32_t> numDropped(0);
+static std::atomic<uint32_t> numFailed(0);
+static std::atomic<uint32_t> numEncoding(0);
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Screenshot(std::string const& path)
+{
+	std::lock_guard<std::mutex> guard(requestLock);
+	screenshotPath = path;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+StartRecording(std::string const& directory, Format format, uint32_t maxFrames)
+{
+	std::lock_guard<std::mutex> guard(requestLock);
+	recording = true;
+	recordDirectory = directory;
+	recordFormat = format;
+	recordFrame = 0;
+	recordMaxFrames = maxFrames;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+StopRecording()
+{
+	std::lock_guard<std::mutex> guard(requestLock);
+	recording = false;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+IsRecording()
+{
+	std::lock_guard<std::mutex> guard(requestLock);
+	return recording;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+Stats
+GetStats()
+{
+	Stats stats;
+	stats.captured = numCaptured;
+	stats.written = numWritten;
+	stats.dropped = numDropped;
+	stats.failed = numFailed;
+	return stats;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Takes the next pending capture request. Returns false if there is none.
+*/
+static bool
+TakeRequest(int width, int height, std::string& path, Format& format)
+{
+	std::lock_guard<std::mutex> guard(requestLock);
+	if (!screenshotPath.empty())
+	{
+		path.swap(screenshotPath);
+		screenshotPath.clear();
+		format = Format::Png;
+		return true;
+	}
+	if (!recording)
+		return false;
+
+	char name[64];
+	if (recordFormat == Format::Png)
+		snprintf(name, sizeof(name), "/frame_%06u.png", recordFrame);
+	else
+		snprintf(name, sizeof(name), "/frame_%06u_%dx%d.rgba", recordFrame, width, height);
+	path = recordDirectory + name;
+	format = recordFormat;
+	recordFrame++;
+	if (recordMaxFrames != 0 && recordFrame >= recordMaxFrames)
+		recording = false;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+Encode(std::shared_ptr<std::vector<uint8_t>> const& pixels, int width, int height, std::string const& path, Format format)
+{
+	N_PROFILE_SCOPE("FrameCapture::Encode");
+	bool ok = false;
+	if (format == Format::Png)
+	{
+		ok = stbi_write_png(path.c_str(), width, height, 4, pixels->data(), width * 4) != 0;
+	}
+	else
+	{
+		FILE* const file = fopen(path.c_str(), "wb");
+		if (file != nullptr)
+		{
+			ok = fwrite(pixels->data(), 1, pixels->size(), file) == pixels->size();
+			ok &= fclose(file) == 0;
+		}
+	}
+	if (ok)
+		numWritten++;
+	else
+	{
+		numFailed++;
+		n_printf("FrameCapture: could not write '%s'\n", path.c_str());
+	}
+	numEncoding--;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Copies a finished read back out of its buffer, flipping it to top row
+	first, and submits it for encoding. Drops it if the encoders are behind,
+	unless asked to wait for them.
+*/
+static void
+Retrieve(Slot& slot, bool wait)
+{
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	numPending--;
+
+	while (wait && numEncoding >= MAX_ENCODING)
+		std::this_thread::yield();
+	if (numEncoding >= MAX_ENCODING)
+	{
+		numDropped++;
+		return;
+	}
+
+	size_t const rowSize = (size_t)slot.width * 4;
+	auto pixels = std::make_shared<std::vector<uint8_t>>(rowSize * slot.height);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	uint8_t const* const mapped = (uint8_t const*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+	if (mapped == nullptr)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		numFailed++;
+		return;
+	}
+	for (int y = 0; y < slot.height; y++)
+		memcpy(pixels->data() + rowSize * y, mapped + rowSize * (slot.height - 1 - y), rowSize);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	numEncoding++;
+	int const width = slot.width;
+	int const height = slot.height;
+	std::string const path = slot.path;
+	Format const format = slot.format;
+	Core::JobSystem::Submit([pixels, width, height, path, format]() { Encode(pixels, width, height, path, format); });
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Capture(int width, int height, uint32_t framebuffer)
+{
+	N_PROFILE_SCOPE("FrameCapture::Capture");
+	// oldest first, stop at the first one the GPU is still working on
+	while (numPending > 0)
+	{
+		Slot& oldest = slots[(nextSlot + NUM_SLOTS - numPending) % NUM_SLOTS];
+		GLenum const status = glClientWaitSync(oldest.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			break;
+		Retrieve(oldest, false);
+	}
+
+	std::string path;
+	Format format;
+	if (width <= 0 || height <= 0 || !TakeRequest(width, height, path, format))
+		return;
+	if (numPending == NUM_SLOTS)
+	{
+		numDropped++;
+		return;
+	}
+
+	Slot& slot = slots[nextSlot];
+	if (slot.buffer == 0)
+		glGenBuffers(1, &slot.buffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	GLsizeiptr const size = (GLsizeiptr)width * height * 4;
+	if (slot.size != size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot.size = size;
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.width = width;
+	slot.height = height;
+	slot.path = std::move(path);
+	slot.format = format;
+
+	nextSlot = (nextSlot + 1) % NUM_SLOTS;
+	numPending++;
+	numCaptured++;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Flush()
+{
+	while (numPending > 0)
+	{
+		Slot& oldest = slots[(nextSlot + NUM_SLOTS - numPending) % NUM_SLOTS];
+		glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+		Retrieve(oldest, true);
+	}
+	while (numEncoding > 0)
+		std::this_thread::yield();
+}
+
+} // namespace FrameCapture
+} // namespace Render
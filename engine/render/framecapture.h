@@ -0,0 +1,65 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file framecapture.h
+
+	Screenshots and frame recordings without stalling the renderer.
+
+	The backbuffer is read into a ring of pixel buffer objects, which the GPU
+	fills in the background. A few frames later, once its fence has signaled,
+	a buffer is mapped and copied out, and the frame is encoded and written on
+	the job system. Frames are dropped and counted instead of waiting, both
+	when every buffer of the ring is still in flight and when too many frames
+	are waiting to be encoded.
+
+	Raw frames are written as tightly packed RGBA8 rows, top row first, to
+	files named after their number and size, for example
+	frame_000012_1280x720.rgba.
+
+	Screenshot and StartRecording can be called from any thread.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <string>
+
+namespace Render
+{
+
+namespace FrameCapture
+{
+	enum class Format
+	{
+		Png,
+		Raw
+	};
+
+	struct Stats
+	{
+		/// frames read back from the GPU
+		uint32_t captured;
+		/// frames written to disk
+		uint32_t written;
+		/// frames skipped to avoid a stall
+		uint32_t dropped;
+		/// frames that could not be written
+		uint32_t failed;
+	};
+
+	/// write the next presented frame to a PNG file
+	void Screenshot(std::string const& path);
+	/// write every presented frame to numbered files in an existing directory, until StopRecording or maxFrames frames
+	void StartRecording(std::string const& directory, Format format, uint32_t maxFrames = 0);
+	void StopRecording();
+	bool IsRecording();
+	/// counts since startup
+	Stats GetStats();
+
+	/// read back the backbuffer, or the framebuffer standing in for it, if a capture is pending, and hand finished read backs to the encoders. Called on the GL thread before presenting.
+	void Capture(int width, int height, uint32_t framebuffer = 0);
+	/// wait for all frames in flight to be written. Called on the GL thread.
+	void Flush();
+} // namespace FrameCapture
+
+} // namespace Render
@@ -0,0 +1,577 @@
+//------------------------------------------------------------------------------
+//  @file framegraph.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "framegraph.h"
+#include "gpuprofiler.h"
+#include "core/profiler.h"
+#include <queue>
+#include <algorithm>
+#include <cstring>
+
+namespace Render
+{
+
+/// pooled textures and framebuffers that have not been used for this many frames are deleted
+static const uint64_t POOL_TIMEOUT_FRAMES = 120;
+
+//------------------------------------------------------------------------------
+/**
+*/
+static size_t
+BytesPerPixel(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+		return 2;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		// RGBA8, R11F_G11F_B10F, RGB9_E5, RG16F, R32F, DEPTH_COMPONENT32F, DEPTH24_STENCIL8...
+		return 4;
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FrameGraph::FrameGraph()
+{
+	// empty
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FrameGraph::~FrameGraph()
+{
+	for (CachedFramebuffer const& fb : this->framebuffers)
+		glDeleteFramebuffers(1, &fb.framebuffer);
+	for (PooledTexture const& tex : this->pool)
+		glDeleteTextures(1, &tex.texture);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FrameGraph::ResourceHandle
+FrameGraph::CreateTexture(const char* name, TextureDesc const& desc)
+{
+	n_assert(!this->compiled);
+	Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	this->resources.push_back(resource);
+	return (ResourceHandle)(this->resources.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FrameGraph::ResourceHandle
+FrameGraph::ImportTexture(const char* name, GLuint texture)
+{
+	n_assert(!this->compiled);
+	Resource resource;
+	resource.name = name;
+	resource.texture = texture;
+	resource.imported = true;
+	this->resources.push_back(resource);
+	return (ResourceHandle)(this->resources.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FrameGraph::ResourceHandle
+FrameGraph::ImportBackbuffer(GLuint framebuffer)
+{
+	ResourceHandle const handle = this->ImportTexture("Backbuffer", 0);
+	this->resources[handle].backbuffer = true;
+	this->backbufferFramebuffer = framebuffer;
+	return handle;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FrameGraph::PassHandle
+FrameGraph::AddPass(const char* name, std::function<void()> const& execute)
+{
+	n_assert(!this->compiled);
+	Pass pass;
+	pass.name = name;
+	pass.execute = execute;
+	this->passes.push_back(pass);
+	return (PassHandle)(this->passes.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameGraph::Read(PassHandle pass, ResourceHandle resource)
+{
+	n_assert(resource < this->resources.size());
+	n_assert2(!this->resources[resource].backbuffer, "The backbuffer can not be read by a pass!");
+	this->passes[pass].reads.push_back(resource);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameGraph::WriteColor(PassHandle pass, ResourceHandle resource, unsigned int slot)
+{
+	n_assert(resource < this->resources.size());
+	n_assert(slot < MAX_COLOR_ATTACHMENTS);
+	this->passes[pass].colors[slot] = resource;
+	this->passes[pass].writes.push_back(resource);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameGraph::WriteDepth(PassHandle pass, ResourceHandle resource)
+{
+	n_assert(resource < this->resources.size());
+	this->passes[pass].depth = resource;
+	this->passes[pass].writes.push_back(resource);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameGraph::SetSideEffect(PassHandle pass)
+{
+	this->passes[pass].sideEffect = true;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Culls passes by reference counting. A pass is referenced once for every
+	resource it writes, and a resource once for every pass reading it. Resources
+	nobody reads release their writers, and culled passes release what they read.
+*/
+void
+FrameGraph::Cull()
+{
+	std::vector<ResourceHandle> unreferenced;
+	for (Pass& pass : this->passes)
+	{
+		pass.refCount = (int)pass.writes.size();
+		for (ResourceHandle const r : pass.reads)
+			this->resources[r].refCount++;
+	}
+	for (size_t i = 0; i < this->resources.size(); i++)
+	{
+		Resource& resource = this->resources[i];
+		// the backbuffer is always consumed by the window
+		if (resource.backbuffer)
+			resource.refCount++;
+		if (resource.refCount == 0)
+			unreferenced.push_back((ResourceHandle)i);
+	}
+	// passes without outputs are culled right away
+	for (Pass const& pass : this->passes)
+	{
+		if (pass.refCount > 0 || pass.sideEffect)
+			continue;
+		for (ResourceHandle const read : pass.reads)
+		{
+			if (--this->resources[read].refCount == 0)
+				unreferenced.push_back(read);
+		}
+	}
+
+	while (!unreferenced.empty())
+	{
+		ResourceHandle const r = unreferenced.back();
+		unreferenced.pop_back();
+		for (Pass& pass : this->passes)
+		{
+			if (pass.refCount == 0 || std::find(pass.writes.begin(), pass.writes.end(), r) == pass.writes.end())
+				continue;
+
+			if (--pass.refCount == 0 && !pass.sideEffect)
+			{
+				for (ResourceHandle const read : pass.reads)
+				{
+					if (--this->resources[read].refCount == 0)
+						unreferenced.push_back(read);
+				}
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Orders the passes that survived culling. A pass reading a resource runs after
+	all passes writing it, and passes writing the same resource run in the order
+	they were added. Otherwise the order they were added in is kept.
+*/
+void
+FrameGraph::Sort()
+{
+	size_t const numPasses = this->passes.size();
+	std::vector<std::vector<PassHandle>> edges(numPasses);
+	std::vector<int> numDependencies(numPasses, 0);
+
+	auto IsAlive = [this](size_t p) { return this->passes[p].refCount > 0 || this->passes[p].sideEffect; };
+	auto AddEdge = [&](size_t from, size_t to)
+	{
+		if (from == to || std::find(edges[from].begin(), edges[from].end(), (PassHandle)to) != edges[from].end())
+			return;
+		edges[from].push_back((PassHandle)to);
+		numDependencies[to]++;
+	};
+
+	for (size_t p = 0; p < numPasses; p++)
+	{
+		if (!IsAlive(p))
+			continue;
+		Pass const& pass = this->passes[p];
+		for (size_t other = 0; other < numPasses; other++)
+		{
+			if (other == p || !IsAlive(other))
+				continue;
+			Pass const& otherPass = this->passes[other];
+			for (ResourceHandle const r : pass.reads)
+			{
+				if (std::find(otherPass.writes.begin(), otherPass.writes.end(), r) != otherPass.writes.end())
+					AddEdge(other, p);
+			}
+			if (other < p)
+			{
+				for (ResourceHandle const w : pass.writes)
+				{
+					if (std::find(otherPass.writes.begin(), otherPass.writes.end(), w) != otherPass.writes.end())
+						AddEdge(other, p);
+				}
+			}
+		}
+	}
+
+	// Kahn's algorithm, preferring the pass that was added first
+	std::priority_queue<PassHandle, std::vector<PassHandle>, std::greater<PassHandle>> ready;
+	size_t numAlive = 0;
+	for (size_t p = 0; p < numPasses; p++)
+	{
+		if (!IsAlive(p))
+			continue;
+		numAlive++;
+		if (numDependencies[p] == 0)
+			ready.push((PassHandle)p);
+	}
+
+	this->order.clear();
+	while (!ready.empty())
+	{
+		PassHandle const p = ready.top();
+		ready.pop();
+		this->order.push_back(p);
+		for (PassHandle const next : edges[p])
+		{
+			if (--numDependencies[next] == 0)
+				ready.push(next);
+		}
+	}
+	n_assert2(this->order.size() == numAlive, "Frame graph contains a cycle!");
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+GLuint
+FrameGraph::AcquireTexture(TextureDesc const& desc)
+{
+	for (PooledTexture& tex : this->pool)
+	{
+		if (!tex.inUse && tex.desc.width == desc.width && tex.desc.height == desc.height && tex.desc.internalFormat == desc.internalFormat)
+		{
+			tex.inUse = true;
+			tex.lastUsedFrame = this->frameIndex;
+			if (tex.desc.filter != desc.filter)
+			{
+				glBindTexture(GL_TEXTURE_2D, tex.texture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+				tex.desc.filter = desc.filter;
+			}
+			return tex.texture;
+		}
+	}
+
+	PooledTexture tex;
+	tex.desc = desc;
+	tex.inUse = true;
+	tex.lastUsedFrame = this->frameIndex;
+	glGenTextures(1, &tex.texture);
+	glBindTexture(GL_TEXTURE_2D, tex.texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, desc.width, desc.height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	this->pool.push_back(tex);
+	return tex.texture;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameGraph::ReleaseTexture(GLuint texture)
+{
+	for (PooledTexture& tex : this->pool)
+	{
+		if (tex.texture == texture)
+		{
+			tex.inUse = false;
+			return;
+		}
+	}
+	n_error("Releasing a texture that is not in the frame graph pool!\n");
+}
+
+//------------------------------------------------------------------------------
+/**
+	Walks the passes in execution order and hands out pooled textures. A texture
+	goes back to the pool after the last pass using it, so that later resources
+	with the same description can alias it.
+*/
+void
+FrameGraph::AllocateTextures()
+{
+	for (size_t i = 0; i < this->order.size(); i++)
+	{
+		Pass const& pass = this->passes[this->order[i]];
+		auto Use = [this, i](ResourceHandle r)
+		{
+			Resource& resource = this->resources[r];
+			if (resource.firstUse == -1)
+				resource.firstUse = (int)i;
+			resource.lastUse = (int)i;
+		};
+		for (ResourceHandle const r : pass.reads)
+			Use(r);
+		for (ResourceHandle const r : pass.writes)
+			Use(r);
+	}
+
+	size_t inUseBytes = 0;
+	for (size_t i = 0; i < this->order.size(); i++)
+	{
+		for (Resource& resource : this->resources)
+		{
+			if (resource.imported || resource.firstUse != (int)i)
+				continue;
+			resource.texture = this->AcquireTexture(resource.desc);
+			size_t const bytes = resource.desc.width * resource.desc.height * BytesPerPixel(resource.desc.internalFormat);
+			inUseBytes += bytes;
+			this->stats.unaliasedTransientBytes += bytes;
+			this->stats.numTransientTextures++;
+		}
+
+		this->stats.peakTransientBytes = std::max(this->stats.peakTransientBytes, inUseBytes);
+
+		for (Resource const& resource : this->resources)
+		{
+			if (resource.imported || resource.lastUse != (int)i)
+				continue;
+			this->ReleaseTexture(resource.texture);
+			inUseBytes -= resource.desc.width * resource.desc.height * BytesPerPixel(resource.desc.internalFormat);
+		}
+	}
+
+	for (PooledTexture const& tex : this->pool)
+	{
+		if (tex.lastUsedFrame == this->frameIndex)
+			this->stats.numPhysicalTextures++;
+		this->stats.pooledBytes += tex.desc.width * tex.desc.height * BytesPerPixel(tex.desc.internalFormat);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameGraph::Compile()
+{
+	N_PROFILE_SCOPE("FrameGraph::Compile");
+	n_assert(!this->compiled);
+
+	this->stats = Stats();
+	this->Cull();
+	this->Sort();
+	this->AllocateTextures();
+
+	this->stats.numPasses = (int)this->order.size();
+	this->stats.numCulledPasses = (int)(this->passes.size() - this->order.size());
+	this->compiled = true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+GLuint
+FrameGraph::GetFramebuffer(Pass const& pass)
+{
+	GLuint attachments[MAX_COLOR_ATTACHMENTS + 1];
+	bool empty = true;
+	for (unsigned int i = 0; i < MAX_COLOR_ATTACHMENTS + 1; i++)
+	{
+		ResourceHandle const r = i < MAX_COLOR_ATTACHMENTS ? pass.colors[i] : pass.depth;
+		attachments[i] = 0;
+		if (r == InvalidResource)
+			continue;
+		if (this->resources[r].backbuffer)
+			return this->backbufferFramebuffer;
+		attachments[i] = this->resources[r].texture;
+		empty = false;
+	}
+
+	// passes without attachments render to the backbuffer
+	if (empty)
+		return this->backbufferFramebuffer;
+
+	for (CachedFramebuffer& fb : this->framebuffers)
+	{
+		if (memcmp(fb.attachments, attachments, sizeof(attachments)) == 0)
+		{
+			fb.lastUsedFrame = this->frameIndex;
+			return fb.framebuffer;
+		}
+	}
+
+	CachedFramebuffer fb;
+	memcpy(fb.attachments, attachments, sizeof(attachments));
+	fb.lastUsedFrame = this->frameIndex;
+	glGenFramebuffers(1, &fb.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, fb.framebuffer);
+
+	GLenum drawBuffers[MAX_COLOR_ATTACHMENTS];
+	GLsizei numDrawBuffers = 0;
+	for (unsigned int i = 0; i < MAX_COLOR_ATTACHMENTS; i++)
+	{
+		if (attachments[i] != 0)
+		{
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, attachments[i], 0);
+			numDrawBuffers = i + 1;
+		}
+		drawBuffers[i] = attachments[i] != 0 ? GL_COLOR_ATTACHMENT0 + i : GL_NONE;
+	}
+	if (attachments[MAX_COLOR_ATTACHMENTS] != 0)
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, attachments[MAX_COLOR_ATTACHMENTS], 0);
+
+	if (numDrawBuffers > 0)
+	{
+		glDrawBuffers(numDrawBuffers, drawBuffers);
+	}
+	else
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	{ GLenum err = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	n_assert2(err == GL_FRAMEBUFFER_COMPLETE, "Frame graph framebuffer is incomplete!"); }
+
+	this->framebuffers.push_back(fb);
+	return fb.framebuffer;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Deletes textures and framebuffers that have not been used for a while, for
+	example the old targets after the window was resized.
+*/
+void
+FrameGraph::CollectGarbage()
+{
+	for (size_t i = 0; i < this->pool.size();)
+	{
+		PooledTexture const& tex = this->pool[i];
+		if (tex.lastUsedFrame + POOL_TIMEOUT_FRAMES >= this->frameIndex)
+		{
+			i++;
+			continue;
+		}
+
+		// framebuffers referencing the texture can not be used anymore
+		for (CachedFramebuffer& fb : this->framebuffers)
+		{
+			for (GLuint const attachment : fb.attachments)
+			{
+				if (attachment == tex.texture)
+					fb.lastUsedFrame = 0;
+			}
+		}
+		glDeleteTextures(1, &tex.texture);
+		this->pool[i] = this->pool.back();
+		this->pool.pop_back();
+	}
+
+	for (size_t i = 0; i < this->framebuffers.size();)
+	{
+		CachedFramebuffer const& fb = this->framebuffers[i];
+		if (fb.lastUsedFrame + POOL_TIMEOUT_FRAMES >= this->frameIndex)
+		{
+			i++;
+			continue;
+		}
+		glDeleteFramebuffers(1, &fb.framebuffer);
+		this->framebuffers[i] = this->framebuffers.back();
+		this->framebuffers.pop_back();
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FrameGraph::Execute()
+{
+	n_assert2(this->compiled, "Frame graph must be compiled before it is executed!");
+
+	for (PassHandle const p : this->order)
+	{
+		Pass const& pass = this->passes[p];
+		N_PROFILE_SCOPE(pass.name);
+		N_GPU_ZONE(pass.name);
+		glBindFramebuffer(GL_FRAMEBUFFER, this->GetFramebuffer(pass));
+		pass.execute();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, this->backbufferFramebuffer);
+
+	this->passes.clear();
+	this->resources.clear();
+	this->order.clear();
+	this->CollectGarbage();
+	this->frameIndex++;
+	this->compiled = false;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+GLuint
+FrameGraph::GetTexture(ResourceHandle resource) const
+{
+	n_assert(this->compiled);
+	n_assert(resource < this->resources.size());
+	return this->resources[resource].texture;
+}
+
+} // namespace Render
@@ -0,0 +1,161 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file framegraph.h
+
+	A small frame graph for the render passes.
+
+	Every frame the passes are declared anew together with the textures they read
+	and write. Compiling the graph culls passes whose results are never used,
+	orders the remaining ones by their dependencies and assigns physical textures
+	to the transient resources. Transient textures whose lifetimes do not overlap
+	share the same texture, and textures are pooled across frames.
+
+	Passes writing to the backbuffer, or flagged with a side effect, are the roots
+	that keep other passes alive.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include "GL/glew.h"
+#include <vector>
+#include <functional>
+
+namespace Render
+{
+
+class FrameGraph
+{
+public:
+	typedef uint16_t ResourceHandle;
+	typedef uint16_t PassHandle;
+	static const ResourceHandle InvalidResource = 0xFFFF;
+
+	/// describes a transient texture
+	struct TextureDesc
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		GLenum internalFormat = GL_RGBA8;
+		GLenum filter = GL_NEAREST;
+	};
+
+	/// statistics of the last compiled frame
+	struct Stats
+	{
+		int numPasses = 0;
+		int numCulledPasses = 0;
+		int numTransientTextures = 0;
+		/// number of textures the transient textures were aliased to
+		int numPhysicalTextures = 0;
+		/// highest amount of transient texture memory in use at the same time
+		size_t peakTransientBytes = 0;
+		/// transient texture memory if nothing was aliased
+		size_t unaliasedTransientBytes = 0;
+		/// memory of all textures in the pool, including unused ones
+		size_t pooledBytes = 0;
+	};
+
+	FrameGraph();
+	~FrameGraph();
+
+	/// declare a transient texture, only valid during this frame
+	ResourceHandle CreateTexture(const char* name, TextureDesc const& desc);
+	/// import a texture that is owned by someone else
+	ResourceHandle ImportTexture(const char* name, GLuint texture);
+	/// import the window backbuffer, or the framebuffer standing in for it. Passes writing to it are never culled.
+	ResourceHandle ImportBackbuffer(GLuint framebuffer = 0);
+
+	/// add a pass. Name must have static lifetime. Passes execute with their framebuffer bound.
+	PassHandle AddPass(const char* name, std::function<void()> const& execute);
+	/// declare that a pass samples a texture
+	void Read(PassHandle pass, ResourceHandle resource);
+	/// declare that a pass renders to a color attachment
+	void WriteColor(PassHandle pass, ResourceHandle resource, unsigned int slot);
+	/// declare that a pass renders to the depth attachment
+	void WriteDepth(PassHandle pass, ResourceHandle resource);
+	/// keep a pass alive even if nothing reads its results
+	void SetSideEffect(PassHandle pass);
+
+	/// cull passes, compute the execution order and allocate textures
+	void Compile();
+	/// execute the compiled passes and reset the graph for the next frame
+	void Execute();
+
+	/// get the texture assigned to a resource. Only valid after Compile.
+	GLuint GetTexture(ResourceHandle resource) const;
+	/// get statistics of the last compiled frame
+	Stats const& GetStats() const;
+
+private:
+	static const unsigned int MAX_COLOR_ATTACHMENTS = 4;
+
+	struct Resource
+	{
+		const char* name;
+		TextureDesc desc;
+		GLuint texture = 0;
+		bool imported = false;
+		bool backbuffer = false;
+		int refCount = 0;
+		int firstUse = -1;
+		int lastUse = -1;
+	};
+
+	struct Pass
+	{
+		const char* name;
+		std::function<void()> execute;
+		std::vector<ResourceHandle> reads;
+		std::vector<ResourceHandle> writes;
+		ResourceHandle colors[MAX_COLOR_ATTACHMENTS] = { InvalidResource, InvalidResource, InvalidResource, InvalidResource };
+		ResourceHandle depth = InvalidResource;
+		bool sideEffect = false;
+		int refCount = 0;
+	};
+
+	struct PooledTexture
+	{
+		TextureDesc desc;
+		GLuint texture;
+		uint64_t lastUsedFrame;
+		bool inUse;
+	};
+
+	struct CachedFramebuffer
+	{
+		GLuint attachments[MAX_COLOR_ATTACHMENTS + 1];
+		GLuint framebuffer;
+		uint64_t lastUsedFrame;
+	};
+
+	void Cull();
+	void Sort();
+	void AllocateTextures();
+	GLuint AcquireTexture(TextureDesc const& desc);
+	void ReleaseTexture(GLuint texture);
+	GLuint GetFramebuffer(Pass const& pass);
+	void CollectGarbage();
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<PassHandle> order;
+	std::vector<PooledTexture> pool;
+	std::vector<CachedFramebuffer> framebuffers;
+	GLuint backbufferFramebuffer = 0;
+	uint64_t frameIndex = 0;
+	bool compiled = false;
+	Stats stats;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline FrameGraph::Stats const&
+FrameGraph::GetStats() const
+{
+	return this->stats;
+}
+
+} // namespace Render
@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+//  @file framepacket.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "framepacket.h"
+
+namespace Render
+{
+
+//------------------------------------------------------------------------------
+/**
+*/
+FramePacket::~FramePacket()
+{
+	this->ClearUi();
+}
+
+//------------------------------------------------------------------------------
+/**
+	ImGui reuses its draw lists every frame, so the packet needs its own copies
+	while the game thread builds the UI of the next frame.
+*/
+void
+FramePacket::CloneUi(ImDrawData const* drawData)
+{
+	this->ClearUi();
+	if (drawData == nullptr || !drawData->Valid)
+		return;
+
+	for (int i = 0; i < drawData->CmdListsCount; i++)
+		this->uiDrawLists.push_back(drawData->CmdLists[i]->CloneOutput());
+
+	this->uiDrawData.Valid = true;
+	this->uiDrawData.CmdListsCount = (int)this->uiDrawLists.size();
+	this->uiDrawData.CmdLists = this->uiDrawLists.data();
+	this->uiDrawData.TotalIdxCount = drawData->TotalIdxCount;
+	this->uiDrawData.TotalVtxCount = drawData->TotalVtxCount;
+	this->uiDrawData.DisplayPos = drawData->DisplayPos;
+	this->uiDrawData.DisplaySize = drawData->DisplaySize;
+	this->uiDrawData.FramebufferScale = drawData->FramebufferScale;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+FramePacket::ClearUi()
+{
+	for (ImDrawList* list : this->uiDrawLists)
+		IM_DELETE(list);
+	this->uiDrawLists.clear();
+	this->uiDrawData.Clear();
+}
+
+} // namespace Render
@@ -0,0 +1,104 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file framepacket.h
+
+	Everything the render thread needs to draw one frame.
+
+	The game thread fills a packet with copies of the draw commands, cameras,
+	lights, debug shapes and UI draw lists, and hands it over to the render
+	thread. From then on the game thread is free to simulate the next frame
+	without touching anything the render thread reads.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include "renderdevice.h"
+#include "texturepool.h"
+#include "model.h"
+#include "cameramanager.h"
+#include "lightserver.h"
+#include "debugrender.h"
+#include "particlesystem.h"
+#include "imgui.h"
+#include <vector>
+#include <chrono>
+
+namespace Render
+{
+
+/// a primitive to draw with its material resolved, so submitting it needs no lookups
+struct DrawPacket
+{
+	/// material features, selecting the program variant that draws the packet
+	enum Feature : uint8_t
+	{
+		FEATURE_ALPHA_MASK = 1 << 0,
+		FEATURE_DOUBLE_SIDED = 1 << 1,
+		FEATURE_SKINNED = 1 << 2,
+		NUM_FEATURE_MASKS = 1 << 3
+	};
+
+	glm::mat4 transform;
+	glm::vec4 baseColorFactor;
+	glm::vec4 emissiveFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	// zero unless the material uses alpha masking
+	float alphaCutoff;
+	GLuint vao;
+	// vertex array with positions only
+	GLuint depthVao;
+	GLuint numIndices;
+	GLuint offset;
+	GLenum indexType;
+	// texture array layers, no array for unused slots
+	TextureLayer textures[Model::Material::NUM_TEXTURES];
+	// mask of Feature bits
+	uint8_t features;
+	// first matrix of the joint palette, for skinned packets
+	uint32_t firstJoint;
+};
+
+struct FramePacket
+{
+	FramePacket() = default;
+	~FramePacket();
+	FramePacket(FramePacket const&) = delete;
+	void operator=(FramePacket const&) = delete;
+
+	/// copy the draw lists of the UI into the packet
+	void CloneUi(ImDrawData const* drawData);
+	/// free the cloned draw lists
+	void ClearUi();
+
+	uint64_t frameIndex = 0;
+	Display::Window* window = nullptr;
+	int width = 0;
+	int height = 0;
+	// GL handle of the skybox cubemap, zero if there is none. Texture ids can only be resolved on the game thread.
+	GLuint skyboxTexture = 0;
+
+	std::vector<DrawCommand> drawCommands;
+	/// draws that passed culling, built in parallel with one list per job system thread
+	std::vector<std::vector<DrawPacket>> geometryDraws;
+	std::vector<std::vector<DrawPacket>> shadowDraws;
+	/// alpha blended draws, in no particular order
+	std::vector<std::vector<DrawPacket>> transparentDraws;
+	CameraManager::Snapshot cameras;
+	LightServer::Snapshot lights;
+	Debug::CommandList debugCommands;
+	/// skinning matrices of the animation instances, as of the last Animation::Update
+	std::vector<glm::mat4> jointPalettes;
+	ParticleSystem::Snapshot particles;
+
+	/// points into uiDrawLists, draw it with Window::DrawUi
+	ImDrawData uiDrawData;
+	std::vector<ImDrawList*> uiDrawLists;
+
+	/// when the input this frame is based on was polled
+	std::chrono::steady_clock::time_point inputTime;
+};
+
+} // namespace Render
@@ -0,0 +1,505 @@
+//------------------------------------------------------------------------------
+//  @file gpuprofiler.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "GL/glew.h"
+#include "gpuprofiler.h"
+#include "imgui.h"
+#include "core/cvar.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+
+namespace Render
+{
+namespace GpuProfiler
+{
+
+/// number of frames that can be in flight before their queries are reused
+static const int NUM_FRAMES = 4;
+
+struct Zone
+{
+	std::string name;
+	int depth = 0;
+	float history[HISTORY_SIZE] = {};
+	int head = 0;
+	int numSamples = 0;
+	float last = 0.0f;
+	// time accumulated while resolving a frame, zones can be entered more than once per frame
+	float accumulated = 0.0f;
+	bool touched = false;
+};
+
+struct ZoneRecord
+{
+	uint16_t zone;
+	uint16_t beginQuery;
+	uint16_t endQuery;
+};
+
+struct Frame
+{
+	std::vector<GLuint> queries;
+	uint16_t numQueries = 0;
+	std::vector<ZoneRecord> records;
+	bool pending = false;
+	// number of the frame, see FrameTimes
+	uint64_t index = 0;
+};
+
+/// gpu profiler singleton state
+struct State
+{
+	Frame frames[NUM_FRAMES];
+	uint64_t frameIndex = 0;
+	uint64_t resolvedFrames = 0;
+	uint64_t droppedFrames = 0;
+	bool recording = false;
+
+	std::vector<Zone> zones;
+	// zone names have static lifetime, so the pointer is a cheap key
+	std::unordered_map<const char*, uint16_t> zoneTable;
+	// open records, -1 for zones begun outside of a frame
+	std::vector<int> stack;
+
+	// resolved frames, kept between BeginFrameLog and EndFrameLog
+	bool logging = false;
+	std::vector<FrameTimes> log;
+
+	// frames are recorded on the render thread while the results are read on the game thread,
+	// guards the zones and the resolved frame counters
+	std::mutex lock;
+};
+
+static State* state = nullptr;
+static Core::CVar* r_gpu_profiler = nullptr;
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Create()
+{
+	n_assert(state == nullptr);
+	state = new State();
+	r_gpu_profiler = Core::CVarCreate(Core::CVarType::CVar_Int, "r_gpu_profiler", "0", "Show the GPU profiler overlay");
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Destroy()
+{
+	n_assert(state != nullptr);
+	for (int i = 0; i < NUM_FRAMES; i++)
+	{
+		Frame& frame = state->frames[i];
+		if (!frame.queries.empty())
+			glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+	}
+	delete state;
+	state = nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static uint16_t
+AllocateQuery(Frame& frame)
+{
+	if (frame.numQueries == frame.queries.size())
+	{
+		const size_t grow = 32;
+		size_t const offset = frame.queries.size();
+		frame.queries.resize(offset + grow);
+		glGenQueries((GLsizei)grow, &frame.queries[offset]);
+	}
+	return frame.numQueries++;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Reads back the queries of a frame if the GPU has finished it.
+	Returns false if the results are not available yet.
+*/
+static bool
+ResolveFrame(Frame& frame)
+{
+	if (frame.records.empty())
+	{
+		frame.pending = false;
+		return true;
+	}
+
+	// queries finish in order, so if the last one is done the frame is done
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return false;
+
+	for (ZoneRecord const& record : frame.records)
+	{
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[record.beginQuery], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[record.endQuery], GL_QUERY_RESULT, &end);
+		Zone& zone = state->zones[record.zone];
+		zone.accumulated += float(double(end - begin) / 1000000.0);
+		zone.touched = true;
+	}
+
+	if (state->logging)
+	{
+		state->log.emplace_back();
+		state->log.back().frame = frame.index;
+	}
+
+	for (Zone& zone : state->zones)
+	{
+		// a zone that didn't run in the frame took no time, its history is kept for the overlay
+		if (!zone.touched)
+		{
+			zone.last = 0.0f;
+			continue;
+		}
+
+		if (state->logging)
+			state->log.back().zones.push_back({ zone.name, zone.accumulated });
+
+		zone.last = zone.accumulated;
+		zone.history[zone.head] = zone.accumulated;
+		zone.head = (zone.head + 1) % HISTORY_SIZE;
+		zone.numSamples = std::min(zone.numSamples + 1, HISTORY_SIZE);
+		zone.accumulated = 0.0f;
+		zone.touched = false;
+	}
+
+	state->resolvedFrames++;
+	frame.pending = false;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+BeginFrame()
+{
+	n_assert(!state->recording);
+	std::unique_lock<std::mutex> guard(state->lock);
+
+	// resolve frames in submission order, the slot about to be reused is the oldest
+	for (int i = NUM_FRAMES; i > 0; i--)
+	{
+		Frame& frame = state->frames[(state->frameIndex + NUM_FRAMES - i) % NUM_FRAMES];
+		if (frame.pending && !ResolveFrame(frame))
+			break;
+	}
+
+	Frame& frame = state->frames[state->frameIndex % NUM_FRAMES];
+	if (frame.pending)
+	{
+		// the GPU is more than NUM_FRAMES behind, drop the oldest results instead of waiting
+		frame.pending = false;
+		state->droppedFrames++;
+	}
+	guard.unlock();
+
+	frame.numQueries = 0;
+	frame.records.clear();
+	frame.index = state->frameIndex;
+	state->stack.clear();
+	state->recording = true;
+
+	BeginZone("Frame");
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+EndFrame()
+{
+	n_assert(state->recording);
+	EndZone();
+	n_assert2(state->stack.empty(), "Unbalanced GPU profiler zones!");
+
+	Frame& frame = state->frames[state->frameIndex % NUM_FRAMES];
+	frame.pending = true;
+	state->recording = false;
+	state->frameIndex++;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+BeginZone(const char* name)
+{
+	if (!state->recording)
+	{
+		state->stack.push_back(-1);
+		return;
+	}
+
+	uint16_t zoneIndex;
+	auto it = state->zoneTable.find(name);
+	if (it != state->zoneTable.end())
+	{
+		zoneIndex = it->second;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		zoneIndex = (uint16_t)state->zones.size();
+		Zone zone;
+		zone.name = name;
+		zone.depth = (int)state->stack.size();
+		state->zones.push_back(zone);
+		state->zoneTable.emplace(name, zoneIndex);
+	}
+
+	Frame& frame = state->frames[state->frameIndex % NUM_FRAMES];
+	ZoneRecord record;
+	record.zone = zoneIndex;
+	record.beginQuery = AllocateQuery(frame);
+	record.endQuery = record.beginQuery;
+	glQueryCounter(frame.queries[record.beginQuery], GL_TIMESTAMP);
+
+	state->stack.push_back((int)frame.records.size());
+	frame.records.push_back(record);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+EndZone()
+{
+	n_assert(!state->stack.empty());
+	int const recordIndex = state->stack.back();
+	state->stack.pop_back();
+	if (recordIndex == -1)
+		return;
+
+	Frame& frame = state->frames[state->frameIndex % NUM_FRAMES];
+	ZoneRecord& record = frame.records[recordIndex];
+	record.endQuery = AllocateQuery(frame);
+	glQueryCounter(frame.queries[record.endQuery], GL_TIMESTAMP);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static Zone const*
+FindZone(const char* name)
+{
+	for (Zone const& zone : state->zones)
+	{
+		if (zone.name == name)
+			return &zone;
+	}
+	return nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+float
+GetZoneTime(const char* name)
+{
+	std::lock_guard<std::mutex> guard(state->lock);
+	Zone const* zone = FindZone(name);
+	return zone != nullptr ? zone->last : 0.0f;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+float
+GetZoneAverage(const char* name)
+{
+	std::lock_guard<std::mutex> guard(state->lock);
+	Zone const* zone = FindZone(name);
+	if (zone == nullptr || zone->numSamples == 0)
+		return 0.0f;
+
+	float sum = 0.0f;
+	for (int i = 0; i < zone->numSamples; i++)
+		sum += zone->history[i];
+	return sum / zone->numSamples;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint64_t
+GetResolvedFrameCount()
+{
+	std::lock_guard<std::mutex> guard(state->lock);
+	return state->resolvedFrames;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+BeginFrameLog()
+{
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->log.clear();
+	state->logging = true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::vector<FrameTimes>
+EndFrameLog()
+{
+	std::lock_guard<std::mutex> guard(state->lock);
+	state->logging = false;
+	std::vector<FrameTimes> log;
+	log.swap(state->log);
+	return log;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+float
+FrameTimes::GetZoneTime(const char* name) const
+{
+	for (auto const& zone : this->zones)
+	{
+		if (zone.first == name)
+			return zone.second;
+	}
+	return 0.0f;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+struct ZoneStats
+{
+	float avg = 0.0f;
+	float min = 0.0f;
+	float max = 0.0f;
+	float p50 = 0.0f;
+	float p95 = 0.0f;
+	float p99 = 0.0f;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+static ZoneStats
+ComputeStats(Zone const& zone)
+{
+	ZoneStats stats;
+	if (zone.numSamples == 0)
+		return stats;
+
+	std::vector<float> sorted(zone.history, zone.history + zone.numSamples);
+	std::sort(sorted.begin(), sorted.end());
+	float sum = 0.0f;
+	for (float const sample : sorted)
+		sum += sample;
+
+	size_t const last = sorted.size() - 1;
+	stats.avg = sum / sorted.size();
+	stats.min = sorted.front();
+	stats.max = sorted.back();
+	stats.p50 = sorted[last / 2];
+	stats.p95 = sorted[(last * 95) / 100];
+	stats.p99 = sorted[(last * 99) / 100];
+	return stats;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+DrawOverlay()
+{
+	if (Core::CVarReadInt(r_gpu_profiler) == 0)
+		return;
+
+	static char reportPath[256] = "gpu_profile.json";
+	bool exportReport = false;
+
+	std::unique_lock<std::mutex> guard(state->lock);
+	ImGui::Begin("GPU Profiler");
+	ImGui::Text("Resolved frames: %llu, dropped: %llu", (unsigned long long)state->resolvedFrames, (unsigned long long)state->droppedFrames);
+
+	for (Zone const& zone : state->zones)
+	{
+		ZoneStats const stats = ComputeStats(zone);
+		ImGui::PushID(zone.name.c_str());
+		ImGui::Indent(zone.depth * 10.0f + 1.0f);
+		ImGui::Text("%s: %.3f ms (avg %.3f, p95 %.3f, max %.3f)", zone.name.c_str(), zone.last, stats.avg, stats.p95, stats.max);
+		// oldest sample first
+		int const offset = zone.numSamples < HISTORY_SIZE ? 0 : zone.head;
+		ImGui::PlotHistogram("##history", zone.history, zone.numSamples, offset, nullptr, 0.0f, stats.max * 1.25f, ImVec2(0, 40));
+		ImGui::Unindent(zone.depth * 10.0f + 1.0f);
+		ImGui::PopID();
+	}
+
+	ImGui::InputText("Report", reportPath, sizeof(reportPath));
+	ImGui::SameLine();
+	exportReport = ImGui::Button("Export");
+
+	ImGui::End();
+	guard.unlock();
+
+	if (exportReport)
+		WriteReport(reportPath);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+WriteReport(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		n_warning("Could not open GPU profiler report '%s' for writing!\n", path);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(state->lock);
+	fprintf(file, "{\n");
+	fprintf(file, "  \"resolvedFrames\": %llu,\n", (unsigned long long)state->resolvedFrames);
+	fprintf(file, "  \"droppedFrames\": %llu,\n", (unsigned long long)state->droppedFrames);
+	fprintf(file, "  \"zones\": [\n");
+	for (size_t i = 0; i < state->zones.size(); i++)
+	{
+		Zone const& zone = state->zones[i];
+		ZoneStats const stats = ComputeStats(zone);
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"name\": \"%s\",\n", zone.name.c_str());
+		fprintf(file, "      \"depth\": %d,\n", zone.depth);
+		fprintf(file, "      \"samples\": %d,\n", zone.numSamples);
+		fprintf(file, "      \"avgMs\": %f, \"minMs\": %f, \"maxMs\": %f,\n", stats.avg, stats.min, stats.max);
+		fprintf(file, "      \"p50Ms\": %f, \"p95Ms\": %f, \"p99Ms\": %f,\n", stats.p50, stats.p95, stats.p99);
+		fprintf(file, "      \"history\": [");
+		int const offset = zone.numSamples < HISTORY_SIZE ? 0 : zone.head;
+		for (int s = 0; s < zone.numSamples; s++)
+			fprintf(file, s == 0 ? "%f" : ", %f", zone.history[(offset + s) % HISTORY_SIZE]);
+		fprintf(file, "]\n");
+		fprintf(file, i + 1 < state->zones.size() ? "    },\n" : "    }\n");
+	}
+	fprintf(file, "  ]\n}\n");
+	fclose(file);
+	return true;
+}
+
+} // namespace GpuProfiler
+} // namespace Render
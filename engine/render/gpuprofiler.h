@@ -0,0 +1,83 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file gpuprofiler.h
+
+	Measures GPU time of render passes with timestamp queries.
+
+	Zones are recorded with glQueryCounter and read back a few frames later,
+	once the results are available, so the profiler never stalls the pipeline.
+	Every zone keeps a rolling history of its most recent samples.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <string>
+#include <vector>
+
+namespace Render
+{
+
+namespace GpuProfiler
+{
+	/// number of samples kept per zone
+	static const int HISTORY_SIZE = 256;
+
+	/// zone times of one resolved frame
+	struct FrameTimes
+	{
+		/// number of the frame, counting BeginFrame calls from 0. RenderDevice begins one frame per Render.
+		uint64_t frame;
+		/// zones that ran in the frame and their times, in milliseconds
+		std::vector<std::pair<std::string, float>> zones;
+
+		/// get the time of a zone in this frame, in milliseconds. Returns 0 if it didn't run.
+		float GetZoneTime(const char* name) const;
+	};
+
+	/// create the singleton
+	void Create();
+	/// destroy the singleton
+	void Destroy();
+
+	/// resolve finished queries and start recording a new frame
+	void BeginFrame();
+	/// stop recording the current frame
+	void EndFrame();
+
+	/// begin a named zone. Name must be a string with static lifetime.
+	void BeginZone(const char* name);
+	/// end the last begun zone
+	void EndZone();
+
+	/// get the time of a zone in the most recently resolved frame, in milliseconds. Returns 0 if it didn't run in that frame.
+	float GetZoneTime(const char* name);
+	/// get the average time of a zone over the history, in milliseconds
+	float GetZoneAverage(const char* name);
+	/// get the number of frames that have been read back so far
+	uint64_t GetResolvedFrameCount();
+	/// keep the zone times of every frame resolved from now on, until EndFrameLog
+	void BeginFrameLog();
+	/// stop logging and return the frames resolved since BeginFrameLog, in order. Dropped frames are missing.
+	std::vector<FrameTimes> EndFrameLog();
+
+	/// draw the profiler overlay using ImGui, if enabled with r_gpu_profiler
+	void DrawOverlay();
+	/// write all zone statistics and histories to a json file
+	bool WriteReport(const char* path);
+
+	/// scoped zone helper
+	struct ScopedZone
+	{
+		ScopedZone(const char* name) { BeginZone(name); }
+		~ScopedZone() { EndZone(); }
+	};
+};
+
+} // namespace Render
+
+#define N_GPU_ZONE_CONCAT_IMPL(a, b) a##b
+#define N_GPU_ZONE_CONCAT(a, b) N_GPU_ZONE_CONCAT_IMPL(a, b)
+/// measure GPU time from this point until the end of the scope
+#define N_GPU_ZONE(name) Render::GpuProfiler::ScopedZone N_GPU_ZONE_CONCAT(__gpuZone, __LINE__)(name)
@@ -5,6 +5,7 @@
 #include "config.h"
 #include "inputserver.h"
 #include "GLFW/glfw3.h"
+#include "core/profiler.h"
 
 namespace Input
 {
@@ -34,6 +35,7 @@ InputHandler::Create()
 void
 InputHandler::BeginFrame()
 {
+	N_PROFILE_SCOPE("InputHandler::BeginFrame");
 	for (int i = 0; i < Key::Code::NumKeyCodes; i++)
 	{
 		if (hid->keyboard.released[i])
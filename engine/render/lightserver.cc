@@ -31,6 +31,8 @@ static Util::IdPool<PointLightId> pointLightPool;
 static Core::CVar* r_draw_light_spheres = nullptr;
 static Core::CVar* r_draw_light_sphere_id = nullptr;
 static PointLights pointLights;
+// lights of the frame being rendered, only touched by the render thread
+static Snapshot const* renderLights = nullptr;
 
 
 
@@ -56,9 +58,10 @@ Initialize()
 void
 Update(Render::ShaderProgramId pid)
 {
+	n_assert(renderLights != nullptr);
 	GLuint programHandle = ShaderResource::GetProgramHandle(pid);
-	glUniform3fv(glGetUniformLocation(programHandle, "GlobalLightDirection"), 1, &globalLightDirection[0]);
-	glUniform3fv(glGetUniformLocation(programHandle, "GlobalLightColor"), 1, &globalLightColor[0]);
+	glUniform3fv(glGetUniformLocation(programHandle, "GlobalLightDirection"), 1, &renderLights->globalLightDirection[0]);
+	glUniform3fv(glGetUniformLocation(programHandle, "GlobalLightColor"), 1, &renderLights->globalLightColor[0]);
 }
 
 //------------------------------------------------------------------------------
@@ -67,6 +70,11 @@ Update(Render::ShaderProgramId pid)
 void
 DrawPointLights(Render::ShaderProgramId pid)
 {
+	n_assert(renderLights != nullptr);
+	std::vector<glm::vec3> const& positions = renderLights->pointLightPositions;
+	std::vector<glm::vec3> const& colors = renderLights->pointLightColors;
+	std::vector<float> const& radii = renderLights->pointLightRadii;
+
 	glDepthFunc(GL_GEQUAL);
 	glCullFace(GL_FRONT);
 	GLuint programHandle = ShaderResource::GetProgramHandle(pid);
@@ -81,16 +89,14 @@ DrawPointLights(Render::ShaderProgramId pid)
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_ONE, GL_ONE);
 	glBindVertexArray(primitive.vao);
-	for (int i = 0; i < pointLights.active.size(); i++)
+	// the snapshot only holds active lights
+	for (size_t i = 0; i < positions.size(); i++)
 	{
-		// TODO: we could instead pack the point light array and issue a single instanced drawcall. This does require some indirection from pointlightID to index, but should be a favorable tradeoff
-		if (pointLights.active[i])
-		{
-			glUniform3fv(lightPosLocation, 1, &pointLights.positions[i][0]);
-			glUniform3fv(lightColorLocation, 1, &pointLights.colors[i][0]);
-			glUniform1f(lightRadiusLocation, pointLights.radii[i]);
-			glDrawElements(GL_TRIANGLES, primitive.numIndices, primitive.indexType, (void*)(intptr_t)primitive.offset);
-		}
+		// TODO: we could instead issue a single instanced drawcall, now that the snapshot is packed
+		glUniform3fv(lightPosLocation, 1, &positions[i][0]);
+		glUniform3fv(lightColorLocation, 1, &colors[i][0]);
+		glUniform1f(lightRadiusLocation, radii[i]);
+		glDrawElements(GL_TRIANGLES, primitive.numIndices, primitive.indexType, (void*)(intptr_t)primitive.offset);
 	}
 	
 	glDisable(GL_BLEND);
@@ -112,22 +118,19 @@ DrawPointLights(Render::ShaderProgramId pid)
 
 		static GLuint model = glGetUniformLocation(debugProgramHandle, "model");
 		static GLuint viewProjection = glGetUniformLocation(debugProgramHandle, "viewProjection");
-		Render::Camera* const mainCamera = Render::CameraManager::GetCamera(CAMERA_MAIN);
+		Render::Camera* const mainCamera = Render::CameraManager::GetRenderCamera(CAMERA_MAIN);
 		glUniformMatrix4fv(viewProjection, 1, GL_FALSE, &mainCamera->viewProjection[0][0]);
 
 		glDisable(GL_CULL_FACE);
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 		int drawId = Core::CVarReadInt(r_draw_light_sphere_id);
-		for (int i = 0; i < pointLights.active.size(); i++)
+		for (int i = 0; i < (int)positions.size(); i++)
 		{
 			if (drawId < 0 || i == drawId)
 			{
-				if (pointLights.active[i])
-				{
-					glm::mat4 transform = glm::translate(pointLights.positions[i]) * glm::scale(glm::vec3(pointLights.radii[i]));
-					glUniformMatrix4fv(model, 1, GL_FALSE, &transform[0][0]);
-					glDrawElements(GL_TRIANGLES, primitive.numIndices, primitive.indexType, (void*)(intptr_t)primitive.offset);
-				}
+				glm::mat4 transform = glm::translate(positions[i]) * glm::scale(glm::vec3(radii[i]));
+				glUniformMatrix4fv(model, 1, GL_FALSE, &transform[0][0]);
+				glDrawElements(GL_TRIANGLES, primitive.numIndices, primitive.indexType, (void*)(intptr_t)primitive.offset);
 			}
 		}
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -243,6 +246,34 @@ GetRadius(PointLightId id)
 //------------------------------------------------------------------------------
 /**
 */
-		
+void
+CaptureSnapshot(Snapshot& snapshot)
+{
+	snapshot.globalLightDirection = globalLightDirection;
+	snapshot.globalLightColor = globalLightColor;
+	snapshot.pointLightPositions.clear();
+	snapshot.pointLightColors.clear();
+	snapshot.pointLightRadii.clear();
+	for (size_t i = 0; i < pointLights.active.size(); i++)
+	{
+		if (pointLights.active[i])
+		{
+			snapshot.pointLightPositions.push_back(pointLights.positions[i]);
+			snapshot.pointLightColors.push_back(pointLights.colors[i]);
+			snapshot.pointLightRadii.push_back(pointLights.radii[i]);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	The snapshot must stay alive until the frame has been rendered.
+*/
+void
+ApplySnapshot(Snapshot const& snapshot)
+{
+	renderLights = &snapshot;
+}
+
 }
 } // namespace Render
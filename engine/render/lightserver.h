@@ -19,11 +19,26 @@ namespace LightServer
 	extern glm::vec3 globalLightDirection;
 	extern glm::vec3 globalLightColor;
 
+	/// copy of all light data, handed from the game thread to the render thread
+	struct Snapshot
+	{
+		glm::vec3 globalLightDirection;
+		glm::vec3 globalLightColor;
+		std::vector<glm::vec3> pointLightPositions;
+		std::vector<glm::vec3> pointLightColors;
+		std::vector<float> pointLightRadii;
+	};
+
 	void Initialize();
 	void Update(Render::ShaderProgramId pid);
 
     void DrawPointLights(Render::ShaderProgramId pid);
 
+	/// copy all active lights into a snapshot. Called on the game thread.
+	void CaptureSnapshot(Snapshot& snapshot);
+	/// render the lights of a snapshot from now on. Called on the render thread.
+	void ApplySnapshot(Snapshot const& snapshot);
+
     bool IsValid(PointLightId id);
 	PointLightId CreatePointLight(glm::vec3 position, glm::vec3 color, float intensity, float radius);
 	void DestroyPointLight(PointLightId id);
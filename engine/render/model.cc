@@ -4,370 +4,776 @@
 //------------------------------------------------------------------------------
 #include "config.h"
 #include "model.h"
-#include "gltf.h"
+#include "modelfile.h"
 #include "textureresource.h"
+#include "core/profiler.h"
+#include "core/cvar.h"
+#include "core/hash.h"
+#include "core/mappedfile.h"
+#include "core/idpool.h"
+#include "core/jobsystem.h"
+#include "renderthread.h"
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace Render
 {
 
-static uint nameCounter = 0;
+/// a vertex or index buffer, shared by all models with a buffer view of the same contents
+struct SharedBuffer
+{
+	GLuint buffer;
+	uint refcount;
+};
+
+static Util::IdPool<ModelId> modelPool;
 static std::vector<Model> modelAllocator;
+// name each slot is registered with
+static std::vector<std::string> modelNames;
 static std::unordered_map<std::string, ModelId> modelRegistry;
+static std::unordered_map<uint64_t, SharedBuffer> bufferRegistry;
+// buffers that are created and not deleted yet, read on the game thread
+static std::atomic<uint32_t> numBuffers(0);
+static Core::CVar* r_texture_streaming = nullptr;
+static Core::CVar* r_model_cache = nullptr;
 
-int SlotFromGltf(std::string const& attr)
+//------------------------------------------------------------------------------
+/**
+	Embedded images are named by a hash of their encoded data, so the same
+	image embedded in several files is only decoded and uploaded once. The
+	sampler, color space and usage change the texture, so they are part of the
+	name as well.
+*/
+static std::string
+GetEmbeddedImageName(std::vector<uint8_t> const& data, MagFilter mag, MinFilter min, WrappingMode wrapS, WrappingMode wrapT, bool sRGB, TextureUsage usage)
 {
-	if (attr == "POSITION")		return 0;
-	if (attr == "NORMAL")		return 1;
-	if (attr == "TANGENT")		return 2;
-	if (attr == "TEXCOORD_0")	return 3;
-	if (attr == "COLOR_0")		return 4;
-	if (attr == "JOINTS_0")		return 5;
-	if (attr == "WEIGHTS_0")	return 6;
-	
-	n_error("Attribute location not set!\n");
-	return 0;
+	uint16_t const key[] = { (uint16_t)mag, (uint16_t)min, (uint16_t)wrapS, (uint16_t)wrapT, (uint16_t)sRGB, (uint16_t)usage };
+	uint64_t const hash = Core::Hash64(data.data(), data.size(), Core::Hash64(key, sizeof(key)));
+
+	char name[48];
+	snprintf(name, sizeof(name), "embedded_image_%016llx", (unsigned long long)hash);
+	return name;
 }
 
-void InferBufferTargets(fx::gltf::Document& model)
+//------------------------------------------------------------------------------
+/**
+	Returns the buffer holding the given data, and creates it if no other model
+	has a buffer with the same contents. The key is set to the content hash the
+	buffer is registered with.
+*/
+static GLuint
+AcquireBuffer(GLenum target, void const* data, GLsizeiptr size, uint64_t& key)
 {
-    bool infer = false;
-	for (unsigned i = 0; i < model.bufferViews.size(); i++)
+	key = Core::Hash64(data, (size_t)size, (uint64_t)target);
+	auto iter = bufferRegistry.find(key);
+	if (iter != bufferRegistry.end())
 	{
-		bool br = false;
-		auto const& bufferView = model.bufferViews[i];
-		if (bufferView.target == fx::gltf::BufferView::TargetType::None)
-		{
-			infer = true;
-			break;
-		}
+		iter->second.refcount++;
+		return iter->second.buffer;
 	}
 
-	if (infer)
-    {
-        // TODO: could be better
-        for (auto const& mesh : model.meshes)
-        {
-            for (auto const& primitive : mesh.primitives)
-            {
-                for (auto const& attr : primitive.attributes)
-                {
-                    auto const& accessor = model.accessors[attr.second];
-                    model.bufferViews[accessor.bufferView].target = (fx::gltf::BufferView::TargetType)GL_ARRAY_BUFFER;
-                }
-
-                auto const& accessor = model.accessors[primitive.indices];
-				model.bufferViews[accessor.bufferView].target = (fx::gltf::BufferView::TargetType)GL_ELEMENT_ARRAY_BUFFER;
-            }
-        }
-    }
+	SharedBuffer shared;
+	shared.refcount = 1;
+	glGenBuffers(1, &shared.buffer);
+	glBindBuffer(target, shared.buffer);
+	glBufferData(target, size, data, GL_STATIC_DRAW);
+	bufferRegistry.emplace(key, shared);
+	numBuffers++;
+	return shared.buffer;
 }
 
-Model LoadGLTF(std::string const& uri)
+//------------------------------------------------------------------------------
+/**
+	Returns the texture for an image of a model, and loads it if no other model
+	has loaded the same image.
+*/
+static TextureResourceId
+LoadModelTexture(std::string const& uri, uint8_t const* data, ModelFile::Texture const& texture, bool streaming)
 {
-	fx::gltf::Document doc;
-
-	try
-	{
-		if (uri.substr(uri.find_last_of(".") + 1) == "glb")
-			doc = fx::gltf::LoadFromBinary(uri);
-		else
-			doc = fx::gltf::LoadFromText(uri);
-	}
-	catch (const std::exception& err)
+	MagFilter const mag = (MagFilter)texture.magFilter;
+	MinFilter const min = (MinFilter)texture.minFilter;
+	WrappingMode const wrapS = (WrappingMode)texture.wrapS;
+	WrappingMode const wrapT = (WrappingMode)texture.wrapT;
+	bool const sRGB = texture.sRGB != 0;
+	TextureUsage const usage = (TextureUsage)texture.usage;
+
+	// streamed textures show the default texture of the slot they are used in until they are loaded
+	TextureResourceId placeholder;
+	switch ((ModelFile::Placeholder)texture.placeholder)
 	{
-		printf(err.what());
-		assert(false);
-		return Model();
+	case ModelFile::Placeholder::Black: placeholder = TextureResource::GetBlackTexture(); break;
+	case ModelFile::Placeholder::Normal: placeholder = TextureResource::GetDefaultNormalTexture(); break;
+	case ModelFile::Placeholder::MetallicRoughness: placeholder = TextureResource::GetDefaultMetallicRoughnessTexture(); break;
+	default: placeholder = TextureResource::GetWhiteTexture(); break;
 	}
-	
-    InferBufferTargets(doc); // fix up buffertargets if necessary
 
-	int numBuffers = 0;
-	//count number of buffers necessary
-	size_t const numBufferViews = doc.bufferViews.size();
-	for (unsigned i = 0; i < numBufferViews; i++)
+	if (texture.external)
 	{
-		numBuffers += (doc.bufferViews[i].target != fx::gltf::BufferView::TargetType::None);
+		// get base path to file, textures are registered by their path
+		std::filesystem::path p(uri);
+		std::string const imagePath = p.parent_path().string() + "/" + std::string((char const*)data + texture.offset, texture.size);
+		TextureResourceId id = TextureResource::AcquireTexture(imagePath);
+		if (id == InvalidResourceId)
+		{
+			if (streaming)
+				id = TextureResource::LoadTextureAsync(imagePath.c_str(), mag, min, wrapS, wrapT, sRGB, usage, placeholder);
+			else
+				id = TextureResource::LoadTexture(imagePath.c_str(), mag, min, wrapS, wrapT, sRGB, usage);
+		}
+		return id;
 	}
 
-	Model gltf;
-	gltf.buffers.reserve(numBuffers);
-	for (int i = 0; i < numBuffers; i++)
-		gltf.buffers.push_back(-1); // FIXME: missing function in vector?
-    glGenBuffers(numBuffers, &gltf.buffers[0]);
-
-	std::vector<int> bufferViewMap(numBufferViews);
-
-	//TODO: We should use less buffers and possibly rebind less often.
-	//		Put everything in one buffer and just use the offsets in the attribute pointers
-	unsigned bufferIndex = 0;
-    for (unsigned i = 0; i < numBufferViews; i++)
-    {
-		auto const& bufferView = doc.bufferViews[i];
-		if (bufferView.target != fx::gltf::BufferView::TargetType::None)
+	std::vector<uint8_t> image(data + texture.offset, data + texture.offset + texture.size);
+	std::string const name = GetEmbeddedImageName(image, mag, min, wrapS, wrapT, sRGB, usage);
+	TextureResourceId id = TextureResource::AcquireTexture(name);
+	if (id == InvalidResourceId)
+	{
+		if (streaming)
 		{
-			GLenum const target = (GLenum)bufferView.target;
-			glBindBuffer(target, gltf.buffers[bufferIndex]);
-			glBufferData(target, bufferView.byteLength, &(doc.buffers[bufferView.buffer].data[0]) + bufferView.byteOffset, GL_STATIC_DRAW);
-			bufferViewMap[i] = bufferIndex;
-			bufferIndex++;
+			id = TextureResource::LoadTextureFromMemoryAsync(name, std::move(image), mag, min, wrapS, wrapT, sRGB, usage, placeholder);
 		}
-    }
-	
-	std::vector<TextureResourceId> textures;
-	textures.resize(doc.textures.size(), InvalidResourceId);
-	
-	auto LoadTexture = [&doc, &uri, &textures](int textureIndex, fx::gltf::Texture const& texture, bool sRGB = false) {
-		fx::gltf::Image const& image = doc.images[texture.source];
-		fx::gltf::Sampler sampler;
-		if (texture.sampler != -1)
+		else
 		{
-			sampler = doc.samplers[texture.sampler];
+			ImageCreateInfo info;
+			info.extents = {};
+			info.type = ImageType::TEXTURE_2D;
+			id = TextureResource::AllocateImage(info);
+			TextureResource::LoadTextureFromMemory(name, image.data(), image.size(), id, mag, min, wrapS, wrapT, sRGB, usage);
 		}
+	}
+	return id;
+}
 
-		// set invalid samplers to default values for GL
-		if (sampler.magFilter == fx::gltf::Sampler::MagFilter::None)
-			sampler.magFilter = fx::gltf::Sampler::MagFilter::Linear;
-		if (sampler.minFilter == fx::gltf::Sampler::MinFilter::None)
-			sampler.minFilter = fx::gltf::Sampler::MinFilter::NearestMipMapLinear;
-
-		ImageCreateInfo info;
-		info.extents = {};
-		info.type = ImageType::TEXTURE_2D;
-
-		std::string name;
-		ImageId id;
-		if (image.IsEmbeddedResource())
-		{
-			// Make up some random name
-			uint guid = nameCounter++;
-			name = "embedded_image_";
-			name += std::to_string(guid);
+//------------------------------------------------------------------------------
+/**
+	Creates one buffer of a cooked model. Buffers are uploaded straight from
+	data, which is usually the mapped file.
+*/
+static void
+CreateModelBuffer(uint8_t const* data, Model& model, uint32_t index)
+{
+	ModelFile::Header const& header = *(ModelFile::Header const*)data;
+	ModelFile::Buffer const& buffer = ModelFile::GetTable<ModelFile::Buffer>(data, header.buffers)[index];
+	model.buffers[index] = AcquireBuffer(buffer.target, data + buffer.offset, (GLsizeiptr)buffer.size, model.bufferKeys[index]);
+}
 
-			id = TextureResource::AllocateImage(info);
-			std::vector<uint8_t> data;
-
-			image.MaterializeData(data);
-
-			TextureResource::LoadTextureFromMemory(
-				name,
-				&data[0],
-				data.size(),
-				id,
-				(Render::MagFilter)sampler.magFilter,
-				(Render::MinFilter)sampler.minFilter,
-				(Render::WrappingMode)sampler.wrapS,
-				(Render::WrappingMode)sampler.wrapT,
-				sRGB
-			);
-		}
-		else if (image.uri.empty())
-		{
-			// this mean the image is in a buffer view, and this needs to be handled as well
-			fx::gltf::BufferView const& bufferView = doc.bufferViews[image.bufferView];
-			fx::gltf::Buffer const& buffer = doc.buffers[bufferView.buffer];
+//------------------------------------------------------------------------------
+/**
+	Loads or acquires the textures of a cooked model. Basecolor textures are
+	loaded first, then the rest.
+*/
+static std::vector<TextureResourceId>
+LoadModelTextures(uint8_t const* data, std::string const& uri, bool streaming)
+{
+	ModelFile::Header const& header = *(ModelFile::Header const*)data;
+	ModelFile::Texture const* const textures = ModelFile::GetTable<ModelFile::Texture>(data, header.textures);
 
-			// Make up some random name
-			uint guid = nameCounter++;
-			name = "embedded_image_";
-			name += std::to_string(guid);
+	std::vector<TextureResourceId> textureIds(header.textures.count, InvalidResourceId);
+	for (uint32_t i = 0; i < header.textures.count; i++)
+	{
+		if (textures[i].sRGB)
+			textureIds[i] = LoadModelTexture(uri, data, textures[i], streaming);
+	}
+	for (uint32_t i = 0; i < header.textures.count; i++)
+	{
+		if (!textures[i].sRGB)
+			textureIds[i] = LoadModelTexture(uri, data, textures[i], streaming);
+	}
+	return textureIds;
+}
 
-			id = TextureResource::AllocateImage(info);
-			TextureResource::LoadTextureFromMemory(
-				name,
-				(void*)&buffer.data[bufferView.byteOffset],
-				bufferView.byteLength,
-				id,
-				(Render::MagFilter)sampler.magFilter,
-				(Render::MinFilter)sampler.minFilter,
-				(Render::WrappingMode)sampler.wrapS,
-				(Render::WrappingMode)sampler.wrapT,
-				sRGB
-			);
-		}
-		else // external image
+//------------------------------------------------------------------------------
+/**
+	Creates the vertex arrays and materials of a cooked model. All buffers of
+	the model have to be created. The model takes over the texture references.
+*/
+static void
+CreateModelMeshes(uint8_t const* data, Model& model, std::vector<TextureResourceId> const& textureIds)
+{
+	ModelFile::Header const& header = *(ModelFile::Header const*)data;
+	ModelFile::Buffer const* const buffers = ModelFile::GetTable<ModelFile::Buffer>(data, header.buffers);
+	ModelFile::Material const* const materials = ModelFile::GetTable<ModelFile::Material>(data, header.materials);
+	ModelFile::Mesh const* const meshes = ModelFile::GetTable<ModelFile::Mesh>(data, header.meshes);
+	ModelFile::Primitive const* const primitives = ModelFile::GetTable<ModelFile::Primitive>(data, header.primitives);
+	ModelFile::Attribute const* const attributes = ModelFile::GetTable<ModelFile::Attribute>(data, header.attributes);
+
+	for (uint32_t meshIndex = 0; meshIndex < header.meshes.count; meshIndex++)
+	{
+		ModelFile::Mesh const& mesh = meshes[meshIndex];
+		Model::Mesh m;
+		for (uint32_t primitiveIndex = mesh.firstPrimitive; primitiveIndex < mesh.firstPrimitive + mesh.numPrimitives; primitiveIndex++)
 		{
-			name = image.uri;
-			id = TextureResource::GetImageId(name);
-			if (id == InvalidImageId)
+			ModelFile::Primitive const& primitive = primitives[primitiveIndex];
+			Model::Mesh::Primitive p;
+			glGenVertexArrays(1, &p.vao);
+			glBindVertexArray(p.vao);
+			for (uint32_t a = primitive.firstAttribute; a < primitive.firstAttribute + primitive.numAttributes; a++)
 			{
-				// get base path to file
-				std::filesystem::path p(uri);
-				std::string imagePath = p.parent_path().string() + "/" + name;
-				id = TextureResource::LoadTexture(
-					imagePath.c_str(),
-					(Render::MagFilter)sampler.magFilter,
-					(Render::MinFilter)sampler.minFilter,
-					(Render::WrappingMode)sampler.wrapS,
-					(Render::WrappingMode)sampler.wrapT,
-					sRGB
-				);
+				ModelFile::Attribute const& attr = attributes[a];
+				glBindBuffer(buffers[attr.buffer].target, model.buffers[attr.buffer]);
+				glEnableVertexArrayAttrib(p.vao, attr.slot);
+				glVertexAttribPointer(attr.slot, attr.components, attr.type, attr.normalized, attr.stride, (void*)(intptr_t)attr.offset);
+				// JOINTS_0
+				if (attr.slot == 5)
+					p.skinned = true;
 			}
-		}
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.buffers[primitive.indexBuffer]);
 
-		textures[textureIndex] = id;
-	};
-
-	// load all basecolor textures
-	for (auto const& material : doc.materials)
-	{
-		int textureIndex = material.pbrMetallicRoughness.baseColorTexture.index;
-		if (textureIndex != -1)
-		{
-			// Load basecolor texture as sRGB because it's required by GLTF to be in sRGB space
-			LoadTexture(textureIndex, doc.textures[textureIndex], true);
-		}
-	}
+			// the depth pre-pass only fetches positions
+			glGenVertexArrays(1, &p.depthVao);
+			glBindVertexArray(p.depthVao);
+			for (uint32_t a = primitive.firstAttribute; a < primitive.firstAttribute + primitive.numAttributes; a++)
+			{
+				ModelFile::Attribute const& attr = attributes[a];
+				if (attr.slot != 0)
+					continue;
+				glBindBuffer(buffers[attr.buffer].target, model.buffers[attr.buffer]);
+				glEnableVertexArrayAttrib(p.depthVao, attr.slot);
+				glVertexAttribPointer(attr.slot, attr.components, attr.type, attr.normalized, attr.stride, (void*)(intptr_t)attr.offset);
+			}
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.buffers[primitive.indexBuffer]);
+			glBindVertexArray(p.vao);
 
-	// load the rest of the textures
-    for (int i = 0; i < doc.textures.size(); i++)
-    {
-		if (textures[i] != InvalidResourceId)
-			continue;
+			p.numIndices = primitive.numIndices;
+			p.offset = primitive.indexOffset;
+			p.indexType = primitive.indexType;
 
-		auto const& texture = doc.textures[i];
-		LoadTexture(i, texture);
-    }
-
-    for (auto const& mesh : doc.meshes)
-    {
-        Model::Mesh m;
-        for (auto const& primitive : mesh.primitives)
-        {
-            Model::Mesh::Primitive p;
-            glGenVertexArrays(1, &p.vao);
-            glBindVertexArray(p.vao);
-            for (auto const& attribute : primitive.attributes)
-            {
-				auto const& accessor = doc.accessors[attribute.second];
-                
-                Model::VertexAttribute attr;
-                attr.offset = accessor.byteOffset;
-				attr.stride = doc.bufferViews[accessor.bufferView].byteStride;
-                attr.normalized = accessor.normalized;
-
-                attr.slot = SlotFromGltf(attribute.first);
-				attr.type = (GLenum)accessor.componentType;
-
-                switch (accessor.type)
-                {
-				case fx::gltf::Accessor::Type::Scalar:
-                    attr.components = 1;
-                    break;
-				case fx::gltf::Accessor::Type::Vec2:
-				case fx::gltf::Accessor::Type::Vec3:
-				case fx::gltf::Accessor::Type::Vec4:
-                    attr.components = (GLint)accessor.type;
-                    break;
-                default:
-                    n_assert(false);
-                    break;
-                }
-                
-				fx::gltf::BufferView const& bufferView = doc.bufferViews[accessor.bufferView];
-				fx::gltf::Buffer const& buffer = doc.buffers[bufferView.buffer];
-                glBindBuffer((GLenum)doc.bufferViews[accessor.bufferView].target, gltf.buffers[bufferViewMap[accessor.bufferView]]);
-				glEnableVertexArrayAttrib(p.vao, attr.slot);
-                glVertexAttribPointer(attr.slot, attr.components, attr.type, attr.normalized, attr.stride, (void*)(intptr_t)attr.offset);
-            }
-            auto const& ibAccessor = doc.accessors[primitive.indices];
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gltf.buffers[bufferViewMap[ibAccessor.bufferView]]);
-            p.numIndices = ibAccessor.count;
-			p.offset = ibAccessor.byteOffset;
-            p.indexType = (GLenum)ibAccessor.componentType;
-            
 			if (primitive.material != -1)
 			{
 				// TODO: cutout materials
-				fx::gltf::Material const& gltfMaterial = doc.materials[primitive.material];
-				auto const& bcf = gltfMaterial.pbrMetallicRoughness.baseColorFactor;
-				p.material.baseColorFactor = glm::vec4(bcf[0], bcf[1], bcf[2], bcf[3]);
-				
-				p.material.textures[Model::Material::TEXTURE_BASECOLOR]			= gltfMaterial.pbrMetallicRoughness.baseColorTexture.index > -1 ?
-																					textures[gltfMaterial.pbrMetallicRoughness.baseColorTexture.index] :
-																					TextureResource::GetWhiteTexture();
-
-				p.material.textures[Model::Material::TEXTURE_NORMAL]			= gltfMaterial.normalTexture.index > -1 ?
-																					textures[gltfMaterial.normalTexture.index] :
-																					TextureResource::GetDefaultNormalTexture();
-
-				p.material.textures[Model::Material::TEXTURE_METALLICROUGHNESS] = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index > -1 ?
-																					textures[gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index] :
-																					TextureResource::GetDefaultMetallicRoughnessTexture();
-
-				p.material.textures[Model::Material::TEXTURE_EMISSIVE]			= gltfMaterial.emissiveTexture.index > -1 ?
-																					textures[gltfMaterial.emissiveTexture.index] :
-																					TextureResource::GetBlackTexture();
-
-				p.material.textures[Model::Material::TEXTURE_OCCLUSION]			= gltfMaterial.occlusionTexture.index > -1 ?
-																					textures[gltfMaterial.occlusionTexture.index] :
-																					TextureResource::GetBlackTexture();
-
-				p.material.alphaMode = (Model::Material::AlphaMode)gltfMaterial.alphaMode;
-				p.material.alphaCutoff = gltfMaterial.alphaCutoff;
-				p.material.doubleSided = gltfMaterial.doubleSided;
+				ModelFile::Material const& material = materials[primitive.material];
+				TextureResourceId const defaultTextures[Model::Material::NUM_TEXTURES] =
+				{
+					TextureResource::GetWhiteTexture(),
+					TextureResource::GetDefaultNormalTexture(),
+					TextureResource::GetDefaultMetallicRoughnessTexture(),
+					TextureResource::GetBlackTexture(),
+					TextureResource::GetBlackTexture()
+				};
+				p.material.baseColorFactor = glm::vec4(material.baseColorFactor[0], material.baseColorFactor[1], material.baseColorFactor[2], material.baseColorFactor[3]);
+				for (int i = 0; i < Model::Material::NUM_TEXTURES; i++)
+					p.material.textures[i] = material.textures[i] > -1 ? textureIds[material.textures[i]] : defaultTextures[i];
+
+				p.material.alphaMode = (Model::Material::AlphaMode)material.alphaMode;
+				p.material.alphaCutoff = material.alphaCutoff;
+				p.material.doubleSided = material.doubleSided != 0;
 				if (p.material.alphaMode == Model::Material::AlphaMode::Blend)
 					m.blendPrimitives.push_back((uint16_t)m.primitives.size());
 				else
 					m.opaquePrimitives.push_back((uint16_t)m.primitives.size());
 			}
 
-            glBindVertexArray(0);
+			glBindVertexArray(0);
 
-            m.primitives.push_back(std::move(p));
-        }
-		gltf.meshes.push_back(std::move(m));
-        
-    }
-	
-    return gltf;
+			m.primitives.push_back(std::move(p));
+		}
+		model.meshes.push_back(std::move(m));
+	}
+
+	model.boundingBoxMin = glm::vec3(header.boundingBoxMin[0], header.boundingBoxMin[1], header.boundingBoxMin[2]);
+	model.boundingBoxMax = glm::vec3(header.boundingBoxMax[0], header.boundingBoxMax[1], header.boundingBoxMax[2]);
+	model.textures = textureIds;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Creates the GL objects of a cooked model.
+*/
+static Model
+LoadCookedModel(uint8_t const* data, std::string const& uri)
+{
+	N_PROFILE_SCOPE("LoadCookedModel");
+	ModelFile::Header const& header = *(ModelFile::Header const*)data;
+
+	Model model;
+	model.buffers.resize(header.buffers.count);
+	model.bufferKeys.resize(header.buffers.count);
+	for (uint32_t i = 0; i < header.buffers.count; i++)
+		CreateModelBuffer(data, model, i);
+
+	if (r_texture_streaming == nullptr)
+		r_texture_streaming = Core::CVarCreate(Core::CVarType::CVar_Int, "r_texture_streaming", "1", "Decode model textures on worker threads and stream them in");
+	bool const streaming = Core::CVarReadInt(r_texture_streaming) != 0;
+
+	CreateModelMeshes(data, model, LoadModelTextures(data, uri, streaming));
+	return model;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Maps the cooked file from the model cache if it is up to date. Otherwise
+	the glTF file is cooked in memory, and written to the cache if cache is 2.
+	Returns the cooked data, which lives in file or cooked. Touches no GL or
+	engine state, so it can run on a worker.
+*/
+static uint8_t const*
+MapOrCookModel(std::string const& name, int cache, Core::MappedFile& file, std::vector<uint8_t>& cooked)
+{
+	std::string const cachePath = ModelFile::GetCachePath(name);
+	if (cache > 0 && file.Open(cachePath.c_str()) && ModelFile::IsValid(file.GetData(), file.GetSize(), name))
+		return file.GetData();
+
+	if (!ModelFile::Cook(name, cooked))
+		return nullptr;
+	if (cache > 1 && !ModelFile::Write(cachePath, cooked))
+		n_warning("Could not write '%s' to the model cache!\n", cachePath.c_str());
+	return cooked.data();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static int
+GetModelCacheMode()
+{
+	if (r_model_cache == nullptr)
+		r_model_cache = Core::CVarCreate(Core::CVarType::CVar_Int, "r_model_cache", "2", "Cooked models. 0 = always load glTF, 1 = load from the model cache, 2 = also cook models missing from the cache");
+	return Core::CVarReadInt(r_model_cache);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Puts a model into a free slot and registers it by name.
+*/
+static ModelId
+AddModel(std::string const& name, Model&& model)
+{
+	ModelId mid;
+	if (modelPool.Allocate(mid))
+	{
+		modelAllocator.push_back(std::move(model));
+		modelNames.push_back(name);
+	}
+	else
+	{
+		modelAllocator[mid.index] = std::move(model);
+		modelNames[mid.index] = name;
+	}
+	modelRegistry.emplace(name, mid);
+	return mid;
 }
 
+//------------------------------------------------------------------------------
+/**
+	Blocks until the model and its buffers are loaded. Waits for the model if
+	it is being loaded asynchronously. While the render thread runs, the game
+	thread has no GL context, so the model goes through the asynchronous
+	stages instead, which create its buffers on the render thread.
+*/
 ModelId LoadModel(std::string name)
 {
+	N_PROFILE_SCOPE("LoadModel");
 	auto iter = modelRegistry.find(name);
 	if (iter != modelRegistry.end())
 	{
 		ModelId const mid = (*iter).second;
-		modelAllocator[mid].refcount++; // increment refcount
+		modelAllocator[mid.index].refcount++; // increment refcount
+		if (!modelAllocator[mid.index].ready)
+			WaitForModel(mid);
+		return mid;
+	}
+
+	if (RenderThread::IsRunning())
+	{
+		ModelId const mid = LoadModelAsync(name);
+		WaitForModel(mid);
 		return mid;
 	}
 
 	if (std::filesystem::exists(name))
 	{
-		Model mdl = LoadGLTF(name);
+		Core::MappedFile file;
+		std::vector<uint8_t> cooked;
+		uint8_t const* const data = MapOrCookModel(name, GetModelCacheMode(), file, cooked);
+		if (data == nullptr)
+			return LoadModel("assets/error.glb");
+
+		Model mdl = LoadCookedModel(data, name);
 		mdl.refcount = 1;
-		ModelId const mid = (ModelId)modelAllocator.size();
-		modelAllocator.push_back(mdl);
-		modelRegistry.emplace(name, mid);
-		return mid;
+		return AddModel(name, std::move(mdl));
 	}
 
 	n_warning("Trying to load invalid model named '%s'!\n", name.c_str());
 	return LoadModel("assets/error.glb");
 }
 
-void UnloadModel(ModelId mid)
+//------------------------------------------------------------------------------
+/**
+	Stages of an asynchronous load:
+
+	1. A job maps or cooks the model file and queues it in cookedModels.
+	2. UpdateModelStreaming loads its textures on the game thread, they stream
+	   in on their own, and queues it in uploadModels.
+	3. UploadStreamedModels creates its buffers on the GL thread, a budget per
+	   frame, then its vertex arrays, and queues it in uploadedModels.
+	4. UpdateModelStreaming moves the finished model into its slot.
+
+	Each stage owns the model while it works on it, only the queues are locked.
+*/
+struct StreamingModel
 {
-	n_assert(IsModelValid(mid));
-	modelAllocator[mid].refcount--;
-	if (modelAllocator[mid].refcount <= 0)
+	ModelId id;
+	std::string name;
+	Core::MappedFile file;
+	std::vector<uint8_t> cooked;
+	// the cooked data, in file or cooked. Null if the model could not be loaded.
+	uint8_t const* data = nullptr;
+	std::vector<TextureResourceId> textureIds;
+	Model model;
+	uint32_t numBuffersCreated = 0;
+};
+
+static std::mutex streamingLock;
+static std::vector<std::shared_ptr<StreamingModel>> cookedModels;
+static std::deque<std::shared_ptr<StreamingModel>> uploadModels;
+static std::vector<std::shared_ptr<StreamingModel>> uploadedModels;
+static Core::CVar* r_model_upload_budget = nullptr;
+
+/// GL objects of an unloaded model, deleted once no frame uses them anymore
+struct RetiredModel
+{
+	std::vector<GLuint> vertexArrays;
+	std::vector<uint64_t> bufferKeys;
+	int framesLeft;
+	// buffers whose last reference went away, and the fence they wait for
+	std::vector<GLuint> buffers;
+	GLsync fence = nullptr;
+};
+
+// frames until an unloaded model is deleted, so no frame in flight draws with it
+static const int RETIRE_FRAMES = RenderThread::NUM_PACKETS + 1;
+// guarded by streamingLock
+static std::vector<RetiredModel> retiredModels;
+// only used on the GL thread
+static std::vector<RetiredModel> fencedModels;
+static std::atomic<uint32_t> numRetiredModels(0);
+
+static void UploadPendingModels();
+
+//------------------------------------------------------------------------------
+/**
+	Drops the texture references of a model and hands its GL objects over to
+	the GL thread, which deletes them. Leaves the model empty.
+*/
+static void
+ReleaseModel(Model& model)
+{
+	RetiredModel retired;
+	for (Model::Mesh const& mesh : model.meshes)
+	{
+		for (Model::Mesh::Primitive const& primitive : mesh.primitives)
+		{
+			retired.vertexArrays.push_back(primitive.vao);
+			retired.vertexArrays.push_back(primitive.depthVao);
+		}
+	}
+	retired.bufferKeys = std::move(model.bufferKeys);
+	retired.framesLeft = RETIRE_FRAMES;
+
+	for (TextureResourceId const tid : model.textures)
 	{
-		// TODO: Fully unload model
+		if (tid != InvalidResourceId)
+			TextureResource::ReleaseTexture(tid);
 	}
-	return;
+
+	uint const refcount = model.refcount;
+	model = Model();
+	model.refcount = refcount;
+
+	numRetiredModels++;
+	std::lock_guard<std::mutex> lock(streamingLock);
+	retiredModels.push_back(std::move(retired));
+}
+
+//------------------------------------------------------------------------------
+/**
+	Returns right away. The model draws nothing until it is ready. Loading
+	falls back to the error model like LoadModel, and textures are always
+	streamed.
+*/
+ModelId LoadModelAsync(std::string name)
+{
+	N_PROFILE_SCOPE("LoadModelAsync");
+	auto iter = modelRegistry.find(name);
+	if (iter != modelRegistry.end())
+	{
+		ModelId const mid = (*iter).second;
+		modelAllocator[mid.index].refcount++;
+		return mid;
+	}
+
+	Model placeholder;
+	placeholder.refcount = 1;
+	placeholder.ready = false;
+	ModelId const mid = AddModel(name, std::move(placeholder));
+
+	std::shared_ptr<StreamingModel> streaming = std::make_shared<StreamingModel>();
+	streaming->id = mid;
+	streaming->name = name;
+	int const cache = GetModelCacheMode();
+	Core::JobSystem::Submit([streaming, cache]()
+	{
+		N_PROFILE_SCOPE("CookStreamingModel");
+		if (std::filesystem::exists(streaming->name))
+			streaming->data = MapOrCookModel(streaming->name, cache, streaming->file, streaming->cooked);
+		else
+			n_warning("Trying to load invalid model named '%s'!\n", streaming->name.c_str());
+
+		if (streaming->data == nullptr)
+		{
+			streaming->name = "assets/error.glb";
+			streaming->cooked.clear();
+			streaming->data = MapOrCookModel(streaming->name, cache, streaming->file, streaming->cooked);
+		}
+
+		std::lock_guard<std::mutex> lock(streamingLock);
+		cookedModels.push_back(streaming);
+	});
+	return mid;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool IsModelReady(ModelId id)
+{
+	return IsModelValid(id) && modelAllocator[id.index].ready;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Drives all stages of the load itself, so it also works before the first
+	frame. Returns early if the model is unloaded meanwhile.
+*/
+void WaitForModel(ModelId id)
+{
+	N_PROFILE_SCOPE("WaitForModel");
+	while (IsModelValid(id) && !IsModelReady(id))
+	{
+		UpdateModelStreaming();
+		RenderThread::Enqueue([]() { UploadPendingModels(); });
+		RenderThread::Flush();
+		std::this_thread::yield();
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Models that were unloaded while they streamed in are released as soon as
+	they arrive.
+*/
+void UpdateModelStreaming()
+{
+	N_PROFILE_SCOPE("UpdateModelStreaming");
+	std::vector<std::shared_ptr<StreamingModel>> cooked;
+	std::vector<std::shared_ptr<StreamingModel>> uploaded;
+	{
+		std::lock_guard<std::mutex> lock(streamingLock);
+		cooked.swap(cookedModels);
+		uploaded.swap(uploadedModels);
+	}
+
+	for (std::shared_ptr<StreamingModel> const& streaming : uploaded)
+	{
+		if (!IsModelValid(streaming->id))
+		{
+			ReleaseModel(streaming->model);
+			continue;
+		}
+
+		Model& model = modelAllocator[streaming->id.index];
+		uint const refcount = model.refcount;
+		model = std::move(streaming->model);
+		model.refcount = refcount;
+		model.ready = true;
+	}
+
+	for (std::shared_ptr<StreamingModel> const& streaming : cooked)
+	{
+		if (!IsModelValid(streaming->id))
+			continue;
+
+		if (streaming->data == nullptr)
+		{
+			// not even the error model loaded, leave the model empty
+			modelAllocator[streaming->id.index].ready = true;
+			continue;
+		}
+
+		ModelFile::Header const& header = *(ModelFile::Header const*)streaming->data;
+		streaming->textureIds = LoadModelTextures(streaming->data, streaming->name, true);
+		streaming->model.buffers.resize(header.buffers.count);
+		streaming->model.bufferKeys.resize(header.buffers.count);
+		std::lock_guard<std::mutex> lock(streamingLock);
+		uploadModels.push_back(streaming);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Creates buffers up to r_model_upload_budget megabytes, but at least one, so
+	a frame never stalls on a large model.
+*/
+static void
+UploadPendingModels()
+{
+	if (r_model_upload_budget == nullptr)
+		r_model_upload_budget = Core::CVarCreate(Core::CVarType::CVar_Int, "r_model_upload_budget", "16", "Megabytes of vertex and index data of streamed models to upload per frame");
+	size_t const budget = (size_t)std::max(0, Core::CVarReadInt(r_model_upload_budget)) * 1024 * 1024;
+
+	size_t uploadedBytes = 0;
+	while (uploadedBytes < budget || uploadedBytes == 0)
+	{
+		std::shared_ptr<StreamingModel> streaming;
+		{
+			std::lock_guard<std::mutex> lock(streamingLock);
+			if (uploadModels.empty())
+				return;
+			streaming = uploadModels.front();
+		}
+
+		ModelFile::Header const& header = *(ModelFile::Header const*)streaming->data;
+		ModelFile::Buffer const* const buffers = ModelFile::GetTable<ModelFile::Buffer>(streaming->data, header.buffers);
+		if (streaming->numBuffersCreated < header.buffers.count)
+		{
+			uploadedBytes += std::max<size_t>(buffers[streaming->numBuffersCreated].size, 1);
+			CreateModelBuffer(streaming->data, streaming->model, streaming->numBuffersCreated++);
+			continue;
+		}
+
+		CreateModelMeshes(streaming->data, streaming->model, streaming->textureIds);
+		std::lock_guard<std::mutex> lock(streamingLock);
+		uploadModels.pop_front();
+		uploadedModels.push_back(streaming);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Retired models wait RETIRE_FRAMES frames, until no frame packet that was
+	built before the unload can draw them. Then their buffer references are
+	dropped and a fence is inserted, and the objects are deleted once the GPU
+	has passed it. The buffer registry is only touched on the GL thread, like
+	in AcquireBuffer.
+*/
+static void
+DeleteRetiredModels()
+{
+	std::vector<RetiredModel> expired;
+	{
+		std::lock_guard<std::mutex> lock(streamingLock);
+		for (size_t i = 0; i < retiredModels.size();)
+		{
+			if (--retiredModels[i].framesLeft > 0)
+			{
+				i++;
+				continue;
+			}
+			expired.push_back(std::move(retiredModels[i]));
+			retiredModels[i] = std::move(retiredModels.back());
+			retiredModels.pop_back();
+		}
+	}
+
+	for (RetiredModel& retired : expired)
+	{
+		for (uint64_t const key : retired.bufferKeys)
+		{
+			auto iter = bufferRegistry.find(key);
+			n_assert(iter != bufferRegistry.end());
+			if (--iter->second.refcount == 0)
+			{
+				retired.buffers.push_back(iter->second.buffer);
+				bufferRegistry.erase(iter);
+			}
+		}
+		retired.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		fencedModels.push_back(std::move(retired));
+	}
+
+	for (size_t i = 0; i < fencedModels.size();)
+	{
+		RetiredModel& retired = fencedModels[i];
+		GLenum const status = glClientWaitSync(retired.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			i++;
+			continue;
+		}
+		glDeleteSync(retired.fence);
+		glDeleteVertexArrays((GLsizei)retired.vertexArrays.size(), retired.vertexArrays.data());
+		glDeleteBuffers((GLsizei)retired.buffers.size(), retired.buffers.data());
+		numBuffers -= (uint32_t)retired.buffers.size();
+		fencedModels[i] = std::move(fencedModels.back());
+		fencedModels.pop_back();
+		numRetiredModels--;
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void UploadStreamedModels()
+{
+	N_PROFILE_SCOPE("UploadStreamedModels");
+	UploadPendingModels();
+	DeleteRetiredModels();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t GetNumRetiredModels()
+{
+	return numRetiredModels.load();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ModelStats GetModelStats()
+{
+	ModelStats stats;
+	stats.numModels = (uint32_t)modelRegistry.size();
+	stats.numSlots = (uint32_t)modelAllocator.size();
+	stats.numRetired = numRetiredModels.load();
+	stats.numBuffers = numBuffers.load();
+	return stats;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Models that are still streaming in are released once they arrive.
+*/
+void UnloadModel(ModelId mid)
+{
+	n_assert(IsModelValid(mid));
+	Model& model = modelAllocator[mid.index];
+	model.refcount--;
+	if (model.refcount > 0)
+		return;
+
+	modelRegistry.erase(modelNames[mid.index]);
+	modelNames[mid.index].clear();
+	modelPool.Deallocate(mid);
+	if (model.ready)
+		ReleaseModel(model);
 }
 
 Model const& GetModel(ModelId id)
 {
-    return modelAllocator[id];
+	n_assert(IsModelValid(id));
+    return modelAllocator[id.index];
 }
 
-bool const IsModelValid(ModelId)
+bool const IsModelValid(ModelId id)
 {
-	// FIXME: we should use a generational id for the models.
-	return true;
+	return modelPool.IsValid(id);
 }
 
 
@@ -14,8 +14,6 @@
 namespace Render
 {
 
-typedef uint32_t ModelId;
-
 struct Model
 {
     struct VertexAttribute
@@ -69,10 +67,14 @@ struct Model
         struct Primitive
         {
             GLuint vao;
+            /// only the positions, for depth-only passes
+            GLuint depthVao = 0;
             GLuint numIndices;
             GLuint offset = 0;
             GLenum indexType;
             Material material;
+            /// has joints and weights, and is drawn with the palette of an animation instance
+            bool skinned = false;
         };
 
         std::vector<Primitive> primitives;
@@ -81,13 +83,49 @@ struct Model
     };
 
     std::vector<Mesh> meshes;
-    //std::vector<TextureResourceId> textures;
+    /// object space bounding box of all meshes
+    glm::vec3 boundingBoxMin = glm::vec3(0.0f);
+    glm::vec3 boundingBoxMax = glm::vec3(0.0f);
+    /// textures the model holds a reference to, released on unload
+    std::vector<TextureResourceId> textures;
     std::vector<GLuint> buffers;
+    /// content hashes the buffers are shared by, one per buffer
+    std::vector<uint64_t> bufferKeys;
     uint refcount;
+    /// false while the model is loaded asynchronously, it has no meshes until then
+    bool ready = true;
 };
 
 ModelId LoadModel(std::string name);
+/// start loading a model in the background and return its id right away
+ModelId LoadModelAsync(std::string name);
+/// true once an asynchronously loaded model can be drawn
+bool IsModelReady(ModelId id);
+/// block until an asynchronously loaded model is ready
+void WaitForModel(ModelId id);
+/// finish asynchronous loads on the game thread, call once per frame
+void UpdateModelStreaming();
+/// create the GL objects of asynchronous loads within the upload budget and delete retired ones, call once per frame on the GL thread
+void UploadStreamedModels();
+/// number of unloaded models whose GL objects are not deleted yet
+uint32_t GetNumRetiredModels();
+
+/// resources held by models, to check that loading and unloading doesn't leak
+struct ModelStats
+{
+	/// models that are loaded or streaming in
+	uint32_t numModels;
+	/// model slots, used or free
+	uint32_t numSlots;
+	/// unloaded models whose GL objects are not deleted yet
+	uint32_t numRetired;
+	/// GL buffers of loaded models, and of retired models until they are deleted
+	uint32_t numBuffers;
+};
+/// get the resources held by models. Call on the game thread.
+ModelStats GetModelStats();
 
+/// drop a reference. The last one releases the model, its GL objects are deleted once no frame in flight uses them.
 void UnloadModel(ModelId);
 
 bool const IsModelValid(ModelId);
@@ -0,0 +1,504 @@
+//------------------------------------------------------------------------------
+//  @file modelfile.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "modelfile.h"
+#include "gltf.h"
+#include "texturecompressor.h"
+#include "core/profiler.h"
+#include "core/hash.h"
+#include "GL/glew.h"
+#include <cstring>
+#include <cfloat>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+namespace Render
+{
+namespace ModelFile
+{
+
+static const char* CACHE_DIRECTORY = "cache/models";
+
+//------------------------------------------------------------------------------
+/**
+*/
+static int
+SlotFromGltf(std::string const& attr)
+{
+	if (attr == "POSITION")		return 0;
+	if (attr == "NORMAL")		return 1;
+	if (attr == "TANGENT")		return 2;
+	if (attr == "TEXCOORD_0")	return 3;
+	if (attr == "COLOR_0")		return 4;
+	if (attr == "JOINTS_0")		return 5;
+	if (attr == "WEIGHTS_0")	return 6;
+
+	n_error("Attribute location not set!\n");
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+InferBufferTargets(fx::gltf::Document& model)
+{
+	bool infer = false;
+	for (unsigned i = 0; i < model.bufferViews.size(); i++)
+	{
+		auto const& bufferView = model.bufferViews[i];
+		if (bufferView.target == fx::gltf::BufferView::TargetType::None)
+		{
+			infer = true;
+			break;
+		}
+	}
+
+	if (infer)
+	{
+		// TODO: could be better
+		for (auto const& mesh : model.meshes)
+		{
+			for (auto const& primitive : mesh.primitives)
+			{
+				for (auto const& attr : primitive.attributes)
+				{
+					auto const& accessor = model.accessors[attr.second];
+					model.bufferViews[accessor.bufferView].target = (fx::gltf::BufferView::TargetType)GL_ARRAY_BUFFER;
+				}
+
+				auto const& accessor = model.accessors[primitive.indices];
+				model.bufferViews[accessor.bufferView].target = (fx::gltf::BufferView::TargetType)GL_ELEMENT_ARRAY_BUFFER;
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Appends data to the blob section, and returns its offset from the start of
+	the section.
+*/
+static uint64_t
+AppendBlob(std::vector<uint8_t>& blobs, void const* data, size_t size)
+{
+	blobs.resize((blobs.size() + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1), 0);
+	uint64_t const offset = blobs.size();
+	blobs.insert(blobs.end(), (uint8_t const*)data, (uint8_t const*)data + size);
+	return offset;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Appends the records of a table, aligned to 8 bytes.
+*/
+template<typename T>
+static Table
+AppendTable(std::vector<uint8_t>& out, std::vector<T> const& records)
+{
+	out.resize((out.size() + 7) & ~(size_t)7, 0);
+	Table table;
+	table.offset = out.size();
+	table.count = (uint32_t)records.size();
+	table.pad = 0;
+	out.insert(out.end(), (uint8_t const*)records.data(), (uint8_t const*)(records.data() + records.size()));
+	return table;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+template<typename T>
+static bool
+IsTableValid(Table const& table, size_t size)
+{
+	return table.offset % alignof(T) == 0 && table.offset <= size && (size - table.offset) / sizeof(T) >= table.count;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static bool
+GetSourceStamp(std::string const& path, uint64_t& size, int64_t& time)
+{
+	std::error_code error;
+	size = (uint64_t)std::filesystem::file_size(path, error);
+	if (error)
+		return false;
+	time = (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+	return !error;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Builds all records with blob offsets relative to the blob section, which
+	goes after the tables. The offsets are fixed up once the size of the
+	tables is known.
+*/
+bool
+Cook(std::string const& path, std::vector<uint8_t>& out)
+{
+	N_PROFILE_SCOPE("ModelFile::Cook");
+	fx::gltf::Document doc;
+	try
+	{
+		if (path.substr(path.find_last_of(".") + 1) == "glb")
+			doc = fx::gltf::LoadFromBinary(path);
+		else
+			doc = fx::gltf::LoadFromText(path);
+	}
+	catch (const std::exception& err)
+	{
+		n_warning("Could not load '%s': %s\n", path.c_str(), err.what());
+		return false;
+	}
+
+	InferBufferTargets(doc); // fix up buffertargets if necessary
+
+	Header header = {};
+	header.magic = MAGIC;
+	header.version = VERSION;
+	if (!GetSourceStamp(path, header.sourceSize, header.sourceTime))
+		return false;
+
+	std::vector<uint8_t> blobs;
+
+	// buffer views that are used as vertex or index buffers
+	std::vector<Buffer> buffers;
+	std::vector<uint32_t> bufferViewMap(doc.bufferViews.size(), 0);
+	for (size_t i = 0; i < doc.bufferViews.size(); i++)
+	{
+		fx::gltf::BufferView const& bufferView = doc.bufferViews[i];
+		if (bufferView.target == fx::gltf::BufferView::TargetType::None)
+			continue;
+
+		Buffer buffer = {};
+		buffer.offset = AppendBlob(blobs, doc.buffers[bufferView.buffer].data.data() + bufferView.byteOffset, bufferView.byteLength);
+		buffer.size = bufferView.byteLength;
+		buffer.target = (uint32_t)bufferView.target;
+		bufferViewMap[i] = (uint32_t)buffers.size();
+		buffers.push_back(buffer);
+	}
+
+	// the slot a texture is used in decides its placeholder and how it is compressed
+	std::vector<Texture> textures(doc.textures.size(), Texture());
+	for (auto const& material : doc.materials)
+	{
+		if (material.normalTexture.index > -1)
+		{
+			textures[material.normalTexture.index].placeholder = (uint8_t)Placeholder::Normal;
+			textures[material.normalTexture.index].usage = (uint8_t)TextureUsage::Normal;
+		}
+		if (material.pbrMetallicRoughness.metallicRoughnessTexture.index > -1)
+		{
+			textures[material.pbrMetallicRoughness.metallicRoughnessTexture.index].placeholder = (uint8_t)Placeholder::MetallicRoughness;
+			textures[material.pbrMetallicRoughness.metallicRoughnessTexture.index].usage = (uint8_t)TextureUsage::MetallicRoughness;
+		}
+		if (material.emissiveTexture.index > -1)
+			textures[material.emissiveTexture.index].placeholder = (uint8_t)Placeholder::Black;
+		if (material.occlusionTexture.index > -1)
+			textures[material.occlusionTexture.index].placeholder = (uint8_t)Placeholder::Black;
+		if (material.pbrMetallicRoughness.baseColorTexture.index > -1)
+		{
+			// GLTF requires basecolor textures to be in sRGB space
+			textures[material.pbrMetallicRoughness.baseColorTexture.index].placeholder = (uint8_t)Placeholder::White;
+			textures[material.pbrMetallicRoughness.baseColorTexture.index].sRGB = 1;
+		}
+	}
+
+	for (size_t i = 0; i < doc.textures.size(); i++)
+	{
+		Texture& texture = textures[i];
+		fx::gltf::Sampler sampler;
+		if (doc.textures[i].sampler != -1)
+			sampler = doc.samplers[doc.textures[i].sampler];
+
+		// set invalid samplers to default values for GL
+		if (sampler.magFilter == fx::gltf::Sampler::MagFilter::None)
+			sampler.magFilter = fx::gltf::Sampler::MagFilter::Linear;
+		if (sampler.minFilter == fx::gltf::Sampler::MinFilter::None)
+			sampler.minFilter = fx::gltf::Sampler::MinFilter::NearestMipMapLinear;
+		texture.magFilter = (uint16_t)sampler.magFilter;
+		texture.minFilter = (uint16_t)sampler.minFilter;
+		texture.wrapS = (uint16_t)sampler.wrapS;
+		texture.wrapT = (uint16_t)sampler.wrapT;
+
+		fx::gltf::Image const& image = doc.images[doc.textures[i].source];
+		if (image.IsEmbeddedResource())
+		{
+			std::vector<uint8_t> data;
+			image.MaterializeData(data);
+			texture.offset = AppendBlob(blobs, data.data(), data.size());
+			texture.size = data.size();
+		}
+		else if (image.uri.empty())
+		{
+			// the image is in a buffer view
+			fx::gltf::BufferView const& bufferView = doc.bufferViews[image.bufferView];
+			texture.offset = AppendBlob(blobs, doc.buffers[bufferView.buffer].data.data() + bufferView.byteOffset, bufferView.byteLength);
+			texture.size = bufferView.byteLength;
+		}
+		else
+		{
+			texture.offset = AppendBlob(blobs, image.uri.data(), image.uri.size());
+			texture.size = image.uri.size();
+			texture.external = 1;
+		}
+	}
+
+	std::vector<Material> materials;
+	for (fx::gltf::Material const& gltfMaterial : doc.materials)
+	{
+		Material material = {};
+		memcpy(material.baseColorFactor, gltfMaterial.pbrMetallicRoughness.baseColorFactor.data(), sizeof(material.baseColorFactor));
+		// same order as Model::Material
+		material.textures[0] = gltfMaterial.pbrMetallicRoughness.baseColorTexture.index;
+		material.textures[1] = gltfMaterial.normalTexture.index;
+		material.textures[2] = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index;
+		material.textures[3] = gltfMaterial.emissiveTexture.index;
+		material.textures[4] = gltfMaterial.occlusionTexture.index;
+		material.alphaCutoff = gltfMaterial.alphaCutoff;
+		material.alphaMode = (uint8_t)gltfMaterial.alphaMode;
+		material.doubleSided = gltfMaterial.doubleSided;
+		materials.push_back(material);
+	}
+
+	glm::vec3 boundingBoxMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundingBoxMax = glm::vec3(-FLT_MAX);
+
+	std::vector<Mesh> meshes;
+	std::vector<Primitive> primitives;
+	std::vector<Attribute> attributes;
+	for (fx::gltf::Mesh const& gltfMesh : doc.meshes)
+	{
+		Mesh mesh;
+		mesh.firstPrimitive = (uint32_t)primitives.size();
+		mesh.numPrimitives = (uint32_t)gltfMesh.primitives.size();
+		for (fx::gltf::Primitive const& gltfPrimitive : gltfMesh.primitives)
+		{
+			Primitive primitive = {};
+			primitive.firstAttribute = (uint32_t)attributes.size();
+			primitive.numAttributes = (uint32_t)gltfPrimitive.attributes.size();
+			for (auto const& gltfAttribute : gltfPrimitive.attributes)
+			{
+				fx::gltf::Accessor const& accessor = doc.accessors[gltfAttribute.second];
+
+				Attribute attribute = {};
+				attribute.buffer = bufferViewMap[accessor.bufferView];
+				attribute.slot = SlotFromGltf(gltfAttribute.first);
+				attribute.type = (uint32_t)accessor.componentType;
+				attribute.stride = doc.bufferViews[accessor.bufferView].byteStride;
+				attribute.offset = accessor.byteOffset;
+				attribute.normalized = accessor.normalized;
+
+				// gltf requires min and max for positions
+				if (attribute.slot == 0 && accessor.min.size() == 3 && accessor.max.size() == 3)
+				{
+					boundingBoxMin = glm::min(boundingBoxMin, glm::vec3(accessor.min[0], accessor.min[1], accessor.min[2]));
+					boundingBoxMax = glm::max(boundingBoxMax, glm::vec3(accessor.max[0], accessor.max[1], accessor.max[2]));
+				}
+
+				switch (accessor.type)
+				{
+				case fx::gltf::Accessor::Type::Scalar:
+					attribute.components = 1;
+					break;
+				case fx::gltf::Accessor::Type::Vec2:
+				case fx::gltf::Accessor::Type::Vec3:
+				case fx::gltf::Accessor::Type::Vec4:
+					attribute.components = (int32_t)accessor.type;
+					break;
+				default:
+					n_assert(false);
+					break;
+				}
+				attributes.push_back(attribute);
+			}
+
+			fx::gltf::Accessor const& ibAccessor = doc.accessors[gltfPrimitive.indices];
+			primitive.indexBuffer = bufferViewMap[ibAccessor.bufferView];
+			primitive.numIndices = ibAccessor.count;
+			primitive.indexOffset = ibAccessor.byteOffset;
+			primitive.indexType = (uint32_t)ibAccessor.componentType;
+			primitive.material = gltfPrimitive.material;
+			primitives.push_back(primitive);
+		}
+		meshes.push_back(mesh);
+	}
+
+	if (boundingBoxMin.x <= boundingBoxMax.x)
+	{
+		memcpy(header.boundingBoxMin, &boundingBoxMin[0], sizeof(header.boundingBoxMin));
+		memcpy(header.boundingBoxMax, &boundingBoxMax[0], sizeof(header.boundingBoxMax));
+	}
+	else
+	{
+		// no bounds in the file, make sure the model is never culled
+		std::fill(header.boundingBoxMin, header.boundingBoxMin + 3, -FLT_MAX);
+		std::fill(header.boundingBoxMax, header.boundingBoxMax + 3, FLT_MAX);
+	}
+
+	// the blob section starts after the tables
+	size_t tablesSize = sizeof(Header);
+	auto const AddTableSize = [&tablesSize](size_t count, size_t recordSize)
+	{
+		tablesSize = ((tablesSize + 7) & ~(size_t)7) + count * recordSize;
+	};
+	AddTableSize(buffers.size(), sizeof(Buffer));
+	AddTableSize(textures.size(), sizeof(Texture));
+	AddTableSize(materials.size(), sizeof(Material));
+	AddTableSize(meshes.size(), sizeof(Mesh));
+	AddTableSize(primitives.size(), sizeof(Primitive));
+	AddTableSize(attributes.size(), sizeof(Attribute));
+	uint64_t const blobStart = (tablesSize + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+	for (Buffer& buffer : buffers)
+		buffer.offset += blobStart;
+	for (Texture& texture : textures)
+		texture.offset += blobStart;
+
+	out.clear();
+	out.reserve(blobStart + blobs.size());
+	out.resize(sizeof(Header));
+	header.buffers = AppendTable(out, buffers);
+	header.textures = AppendTable(out, textures);
+	header.materials = AppendTable(out, materials);
+	header.meshes = AppendTable(out, meshes);
+	header.primitives = AppendTable(out, primitives);
+	header.attributes = AppendTable(out, attributes);
+	n_assert(out.size() == tablesSize);
+	out.resize(blobStart, 0);
+	out.insert(out.end(), blobs.begin(), blobs.end());
+	header.fileSize = out.size();
+	memcpy(out.data(), &header, sizeof(header));
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Checks every table and blob range and every reference between records, so
+	loading does not have to.
+*/
+bool
+IsValid(uint8_t const* data, size_t size, std::string const& sourcePath)
+{
+	if (size < sizeof(Header))
+		return false;
+
+	Header const& header = *(Header const*)data;
+	if (header.magic != MAGIC || header.version != VERSION || header.fileSize != size)
+		return false;
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!GetSourceStamp(sourcePath, sourceSize, sourceTime) || sourceSize != header.sourceSize || sourceTime != header.sourceTime)
+		return false;
+
+	if (!IsTableValid<Buffer>(header.buffers, size) ||
+		!IsTableValid<Texture>(header.textures, size) ||
+		!IsTableValid<Material>(header.materials, size) ||
+		!IsTableValid<Mesh>(header.meshes, size) ||
+		!IsTableValid<Primitive>(header.primitives, size) ||
+		!IsTableValid<Attribute>(header.attributes, size))
+		return false;
+
+	auto const IsBlobValid = [size](uint64_t offset, uint64_t bytes)
+	{
+		return offset <= size && size - offset >= bytes;
+	};
+
+	Buffer const* const buffers = GetTable<Buffer>(data, header.buffers);
+	for (uint32_t i = 0; i < header.buffers.count; i++)
+	{
+		if (!IsBlobValid(buffers[i].offset, buffers[i].size))
+			return false;
+	}
+
+	Texture const* const textures = GetTable<Texture>(data, header.textures);
+	for (uint32_t i = 0; i < header.textures.count; i++)
+	{
+		if (!IsBlobValid(textures[i].offset, textures[i].size))
+			return false;
+	}
+
+	Material const* const materials = GetTable<Material>(data, header.materials);
+	for (uint32_t i = 0; i < header.materials.count; i++)
+	{
+		for (uint32_t t = 0; t < NUM_MATERIAL_TEXTURES; t++)
+		{
+			if (materials[i].textures[t] < -1 || materials[i].textures[t] >= (int32_t)header.textures.count)
+				return false;
+		}
+	}
+
+	Mesh const* const meshes = GetTable<Mesh>(data, header.meshes);
+	for (uint32_t i = 0; i < header.meshes.count; i++)
+	{
+		if (meshes[i].firstPrimitive > header.primitives.count || header.primitives.count - meshes[i].firstPrimitive < meshes[i].numPrimitives)
+			return false;
+	}
+
+	Primitive const* const primitives = GetTable<Primitive>(data, header.primitives);
+	for (uint32_t i = 0; i < header.primitives.count; i++)
+	{
+		Primitive const& primitive = primitives[i];
+		if (primitive.firstAttribute > header.attributes.count || header.attributes.count - primitive.firstAttribute < primitive.numAttributes)
+			return false;
+		if (primitive.indexBuffer >= header.buffers.count || primitive.material < -1 || primitive.material >= (int32_t)header.materials.count)
+			return false;
+	}
+
+	Attribute const* const attributes = GetTable<Attribute>(data, header.attributes);
+	for (uint32_t i = 0; i < header.attributes.count; i++)
+	{
+		if (attributes[i].buffer >= header.buffers.count)
+			return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+std::string
+GetCachePath(std::string const& sourcePath)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.mdl", (unsigned long long)Core::Hash64(sourcePath.data(), sourcePath.size()));
+	return std::string(CACHE_DIRECTORY) + "/" + name;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Writes to a temporary file first, so a model that is being written is
+	never mapped by another process.
+*/
+bool
+Write(std::string const& path, std::vector<uint8_t> const& data)
+{
+	N_PROFILE_SCOPE("ModelFile::Write");
+	std::error_code error;
+	std::filesystem::path const target(path);
+	if (target.has_parent_path())
+		std::filesystem::create_directories(target.parent_path(), error);
+
+	std::string const temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream stream(temporary, std::ios::binary);
+		if (!stream.write((char const*)data.data(), data.size()))
+			return false;
+	}
+	std::filesystem::rename(temporary, target, error);
+	if (error)
+	{
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+	return true;
+}
+
+} // namespace ModelFile
+} // namespace Render
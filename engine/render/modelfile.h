@@ -0,0 +1,164 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file modelfile.h
+
+	The cooked model format.
+
+	Models are cooked from glTF to a flat file that can be memory mapped and
+	used without parsing. A header is followed by tables of fixed size
+	records, and all vertex and index data, embedded images and strings live
+	in blobs aligned to BLOB_ALIGNMENT, so buffers can be uploaded straight
+	from the mapped pages. Records refer to each other by index, and to blobs
+	by offset from the start of the file.
+
+	Cooked files are written to the model cache, named by the path of their
+	source file, and store the size and modification time of the source so
+	that changed models are cooked again. glTF files are cooked in memory
+	when there is no up to date cooked file, so both paths load the same data.
+
+	Nothing in here touches GL, so models can be cooked without a context.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace Render
+{
+
+namespace ModelFile
+{
+
+// "MDL1"
+static const uint32_t MAGIC = 0x314C444D;
+// bump when the layout or the cooked contents change
+static const uint32_t VERSION = 1;
+static const uint64_t BLOB_ALIGNMENT = 16;
+static const uint32_t NUM_MATERIAL_TEXTURES = 5;
+
+/// range of records in the file
+struct Table
+{
+	uint64_t offset;
+	uint32_t count;
+	uint32_t pad;
+};
+
+struct Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t fileSize;
+	// the source file the model was cooked from
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	float boundingBoxMin[3];
+	float boundingBoxMax[3];
+	Table buffers;
+	Table textures;
+	Table materials;
+	Table meshes;
+	Table primitives;
+	Table attributes;
+};
+
+/// a vertex or index buffer
+struct Buffer
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t target;
+	uint32_t pad;
+};
+
+/// texture shown until a streamed texture is resident, decided by the slot it is used in
+enum class Placeholder : uint8_t
+{
+	White,
+	Black,
+	Normal,
+	MetallicRoughness
+};
+
+struct Texture
+{
+	// encoded image, or the uri of the image relative to the model if external is set
+	uint64_t offset;
+	uint64_t size;
+	uint16_t magFilter;
+	uint16_t minFilter;
+	uint16_t wrapS;
+	uint16_t wrapT;
+	uint8_t sRGB;
+	uint8_t usage;
+	uint8_t placeholder;
+	uint8_t external;
+	uint32_t pad;
+};
+
+struct Material
+{
+	float baseColorFactor[4];
+	// texture records in Model::Material order, -1 for the default texture of the slot
+	int32_t textures[NUM_MATERIAL_TEXTURES];
+	float alphaCutoff;
+	uint8_t alphaMode;
+	uint8_t doubleSided;
+	uint8_t pad[2];
+};
+
+struct Mesh
+{
+	uint32_t firstPrimitive;
+	uint32_t numPrimitives;
+};
+
+struct Primitive
+{
+	uint32_t firstAttribute;
+	uint32_t numAttributes;
+	uint32_t indexBuffer;
+	uint32_t numIndices;
+	uint32_t indexOffset;
+	uint32_t indexType;
+	// -1 if the primitive has no material, which means it is not drawn
+	int32_t material;
+	uint32_t pad;
+};
+
+struct Attribute
+{
+	uint32_t buffer;
+	uint32_t slot;
+	int32_t components;
+	uint32_t type;
+	int32_t stride;
+	int32_t offset;
+	uint8_t normalized;
+	uint8_t pad[3];
+};
+
+/// cook a glTF or glb file. Returns false if the file could not be parsed.
+bool Cook(std::string const& path, std::vector<uint8_t>& out);
+/// returns true if data holds a complete model of the current version, cooked from the current version of the source file
+bool IsValid(uint8_t const* data, size_t size, std::string const& sourcePath);
+/// path of the cooked file for a source file
+std::string GetCachePath(std::string const& sourcePath);
+/// write a cooked model
+bool Write(std::string const& path, std::vector<uint8_t> const& data);
+
+/// typed access to a table
+template<typename T>
+T const*
+GetTable(uint8_t const* data, Table const& table)
+{
+	return (T const*)(data + table.offset);
+}
+
+} // namespace ModelFile
+
+} // namespace Render
@@ -0,0 +1,441 @@
+//------------------------------------------------------------------------------
+//  @file particlesystem.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "particlesystem.h"
+#include "physics.h"
+#include "core/jobsystem.h"
+#include "core/profiler.h"
+#include "core/random.h"
+#include <emmintrin.h>
+#include <memory>
+#include <cstring>
+
+namespace Render
+{
+namespace ParticleSystem
+{
+
+// blocks per job
+static const uint32_t BLOCK_GRAIN_SIZE = 4;
+
+struct alignas(16) Block
+{
+	float positionX[BLOCK_SIZE];
+	float positionY[BLOCK_SIZE];
+	float positionZ[BLOCK_SIZE];
+	float velocityX[BLOCK_SIZE];
+	float velocityY[BLOCK_SIZE];
+	float velocityZ[BLOCK_SIZE];
+	float age[BLOCK_SIZE];
+	float inverseLifetime[BLOCK_SIZE];
+	// what gets drawn, written by the update
+	glm::vec4 positionSizes[BLOCK_SIZE];
+	uint32_t colors[BLOCK_SIZE];
+	uint32_t count;
+};
+
+struct Emitter
+{
+	EmitterCreateInfo info;
+	glm::mat4 transform = glm::mat4(1.0f);
+	// fraction of a particle left over from the last spawn
+	float spawnRemainder = 0.0f;
+	uint32_t burst = 0;
+	uint32_t numParticles = 0;
+	std::vector<uint32_t> blocks;
+	bool active = false;
+};
+
+/// a block to update and the emitter it belongs to
+struct Job
+{
+	uint32_t emitter;
+	uint32_t block;
+	// where the block starts in the snapshot
+	uint32_t firstParticle;
+};
+
+static std::vector<Emitter> emitters;
+static std::vector<EmitterId> freeEmitters;
+static std::vector<std::unique_ptr<Block>> blocks;
+static std::vector<uint32_t> freeBlocks;
+static std::vector<Job> jobs;
+static uint32_t numParticles = 0;
+
+//------------------------------------------------------------------------------
+/**
+*/
+static uint32_t
+AllocateBlock()
+{
+	uint32_t index;
+	if (!freeBlocks.empty())
+	{
+		index = freeBlocks.back();
+		freeBlocks.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)blocks.size();
+		blocks.emplace_back(new Block);
+	}
+	blocks[index]->count = 0;
+	return index;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+EmitterId
+CreateEmitter(EmitterCreateInfo const& info)
+{
+	EmitterId id;
+	if (!freeEmitters.empty())
+	{
+		id = freeEmitters.back();
+		freeEmitters.pop_back();
+	}
+	else
+	{
+		id = (EmitterId)emitters.size();
+		emitters.emplace_back();
+	}
+	emitters[id] = Emitter();
+	emitters[id].info = info;
+	emitters[id].active = true;
+	return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+DestroyEmitter(EmitterId emitter)
+{
+	Emitter& e = emitters[emitter];
+	n_assert(e.active);
+	freeBlocks.insert(freeBlocks.end(), e.blocks.begin(), e.blocks.end());
+	numParticles -= e.numParticles;
+	e = Emitter();
+	freeEmitters.push_back(emitter);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SetTransform(EmitterId emitter, glm::mat4 const& transform)
+{
+	emitters[emitter].transform = transform;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SetRate(EmitterId emitter, float rate)
+{
+	emitters[emitter].info.rate = rate;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Burst(EmitterId emitter, uint32_t count)
+{
+	emitters[emitter].burst += count;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Fills the free space of the blocks of an emitter with new particles, and
+	takes more blocks from the pool when they are full.
+*/
+static void
+Spawn(Emitter& emitter, uint32_t count)
+{
+	EmitterCreateInfo const& info = emitter.info;
+	count = std::min(count, info.maxParticles - std::min(info.maxParticles, emitter.numParticles));
+	if (count == 0)
+		return;
+
+	glm::vec3 const origin = emitter.transform[3];
+	glm::vec3 const direction = glm::normalize(glm::mat3(emitter.transform) * info.direction);
+	glm::vec3 const tangent = glm::normalize(glm::abs(direction.y) < 0.99f ? glm::cross(direction, glm::vec3(0.0f, 1.0f, 0.0f)) : glm::cross(direction, glm::vec3(1.0f, 0.0f, 0.0f)));
+	glm::vec3 const bitangent = glm::cross(direction, tangent);
+	float const cosSpread = cosf(info.spread);
+
+	size_t blockIndex = 0;
+	while (count > 0)
+	{
+		while (blockIndex < emitter.blocks.size() && blocks[emitter.blocks[blockIndex]]->count == BLOCK_SIZE)
+			blockIndex++;
+		if (blockIndex == emitter.blocks.size())
+			emitter.blocks.push_back(AllocateBlock());
+		Block& block = *blocks[emitter.blocks[blockIndex]];
+
+		uint32_t const n = std::min(count, BLOCK_SIZE - block.count);
+		for (uint32_t i = block.count; i < block.count + n; i++)
+		{
+			// uniform within the cone around the direction
+			float const cosTheta = 1.0f - Core::RandomFloat() * (1.0f - cosSpread);
+			float const sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+			float const phi = Core::RandomFloat() * 6.2831853f;
+			glm::vec3 const velocity = (tangent * (sinTheta * cosf(phi)) + bitangent * (sinTheta * sinf(phi)) + direction * cosTheta) *
+				glm::mix(info.minSpeed, info.maxSpeed, Core::RandomFloat());
+
+			block.positionX[i] = origin.x;
+			block.positionY[i] = origin.y;
+			block.positionZ[i] = origin.z;
+			block.velocityX[i] = velocity.x;
+			block.velocityY[i] = velocity.y;
+			block.velocityZ[i] = velocity.z;
+			block.age[i] = 0.0f;
+			block.inverseLifetime[i] = 1.0f / std::max(glm::mix(info.minLifetime, info.maxLifetime, Core::RandomFloat()), 1e-3f);
+		}
+		block.count += n;
+		emitter.numParticles += n;
+		count -= n;
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Moves particles that crossed a collider during the last step back to where
+	they hit it, and stops them there.
+*/
+static void
+CollideBlock(EmitterCreateInfo const& info, Block& block, float dt)
+{
+	for (uint32_t i = 0; i < block.count; i++)
+	{
+		glm::vec3 const position(block.positionX[i], block.positionY[i], block.positionZ[i]);
+		glm::vec3 const step = glm::vec3(block.velocityX[i], block.velocityY[i], block.velocityZ[i]) * dt;
+		float const length = glm::length(step);
+		if (length <= 0.0f)
+			continue;
+		Physics::RaycastPayload const payload = Physics::Raycast(position - step, step / length, length, info.collisionMask);
+		if (!payload.hit)
+			continue;
+		block.positionX[i] = payload.hitPoint.x;
+		block.positionY[i] = payload.hitPoint.y;
+		block.positionZ[i] = payload.hitPoint.z;
+		block.velocityX[i] = 0.0f;
+		block.velocityY[i] = 0.0f;
+		block.velocityZ[i] = 0.0f;
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Swaps dead particles with the last live particle of the block.
+*/
+static void
+KillBlock(Block& block)
+{
+	uint32_t i = 0;
+	while (i < block.count)
+	{
+		if (block.age[i] * block.inverseLifetime[i] < 1.0f)
+		{
+			i++;
+			continue;
+		}
+		uint32_t const last = --block.count;
+		block.positionX[i] = block.positionX[last];
+		block.positionY[i] = block.positionY[last];
+		block.positionZ[i] = block.positionZ[last];
+		block.velocityX[i] = block.velocityX[last];
+		block.velocityY[i] = block.velocityY[last];
+		block.velocityZ[i] = block.velocityZ[last];
+		block.age[i] = block.age[last];
+		block.inverseLifetime[i] = block.inverseLifetime[last];
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Integrates velocities and positions, ages the particles, kills the dead
+	ones and writes what gets drawn of the live ones. Lanes past the last live
+	particle compute garbage that is never read.
+*/
+static void
+UpdateBlock(EmitterCreateInfo const& info, Block& block, float dt)
+{
+	__m128 const step = _mm_set1_ps(dt);
+	__m128 const damping = _mm_set1_ps(std::max(0.0f, 1.0f - info.drag * dt));
+	__m128 const accelerationX = _mm_set1_ps(info.acceleration.x * dt);
+	__m128 const accelerationY = _mm_set1_ps(info.acceleration.y * dt);
+	__m128 const accelerationZ = _mm_set1_ps(info.acceleration.z * dt);
+	for (uint32_t i = 0; i < block.count; i += 4)
+	{
+		__m128 const vx = _mm_mul_ps(_mm_add_ps(_mm_load_ps(&block.velocityX[i]), accelerationX), damping);
+		__m128 const vy = _mm_mul_ps(_mm_add_ps(_mm_load_ps(&block.velocityY[i]), accelerationY), damping);
+		__m128 const vz = _mm_mul_ps(_mm_add_ps(_mm_load_ps(&block.velocityZ[i]), accelerationZ), damping);
+		_mm_store_ps(&block.velocityX[i], vx);
+		_mm_store_ps(&block.velocityY[i], vy);
+		_mm_store_ps(&block.velocityZ[i], vz);
+		_mm_store_ps(&block.positionX[i], _mm_add_ps(_mm_load_ps(&block.positionX[i]), _mm_mul_ps(vx, step)));
+		_mm_store_ps(&block.positionY[i], _mm_add_ps(_mm_load_ps(&block.positionY[i]), _mm_mul_ps(vy, step)));
+		_mm_store_ps(&block.positionZ[i], _mm_add_ps(_mm_load_ps(&block.positionZ[i]), _mm_mul_ps(vz, step)));
+		_mm_store_ps(&block.age[i], _mm_add_ps(_mm_load_ps(&block.age[i]), step));
+	}
+
+	if (info.collide)
+		CollideBlock(info, block, dt);
+	KillBlock(block);
+
+	// the color curve is a sum of hat functions centered on the keys, which needs no per lane lookups
+	__m128 keys[NUM_COLOR_KEYS][4];
+	for (uint32_t k = 0; k < NUM_COLOR_KEYS; k++)
+	{
+		for (int c = 0; c < 4; c++)
+			keys[k][c] = _mm_set1_ps(glm::clamp(info.colors[k][c], 0.0f, 1.0f) * 255.0f);
+	}
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 const half = _mm_set1_ps(0.5f);
+	__m128 const lastKey = _mm_set1_ps((float)(NUM_COLOR_KEYS - 1));
+	__m128 const startSize = _mm_set1_ps(info.startSize);
+	__m128 const sizeChange = _mm_set1_ps(info.endSize - info.startSize);
+	for (uint32_t i = 0; i < block.count; i += 4)
+	{
+		__m128 const t = _mm_min_ps(_mm_mul_ps(_mm_load_ps(&block.age[i]), _mm_load_ps(&block.inverseLifetime[i])), one);
+
+		__m128 x = _mm_load_ps(&block.positionX[i]);
+		__m128 y = _mm_load_ps(&block.positionY[i]);
+		__m128 z = _mm_load_ps(&block.positionZ[i]);
+		__m128 size = _mm_add_ps(startSize, _mm_mul_ps(sizeChange, t));
+		_MM_TRANSPOSE4_PS(x, y, z, size);
+		_mm_store_ps(&block.positionSizes[i][0], x);
+		_mm_store_ps(&block.positionSizes[i + 1][0], y);
+		_mm_store_ps(&block.positionSizes[i + 2][0], z);
+		_mm_store_ps(&block.positionSizes[i + 3][0], size);
+
+		__m128 const s = _mm_mul_ps(t, lastKey);
+		__m128 color[4] = { zero, zero, zero, zero };
+		for (uint32_t k = 0; k < NUM_COLOR_KEYS; k++)
+		{
+			__m128 const distance = _mm_and_ps(_mm_sub_ps(s, _mm_set1_ps((float)k)), absMask);
+			__m128 const weight = _mm_max_ps(_mm_sub_ps(one, distance), zero);
+			for (int c = 0; c < 4; c++)
+				color[c] = _mm_add_ps(color[c], _mm_mul_ps(weight, keys[k][c]));
+		}
+		__m128i packed = _mm_cvttps_epi32(_mm_add_ps(color[0], half));
+		packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(color[1], half)), 8));
+		packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(color[2], half)), 16));
+		packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(color[3], half)), 24));
+		_mm_store_si128((__m128i*)&block.colors[i], packed);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Update(float dt)
+{
+	N_PROFILE_SCOPE("ParticleSystem::Update");
+	jobs.clear();
+	for (uint32_t e = 0; e < emitters.size(); e++)
+	{
+		Emitter& emitter = emitters[e];
+		if (!emitter.active)
+			continue;
+		float const spawn = emitter.spawnRemainder + emitter.info.rate * dt;
+		uint32_t const count = (uint32_t)spawn;
+		emitter.spawnRemainder = spawn - (float)count;
+		Spawn(emitter, count + emitter.burst);
+		emitter.burst = 0;
+		for (uint32_t const block : emitter.blocks)
+			jobs.push_back({ e, block, 0 });
+	}
+
+	Core::JobSystem::ParallelFor((uint32_t)jobs.size(), BLOCK_GRAIN_SIZE, [dt](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t j = begin; j < end; j++)
+			UpdateBlock(emitters[jobs[j].emitter].info, *blocks[jobs[j].block], dt);
+	});
+
+	// return empty blocks to the pool
+	numParticles = 0;
+	for (Emitter& emitter : emitters)
+	{
+		if (!emitter.active)
+			continue;
+		emitter.numParticles = 0;
+		size_t kept = 0;
+		for (uint32_t const block : emitter.blocks)
+		{
+			if (blocks[block]->count == 0)
+			{
+				freeBlocks.push_back(block);
+				continue;
+			}
+			emitter.blocks[kept++] = block;
+			emitter.numParticles += blocks[block]->count;
+		}
+		emitter.blocks.resize(kept);
+		numParticles += emitter.numParticles;
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t
+GetNumParticles()
+{
+	return numParticles;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Alpha blended particles go first, so additive ones brighten them instead of
+	being covered.
+*/
+void
+CaptureSnapshot(Snapshot& snapshot)
+{
+	N_PROFILE_SCOPE("ParticleSystem::CaptureSnapshot");
+	snapshot.batches.clear();
+	snapshot.positionSizes.resize(numParticles);
+	snapshot.colors.resize(numParticles);
+
+	jobs.clear();
+	uint32_t offset = 0;
+	for (bool const additive : { false, true })
+	{
+		Batch batch = { additive, offset, 0 };
+		for (uint32_t e = 0; e < emitters.size(); e++)
+		{
+			if (!emitters[e].active || emitters[e].info.additive != additive)
+				continue;
+			for (uint32_t const block : emitters[e].blocks)
+			{
+				jobs.push_back({ e, block, offset });
+				offset += blocks[block]->count;
+			}
+		}
+		batch.numParticles = offset - batch.firstParticle;
+		if (batch.numParticles > 0)
+			snapshot.batches.push_back(batch);
+	}
+
+	Core::JobSystem::ParallelFor((uint32_t)jobs.size(), BLOCK_GRAIN_SIZE * 4, [&snapshot](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t j = begin; j < end; j++)
+		{
+			Block const& block = *blocks[jobs[j].block];
+			memcpy(&snapshot.positionSizes[jobs[j].firstParticle], block.positionSizes, block.count * sizeof(glm::vec4));
+			memcpy(&snapshot.colors[jobs[j].firstParticle], block.colors, block.count * sizeof(uint32_t));
+		}
+	});
+}
+
+} // namespace ParticleSystem
+} // namespace Render
@@ -0,0 +1,107 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file particlesystem.h
+
+	CPU particles.
+
+	Emitters keep their particles in SoA blocks of BLOCK_SIZE particles, taken
+	from a pool shared by all emitters. Update spawns new particles, then
+	integrates, ages and colors all blocks in parallel on the job system, four
+	particles at a time in SSE registers. Dead particles are swapped with the
+	last live particle of their block, and empty blocks go back to the pool.
+
+	The color of a particle follows a curve through NUM_COLOR_KEYS evenly spaced
+	keys over its lifetime, and its size goes linearly from the start size to
+	the end size.
+
+	Particles of emitters with collisions enabled stop where they hit a
+	collider, found with a Physics::Raycast from their last position.
+
+	Rendering draws camera facing billboards with one instanced draw per blend
+	mode, after the transparent geometry. Call everything from the game thread.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include "renderdevice.h"
+#include <vector>
+
+namespace Render
+{
+
+namespace ParticleSystem
+{
+	typedef ResourceId EmitterId;
+
+	/// particles per pooled block
+	static const uint32_t BLOCK_SIZE = 256;
+	/// keys of the color curve
+	static const uint32_t NUM_COLOR_KEYS = 4;
+
+	struct EmitterCreateInfo
+	{
+		uint32_t maxParticles = 1000;
+		/// particles spawned per second
+		float rate = 100.0f;
+		float minLifetime = 1.0f;
+		float maxLifetime = 1.0f;
+		/// launch direction in emitter space, randomized within a cone of spread radians
+		glm::vec3 direction = glm::vec3(0.0f, 1.0f, 0.0f);
+		float spread = 0.0f;
+		float minSpeed = 1.0f;
+		float maxSpeed = 1.0f;
+		/// world space acceleration, like gravity
+		glm::vec3 acceleration = glm::vec3(0.0f);
+		/// fraction of the velocity lost per second
+		float drag = 0.0f;
+		float startSize = 0.1f;
+		float endSize = 0.1f;
+		/// color over the lifetime, from birth to death
+		glm::vec4 colors[NUM_COLOR_KEYS] = { glm::vec4(1.0f), glm::vec4(1.0f), glm::vec4(1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 0.0f) };
+		/// add to the background instead of blending over it
+		bool additive = true;
+		/// stop particles at colliders matching the mask, see Physics::Raycast
+		bool collide = false;
+		uint16_t collisionMask = 0;
+	};
+
+	/// particles of one blend mode, drawn with a single instanced call
+	struct Batch
+	{
+		bool additive;
+		uint32_t firstParticle;
+		uint32_t numParticles;
+	};
+
+	/// copy of all live particles, handed from the game thread to the render thread
+	struct Snapshot
+	{
+		std::vector<Batch> batches;
+		/// world space position in xyz and size in w
+		std::vector<glm::vec4> positionSizes;
+		/// RGBA8 colors
+		std::vector<uint32_t> colors;
+	};
+
+	EmitterId CreateEmitter(EmitterCreateInfo const& info);
+	/// destroy an emitter and its particles
+	void DestroyEmitter(EmitterId emitter);
+	/// place an emitter, particles spawn at its origin
+	void SetTransform(EmitterId emitter, glm::mat4 const& transform);
+	/// change how many particles an emitter spawns per second
+	void SetRate(EmitterId emitter, float rate);
+	/// spawn a number of particles at the next update
+	void Burst(EmitterId emitter, uint32_t count);
+
+	/// spawn, simulate and kill particles
+	void Update(float dt);
+	/// number of live particles after the last update
+	uint32_t GetNumParticles();
+
+	/// copy all live particles into a snapshot. Called on the game thread.
+	void CaptureSnapshot(Snapshot& snapshot);
+} // namespace ParticleSystem
+
+} // namespace Render
@@ -5,6 +5,7 @@
 #include "config.h"
 #include "physics.h"
 #include "core/idpool.h"
+#include "core/profiler.h"
 #include "render/gltf.h"
 #include "debugrender.h"
 
@@ -231,6 +232,7 @@ SetTransform(ColliderId collider, glm::mat4 const& transform)
 RaycastPayload
 Raycast(glm::vec3 start, glm::vec3 dir, float maxDistance, uint16_t mask)
 {
+    N_PROFILE_SCOPE("Physics::Raycast");
     RaycastPayload ret;
     ret.hitDistance = maxDistance;
     // TODO: spatial acceleration instead of just checking everything...
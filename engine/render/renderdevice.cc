@@ -11,6 +11,15 @@
 #include "cameramanager.h"
 #include "debugrender.h"
 #include "render/grid.h"
+#include "core/cvar.h"
+#include "gpuprofiler.h"
+#include "core/profiler.h"
+#include "framepacket.h"
+#include "renderthread.h"
+#include "core/jobsystem.h"
+#include "animation.h"
+#include "particlesystem.h"
+#include "framecapture.h"
 
 namespace Render
 {
@@ -20,21 +29,39 @@ Render::ShaderProgramId directionalLightProgram;
 Render::ShaderProgramId pointlightProgram;
 Render::ShaderProgramId staticGeometryProgram;
 Render::ShaderProgramId staticShadowProgram;
+Render::ShaderProgramId depthProgram;
+Render::ShaderProgramId transparentProgram;
+Render::ShaderProgramId transparentCompositeProgram;
+Render::ShaderProgramId particleProgram;
 Render::ShaderProgramId skyboxProgram;
+Render::ShaderProgramId upscaleProgram;
 
 GLuint fullscreenQuadVB;
 GLuint fullscreenQuadVAO;
 
 GLuint globalShadowMap;
-GLuint globalShadowFrameBuffer;
 const unsigned int shadowMapSize = 4096;
 
+// number of draw commands per job when building draw packets
+static const uint32_t drawPacketGrainSize = 256;
+
+// material features that the geometry and shadow programs are compiled with, in the bit order of DrawPacket::features
+static const std::vector<std::string> materialFeatures = { "ALPHA_MASK", "DOUBLE_SIDED", "SKINNED" };
+
+static Core::CVar* r_render_scale = nullptr;
+static Core::CVar* r_dynamic_resolution = nullptr;
+static Core::CVar* r_dynamic_resolution_budget = nullptr;
+static Core::CVar* r_dynamic_resolution_min = nullptr;
+static Core::CVar* r_depth_prepass = nullptr;
+
 //------------------------------------------------------------------------------
 /**
 */
 RenderDevice::RenderDevice() :
     frameSizeW(1024),
-    frameSizeH(1024)
+    frameSizeH(1024),
+    renderSizeW(1024),
+    renderSizeH(1024)
 {
     // empty
 }
@@ -69,6 +96,7 @@ void RenderDevice::Init()
     LightServer::Initialize();
     TextureResource::Create();
     CameraManager::Create();
+    GpuProfiler::Create();
 
     SetupFullscreenQuad();
     
@@ -76,12 +104,32 @@ void RenderDevice::Init()
     {
         auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_static.glsl");
         auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_static.glsl");
-        staticGeometryProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
+        staticGeometryProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs }, materialFeatures);
     }
     {
         auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_static_shadow.glsl");
         auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_static_shadow.glsl");
-        staticShadowProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
+        staticShadowProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs }, materialFeatures);
+    }
+    {
+        auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_depth.glsl");
+        auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_depth.glsl");
+        depthProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
+    }
+    {
+        auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_transparent.glsl");
+        auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_transparent.glsl");
+        transparentProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
+    }
+    {
+        auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_fullscreen.glsl");
+        auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_transparent_composite.glsl");
+        transparentCompositeProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
+    }
+    {
+        auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_particle.glsl");
+        auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_particle.glsl");
+        particleProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
     }
     {
         auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_skybox.glsl");
@@ -98,68 +146,28 @@ void RenderDevice::Init()
         auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_pointlight.glsl");
         pointlightProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
     }
+    {
+        auto vs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::VERTEXSHADER, "shd/vs_fullscreen.glsl");
+        auto fs = Render::ShaderResource::LoadShader(Render::ShaderResource::ShaderType::FRAGMENTSHADER, "shd/fs_upscale.glsl");
+        upscaleProgram = Render::ShaderResource::CompileShaderProgram({ vs, fs });
+    }
 
     GLint dims[4] = { 0 };
     glGetIntegerv(GL_VIEWPORT, dims);
     // default viewport extents
-    GLint fbWidth = dims[2];
-    GLint fbHeight = dims[3];
-    
-    // Setup geometry buffer
-    glGenFramebuffers(1, &Instance()->geometryBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, Instance()->geometryBuffer);
-
-    glGenTextures(4, Instance()->renderTargets.RT);
-
-    glBindTexture(GL_TEXTURE_2D, Instance()->renderTargets.albedo);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fbWidth, fbHeight, 0, GL_RGB, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glBindTexture(GL_TEXTURE_2D, Instance()->renderTargets.normal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, fbWidth, fbHeight, 0, GL_RGB, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); 
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glBindTexture(GL_TEXTURE_2D, Instance()->renderTargets.properties);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, fbWidth, fbHeight, 0, GL_RGB, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    Instance()->frameSizeW = dims[2];
+    Instance()->frameSizeH = dims[3];
 
-    glBindTexture(GL_TEXTURE_2D, Instance()->renderTargets.emissive);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, fbWidth, fbHeight, 0, GL_RGB, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    r_render_scale = Core::CVarCreate(Core::CVarType::CVar_Float, "r_render_scale", "1.0", "Resolution scale of the geometry and lighting passes");
+    r_dynamic_resolution = Core::CVarCreate(Core::CVarType::CVar_Int, "r_dynamic_resolution", "1", "Adjust r_render_scale automatically to stay within r_dynamic_resolution_budget");
+    r_dynamic_resolution_budget = Core::CVarCreate(Core::CVarType::CVar_Float, "r_dynamic_resolution_budget", "12.0", "GPU time budget in milliseconds for the resolution dependent passes");
+    r_dynamic_resolution_min = Core::CVarCreate(Core::CVarType::CVar_Float, "r_dynamic_resolution_min", "0.5", "Lowest allowed render scale");
+    r_depth_prepass = Core::CVarCreate(Core::CVarType::CVar_Int, "r_depth_prepass", "0", "Lay down depth before the geometry pass, so hidden surfaces skip the G-buffer shading. Pays off when fragment cost dominates vertex cost");
 
-    glGenTextures(1, &Instance()->depthStencilBuffer);
-    glBindTexture(GL_TEXTURE_2D, Instance()->depthStencilBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, fbWidth, fbHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    //glGenRenderbuffers(1, &Instance()->depthStencilBuffer);
-    //glBindRenderbuffer(GL_RENDERBUFFER, Instance()->depthStencilBuffer);
-    //glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Instance()->frameSizeW, Instance()->frameSizeH);
-    
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, Instance()->renderTargets.albedo, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, Instance()->renderTargets.normal, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, Instance()->renderTargets.properties, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, Instance()->renderTargets.emissive, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, Instance()->depthStencilBuffer, 0);
-    //glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, Instance()->depthStencilBuffer);
-    
-    const GLenum drawbuffers[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
-    glDrawBuffers(4, drawbuffers);
-
-    { GLenum err = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    assert(err == GL_FRAMEBUFFER_COMPLETE); }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glGenBuffers(1, &Instance()->transparentInstanceBuffer);
+    glGenBuffers(1, &Instance()->jointPaletteBuffer);
+    glGenBuffers(1, &Instance()->particleBuffer);
+    glGenBuffers(1, &Instance()->particleColorBuffer);
 
     // setup shadow pass
     glGenTextures(1, &globalShadowMap);
@@ -170,12 +178,6 @@ void RenderDevice::Init()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    glGenFramebuffers(1, &globalShadowFrameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, globalShadowFrameBuffer);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, globalShadowMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-
     // setup a shadow camera
     Render::CameraCreateInfo shadowCameraInfo;
     shadowCameraInfo.hash = CAMERA_SHADOW;
@@ -194,78 +196,165 @@ void RenderDevice::Init()
     Instance()->grid = new Grid();
 }
 
-void RenderDevice::Draw(ModelId model, glm::mat4 localToWorld)
+void RenderDevice::Draw(ModelId model, glm::mat4 localToWorld, uint32_t firstJoint)
+{
+    Instance()->drawCommands.push_back({ model, localToWorld, firstJoint });
+}
+
+//------------------------------------------------------------------------------
+/**
+    Renders the depth of all draws that are not alpha masked or skinned, with
+    positions only and no color writes. Masked draws would need their base
+    color and skinned draws their joints, so they write depth in the geometry
+    pass instead.
+*/
+void RenderDevice::DepthPrePass(FramePacket const& packet)
 {
-    Instance()->drawCommands.push_back({ model, localToWorld });
+    Camera* const mainCamera = CameraManager::GetRenderCamera(CAMERA_MAIN);
+
+    GLuint const programHandle = Render::ShaderResource::GetProgramHandle(depthProgram);
+    glUseProgram(programHandle);
+    glUniformMatrix4fv(glGetUniformLocation(programHandle, "ViewProjection"), 1, false, &mainCamera->viewProjection[0][0]);
+    GLuint const modelLocation = glGetUniformLocation(programHandle, "Model");
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    bool culling = true;
+    for (auto const& draws : packet.geometryDraws)
+    {
+        for (DrawPacket const& draw : draws)
+        {
+            if ((draw.features & (DrawPacket::FEATURE_ALPHA_MASK | DrawPacket::FEATURE_SKINNED)) != 0)
+                continue;
+
+            bool const doubleSided = (draw.features & DrawPacket::FEATURE_DOUBLE_SIDED) != 0;
+            if (doubleSided == culling)
+            {
+                culling = !doubleSided;
+                if (culling)
+                    glEnable(GL_CULL_FACE);
+                else
+                    glDisable(GL_CULL_FACE);
+            }
+
+            glUniformMatrix4fv(modelLocation, 1, false, &draw.transform[0][0]);
+            glBindVertexArray(draw.depthVao);
+            glDrawElements(GL_TRIANGLES, draw.numIndices, draw.indexType, (void*)(intptr_t)draw.offset);
+            this->CountDraw(draw.numIndices / 3);
+        }
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glEnable(GL_CULL_FACE);
 }
 
-void RenderDevice::StaticGeometryPass()
+//------------------------------------------------------------------------------
+/**
+    With the depth pre-pass enabled, draws that it has covered only shade
+    the fragments that passed the pre-pass, by testing for equal depth without
+    writing it.
+*/
+void RenderDevice::StaticGeometryPass(FramePacket const& packet)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, Instance()->geometryBuffer);
     glClear(GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
 
-    Camera* const mainCamera = CameraManager::GetCamera(CAMERA_MAIN);
+    Camera* const mainCamera = CameraManager::GetRenderCamera(CAMERA_MAIN);
 
     this->grid->Draw(&mainCamera->viewProjection[0][0]);
 
-    auto programHandle = Render::ShaderResource::GetProgramHandle(staticGeometryProgram);
-    glUseProgram(programHandle);
-    glUniformMatrix4fv(glGetUniformLocation(programHandle, "ViewProjection"), 1, false, &mainCamera->viewProjection[0][0]);
-    
-    GLuint baseColorFactorLocation = glGetUniformLocation(programHandle, "BaseColorFactor");
-    GLuint emissiveFactorLocation = glGetUniformLocation(programHandle, "EmissiveFactor");
-    GLuint metallicFactorLocation = glGetUniformLocation(programHandle, "MetallicFactor");
-    GLuint roughnessFactorLocation = glGetUniformLocation(programHandle, "RoughnessFactor");
-    GLuint modelLocation = glGetUniformLocation(programHandle, "Model");
-    GLuint alphaCutoffLocation = glGetUniformLocation(programHandle, "AlphaCutoff");
-
-    // Draw opaque first
-    for (auto const& cmd : this->drawCommands)
+    bool const depthPrePass = Core::CVarReadInt(r_depth_prepass) != 0;
+    if (depthPrePass)
     {
-        Model const& model = GetModel(cmd.modelId);
-        glUniformMatrix4fv(modelLocation, 1, false, &cmd.transform[0][0]);
+        N_GPU_ZONE("DepthPrePass");
+        this->DepthPrePass(packet);
+    }
 
-        for (auto const& mesh : model.meshes)
+    // material textures live in texture arrays, so consecutive draws usually only change the layers
+    GLuint boundArrays[Model::Material::NUM_TEXTURES] = {};
+
+    // one sweep per material variant, so each program is bound once and variants nothing uses are never linked
+    for (uint8_t features = 0; features < DrawPacket::NUM_FEATURE_MASKS; features++)
+    {
+        GLuint programHandle = 0;
+        GLuint baseColorFactorLocation = 0;
+        GLuint emissiveFactorLocation = 0;
+        GLuint metallicFactorLocation = 0;
+        GLuint roughnessFactorLocation = 0;
+        GLuint modelLocation = 0;
+        GLuint alphaCutoffLocation = 0;
+        GLuint textureLayersLocation = 0;
+        GLuint firstJointLocation = 0;
+
+        for (auto const& draws : packet.geometryDraws)
         {
-            for (auto& primitiveId : mesh.opaquePrimitives)
+            for (DrawPacket const& draw : draws)
             {
-                auto& primitive = mesh.primitives[primitiveId];
+                if (draw.features != features)
+                    continue;
 
+                if (programHandle == 0)
+                {
+                    programHandle = Render::ShaderResource::GetProgramHandle(staticGeometryProgram, features);
+                    glUseProgram(programHandle);
+                    glUniformMatrix4fv(glGetUniformLocation(programHandle, "ViewProjection"), 1, false, &mainCamera->viewProjection[0][0]);
+                    baseColorFactorLocation = glGetUniformLocation(programHandle, "BaseColorFactor");
+                    emissiveFactorLocation = glGetUniformLocation(programHandle, "EmissiveFactor");
+                    metallicFactorLocation = glGetUniformLocation(programHandle, "MetallicFactor");
+                    roughnessFactorLocation = glGetUniformLocation(programHandle, "RoughnessFactor");
+                    modelLocation = glGetUniformLocation(programHandle, "Model");
+                    alphaCutoffLocation = glGetUniformLocation(programHandle, "AlphaCutoff");
+                    textureLayersLocation = glGetUniformLocation(programHandle, "TextureLayers");
+                    firstJointLocation = glGetUniformLocation(programHandle, "FirstJoint");
+                    for (int i = 0; i < Model::Material::NUM_TEXTURES; i++)
+                        glUniform1i(i, i);
+                    if ((features & DrawPacket::FEATURE_DOUBLE_SIDED) != 0)
+                        glDisable(GL_CULL_FACE);
+                    else
+                        glEnable(GL_CULL_FACE);
+                    bool const depthKnown = depthPrePass && (features & (DrawPacket::FEATURE_ALPHA_MASK | DrawPacket::FEATURE_SKINNED)) == 0;
+                    glDepthFunc(depthKnown ? GL_EQUAL : GL_LESS);
+                    glDepthMask(depthKnown ? GL_FALSE : GL_TRUE);
+                }
+
+                glUniformMatrix4fv(modelLocation, 1, false, &draw.transform[0][0]);
+
+                GLint layers[Model::Material::NUM_TEXTURES];
                 for (int i = 0; i < Model::Material::NUM_TEXTURES; i++)
                 {
-                    if (primitive.material.textures[i] != InvalidResourceId)
+                    layers[i] = draw.textures[i].layer;
+                    if (draw.textures[i].array != 0 && draw.textures[i].array != boundArrays[i])
                     {
                         glActiveTexture(GL_TEXTURE0 + i);
-                        glBindTexture(GL_TEXTURE_2D, Render::TextureResource::GetTextureHandle(primitive.material.textures[i]));
-                        glUniform1i(i, i);
+                        glBindTexture(GL_TEXTURE_2D_ARRAY, draw.textures[i].array);
+                        boundArrays[i] = draw.textures[i].array;
                     }
                 }
-
-                glUniform4fv(baseColorFactorLocation, 1, &primitive.material.baseColorFactor[0]);
-                glUniform4fv(emissiveFactorLocation, 1, &primitive.material.emissiveFactor[0]);
-                glUniform1f(metallicFactorLocation, primitive.material.metallicFactor);
-                glUniform1f(roughnessFactorLocation, primitive.material.roughnessFactor);
-
-                if (primitive.material.alphaMode == Model::Material::AlphaMode::Mask)
-                    glUniform1f(alphaCutoffLocation, primitive.material.alphaCutoff);
-                else
-                    glUniform1f(alphaCutoffLocation, 0);
-
-                glBindVertexArray(primitive.vao);
-                glDrawElements(GL_TRIANGLES, primitive.numIndices, primitive.indexType, (void*)(intptr_t)primitive.offset);
+                glUniform1iv(textureLayersLocation, Model::Material::NUM_TEXTURES, layers);
+
+                glUniform4fv(baseColorFactorLocation, 1, &draw.baseColorFactor[0]);
+                glUniform4fv(emissiveFactorLocation, 1, &draw.emissiveFactor[0]);
+                glUniform1f(metallicFactorLocation, draw.metallicFactor);
+                glUniform1f(roughnessFactorLocation, draw.roughnessFactor);
+                glUniform1f(alphaCutoffLocation, draw.alphaCutoff);
+                if ((features & DrawPacket::FEATURE_SKINNED) != 0)
+                    glUniform1i(firstJointLocation, draw.firstJoint);
+
+                glBindVertexArray(draw.vao);
+                glDrawElements(GL_TRIANGLES, draw.numIndices, draw.indexType, (void*)(intptr_t)draw.offset);
+                this->CountDraw(draw.numIndices / 3);
             }
         }
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_CULL_FACE);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
 }
 
-void Render::RenderDevice::LightPass()
+void Render::RenderDevice::LightPass(GeometryBuffer const& gbuffer)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    Camera* const mainCamera = CameraManager::GetCamera(CAMERA_MAIN);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    Camera* const mainCamera = CameraManager::GetRenderCamera(CAMERA_MAIN);
     
     { // Begin directional light drawing
         GLuint programHandle = Render::ShaderResource::GetProgramHandle(directionalLightProgram);
@@ -278,30 +367,31 @@ void Render::RenderDevice::LightPass()
         glActiveTexture(GL_TEXTURE16);
         glBindTexture(GL_TEXTURE_2D, globalShadowMap);
         glUniform1i(glGetUniformLocation(programHandle, "GlobalShadowMap"), 16);
-        Camera* globalShadowCamera = CameraManager::GetCamera(CAMERA_SHADOW);
+        Camera* globalShadowCamera = CameraManager::GetRenderCamera(CAMERA_SHADOW);
         glUniformMatrix4fv(glGetUniformLocation(programHandle, "GlobalShadowMatrix"), 1, false, &globalShadowCamera->viewProjection[0][0]);
 
         LightServer::Update(directionalLightProgram);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->renderTargets.albedo);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.albedo);
         glUniform1i(0, 0);
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, this->renderTargets.normal);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.normal);
         glUniform1i(1, 1);
         glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, this->renderTargets.properties);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.properties);
         glUniform1i(2, 2);
         glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, this->renderTargets.emissive);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.emissive);
         glUniform1i(3, 3);
         glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, this->depthStencilBuffer);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.depth);
         glUniform1i(4, 4);
 
         glBindVertexArray(fullscreenQuadVAO);
 
         glDrawArrays(GL_TRIANGLES, 0, 6);
+        this->CountDraw(2);
     } // end directional light drawing
 
     { // begin drawing point lights
@@ -314,31 +404,29 @@ void Render::RenderDevice::LightPass()
         glUniformMatrix4fv(glGetUniformLocation(programHandle, "ViewProjection"), 1, false, &mainCamera->viewProjection[0][0]);
         
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->renderTargets.albedo);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.albedo);
         glUniform1i(0, 0);
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, this->renderTargets.normal);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.normal);
         glUniform1i(1, 1);
         glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, this->renderTargets.properties);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.properties);
         glUniform1i(2, 2);
         glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, this->depthStencilBuffer);
+        glBindTexture(GL_TEXTURE_2D, gbuffer.depth);
         glUniform1i(4, 4);
         
         LightServer::DrawPointLights(pointlightProgram);
     } // end drawing point lights
 }
 
-void RenderDevice::StaticShadowPass()
+//------------------------------------------------------------------------------
+/**
+    Makes the shadow camera follow the main camera. Runs on the game thread,
+    before the cameras are captured into the frame packet.
+*/
+void RenderDevice::UpdateShadowCamera()
 {
-    glViewport(0, 0, shadowMapSize, shadowMapSize);
-    glBindFramebuffer(GL_FRAMEBUFFER, globalShadowFrameBuffer);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-
     Camera const* const mainCamera = CameraManager::GetCamera(CAMERA_MAIN);
     Camera* const shadowCamera = CameraManager::GetCamera(CAMERA_SHADOW);
 
@@ -352,92 +440,735 @@ void RenderDevice::StaticShadowPass()
                                      glm::vec3(0.0f, 1.0f, 0.0f));
 
     CameraManager::UpdateCamera(shadowCamera);
+}
 
-    auto programHandle = Render::ShaderResource::GetProgramHandle(staticShadowProgram);
-    glUseProgram(programHandle);
-    //glUniformMatrix4fv(glGetUniformLocation(programHandle, "ViewProjection"), 1, false, &shadowCamera->viewProjection[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(programHandle, "View"), 1, false, &shadowCamera->view[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(programHandle, "Projection"), 1, false, &shadowCamera->projection[0][0]);
-    
-    GLuint baseColorFactorLocation = glGetUniformLocation(programHandle, "BaseColorFactor");
-    GLuint modelLocation = glGetUniformLocation(programHandle, "Model");
-    GLuint alphaCutoffLocation = glGetUniformLocation(programHandle, "AlphaCutoff");
+void RenderDevice::StaticShadowPass(FramePacket const& packet)
+{
+    glViewport(0, 0, shadowMapSize, shadowMapSize);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
 
-    // Draw opaque first
-    for (auto const& cmd : this->drawCommands)
-    {
-        Model const& model = GetModel(cmd.modelId);
-        glUniformMatrix4fv(modelLocation, 1, false, &cmd.transform[0][0]);
+    Camera* const shadowCamera = CameraManager::GetRenderCamera(CAMERA_SHADOW);
+
+    GLuint boundArray = 0;
+    glActiveTexture(GL_TEXTURE0 + Model::Material::TEXTURE_BASECOLOR);
 
-        for (auto const& mesh : model.meshes)
+    for (uint8_t features = 0; features < DrawPacket::NUM_FEATURE_MASKS; features++)
+    {
+        GLuint programHandle = 0;
+        GLuint baseColorFactorLocation = 0;
+        GLuint modelLocation = 0;
+        GLuint alphaCutoffLocation = 0;
+        GLuint baseColorLayerLocation = 0;
+        GLuint firstJointLocation = 0;
+
+        for (auto const& draws : packet.shadowDraws)
         {
-            for (auto& primitiveId : mesh.opaquePrimitives)
+            for (DrawPacket const& draw : draws)
             {
-                auto& primitive = mesh.primitives[primitiveId];
-                
-                glActiveTexture(GL_TEXTURE0 + Model::Material::TEXTURE_BASECOLOR);
-                glBindTexture(GL_TEXTURE_2D, Render::TextureResource::GetTextureHandle(primitive.material.textures[Model::Material::TEXTURE_BASECOLOR]));
-                glUniform1i(Model::Material::TEXTURE_BASECOLOR, Model::Material::TEXTURE_BASECOLOR);
-                    
-                glUniform4fv(baseColorFactorLocation, 1, &primitive.material.baseColorFactor[0]);
-                
-                if (primitive.material.alphaMode == Model::Material::AlphaMode::Mask)
-                    glUniform1f(alphaCutoffLocation, primitive.material.alphaCutoff);
-                else
-                    glUniform1f(alphaCutoffLocation, 0);
+                if (draw.features != features)
+                    continue;
 
-                glBindVertexArray(primitive.vao);
-                glDrawElements(GL_TRIANGLES, primitive.numIndices, primitive.indexType, (void*)(intptr_t)primitive.offset);
+                if (programHandle == 0)
+                {
+                    programHandle = Render::ShaderResource::GetProgramHandle(staticShadowProgram, features);
+                    glUseProgram(programHandle);
+                    glUniformMatrix4fv(glGetUniformLocation(programHandle, "View"), 1, false, &shadowCamera->view[0][0]);
+                    glUniformMatrix4fv(glGetUniformLocation(programHandle, "Projection"), 1, false, &shadowCamera->projection[0][0]);
+                    baseColorFactorLocation = glGetUniformLocation(programHandle, "BaseColorFactor");
+                    modelLocation = glGetUniformLocation(programHandle, "Model");
+                    alphaCutoffLocation = glGetUniformLocation(programHandle, "AlphaCutoff");
+                    baseColorLayerLocation = glGetUniformLocation(programHandle, "BaseColorLayer");
+                    firstJointLocation = glGetUniformLocation(programHandle, "FirstJoint");
+                    glUniform1i(Model::Material::TEXTURE_BASECOLOR, Model::Material::TEXTURE_BASECOLOR);
+                    if ((features & DrawPacket::FEATURE_DOUBLE_SIDED) != 0)
+                        glDisable(GL_CULL_FACE);
+                    else
+                        glEnable(GL_CULL_FACE);
+                }
+
+                glUniformMatrix4fv(modelLocation, 1, false, &draw.transform[0][0]);
+
+                // only alpha masked materials sample their base color
+                if ((features & DrawPacket::FEATURE_ALPHA_MASK) != 0)
+                {
+                    TextureLayer const& baseColor = draw.textures[Model::Material::TEXTURE_BASECOLOR];
+                    if (baseColor.array != boundArray)
+                    {
+                        glBindTexture(GL_TEXTURE_2D_ARRAY, baseColor.array);
+                        boundArray = baseColor.array;
+                    }
+                    glUniform1i(baseColorLayerLocation, baseColor.layer);
+                    glUniform4fv(baseColorFactorLocation, 1, &draw.baseColorFactor[0]);
+                    glUniform1f(alphaCutoffLocation, draw.alphaCutoff);
+                }
+                if ((features & DrawPacket::FEATURE_SKINNED) != 0)
+                    glUniform1i(firstJointLocation, draw.firstJoint);
+
+                glBindVertexArray(draw.vao);
+                glDrawElements(GL_TRIANGLES, draw.numIndices, draw.indexType, (void*)(intptr_t)draw.offset);
+                this->CountDraw(draw.numIndices / 3);
             }
         }
     }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_CULL_FACE);
 }
 
-void RenderDevice::SkyboxPass()
+void RenderDevice::SkyboxPass(FramePacket const& packet)
 {
-    Camera* const camera = CameraManager::GetCamera(CAMERA_MAIN);
+    Camera* const camera = CameraManager::GetRenderCamera(CAMERA_MAIN);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LEQUAL);
     GLuint handle = Render::ShaderResource::GetProgramHandle(skyboxProgram);
     glUseProgram(handle);
     glBindVertexArray(fullscreenQuadVAO);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, TextureResource::GetTextureHandle(skybox));
+    glBindTexture(GL_TEXTURE_CUBE_MAP, packet.skyboxTexture);
     glUniform1i(0, 0);
     glUniformMatrix4fv(1, 1, false, &camera->invProjection[0][0]);
     glUniformMatrix4fv(2, 1, false, &camera->invView[0][0]);
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    this->CountDraw(2);
     glDepthFunc(GL_LESS);
 }
 
+//------------------------------------------------------------------------------
+/**
+    Accumulates the transparent draws with weighted blended order-independent
+    transparency, so they need no sorting. Color weighted by coverage and
+    depth is summed into the accumulation target, while the revealage target
+    multiplies up how much of the background stays visible. Draws of the same
+    primitive are bucketed into one instanced call, with their transforms in a
+    shader storage buffer. Both steps are linear in the number of draws.
+*/
+void RenderDevice::TransparentPass(FramePacket const& packet)
+{
+    static GLfloat const clearAccumulation[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static GLfloat const clearRevealage[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+    glClearBufferfv(GL_COLOR, 1, clearRevealage);
+
+    // count the instances of every primitive, then place each batch after the previous one
+    this->transparentBatchIndices.clear();
+    this->transparentBatches.clear();
+    uint32_t numInstances = 0;
+    for (auto const& draws : packet.transparentDraws)
+    {
+        for (DrawPacket const& draw : draws)
+        {
+            auto const inserted = this->transparentBatchIndices.emplace(draw.vao, (uint32_t)this->transparentBatches.size());
+            if (inserted.second)
+                this->transparentBatches.push_back({ &draw, 0, 0 });
+            this->transparentBatches[inserted.first->second].numInstances++;
+            numInstances++;
+        }
+    }
+    if (numInstances == 0)
+        return;
+
+    uint32_t firstInstance = 0;
+    for (TransparentBatch& batch : this->transparentBatches)
+    {
+        batch.firstInstance = firstInstance;
+        firstInstance += batch.numInstances;
+        batch.numInstances = 0;
+    }
+    this->transparentTransforms.resize(numInstances);
+    for (auto const& draws : packet.transparentDraws)
+    {
+        for (DrawPacket const& draw : draws)
+        {
+            TransparentBatch& batch = this->transparentBatches[this->transparentBatchIndices[draw.vao]];
+            this->transparentTransforms[batch.firstInstance + batch.numInstances++] = draw.transform;
+        }
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->transparentInstanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, numInstances * sizeof(glm::mat4), this->transparentTransforms.data(), GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->transparentInstanceBuffer);
+
+    Camera* const mainCamera = CameraManager::GetRenderCamera(CAMERA_MAIN);
+    GLuint const programHandle = Render::ShaderResource::GetProgramHandle(transparentProgram);
+    glUseProgram(programHandle);
+    glUniformMatrix4fv(glGetUniformLocation(programHandle, "ViewProjection"), 1, false, &mainCamera->viewProjection[0][0]);
+    LightServer::Update(transparentProgram);
+    GLuint const baseColorFactorLocation = glGetUniformLocation(programHandle, "BaseColorFactor");
+    GLuint const emissiveFactorLocation = glGetUniformLocation(programHandle, "EmissiveFactor");
+    GLuint const textureLayersLocation = glGetUniformLocation(programHandle, "TextureLayers");
+    GLuint const firstInstanceLocation = glGetUniformLocation(programHandle, "FirstInstance");
+    // the shader only samples these, the other locations belong to other uniforms
+    int const samplers[] = { Model::Material::TEXTURE_BASECOLOR, Model::Material::TEXTURE_NORMAL, Model::Material::TEXTURE_EMISSIVE };
+    for (int const sampler : samplers)
+        glUniform1i(sampler, sampler);
+
+    // test against the opaque depth without writing it, the result does not depend on the draw order
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+
+    for (TransparentBatch const& batch : this->transparentBatches)
+    {
+        DrawPacket const& draw = *batch.draw;
+        if ((draw.features & DrawPacket::FEATURE_DOUBLE_SIDED) != 0)
+            glDisable(GL_CULL_FACE);
+        else
+            glEnable(GL_CULL_FACE);
+
+        GLint layers[Model::Material::NUM_TEXTURES];
+        for (int i = 0; i < Model::Material::NUM_TEXTURES; i++)
+            layers[i] = draw.textures[i].layer;
+        for (int const sampler : samplers)
+        {
+            glActiveTexture(GL_TEXTURE0 + sampler);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, draw.textures[sampler].array);
+        }
+        glUniform1iv(textureLayersLocation, Model::Material::NUM_TEXTURES, layers);
+        glUniform4fv(baseColorFactorLocation, 1, &draw.baseColorFactor[0]);
+        glUniform4fv(emissiveFactorLocation, 1, &draw.emissiveFactor[0]);
+        glUniform1i(firstInstanceLocation, batch.firstInstance);
+
+        glBindVertexArray(draw.vao);
+        glDrawElementsInstanced(GL_TRIANGLES, draw.numIndices, draw.indexType, (void*)(intptr_t)draw.offset, batch.numInstances);
+        this->CountDraw((uint64_t)(draw.numIndices / 3) * batch.numInstances);
+    }
+
+    glBlendFunc(GL_ONE, GL_ZERO);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_CULL_FACE);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Blends the average transparent color over the light target, by how much of
+    the background the transparent surfaces cover.
+*/
+void RenderDevice::TransparentCompositePass(GLuint accumulation, GLuint revealage)
+{
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    GLuint const handle = Render::ShaderResource::GetProgramHandle(transparentCompositeProgram);
+    glUseProgram(handle);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumulation);
+    glUniform1i(0, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, revealage);
+    glUniform1i(1, 1);
+    glBindVertexArray(fullscreenQuadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    this->CountDraw(2);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Draws the particles as camera facing quads, with one instanced draw per
+    batch. They are tested against the scene depth without writing it and are
+    not sorted, which alpha blended particles can get away with as long as
+    they are small or faint.
+*/
+void RenderDevice::ParticlePass(FramePacket const& packet)
+{
+    ParticleSystem::Snapshot const& particles = packet.particles;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->particleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, particles.positionSizes.size() * sizeof(glm::vec4), particles.positionSizes.data(), GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, this->particleBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, this->particleColorBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, particles.colors.size() * sizeof(uint32_t), particles.colors.data(), GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, this->particleColorBuffer);
+
+    Camera* const mainCamera = CameraManager::GetRenderCamera(CAMERA_MAIN);
+    GLuint const programHandle = Render::ShaderResource::GetProgramHandle(particleProgram);
+    glUseProgram(programHandle);
+    glUniformMatrix4fv(glGetUniformLocation(programHandle, "ViewProjection"), 1, false, &mainCamera->viewProjection[0][0]);
+    glUniform3fv(glGetUniformLocation(programHandle, "CameraRight"), 1, &mainCamera->invView[0][0]);
+    glUniform3fv(glGetUniformLocation(programHandle, "CameraUp"), 1, &mainCamera->invView[1][0]);
+    GLuint const firstParticleLocation = glGetUniformLocation(programHandle, "FirstParticle");
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    // the vertices come from gl_VertexID, any vertex array will do
+    glBindVertexArray(fullscreenQuadVAO);
+    for (ParticleSystem::Batch const& batch : particles.batches)
+    {
+        glBlendFunc(GL_ONE, batch.additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+        glUniform1i(firstParticleLocation, batch.firstParticle);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch.numParticles);
+        this->CountDraw((uint64_t)batch.numParticles * 2);
+    }
+
+    glBlendFunc(GL_ONE, GL_ZERO);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_CULL_FACE);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Upscales the rendered sub-rect of the light buffer to the window.
+*/
+void RenderDevice::UpscalePass(GLuint source, int windowWidth, int windowHeight)
+{
+    glViewport(0, 0, windowWidth, windowHeight);
+    glDisable(GL_DEPTH_TEST);
+
+    GLuint handle = Render::ShaderResource::GetProgramHandle(upscaleProgram);
+    glUseProgram(handle);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glUniform1i(0, 0);
+    glUniform2f(1, float(this->renderSizeW) / float(this->frameSizeW), float(this->renderSizeH) / float(this->frameSizeH));
+    glBindVertexArray(fullscreenQuadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    this->CountDraw(2);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Steers the render scale towards the point where the measured GPU time of the
+    resolution dependent passes fits within the budget. Cost scales with pixel
+    count, so the correction is applied to the area and not the side length.
+*/
+void RenderDevice::UpdateRenderScale()
+{
+    // only react to new measurements, the same result is visible for several frames
+    uint64_t const resolvedFrame = GpuProfiler::GetResolvedFrameCount();
+    if (resolvedFrame == this->renderScaleFrame)
+        return;
+    this->renderScaleFrame = resolvedFrame;
+
+    float const renderTime = GetRenderTime();
+    if (Core::CVarReadInt(r_dynamic_resolution) == 0 || renderTime <= 0.0f)
+        return;
+
+    float const budget = Core::CVarReadFloat(r_dynamic_resolution_budget);
+    float const minScale = Core::CVarReadFloat(r_dynamic_resolution_min);
+
+    // leave some headroom below the budget and avoid oscillating around it
+    float const upperBound = budget * 0.95f;
+    float const lowerBound = budget * 0.75f;
+    if (renderTime > upperBound || renderTime < lowerBound)
+    {
+        float const areaRatio = glm::clamp(budget * 0.85f / renderTime, 0.5f, 2.0f);
+        float const desired = this->renderScale * sqrtf(areaRatio);
+        // move part of the way there since the measurement is a few frames old
+        float const scale = glm::clamp(glm::mix(this->renderScale, desired, 0.25f), minScale, 1.0f);
+        Core::CVarWriteFloat(r_render_scale, scale);
+    }
+}
+
+/// GPU profiler zones of the passes whose cost depends on the render scale
+static const char* const sceneZones[] = { "StaticGeometryPass", "LightPass", "SkyboxPass", "TransparentPass", "TransparentCompositePass", "ParticlePass" };
+
+//------------------------------------------------------------------------------
+/**
+    GPU time of the scene passes in the last resolved frame. Passes that are
+    only added when they have work, like the transparent and particle passes,
+    count as 0 in frames they were skipped.
+*/
+float RenderDevice::GetRenderTime()
+{
+    float time = 0.0f;
+    for (const char* zone : sceneZones)
+        time += GpuProfiler::GetZoneTime(zone);
+    return time;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+float RenderDevice::GetRenderTime(GpuProfiler::FrameTimes const& frame)
+{
+    float time = 0.0f;
+    for (const char* zone : sceneZones)
+        time += frame.GetZoneTime(zone);
+    return time;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Extracts the six frustum planes of a view projection matrix. Normals point inwards.
+*/
+static void
+ExtractFrustumPlanes(glm::mat4 const& viewProjection, glm::vec4 planes[6])
+{
+    glm::mat4 const m = glm::transpose(viewProjection);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+}
+
+//------------------------------------------------------------------------------
+/**
+    Tests a transformed bounding box against frustum planes.
+*/
+static bool
+IsBoxVisible(glm::vec4 const planes[6], glm::mat4 const& transform, glm::vec3 const& boxMin, glm::vec3 const& boxMax)
+{
+    // move the box to world space as center and extents, which keeps it axis aligned
+    glm::vec3 const localCenter = (boxMin + boxMax) * 0.5f;
+    glm::vec3 const localExtents = (boxMax - boxMin) * 0.5f;
+    glm::vec3 const center = glm::vec3(transform * glm::vec4(localCenter, 1.0f));
+    glm::vec3 const extents =
+        glm::abs(glm::vec3(transform[0])) * localExtents.x +
+        glm::abs(glm::vec3(transform[1])) * localExtents.y +
+        glm::abs(glm::vec3(transform[2])) * localExtents.z;
+
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec3 const normal = glm::vec3(planes[i]);
+        float const radius = glm::dot(glm::abs(normal), extents);
+        if (glm::dot(normal, center) + planes[i].w + radius < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+ResolveDrawPacket(DrawPacket& draw, glm::mat4 const& transform, uint32_t firstJoint, Model::Mesh::Primitive const& primitive)
+{
+    Model::Material const& material = primitive.material;
+    draw.transform = transform;
+    draw.baseColorFactor = material.baseColorFactor;
+    draw.emissiveFactor = material.emissiveFactor;
+    draw.metallicFactor = material.metallicFactor;
+    draw.roughnessFactor = material.roughnessFactor;
+    draw.alphaCutoff = material.alphaMode == Model::Material::AlphaMode::Mask ? material.alphaCutoff : 0.0f;
+    draw.features = 0;
+    if (material.alphaMode == Model::Material::AlphaMode::Mask)
+        draw.features |= DrawPacket::FEATURE_ALPHA_MASK;
+    if (material.doubleSided)
+        draw.features |= DrawPacket::FEATURE_DOUBLE_SIDED;
+    // skinned primitives drawn without an animation instance stay in their bind pose
+    if (primitive.skinned && firstJoint != Animation::NO_JOINTS)
+        draw.features |= DrawPacket::FEATURE_SKINNED;
+    draw.firstJoint = firstJoint;
+    draw.vao = primitive.vao;
+    draw.depthVao = primitive.depthVao;
+    draw.numIndices = primitive.numIndices;
+    draw.offset = primitive.offset;
+    draw.indexType = primitive.indexType;
+    for (int i = 0; i < Model::Material::NUM_TEXTURES; i++)
+    {
+        draw.textures[i] = material.textures[i] != InvalidResourceId ?
+            TextureResource::UseTexture(material.textures[i]) : TextureLayer();
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    Culls the draw commands against the main and shadow cameras and resolves
+    the primitives of the visible ones into flat draw packets. Chunks of draw
+    commands are spread over the job system, and every thread appends to its
+    own lists, so the render thread only has to stream the packets out.
+*/
+void RenderDevice::BuildDrawPackets(FramePacket& packet)
+{
+    N_PROFILE_SCOPE("BuildDrawPackets");
+    uint32_t const numThreads = Core::JobSystem::GetNumThreads();
+    packet.geometryDraws.resize(numThreads);
+    packet.shadowDraws.resize(numThreads);
+    packet.transparentDraws.resize(numThreads);
+    for (uint32_t i = 0; i < numThreads; i++)
+    {
+        packet.geometryDraws[i].clear();
+        packet.shadowDraws[i].clear();
+        packet.transparentDraws[i].clear();
+    }
+
+    glm::vec4 mainPlanes[6];
+    glm::vec4 shadowPlanes[6];
+    ExtractFrustumPlanes(CameraManager::GetCamera(CAMERA_MAIN)->viewProjection, mainPlanes);
+    ExtractFrustumPlanes(CameraManager::GetCamera(CAMERA_SHADOW)->viewProjection, shadowPlanes);
+
+    Core::JobSystem::ParallelFor((uint32_t)packet.drawCommands.size(), drawPacketGrainSize,
+        [&packet, &mainPlanes, &shadowPlanes](uint32_t begin, uint32_t end, uint32_t threadIndex)
+    {
+        std::vector<DrawPacket>& geometryDraws = packet.geometryDraws[threadIndex];
+        std::vector<DrawPacket>& shadowDraws = packet.shadowDraws[threadIndex];
+        std::vector<DrawPacket>& transparentDraws = packet.transparentDraws[threadIndex];
+        for (uint32_t c = begin; c < end; c++)
+        {
+            DrawCommand const& cmd = packet.drawCommands[c];
+            // models that are still loading or have been unloaded draw nothing
+            if (!IsModelReady(cmd.modelId))
+                continue;
+            Model const& model = GetModel(cmd.modelId);
+            bool const visible = IsBoxVisible(mainPlanes, cmd.transform, model.boundingBoxMin, model.boundingBoxMax);
+            bool const castsShadow = IsBoxVisible(shadowPlanes, cmd.transform, model.boundingBoxMin, model.boundingBoxMax);
+            if (!visible && !castsShadow)
+                continue;
+
+            for (auto const& mesh : model.meshes)
+            {
+                for (auto const primitiveId : mesh.opaquePrimitives)
+                {
+                    DrawPacket draw;
+                    ResolveDrawPacket(draw, cmd.transform, cmd.firstJoint, mesh.primitives[primitiveId]);
+                    if (visible)
+                        geometryDraws.push_back(draw);
+                    if (castsShadow)
+                        shadowDraws.push_back(draw);
+                }
+                if (!visible)
+                    continue;
+                for (auto const primitiveId : mesh.blendPrimitives)
+                {
+                    DrawPacket draw;
+                    ResolveDrawPacket(draw, cmd.transform, cmd.firstJoint, mesh.primitives[primitiveId]);
+                    transparentDraws.push_back(draw);
+                }
+            }
+        }
+    });
+}
+
+//------------------------------------------------------------------------------
+/**
+    Copies everything needed to render the frame into a packet. Runs on the game
+    thread, the render thread picks the packet up from here.
+*/
 void RenderDevice::Render(Display::Window* wnd)
 {
+    N_PROFILE_SCOPE("RenderDevice::Render");
+    RenderDevice* const self = Instance();
+    FramePacket* const packet = RenderThread::AcquirePacket();
+
+    packet->drawCommands.swap(self->drawCommands);
+    self->drawCommands.clear();
+
+    UpdateModelStreaming();
+    TextureResource::UpdateStreaming();
     CameraManager::OnBeforeRender();
+    self->UpdateShadowCamera();
+    self->BuildDrawPackets(*packet);
+    CameraManager::CaptureSnapshot(packet->cameras);
+    LightServer::CaptureSnapshot(packet->lights);
+    Debug::CaptureDebugCommands(packet->debugCommands);
+    packet->jointPalettes = Animation::GetPalettes();
+    ParticleSystem::CaptureSnapshot(packet->particles);
+
+    packet->window = wnd;
+    packet->skyboxTexture = self->skybox != InvalidResourceId ? TextureResource::GetTextureHandle(self->skybox) : 0;
+    packet->inputTime = wnd->GetInputTime();
+    wnd->GetSize(packet->width, packet->height);
+    {
+        N_PROFILE_SCOPE("BuildUi");
+        packet->CloneUi(wnd->BuildUi());
+    }
+
+    RenderThread::SubmitPacket(packet);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Declares all passes in the frame graph, executes it and presents the result.
+*/
+void RenderDevice::Execute(FramePacket& packet)
+{
+    N_PROFILE_SCOPE("RenderDevice::Execute");
+    RenderDevice* const self = Instance();
+    CameraManager::ApplySnapshot(packet.cameras);
+    LightServer::ApplySnapshot(packet.lights);
+    TextureResource::UploadStreamedTextures();
+    UploadStreamedModels();
+    ShaderResource::Update();
+
+    if (!packet.jointPalettes.empty())
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, self->jointPaletteBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, packet.jointPalettes.size() * sizeof(glm::mat4), packet.jointPalettes.data(), GL_STREAM_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, self->jointPaletteBuffer);
+    }
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
 
-    wnd->MakeCurrent();
+    self->frameDrawStats = DrawStats();
+    GpuProfiler::BeginFrame();
+    self->UpdateRenderScale();
 
-    Instance()->StaticShadowPass();
+    int const w = packet.width;
+    int const h = packet.height;
 
-    int w, h;
-    wnd->GetSize(w, h);
-    glViewport(0, 0, w, h);
+    // only grow the render targets, smaller windows just use a smaller sub-rect
+    self->frameSizeW = std::max((unsigned)w, self->frameSizeW);
+    self->frameSizeH = std::max((unsigned)h, self->frameSizeH);
+    self->renderScale = glm::clamp(Core::CVarReadFloat(r_render_scale), 0.1f, 1.0f);
+    self->renderSizeW = std::max(1u, (unsigned)(w * self->renderScale));
+    self->renderSizeH = std::max(1u, (unsigned)(h * self->renderScale));
 
-    Instance()->StaticGeometryPass();
+    // a headless window resized while this thread owned the context reallocates its framebuffer here
+    packet.window->UpdateFramebuffer(w, h);
 
-    Instance()->LightPass();
+    FrameGraph& graph = self->frameGraph;
+    FrameGraph::ResourceHandle const backbuffer = graph.ImportBackbuffer(packet.window->GetFramebuffer());
+    FrameGraph::ResourceHandle const shadowMap = graph.ImportTexture("GlobalShadowMap", globalShadowMap);
 
-    if (Instance()->skybox != InvalidResourceId)
+    auto Target = [self](GLenum format, GLenum filter)
     {
-        Instance()->SkyboxPass();
+        FrameGraph::TextureDesc desc;
+        desc.width = self->frameSizeW;
+        desc.height = self->frameSizeH;
+        desc.internalFormat = format;
+        desc.filter = filter;
+        return desc;
+    };
+    FrameGraph::ResourceHandle const albedo = graph.CreateTexture("Albedo", Target(GL_RGBA8, GL_NEAREST));
+    FrameGraph::ResourceHandle const normal = graph.CreateTexture("Normal", Target(GL_R11F_G11F_B10F, GL_NEAREST));
+    FrameGraph::ResourceHandle const properties = graph.CreateTexture("Properties", Target(GL_RG16F, GL_NEAREST));
+    FrameGraph::ResourceHandle const emissive = graph.CreateTexture("Emissive", Target(GL_R11F_G11F_B10F, GL_NEAREST));
+    FrameGraph::ResourceHandle const depth = graph.CreateTexture("Depth", Target(GL_DEPTH_COMPONENT32F, GL_NEAREST));
+    // lighting, skybox and debug drawing end up here before being upscaled to the window
+    FrameGraph::ResourceHandle const lightTarget = graph.CreateTexture("LightTarget", Target(GL_RGBA8, GL_LINEAR));
+    FrameGraph::ResourceHandle const lightDepth = graph.CreateTexture("LightDepth", Target(GL_DEPTH_COMPONENT32F, GL_NEAREST));
+    FrameGraph::ResourceHandle const accumulation = graph.CreateTexture("TransparentAccumulation", Target(GL_RGBA16F, GL_NEAREST));
+    FrameGraph::ResourceHandle const revealage = graph.CreateTexture("TransparentRevealage", Target(GL_R16F, GL_NEAREST));
+
+    auto SetRenderViewport = [self]() { glViewport(0, 0, self->renderSizeW, self->renderSizeH); };
+
+    {
+        FrameGraph::PassHandle const pass = graph.AddPass("StaticShadowPass", [self, &packet]() { self->StaticShadowPass(packet); });
+        graph.WriteDepth(pass, shadowMap);
+    }
+    {
+        FrameGraph::PassHandle const pass = graph.AddPass("StaticGeometryPass", [self, &packet, SetRenderViewport]()
+        {
+            SetRenderViewport();
+            self->StaticGeometryPass(packet);
+        });
+        graph.WriteColor(pass, albedo, 0);
+        graph.WriteColor(pass, normal, 1);
+        graph.WriteColor(pass, properties, 2);
+        graph.WriteColor(pass, emissive, 3);
+        graph.WriteDepth(pass, depth);
+    }
+    {
+        FrameGraph::PassHandle const pass = graph.AddPass("LightPass", [self, &graph, SetRenderViewport, albedo, normal, properties, emissive, depth]()
+        {
+            GeometryBuffer gbuffer;
+            gbuffer.albedo = graph.GetTexture(albedo);
+            gbuffer.normal = graph.GetTexture(normal);
+            gbuffer.properties = graph.GetTexture(properties);
+            gbuffer.emissive = graph.GetTexture(emissive);
+            gbuffer.depth = graph.GetTexture(depth);
+            SetRenderViewport();
+            self->LightPass(gbuffer);
+        });
+        graph.Read(pass, albedo);
+        graph.Read(pass, normal);
+        graph.Read(pass, properties);
+        graph.Read(pass, emissive);
+        graph.Read(pass, depth);
+        graph.Read(pass, shadowMap);
+        graph.WriteColor(pass, lightTarget, 0);
+        graph.WriteDepth(pass, lightDepth);
+    }
+    if (packet.skyboxTexture != 0)
+    {
+        FrameGraph::PassHandle const pass = graph.AddPass("SkyboxPass", [self, &packet, SetRenderViewport]()
+        {
+            SetRenderViewport();
+            self->SkyboxPass(packet);
+        });
+        graph.WriteColor(pass, lightTarget, 0);
+        graph.WriteDepth(pass, lightDepth);
+    }
+    bool hasTransparentDraws = false;
+    for (auto const& draws : packet.transparentDraws)
+        hasTransparentDraws |= !draws.empty();
+    if (hasTransparentDraws)
+    {
+        {
+            FrameGraph::PassHandle const pass = graph.AddPass("TransparentPass", [self, &packet, SetRenderViewport]()
+            {
+                SetRenderViewport();
+                self->TransparentPass(packet);
+            });
+            graph.WriteColor(pass, accumulation, 0);
+            graph.WriteColor(pass, revealage, 1);
+            graph.WriteDepth(pass, lightDepth);
+        }
+        {
+            FrameGraph::PassHandle const pass = graph.AddPass("TransparentCompositePass", [self, &graph, SetRenderViewport, accumulation, revealage]()
+            {
+                SetRenderViewport();
+                self->TransparentCompositePass(graph.GetTexture(accumulation), graph.GetTexture(revealage));
+            });
+            graph.Read(pass, accumulation);
+            graph.Read(pass, revealage);
+            graph.WriteColor(pass, lightTarget, 0);
+        }
+    }
+    if (!packet.particles.batches.empty())
+    {
+        FrameGraph::PassHandle const pass = graph.AddPass("ParticlePass", [self, &packet, SetRenderViewport]()
+        {
+            SetRenderViewport();
+            self->ParticlePass(packet);
+        });
+        graph.WriteColor(pass, lightTarget, 0);
+        graph.WriteDepth(pass, lightDepth);
+    }
+    {
+        FrameGraph::PassHandle const pass = graph.AddPass("DebugDrawing", [&packet, SetRenderViewport]()
+        {
+            SetRenderViewport();
+            Debug::DispatchDebugDrawing(packet.debugCommands);
+        });
+        graph.WriteColor(pass, lightTarget, 0);
+        graph.WriteDepth(pass, lightDepth);
+    }
+    {
+        FrameGraph::PassHandle const pass = graph.AddPass("UpscalePass", [self, &graph, lightTarget, w, h]()
+        {
+            self->UpscalePass(graph.GetTexture(lightTarget), w, h);
+        });
+        graph.Read(pass, lightTarget);
+        graph.WriteColor(pass, backbuffer, 0);
     }
-    
-    Instance()->drawCommands.clear();
 
-    Debug::DispatchDebugDrawing();
+    graph.Compile();
+    {
+        std::lock_guard<std::mutex> guard(self->frameGraphStatsLock);
+        self->frameGraphStats = graph.GetStats();
+    }
+    graph.Execute();
+    {
+        std::lock_guard<std::mutex> guard(self->frameGraphStatsLock);
+        self->drawStats = self->frameDrawStats;
+    }
+
+    {
+        N_GPU_ZONE("Ui");
+        packet.window->DrawUi(&packet.uiDrawData);
+    }
 
+    GpuProfiler::EndFrame();
+    FrameCapture::Capture(w, h, packet.window->GetFramebuffer());
 
+    N_PROFILE_SCOPE("Present");
+    packet.window->Present();
 }
 
 } // namespace Render
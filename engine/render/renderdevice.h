@@ -9,12 +9,16 @@
 #include "GL/glew.h"
 #include <string>
 #include <vector>
+#include <mutex>
+#include <unordered_map>
 #include "render/window.h"
+#include "framegraph.h"
 
 namespace Render
 {
 
 class Grid;
+namespace GpuProfiler { struct FrameTimes; }
 
 typedef unsigned int ResourceId;
 static const ResourceId InvalidResourceId = UINT_MAX;
@@ -28,7 +32,48 @@ typedef ResourceId ShaderProgramId;
 
 typedef unsigned ImageId;
 static const ImageId InvalidImageId = UINT_MAX;
-typedef unsigned ModelId;
+
+/// generational handle of a model, stale handles of unloaded models are detected by IsModelValid
+struct ModelId
+{
+    uint32_t index : 22; // 4M concurrent models
+    uint32_t generation : 10; // 1024 generations per index
+
+    static ModelId Create(uint32_t id)
+    {
+        ModelId ret;
+        ret.index = id & 0x003FFFFF;
+        ret.generation = (id & 0xFFC00000) >> 22;
+        return ret;
+    }
+    explicit constexpr operator uint32_t() const
+    {
+        return (((uint32_t)generation << 22) & 0xFFC00000) + (index & 0x003FFFFF);
+    }
+    static constexpr ModelId Invalid()
+    {
+        return { 0x003FFFFF, 0x3FF };
+    }
+    constexpr uint32_t HashCode() const
+    {
+        return index;
+    }
+    const bool operator==(const ModelId& rhs) const { return index == rhs.index && generation == rhs.generation; }
+    const bool operator!=(const ModelId& rhs) const { return !(*this == rhs); }
+    const bool operator<(const ModelId& rhs) const { return index < rhs.index; }
+    const bool operator>(const ModelId& rhs) const { return index > rhs.index; }
+};
+
+struct DrawCommand
+{
+    ModelId modelId;
+    glm::mat4 transform;
+    // first matrix of the joint palette skinned primitives are drawn with
+    uint32_t firstJoint;
+};
+
+struct FramePacket;
+struct DrawPacket;
 
 class RenderDevice
 {
@@ -44,38 +89,96 @@ public:
     void operator=(const RenderDevice&) = delete;
 
     static void Init();
-    static void Draw(ModelId model, glm::mat4 localToWorld);
+    /// draw a model. Skinned models pass the first joint of their animation instance, see Animation::GetFirstJoint.
+    static void Draw(ModelId model, glm::mat4 localToWorld, uint32_t firstJoint = UINT32_MAX);
+    /// capture the frame into a packet, including the UI of the window, and submit it to the render thread
     static void Render(Display::Window* wnd);
+    /// render and present a frame packet. Called on the thread owning the GL context.
+    static void Execute(FramePacket& packet);
     static void SetSkybox(TextureResourceId tex);
 
-private:
-    struct DrawCommand
+    /// get the current resolution scale of the geometry and lighting passes
+    static float GetRenderScale();
+    /// get the last measured GPU time of the resolution dependent passes, in milliseconds
+    static float GetRenderTime();
+    /// get the GPU time of the resolution dependent passes in a frame logged by the GPU profiler, in milliseconds
+    static float GetRenderTime(GpuProfiler::FrameTimes const& frame);
+    /// get statistics of the last compiled frame graph
+    static FrameGraph::Stats GetFrameGraphStats();
+
+    /// draw calls issued by the render device in a frame, not counting debug drawing and UI
+    struct DrawStats
     {
-        ModelId modelId;
-        glm::mat4 transform;
+        uint32_t drawCalls = 0;
+        uint64_t triangles = 0;
     };
+    /// get the draw statistics of the last executed frame
+    static DrawStats GetDrawStats();
+
+private:
     std::vector<DrawCommand> drawCommands;
 
-    void StaticShadowPass();
-    void StaticGeometryPass();
-    void LightPass();
-    void SkyboxPass();
+    /// geometry buffer textures, as assigned by the frame graph
+    struct GeometryBuffer
+    {
+        GLuint albedo;     // GL_RGBA8
+        GLuint normal;     // GL_R11F_G11F_B10F (signed values, 0 to 1)
+        GLuint properties; // GL_RG16F (metallic, roughness)
+        GLuint emissive;   // GL_R11F_G11F_B10F
+        GLuint depth;      // GL_DEPTH_COMPONENT32F
+    };
 
-    GLuint geometryBuffer;
-    union RenderTargets
+    /// instances of one transparent primitive, drawn with a single instanced call
+    struct TransparentBatch
     {
-        GLuint RT[4];
-        struct
-        {
-            GLuint albedo;     // GL_RGBA8
-            GLuint normal;     // GL_R11F_G11F_B10F (signed values, 0 to 1)
-            GLuint properties; // GL_RG16F (metallic, roughness
-            GLuint emissive;   // GL_RGB9_E5 (this could be problematic on some systems)
-        };
-    } renderTargets;
-    GLuint depthStencilBuffer; // GL_DEPTH24_STENCIL8
+        DrawPacket const* draw;
+        uint32_t firstInstance;
+        uint32_t numInstances;
+    };
+
+    void StaticShadowPass(FramePacket const& packet);
+    void DepthPrePass(FramePacket const& packet);
+    void StaticGeometryPass(FramePacket const& packet);
+    void LightPass(GeometryBuffer const& gbuffer);
+    void SkyboxPass(FramePacket const& packet);
+    void TransparentPass(FramePacket const& packet);
+    void TransparentCompositePass(GLuint accumulation, GLuint revealage);
+    void ParticlePass(FramePacket const& packet);
+    void UpscalePass(GLuint source, int windowWidth, int windowHeight);
+
+    void UpdateShadowCamera();
+    void BuildDrawPackets(FramePacket& packet);
+    void UpdateRenderScale();
+    void CountDraw(uint64_t triangles);
+
+    FrameGraph frameGraph;
+    // copy of the frame graph statistics, the graph itself is owned by the render thread
+    FrameGraph::Stats frameGraphStats;
+    std::mutex frameGraphStatsLock;
+    // draws of the frame being executed, and a copy of the last executed frame guarded by frameGraphStatsLock
+    DrawStats frameDrawStats;
+    DrawStats drawStats;
+
+    // size of the transient render targets, only grows. Frames are rendered to a sub-rect of this size.
     unsigned int frameSizeW;
     unsigned int frameSizeH;
+    // size of the sub-rect that is currently being rendered to
+    unsigned int renderSizeW;
+    unsigned int renderSizeH;
+    float renderScale = 1.0f;
+    uint64_t renderScaleFrame = 0;
+
+    // batches of the transparent pass by vertex array, rebuilt every frame without sorting
+    std::unordered_map<GLuint, uint32_t> transparentBatchIndices;
+    std::vector<TransparentBatch> transparentBatches;
+    std::vector<glm::mat4> transparentTransforms;
+    GLuint transparentInstanceBuffer = 0;
+    // skinning matrices of all animation instances, bound to binding 1
+    GLuint jointPaletteBuffer = 0;
+    // particles of the frame, positions and sizes at binding 0 and colors at binding 2
+    GLuint particleBuffer = 0;
+    GLuint particleColorBuffer = 0;
+
     Render::Grid* grid;
     TextureResourceId skybox = InvalidResourceId;
 };
@@ -85,4 +188,28 @@ inline void RenderDevice::SetSkybox(TextureResourceId tex)
     Instance()->skybox = tex;
 }
 
+inline float RenderDevice::GetRenderScale()
+{
+    return Instance()->renderScale;
+}
+
+inline FrameGraph::Stats RenderDevice::GetFrameGraphStats()
+{
+    std::lock_guard<std::mutex> guard(Instance()->frameGraphStatsLock);
+    return Instance()->frameGraphStats;
+}
+
+inline RenderDevice::DrawStats RenderDevice::GetDrawStats()
+{
+    std::lock_guard<std::mutex> guard(Instance()->frameGraphStatsLock);
+    return Instance()->drawStats;
+}
+
+inline void RenderDevice::CountDraw(uint64_t triangles)
+{
+    this->frameDrawStats.drawCalls++;
+    this->frameDrawStats.triangles += triangles;
+}
+
+
 } // namespace Render
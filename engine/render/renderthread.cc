@@ -0,0 +1,285 @@
+//------------------------------------------------------------------------------
+//  @file renderthread.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "renderthread.h"
+#include "framepacket.h"
+#include "render/window.h"
+#include "core/profiler.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+namespace Render
+{
+namespace RenderThread
+{
+
+static const int LATENCY_HISTORY = 64;
+
+/// render thread singleton state
+struct State
+{
+	std::thread thread;
+	Display::Window* window = nullptr;
+	bool running = false;
+	bool stopRequested = false;
+
+	std::mutex lock;
+	// signaled when packets or commands are queued, or a stop is requested
+	std::condition_variable workAvailable;
+	// signaled when a packet has been rendered and released
+	std::condition_variable workDone;
+
+	FramePacket packets[NUM_PACKETS];
+	std::vector<FramePacket*> freePackets;
+	std::deque<FramePacket*> queue;
+	std::vector<std::function<void()>> commands;
+	// packets and commands taken by the render thread but not finished yet
+	int executing = 0;
+	uint64_t frameIndex = 0;
+
+	float latencies[LATENCY_HISTORY] = {};
+	int latencyHead = 0;
+	int numLatencies = 0;
+};
+
+// never destroyed, the window close callback exits the process while the thread may still be running
+static State& state = *new State();
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+RecordLatency(FramePacket const& packet)
+{
+	float const ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - packet.inputTime).count();
+	std::lock_guard<std::mutex> guard(state.lock);
+	state.latencies[state.latencyHead] = ms;
+	state.latencyHead = (state.latencyHead + 1) % LATENCY_HISTORY;
+	state.numLatencies = std::min(state.numLatencies + 1, LATENCY_HISTORY);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+ExecutePacket(FramePacket* packet)
+{
+	RenderDevice::Execute(*packet);
+	RecordLatency(*packet);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+ThreadMain()
+{
+	N_PROFILE_THREAD("Render");
+	state.window->MakeCurrent();
+
+	std::vector<std::function<void()>> commands;
+	for (;;)
+	{
+		FramePacket* packet = nullptr;
+		{
+			std::unique_lock<std::mutex> guard(state.lock);
+			state.workAvailable.wait(guard, []() { return state.stopRequested || !state.queue.empty() || !state.commands.empty(); });
+			if (state.queue.empty() && state.commands.empty())
+				break;
+
+			commands.swap(state.commands);
+			if (!state.queue.empty())
+			{
+				packet = state.queue.front();
+				state.queue.pop_front();
+			}
+			state.executing++;
+		}
+
+		{
+			N_PROFILE_SCOPE("RenderThread::Commands");
+			for (auto const& command : commands)
+				command();
+			commands.clear();
+		}
+
+		if (packet != nullptr)
+			ExecutePacket(packet);
+
+		{
+			std::lock_guard<std::mutex> guard(state.lock);
+			if (packet != nullptr)
+				state.freePackets.push_back(packet);
+			state.executing--;
+		}
+		state.workDone.notify_all();
+	}
+
+	state.window->ReleaseCurrent();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+InitPackets()
+{
+	if (state.freePackets.empty() && state.queue.empty())
+	{
+		for (int i = 0; i < NUM_PACKETS; i++)
+			state.freePackets.push_back(&state.packets[i]);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Start(Display::Window* window)
+{
+	n_assert(!state.running);
+	InitPackets();
+	state.window = window;
+	state.stopRequested = false;
+	state.running = true;
+
+	// a context can only be current on one thread at a time
+	window->ReleaseCurrent();
+	state.thread = std::thread(ThreadMain);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Stop()
+{
+	if (!state.running)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(state.lock);
+		state.stopRequested = true;
+	}
+	state.workAvailable.notify_all();
+	state.thread.join();
+	state.running = false;
+	state.window->MakeCurrent();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+IsRunning()
+{
+	return state.running;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+FramePacket*
+AcquirePacket()
+{
+	N_PROFILE_SCOPE("RenderThread::AcquirePacket");
+	std::unique_lock<std::mutex> guard(state.lock);
+	InitPackets();
+	state.workDone.wait(guard, []() { return !state.freePackets.empty(); });
+	FramePacket* const packet = state.freePackets.back();
+	state.freePackets.pop_back();
+	packet->frameIndex = state.frameIndex++;
+	return packet;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+SubmitPacket(FramePacket* packet)
+{
+	if (!state.running)
+	{
+		ExecutePacket(packet);
+		std::lock_guard<std::mutex> guard(state.lock);
+		state.freePackets.push_back(packet);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(state.lock);
+		state.queue.push_back(packet);
+	}
+	state.workAvailable.notify_one();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Flush()
+{
+	if (!state.running)
+		return;
+
+	N_PROFILE_SCOPE("RenderThread::Flush");
+	std::unique_lock<std::mutex> guard(state.lock);
+	state.workDone.wait(guard, []() { return state.queue.empty() && state.commands.empty() && state.executing == 0; });
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Enqueue(std::function<void()> const& func)
+{
+	if (!state.running)
+	{
+		func();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(state.lock);
+		state.commands.push_back(func);
+	}
+	state.workAvailable.notify_one();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+float
+GetInputLatency()
+{
+	std::lock_guard<std::mutex> guard(state.lock);
+	if (state.numLatencies == 0)
+		return 0.0f;
+
+	float sum = 0.0f;
+	for (int i = 0; i < state.numLatencies; i++)
+		sum += state.latencies[i];
+	return sum / state.numLatencies;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+float
+GetMaxInputLatency()
+{
+	std::lock_guard<std::mutex> guard(state.lock);
+	float result = 0.0f;
+	for (int i = 0; i < state.numLatencies; i++)
+		result = std::max(result, state.latencies[i]);
+	return result;
+}
+
+} // namespace RenderThread
+} // namespace Render
@@ -0,0 +1,57 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file renderthread.h
+
+	Runs all GL submission on a dedicated thread.
+
+	The game thread builds a FramePacket per frame and submits it. The render
+	thread executes packets in order while the game thread moves on to the next
+	frame. Up to three packets are in flight, so the game thread can run at most
+	two frames ahead before AcquirePacket blocks.
+
+	While the thread is not running, packets and enqueued work execute inline
+	on the calling thread, which keeps tools and loading code working as before.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <functional>
+
+namespace Display { class Window; }
+
+namespace Render
+{
+
+struct FramePacket;
+
+namespace RenderThread
+{
+	/// number of frame packets, one being built, one queued, one rendering
+	static const int NUM_PACKETS = 3;
+
+	/// move the window's context to a new render thread
+	void Start(Display::Window* window);
+	/// render all submitted packets, join the thread and make the context current on the caller again
+	void Stop();
+	/// returns true if the render thread is running
+	bool IsRunning();
+
+	/// get a free packet to fill. Blocks if all packets are in flight.
+	FramePacket* AcquirePacket();
+	/// hand a filled packet over to the render thread
+	void SubmitPacket(FramePacket* packet);
+	/// wait until all submitted packets and enqueued work have executed
+	void Flush();
+
+	/// run GL work on the render thread before the next packet
+	void Enqueue(std::function<void()> const& func);
+
+	/// average time from polling input until the frame using it was presented, over the last frames, in milliseconds
+	float GetInputLatency();
+	/// highest input latency over the last frames, in milliseconds
+	float GetMaxInputLatency();
+} // namespace RenderThread
+
+} // namespace Render
@@ -6,58 +6,328 @@
 #include "shaderresource.h"
 #include <fstream>
 #include <string>
-#include <sstream>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include "core/profiler.h"
+#include "core/cvar.h"
+#include "core/hash.h"
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 namespace Render
 {
 
+static Core::CVar* r_shader_cache = nullptr;
+static Core::CVar* r_shader_hot_reload = nullptr;
+
+// nesting limit for includes, guards against include cycles
+static const int MAX_INCLUDE_DEPTH = 16;
+
+#ifdef __linux__
+//------------------------------------------------------------------------------
+/**
+    Watches the directories of all shader sources and includes with inotify on
+    a background thread, and collects the files that were written.
+*/
+class ShaderWatcher
+{
+public:
+    ~ShaderWatcher()
+    {
+        if (this->fd < 0)
+            return;
+        this->stop = true;
+        this->thread.join();
+        close(this->fd);
+    }
+
+    /// start watching a directory, starts the thread on first use
+    void Watch(std::string const& directory)
+    {
+        if (this->fd < 0)
+        {
+            this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (this->fd < 0)
+                return;
+            this->thread = std::thread([this]() { this->Run(); });
+        }
+
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (auto const& watched : this->directories)
+        {
+            if (watched.second == directory)
+                return;
+        }
+        // editors either write the file in place or rename a new file over it
+        int const wd = inotify_add_watch(this->fd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd >= 0)
+            this->directories[wd] = directory;
+    }
+
+    /// move the files written since the last call into changed
+    bool TakeChanges(std::unordered_set<std::string>& changed)
+    {
+        if (!this->hasChanges.exchange(false))
+            return false;
+        std::lock_guard<std::mutex> guard(this->lock);
+        changed.swap(this->changes);
+        this->changes.clear();
+        return !changed.empty();
+    }
+
+private:
+    void Run()
+    {
+        alignas(inotify_event) char buffer[4096];
+        while (!this->stop)
+        {
+            pollfd pfd = { this->fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 100) <= 0)
+                continue;
+
+            ssize_t const size = read(this->fd, buffer, sizeof(buffer));
+            std::lock_guard<std::mutex> guard(this->lock);
+            for (ssize_t offset = 0; offset < size;)
+            {
+                inotify_event const* event = (inotify_event const*)(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                auto directory = this->directories.find(event->wd);
+                if (directory == this->directories.end() || event->len == 0)
+                    continue;
+                std::filesystem::path const file = std::filesystem::path(directory->second) / event->name;
+                this->changes.insert(file.lexically_normal().generic_string());
+                this->hasChanges = true;
+            }
+        }
+    }
+
+    int fd = -1;
+    std::thread thread;
+    std::atomic<bool> stop{ false };
+    std::atomic<bool> hasChanges{ false };
+    // guards directories and changes
+    std::mutex lock;
+    std::unordered_map<int, std::string> directories;
+    std::unordered_set<std::string> changes;
+};
+
+static ShaderWatcher watcher;
+#endif
+
+//------------------------------------------------------------------------------
+/**
+    Dependencies are compared by their normalized paths, so "shd/a.glsl" and
+    "./shd/a.glsl" are the same file.
+*/
+static std::string
+NormalizePath(std::string const& path)
+{
+    return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+// header of a file in the program binary cache
+struct ProgramBinaryHeader
+{
+    static const uint32_t MAGIC = 0x4E425053; // 'SPBN'
+    uint32_t magic;
+    uint32_t binaryFormat;
+    // key of the program, guards against hash collisions in the file name
+    uint64_t key;
+};
+
 ShaderResource::ShaderResource()
 {
     // empty
 }
 
+//------------------------------------------------------------------------------
+/**
+    Reads a file and replaces its #include "path" lines with the included files,
+    which are preprocessed themselves. Appends the normalized paths of the file
+    and everything it includes to dependencies.
+*/
+bool ShaderResource::ReadSource(std::string const& path, std::string& code, std::vector<std::string>& dependencies, int depth)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    std::string const content((std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>()));
+    if (content.empty())
+        return false;
+    dependencies.push_back(NormalizePath(path));
+
+    static std::string const pragma("#include");
+    code.clear();
+    code.reserve(content.size());
+    size_t begin = 0;
+    while (begin < content.size())
+    {
+        size_t end = content.find('\n', begin);
+        if (end == std::string::npos)
+            end = content.size();
+
+        size_t const directive = content.find(pragma, begin);
+        if (directive < end)
+        {
+            size_t const open = content.find('"', directive + pragma.size());
+            size_t const close = open < end ? content.find('"', open + 1) : std::string::npos;
+            std::string const include = close < end ? content.substr(open + 1, close - open - 1) : std::string();
+            std::string const* const included = GetInclude(include, dependencies, depth + 1);
+            if (included == nullptr)
+            {
+                printf("\n[SHADER PREPROCESSOR ERROR]: Could not find include '%s' in '%s'!\n", include.c_str(), path.c_str());
+                return false;
+            }
+            code += *included;
+        }
+        else
+        {
+            code.append(content, begin, end - begin);
+        }
+        code += '\n';
+        begin = end + 1;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Included files are preprocessed once and shared by all shaders including
+    them, until they change.
+*/
+std::string const* ShaderResource::GetInclude(std::string const& path, std::vector<std::string>& dependencies, int depth)
+{
+    if (path.empty() || depth > MAX_INCLUDE_DEPTH)
+        return nullptr;
+
+    ShaderResource* const self = Instance();
+    std::string const key = NormalizePath(path);
+    auto iter = self->includeCache.find(key);
+    if (iter == self->includeCache.end())
+    {
+        Include include;
+        if (!ReadSource(path, include.code, include.dependencies, depth))
+            return nullptr;
+        iter = self->includeCache.emplace(key, std::move(include)).first;
+    }
+    dependencies.insert(dependencies.end(), iter->second.dependencies.begin(), iter->second.dependencies.end());
+    return &iter->second.code;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void ShaderResource::WatchDependencies(std::vector<std::string> const& dependencies)
+{
+#ifdef __linux__
+    if (r_shader_hot_reload == nullptr)
+        r_shader_hot_reload = Core::CVarCreate(Core::CVarType::CVar_Int, "r_shader_hot_reload", "1", "Recompile shaders when their source files change");
+    if (Core::CVarReadInt(r_shader_hot_reload) == 0)
+        return;
+    for (std::string const& dependency : dependencies)
+        watcher.Watch(std::filesystem::path(dependency).parent_path().generic_string());
+#endif
+}
+
 /// @todo	Check if shader has already been loaded
 ShaderResourceId ShaderResource::LoadShader(ShaderType type, const char* path)
 {
+    N_PROFILE_SCOPE("ShaderResource::LoadShader");
     printf("Loading shader %s... ", path);
-    std::ifstream ifs(path);
-    std::string content((std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>()));
-
-    if (content.empty())
+    std::string content;
+    std::vector<std::string> dependencies;
+    if (!ReadSource(path, content, dependencies, 0))
     {
         printf("FAIL\n[SHADER LOAD ERROR]: Could not load file!");
         return false;
     }
+    WatchDependencies(dependencies);
 
-    // Preprocess includes
-    auto includes = content.find("#include");
-    
-    // TODO: this can be improved
-    auto Preprocess = [](std::string& src) -> std::string
+    Instance()->shaderSources.push_back(path);
+    Instance()->shaderCode.push_back(std::move(content));
+    Instance()->shaderDependencies.push_back(std::move(dependencies));
+    Instance()->shaders.push_back(0);
+    Instance()->shaderTypes.push_back(type);
+    printf("OK\n");
+    return ShaderResourceId(Instance()->shaders.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Returns the bits of mask whose feature the shader mentions. Defines the
+    shader never checks would only produce duplicate variants.
+*/
+uint32_t ShaderResource::GetShaderMask(ShaderResourceId id, std::vector<std::string> const& features, uint32_t mask)
+{
+    std::string const& code = Instance()->shaderCode[id];
+    uint32_t shaderMask = 0;
+    for (uint32_t bit = 0; bit < (uint32_t)features.size(); bit++)
     {
-        std::stringstream ss(src), out;
-        std::string line;
-        std::string pragma("#include");
-        while (std::getline(ss, line))
-        {
-            if (size_t pos = line.find(pragma) != std::string::npos)
-            {
-                std::string include = line.substr(pos + pragma.size() + 1, pos + line.size() - pragma.size() - 4);
-                std::ifstream includeFileStream(include);
-                std::string content((std::istreambuf_iterator<char>(includeFileStream)), (std::istreambuf_iterator<char>()));
-                if (content.empty())
-                {
-                    printf("\n[SHADER PREPROCESSOR ERROR]: Could not find include '%s'!\n", include.c_str());
-                    assert(false);
-                }
-                out << content << std::endl;
-            }
-            else
-                out << line << std::endl;
-        }
-        return out.str();
-    };
-    content = Preprocess(content);
+        if ((mask & (1u << bit)) != 0 && code.find(features[bit]) != std::string::npos)
+            shaderMask |= 1u << bit;
+    }
+    return shaderMask;
+}
 
+//------------------------------------------------------------------------------
+/**
+    The defines of a variant go right after the #version line, which has to
+    stay first.
+*/
+std::string ShaderResource::GetVariantCode(ShaderResourceId id, std::vector<std::string> const& features, uint32_t shaderMask)
+{
+    std::string const& code = Instance()->shaderCode[id];
+    if (shaderMask == 0)
+        return code;
+
+    std::string defines;
+    for (uint32_t bit = 0; bit < (uint32_t)features.size(); bit++)
+    {
+        if ((shaderMask & (1u << bit)) != 0)
+            defines += "#define " + features[bit] + " 1\n";
+    }
+
+    size_t position = 0;
+    size_t const version = code.find("#version");
+    if (version != std::string::npos)
+    {
+        position = code.find('\n', version);
+        position = position == std::string::npos ? code.size() : position + 1;
+    }
+    std::string variant = code;
+    variant.insert(position, defines);
+    return variant;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Shaders are compiled when the first program that is not in the program
+    binary cache needs them, once per combination of features they use. With
+    parallel shader compilation the driver compiles in the background until the
+    result is queried in FinishCompile.
+*/
+GLuint ShaderResource::StartCompile(ShaderResourceId id, std::vector<std::string> const& features, uint32_t mask)
+{
+    N_PROFILE_SCOPE("ShaderResource::StartCompile");
+    ShaderResource* const self = Instance();
+    uint32_t const shaderMask = GetShaderMask(id, features, mask);
+    GLuint& slot = shaderMask == 0 ? self->shaders[id] : self->shaderVariants[((uint64_t)shaderMask << 32) | id];
+    if (slot != 0)
+        return slot;
+
+    if (!self->parallelCompileEnabled)
+    {
+        self->parallelCompileEnabled = true;
+        // let the driver pick the number of threads
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+
+    std::string const content = GetVariantCode(id, features, shaderMask);
+    ShaderType const type = self->shaderTypes[id];
     const char* shdSrc = content.c_str();
 
     // setup vertex shader
@@ -85,6 +355,25 @@ ShaderResourceId ShaderResource::LoadShader(ShaderType type, const char* path)
     glShaderSource(shader, 1, &shdSrc, &length);
     glCompileShader(shader);
 
+    slot = shader;
+    self->compilingShaders[shader] = id;
+    return shader;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Prints the error log of a shader the first time it is checked after a
+    compile. Returns false if it failed to compile.
+*/
+bool ShaderResource::FinishCompile(GLuint shader)
+{
+    ShaderResource* const self = Instance();
+    auto const compiling = self->compilingShaders.find(shader);
+    if (compiling == self->compilingShaders.end())
+        return true;
+    ShaderResourceId const id = compiling->second;
+    self->compilingShaders.erase(compiling);
+
     // get error log
     GLint shaderLogSize;
     glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &shaderLogSize);
@@ -92,7 +381,7 @@ ShaderResourceId ShaderResource::LoadShader(ShaderType type, const char* path)
     {
         char* buf = new char[shaderLogSize];
         glGetShaderInfoLog(shader, shaderLogSize, NULL, buf);
-        printf("\n[SHADER COMPILE ERROR]: %s", buf);
+        printf("\n[SHADER COMPILE ERROR]: %s: %s", self->shaderSources[id].c_str(), buf);
         delete[] buf;
 
 #ifdef _DEBUGs
@@ -100,23 +389,179 @@ ShaderResourceId ShaderResource::LoadShader(ShaderType type, const char* path)
 #endif
      }
 
-    Instance()->shaderSources.push_back(path);
-    Instance()->shaders.push_back(shader);
-    Instance()->shaderTypes.push_back(type);
-    printf("OK\n");
-    return ShaderResourceId(Instance()->shaders.size() - 1);
+    GLint status = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    return status == GL_TRUE;
 }
 
-ShaderProgramId ShaderResource::CompileShaderProgram(std::vector<ShaderResourceId> const& shaders)
+//------------------------------------------------------------------------------
+/**
+    The key covers the preprocessed sources and types of all shaders, with the
+    defines of the variant, and the driver, since binaries are only valid for
+    the driver that produced them.
+*/
+uint64_t ShaderResource::GetProgramKey(std::vector<ShaderResourceId> const& shaders, std::vector<std::string> const& features, uint32_t mask)
 {
-    printf("Creating shader program... ");
-    GLuint program = glCreateProgram();
+    ShaderResource* const self = Instance();
+    if (self->driverHash == 0)
+    {
+        std::string driver;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION })
+        {
+            char const* value = (char const*)glGetString(name);
+            driver += value != nullptr ? value : "";
+            driver += '\n';
+        }
+        self->driverHash = Core::Hash64(driver.data(), driver.size()) | 1;
+    }
+
+    uint64_t key = self->driverHash;
+    for (ShaderResourceId shader : shaders)
+    {
+        std::string const code = GetVariantCode(shader, features, GetShaderMask(shader, features, mask));
+        key = Core::Hash64(&self->shaderTypes[shader], sizeof(ShaderType), key);
+        key = Core::Hash64(code.data(), code.size(), key);
+    }
+    return key;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static std::string
+GetProgramCachePath(uint64_t key)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "cache/shaders/%016llx.bin", (unsigned long long)key);
+    return name;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Creates a program from the binary cache. Returns zero if the program is not
+    cached, or the driver rejects the binary, for example after an update.
+*/
+static GLuint
+LoadProgramBinary(uint64_t key)
+{
+    N_PROFILE_SCOPE("LoadProgramBinary");
+    std::ifstream stream(GetProgramCachePath(key), std::ios::binary | std::ios::ate);
+    if (!stream)
+        return 0;
+
+    size_t const size = (size_t)stream.tellg();
+    ProgramBinaryHeader header;
+    if (size <= sizeof(header))
+        return 0;
+    std::vector<char> binary(size - sizeof(header));
+    stream.seekg(0);
+    if (!stream.read((char*)&header, sizeof(header)) || !stream.read(binary.data(), binary.size()))
+        return 0;
+    if (header.magic != ProgramBinaryHeader::MAGIC || header.key != key)
+        return 0;
+
+    GLuint const program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Writes a linked program to the binary cache, through a temporary file so a
+    crash never leaves a partial binary behind.
+*/
+static void
+SaveProgramBinary(GLuint program, uint64_t key)
+{
+    N_PROFILE_SCOPE("SaveProgramBinary");
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    ProgramBinaryHeader header;
+    header.magic = ProgramBinaryHeader::MAGIC;
+    header.key = key;
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.binaryFormat = format;
+
+    std::string const path = GetProgramCachePath(key);
+    std::string const temporary = path + ".tmp";
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    {
+        std::ofstream stream(temporary, std::ios::binary);
+        if (!stream.write((char const*)&header, sizeof(header)) || !stream.write(binary.data(), length))
+            return;
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+        std::filesystem::remove(temporary, error);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Loads the program from the program binary cache if r_shader_cache is set and
+    the driver supports program binaries. Otherwise its shaders are compiled and
+    linking is started. FinishLink waits for the result.
+*/
+ShaderResource::ProgramLink ShaderResource::StartLink(std::vector<ShaderResourceId> const& shaders, std::vector<std::string> const& features, uint32_t mask)
+{
+    if (r_shader_cache == nullptr)
+        r_shader_cache = Core::CVarCreate(Core::CVarType::CVar_Int, "r_shader_cache", "1", "Cache linked shader programs on disk as driver binaries");
+
+    GLint numBinaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
+    bool const cache = Core::CVarReadInt(r_shader_cache) != 0 && numBinaryFormats > 0;
+
+    ProgramLink link;
+    link.key = cache ? GetProgramKey(shaders, features, mask) : 0;
+    if (cache)
+    {
+        link.program = LoadProgramBinary(link.key);
+        link.cached = link.program != 0;
+        if (link.cached)
+            return link;
+    }
+
+    link.program = glCreateProgram();
     for (auto shader : shaders)
     {
-        glAttachShader(program, Instance()->shaders[shader]);
+        link.objects.push_back(StartCompile(shader, features, mask));
+        glAttachShader(link.program, link.objects.back());
+    }
+
+    if (cache)
+        glProgramParameteri(link.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(link.program);
+    return link;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Prints the error logs of the program and its shaders, and writes linked
+    programs to the binary cache. Returns false if linking failed.
+*/
+bool ShaderResource::FinishLink(ProgramLink const& link)
+{
+    if (link.cached)
+        return true;
+
+    for (auto shader : link.objects)
+    {
+        FinishCompile(shader);
     }
 
-    glLinkProgram(program);
+    GLuint const program = link.program;
     GLint shaderLogSize;
     glGetProgramiv(program, GL_INFO_LOG_LENGTH, &shaderLogSize);
     if (shaderLogSize > 0)
@@ -127,8 +572,30 @@ ShaderProgramId ShaderResource::CompileShaderProgram(std::vector<ShaderResourceI
         delete[] buf;
     }
 
-    Instance()->programs.push_back(program);
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (link.key != 0 && status == GL_TRUE)
+        SaveProgramBinary(program, link.key);
+    return status == GL_TRUE;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Links the variant without features right away, the others are linked by
+    GetProgramHandle when they are first used.
+*/
+ShaderProgramId ShaderResource::CompileShaderProgram(std::vector<ShaderResourceId> const& shaders, std::vector<std::string> const& features)
+{
+    N_PROFILE_SCOPE("ShaderResource::CompileShaderProgram");
+    n_assert(features.size() <= 32);
+    printf("Creating shader program... ");
+    ProgramLink const link = StartLink(shaders, features, 0);
+    FinishLink(link);
+
+    Instance()->programs.push_back(link.program);
     Instance()->programShaders.push_back(shaders);
+    Instance()->programFeatures.push_back(features);
+    Instance()->programVariants.emplace_back();
     printf("OK\n");
     return ShaderProgramId(Instance()->programs.size() - 1);
 }
@@ -138,41 +605,168 @@ GLuint ShaderResource::GetProgramHandle(ShaderProgramId programId)
     return Instance()->programs[programId];
 }
 
+//------------------------------------------------------------------------------
+/**
+    Features none of the shaders check are ignored, so they share a variant.
+    Variants go through the program binary cache like any other program.
+*/
+GLuint ShaderResource::GetProgramHandle(ShaderProgramId programId, uint32_t features)
+{
+    ShaderResource* const self = Instance();
+    std::vector<std::string> const& names = self->programFeatures[programId];
+    uint32_t mask = 0;
+    for (ShaderResourceId shader : self->programShaders[programId])
+        mask |= GetShaderMask(shader, names, features);
+    if (mask == 0)
+        return self->programs[programId];
+
+    std::unordered_map<uint32_t, GLuint>& variants = self->programVariants[programId];
+    auto const iter = variants.find(mask);
+    if (iter != variants.end())
+        return iter->second;
+
+    N_PROFILE_SCOPE("ShaderResource::LinkVariant");
+    printf("Creating shader program variant 0x%x of program %u... ", mask, programId);
+    ProgramLink const link = StartLink(self->programShaders[programId], names, mask);
+    FinishLink(link);
+    variants.emplace(mask, link.program);
+    printf("OK\n");
+    return link.program;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Rereads all sources, but only recompiles what changed.
+*/
 void ShaderResource::ReloadShaders()
 {
     printf("--- RELOAD SHADERS ---\n");
-    // intentional copies
-    std::vector<std::string> paths = Instance()->shaderSources;
-    std::vector<ShaderType> types = Instance()->shaderTypes;
+    Reload(nullptr);
+}
 
-    for (size_t i = 0; i < Instance()->shaders.size(); i++)
-    {
-        glDeleteShader(Instance()->shaders[i]);
-    }
+//------------------------------------------------------------------------------
+/**
+    Reloads the shaders whose files the watcher saw change. Call once per frame
+    on the thread owning the GL context.
+*/
+void ShaderResource::Update()
+{
+#ifdef __linux__
+    std::unordered_set<std::string> changed;
+    if (watcher.TakeChanges(changed))
+        Reload(&changed);
+#endif
+}
 
-    Instance()->shaderSources.clear();
-    Instance()->shaders.clear();
-    Instance()->shaderTypes.clear();
+//------------------------------------------------------------------------------
+/**
+    Shaders that depend on a changed file, or all shaders if changed is null,
+    are read again. Those whose preprocessed code differs are recompiled, all
+    at once so the driver can compile them in parallel, and only the programs
+    using them are relinked. A program that fails to link keeps its previous
+    version, so a typo does not break the frame.
+*/
+void ShaderResource::Reload(std::unordered_set<std::string> const* changed)
+{
+    N_PROFILE_SCOPE("ShaderResource::Reload");
+    ShaderResource* const self = Instance();
+    auto IsChanged = [changed](std::vector<std::string> const& dependencies)
+    {
+        if (changed == nullptr)
+            return true;
+        for (std::string const& dependency : dependencies)
+        {
+            if (changed->count(dependency) > 0)
+                return true;
+        }
+        return false;
+    };
 
-    for (size_t i = 0; i < paths.size(); i++)
+    for (auto iter = self->includeCache.begin(); iter != self->includeCache.end();)
     {
-        LoadShader(types[i], paths[i].c_str());
+        if (IsChanged(iter->second.dependencies))
+            iter = self->includeCache.erase(iter);
+        else
+            iter++;
     }
 
-    std::vector<std::vector<ShaderResourceId>> progs = Instance()->programShaders;
-
-    for (size_t i = 0; i < Instance()->programs.size(); i++)
+    std::vector<bool> recompiled(self->shaders.size(), false);
+    uint32_t numShaders = 0;
+    for (ShaderResourceId id = 0; id < (ShaderResourceId)self->shaders.size(); id++)
     {
-        glDeleteProgram(Instance()->programs[i]);
+        if (!IsChanged(self->shaderDependencies[id]))
+            continue;
+
+        std::string code;
+        std::vector<std::string> dependencies;
+        if (!ReadSource(self->shaderSources[id], code, dependencies, 0))
+        {
+            printf("[SHADER LOAD ERROR]: Could not reload '%s'!\n", self->shaderSources[id].c_str());
+            continue;
+        }
+        WatchDependencies(dependencies);
+        self->shaderDependencies[id] = std::move(dependencies);
+        if (code == self->shaderCode[id])
+            continue;
+
+        self->shaderCode[id] = std::move(code);
+        glDeleteShader(self->shaders[id]);
+        self->shaders[id] = 0;
+        for (auto iter = self->shaderVariants.begin(); iter != self->shaderVariants.end();)
+        {
+            if ((ShaderResourceId)(iter->first & 0xFFFFFFFF) == id)
+            {
+                glDeleteShader(iter->second);
+                iter = self->shaderVariants.erase(iter);
+            }
+            else
+                iter++;
+        }
+        recompiled[id] = true;
+        numShaders++;
     }
+    if (numShaders == 0)
+        return;
 
-    Instance()->programs.clear();
-    Instance()->programShaders.clear();
+    /// a program variant that is relinked
+    struct Relink
+    {
+        ShaderProgramId program;
+        uint32_t mask;
+        ProgramLink link;
+    };
+    std::vector<Relink> links;
+    for (ShaderProgramId pid = 0; pid < (ShaderProgramId)self->programs.size(); pid++)
+    {
+        for (ShaderResourceId shader : self->programShaders[pid])
+        {
+            if (recompiled[shader])
+            {
+                std::vector<ShaderResourceId> const& shaders = self->programShaders[pid];
+                std::vector<std::string> const& features = self->programFeatures[pid];
+                links.push_back({ pid, 0, StartLink(shaders, features, 0) });
+                for (auto const& variant : self->programVariants[pid])
+                    links.push_back({ pid, variant.first, StartLink(shaders, features, variant.first) });
+                break;
+            }
+        }
+    }
 
-    for (size_t i = 0; i < progs.size(); i++)
+    for (Relink const& relink : links)
     {
-        CompileShaderProgram(progs[i]);
+        GLuint& handle = relink.mask == 0 ? self->programs[relink.program] : self->programVariants[relink.program][relink.mask];
+        if (FinishLink(relink.link))
+        {
+            glDeleteProgram(handle);
+            handle = relink.link.program;
+        }
+        else
+        {
+            glDeleteProgram(relink.link.program);
+            printf("[SHADER RELOAD]: Keeping the previous version of program %u variant 0x%x\n", relink.program, relink.mask);
+        }
     }
+    printf("--- RELOADED %u SHADERS, %u PROGRAMS ---\n", numShaders, (uint32_t)links.size());
 }
 
 } // namespace Render
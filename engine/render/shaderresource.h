@@ -7,6 +7,8 @@
 */
 //------------------------------------------------------------------------------
 #include "renderdevice.h"
+#include <unordered_map>
+#include <unordered_set>
 
 namespace Render
 {
@@ -32,23 +34,80 @@ public:
         COMPUTESHADER
     };
 
+    /// read and preprocess a shader. It is compiled once a program that is not in the program binary cache needs it.
     static ShaderResourceId LoadShader(ShaderType type, const char* path);
-    static ShaderProgramId CompileShaderProgram(std::vector<ShaderResourceId> const& shaders);
+    /// link a program, or load it from the program binary cache. Each bit of a feature mask turns on the #define of the same index in features.
+    static ShaderProgramId CompileShaderProgram(std::vector<ShaderResourceId> const& shaders, std::vector<std::string> const& features = {});
 
     static GLuint GetProgramHandle(ShaderProgramId);
+    /// handle of the variant of a program compiled with the given feature mask, linked on first use
+    static GLuint GetProgramHandle(ShaderProgramId, uint32_t features);
 
+    /// reread all shader sources and recompile the ones that changed, and the programs using them
     static void ReloadShaders();
+    /// recompile shaders whose source or included files were written. Call once per frame on the thread owning the GL context.
+    static void Update();
 
 private:
+    /// a program that was loaded from the binary cache, or is still linking
+    struct ProgramLink
+    {
+        GLuint program = 0;
+        uint64_t key = 0;
+        bool cached = false;
+        // attached shader objects
+        std::vector<GLuint> objects;
+    };
+
+    /// a preprocessed include file
+    struct Include
+    {
+        std::string code;
+        // the file and everything it includes
+        std::vector<std::string> dependencies;
+    };
+
+    static bool ReadSource(std::string const& path, std::string& code, std::vector<std::string>& dependencies, int depth);
+    static std::string const* GetInclude(std::string const& path, std::vector<std::string>& dependencies, int depth);
+    static void WatchDependencies(std::vector<std::string> const& dependencies);
+    static uint32_t GetShaderMask(ShaderResourceId id, std::vector<std::string> const& features, uint32_t mask);
+    static std::string GetVariantCode(ShaderResourceId id, std::vector<std::string> const& features, uint32_t shaderMask);
+    static GLuint StartCompile(ShaderResourceId id, std::vector<std::string> const& features, uint32_t mask);
+    static bool FinishCompile(GLuint shader);
+    static ProgramLink StartLink(std::vector<ShaderResourceId> const& shaders, std::vector<std::string> const& features, uint32_t mask);
+    static bool FinishLink(ProgramLink const& link);
+    static uint64_t GetProgramKey(std::vector<ShaderResourceId> const& shaders, std::vector<std::string> const& features, uint32_t mask);
+    static void Reload(std::unordered_set<std::string> const* changed);
+
     //
     // ShaderResourceId
     std::vector<std::string> shaderSources;
+    // preprocessed source
+    std::vector<std::string> shaderCode;
+    // normalized paths of the source and all files it includes
+    std::vector<std::vector<std::string>> shaderDependencies;
+    // zero until compiled
     std::vector<GLuint> shaders;
+    // variants compiled with defines, by the mask of defines in the upper and the shader id in the lower 32 bits
+    std::unordered_map<uint64_t, GLuint> shaderVariants;
+    // shader objects whose compile result has not been checked yet
+    std::unordered_map<GLuint, ShaderResourceId> compilingShaders;
     std::vector<ShaderType> shaderTypes;
 
     // ShaderProgramId
     std::vector<std::vector<ShaderResourceId>> programShaders;
     std::vector<GLuint> programs;
+    // names of the defines of each feature bit
+    std::vector<std::vector<std::string>> programFeatures;
+    // variants with features, by feature mask
+    std::vector<std::unordered_map<uint32_t, GLuint>> programVariants;
+
+    // hash of the driver strings, part of every program key
+    uint64_t driverHash = 0;
+    bool parallelCompileEnabled = false;
+
+    // normalized path to preprocessed include
+    std::unordered_map<std::string, Include> includeCache;
 };
 
 
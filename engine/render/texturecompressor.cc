@@ -0,0 +1,809 @@
+//------------------------------------------------------------------------------
+//  @file texturecompressor.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "texturecompressor.h"
+#include "core/profiler.h"
+#include "core/hash.h"
+#include "stb_image.h"
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <algorithm>
+
+namespace Render
+{
+namespace TextureCompressor
+{
+
+// bump when the encoder output changes, to invalidate the cache
+static const uint32_t ENCODER_VERSION = 1;
+static const char* CACHE_DIRECTORY = "cache/textures";
+
+static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const size_t KTX2_HEADER_SIZE = 80;
+static const size_t KTX2_LEVEL_INDEX_SIZE = 24;
+
+//------------------------------------------------------------------------------
+/**
+*/
+static float
+SRGBToLinear(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static float
+LinearToSRGB(float c)
+{
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static uint16_t
+To565(glm::vec3 c)
+{
+	c = glm::clamp(c, glm::vec3(0.0f), glm::vec3(255.0f));
+	uint16_t const r = (uint16_t)(c.r * 31.0f / 255.0f + 0.5f);
+	uint16_t const g = (uint16_t)(c.g * 63.0f / 255.0f + 0.5f);
+	uint16_t const b = (uint16_t)(c.b * 31.0f / 255.0f + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static glm::vec3
+From565(uint16_t c)
+{
+	uint32_t const r = (c >> 11) & 31;
+	uint32_t const g = (c >> 5) & 63;
+	uint32_t const b = c & 31;
+	return glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+//------------------------------------------------------------------------------
+/**
+	Quantizes two endpoints, picks the closest palette entry for every pixel and
+	writes the block if it has a lower error than best.
+*/
+static void
+FitColorEndpoints(glm::vec3 const pixels[16], glm::vec3 e0, glm::vec3 e1, uint8_t out[8], float& best, uint8_t indices[16])
+{
+	uint16_t c0 = To565(e0);
+	uint16_t c1 = To565(e1);
+	// c0 > c1 selects the four color mode
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	uint32_t bits = 0;
+	float error = 0.0f;
+	uint8_t selected[16] = {};
+	if (c0 != c1)
+	{
+		glm::vec3 const a = From565(c0);
+		glm::vec3 const b = From565(c1);
+		glm::vec3 const palette[4] = { a, b, (2.0f * a + b) / 3.0f, (a + 2.0f * b) / 3.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float closest = FLT_MAX;
+			for (uint8_t p = 0; p < 4; p++)
+			{
+				glm::vec3 const d = pixels[i] - palette[p];
+				float const distance = glm::dot(d, d);
+				if (distance < closest)
+				{
+					closest = distance;
+					selected[i] = p;
+				}
+			}
+			error += closest;
+			bits |= (uint32_t)selected[i] << (2 * i);
+		}
+	}
+	else
+	{
+		glm::vec3 const a = From565(c0);
+		for (int i = 0; i < 16; i++)
+		{
+			glm::vec3 const d = pixels[i] - a;
+			error += glm::dot(d, d);
+		}
+	}
+
+	if (error >= best)
+		return;
+
+	best = error;
+	memcpy(indices, selected, 16);
+	out[0] = (uint8_t)(c0 & 0xFF);
+	out[1] = (uint8_t)(c0 >> 8);
+	out[2] = (uint8_t)(c1 & 0xFF);
+	out[3] = (uint8_t)(c1 >> 8);
+	out[4] = (uint8_t)(bits & 0xFF);
+	out[5] = (uint8_t)((bits >> 8) & 0xFF);
+	out[6] = (uint8_t)((bits >> 16) & 0xFF);
+	out[7] = (uint8_t)(bits >> 24);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Encodes a BC1 block. The endpoints start at the extremes along the principal
+	axis of the colors, and are refined once with a least squares fit to the
+	chosen palette entries.
+*/
+static void
+EncodeColorBlock(uint8_t const block[16][4], uint8_t out[8])
+{
+	glm::vec3 pixels[16];
+	glm::vec3 mean(0.0f);
+	glm::vec3 minColor(255.0f);
+	glm::vec3 maxColor(0.0f);
+	for (int i = 0; i < 16; i++)
+	{
+		pixels[i] = glm::vec3(block[i][0], block[i][1], block[i][2]);
+		mean += pixels[i];
+		minColor = glm::min(minColor, pixels[i]);
+		maxColor = glm::max(maxColor, pixels[i]);
+	}
+	mean /= 16.0f;
+
+	glm::mat3 covariance(0.0f);
+	for (int i = 0; i < 16; i++)
+	{
+		glm::vec3 const d = pixels[i] - mean;
+		covariance += glm::outerProduct(d, d);
+	}
+
+	// power iteration for the principal axis
+	glm::vec3 axis = maxColor - minColor;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 const next = covariance * axis;
+		float const length = glm::length(next);
+		if (length < 1e-6f)
+			break;
+		axis = next / length;
+	}
+
+	glm::vec3 e0 = maxColor;
+	glm::vec3 e1 = minColor;
+	if (glm::length(axis) > 1e-6f)
+	{
+		axis = glm::normalize(axis);
+		float minProjection = FLT_MAX;
+		float maxProjection = -FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			float const projection = glm::dot(pixels[i] - mean, axis);
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+		e0 = mean + axis * maxProjection;
+		e1 = mean + axis * minProjection;
+	}
+
+	float best = FLT_MAX;
+	uint8_t indices[16] = {};
+	FitColorEndpoints(pixels, e0, e1, out, best, indices);
+
+	// the written endpoints might be swapped, so refit against them
+	uint16_t const c0 = out[0] | (out[1] << 8);
+	uint16_t const c1 = out[2] | (out[3] << 8);
+	if (c0 == c1)
+		return;
+
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	glm::vec3 ax(0.0f), bx(0.0f);
+	for (int i = 0; i < 16; i++)
+	{
+		float const w = weights[indices[i]];
+		aa += w * w;
+		ab += w * (1.0f - w);
+		bb += (1.0f - w) * (1.0f - w);
+		ax += w * pixels[i];
+		bx += (1.0f - w) * pixels[i];
+	}
+	float const det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f)
+		return;
+
+	glm::vec3 const a = (ax * bb - bx * ab) / det;
+	glm::vec3 const b = (bx * aa - ax * ab) / det;
+	FitColorEndpoints(pixels, a, b, out, best, indices);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Encodes a BC4 block, which is also the alpha block of BC3 and each channel
+	of BC5.
+*/
+static void
+EncodeChannelBlock(uint8_t const values[16], uint8_t out[8])
+{
+	uint8_t minValue = 255;
+	uint8_t maxValue = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		minValue = std::min(minValue, values[i]);
+		maxValue = std::max(maxValue, values[i]);
+	}
+
+	out[0] = maxValue;
+	out[1] = minValue;
+	uint64_t bits = 0;
+	if (maxValue != minValue)
+	{
+		// maxValue > minValue selects the eight value mode
+		int palette[8] = { maxValue, minValue };
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int closest = INT_MAX;
+			uint64_t selected = 0;
+			for (int p = 0; p < 8; p++)
+			{
+				int const distance = abs(palette[p] - values[i]);
+				if (distance < closest)
+				{
+					closest = distance;
+					selected = p;
+				}
+			}
+			bits |= selected << (3 * i);
+		}
+	}
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (uint8_t)((bits >> (8 * i)) & 0xFF);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static size_t
+GetBlockSize(Format format)
+{
+	return (format == FORMAT_BC1_RGB_UNORM || format == FORMAT_BC1_RGB_SRGB || format == FORMAT_BC4_UNORM) ? 8 : 16;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static size_t
+GetLevelSize(Format format, uint32_t width, uint32_t height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockSize(format);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Encodes one mip level. Blocks reaching past the edge repeat the last row or column.
+*/
+static void
+EncodeLevel(uint8_t const* rgba, uint32_t width, uint32_t height, Format format, TextureUsage usage, uint8_t* out)
+{
+	uint32_t const blocksX = (width + 3) / 4;
+	uint32_t const blocksY = (height + 3) / 4;
+	size_t const blockSize = GetBlockSize(format);
+
+	for (uint32_t by = 0; by < blocksY; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			uint8_t block[16][4];
+			for (uint32_t y = 0; y < 4; y++)
+			{
+				for (uint32_t x = 0; x < 4; x++)
+				{
+					uint32_t const px = std::min(bx * 4 + x, width - 1);
+					uint32_t const py = std::min(by * 4 + y, height - 1);
+					memcpy(block[y * 4 + x], rgba + ((size_t)py * width + px) * 4, 4);
+				}
+			}
+
+			uint8_t* const dst = out + ((size_t)by * blocksX + bx) * blockSize;
+			uint8_t channel[16];
+			switch (format)
+			{
+			case FORMAT_BC1_RGB_UNORM:
+			case FORMAT_BC1_RGB_SRGB:
+				EncodeColorBlock(block, dst);
+				break;
+			case FORMAT_BC3_UNORM:
+			case FORMAT_BC3_SRGB:
+				for (int i = 0; i < 16; i++)
+					channel[i] = block[i][3];
+				EncodeChannelBlock(channel, dst);
+				EncodeColorBlock(block, dst + 8);
+				break;
+			case FORMAT_BC4_UNORM:
+				for (int i = 0; i < 16; i++)
+					channel[i] = block[i][0];
+				EncodeChannelBlock(channel, dst);
+				break;
+			case FORMAT_BC5_UNORM:
+			{
+				// metallic roughness keeps roughness (g) and metalness (b)
+				int const first = usage == TextureUsage::MetallicRoughness ? 1 : 0;
+				for (int c = 0; c < 2; c++)
+				{
+					for (int i = 0; i < 16; i++)
+						channel[i] = block[i][first + c];
+					EncodeChannelBlock(channel, dst + 8 * c);
+				}
+				break;
+			}
+			default:
+				n_error("Unsupported texture format %u!\n", format);
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Box filters the next mip level. Odd sizes repeat the last row or column.
+*/
+static void
+Downsample(std::vector<glm::vec4> const& src, uint32_t width, uint32_t height, TextureUsage usage, std::vector<glm::vec4>& dst)
+{
+	uint32_t const dstWidth = std::max(1u, width / 2);
+	uint32_t const dstHeight = std::max(1u, height / 2);
+	dst.resize((size_t)dstWidth * dstHeight);
+	for (uint32_t y = 0; y < dstHeight; y++)
+	{
+		uint32_t const y0 = std::min(y * 2, height - 1);
+		uint32_t const y1 = std::min(y * 2 + 1, height - 1);
+		for (uint32_t x = 0; x < dstWidth; x++)
+		{
+			uint32_t const x0 = std::min(x * 2, width - 1);
+			uint32_t const x1 = std::min(x * 2 + 1, width - 1);
+			glm::vec4 sum = src[(size_t)y0 * width + x0] + src[(size_t)y0 * width + x1] + src[(size_t)y1 * width + x0] + src[(size_t)y1 * width + x1];
+			sum *= 0.25f;
+			if (usage == TextureUsage::Normal && glm::length(glm::vec3(sum)) > 1e-6f)
+				sum = glm::vec4(glm::normalize(glm::vec3(sum)), sum.w);
+			dst[(size_t)y * dstWidth + x] = sum;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Mips are filtered in linear space. sRGB colors are converted before
+	filtering, and normals are unpacked and renormalized.
+*/
+void
+Compress(uint8_t const* rgba, uint32_t width, uint32_t height, TextureUsage usage, bool sRGB, CompressedTexture& out)
+{
+	N_PROFILE_SCOPE("TextureCompressor::Compress");
+	size_t const numPixels = (size_t)width * height;
+
+	switch (usage)
+	{
+	case TextureUsage::Color:
+	{
+		bool alpha = false;
+		for (size_t i = 0; i < numPixels && !alpha; i++)
+			alpha = rgba[i * 4 + 3] != 255;
+		if (alpha)
+			out.format = sRGB ? FORMAT_BC3_SRGB : FORMAT_BC3_UNORM;
+		else
+			out.format = sRGB ? FORMAT_BC1_RGB_SRGB : FORMAT_BC1_RGB_UNORM;
+		memcpy(out.swizzle, "rgba", 4);
+		break;
+	}
+	case TextureUsage::Normal:
+		out.format = FORMAT_BC5_UNORM;
+		memcpy(out.swizzle, "rg01", 4);
+		break;
+	case TextureUsage::MetallicRoughness:
+		out.format = FORMAT_BC5_UNORM;
+		memcpy(out.swizzle, "0rg1", 4);
+		break;
+	}
+
+	float srgbToLinear[256];
+	for (int i = 0; i < 256; i++)
+		srgbToLinear[i] = SRGBToLinear(i / 255.0f);
+
+	std::vector<glm::vec4> level(numPixels);
+	for (size_t i = 0; i < numPixels; i++)
+	{
+		uint8_t const* p = rgba + i * 4;
+		glm::vec4 c = glm::vec4(p[0], p[1], p[2], p[3]) / 255.0f;
+		if (usage == TextureUsage::Normal)
+			c = glm::vec4(glm::vec3(c) * 2.0f - 1.0f, c.a);
+		else if (sRGB)
+			c = glm::vec4(srgbToLinear[p[0]], srgbToLinear[p[1]], srgbToLinear[p[2]], c.a);
+		level[i] = c;
+	}
+
+	uint32_t numLevels = 1;
+	while ((width >> numLevels) > 0 || (height >> numLevels) > 0)
+		numLevels++;
+
+	out.levels.clear();
+	out.data.clear();
+	std::vector<uint8_t> pixels(numPixels * 4);
+	std::vector<glm::vec4> next;
+	uint32_t w = width;
+	uint32_t h = height;
+	for (uint32_t l = 0; l < numLevels; l++)
+	{
+		if (l == 0)
+		{
+			memcpy(pixels.data(), rgba, numPixels * 4);
+		}
+		else
+		{
+			for (size_t i = 0; i < (size_t)w * h; i++)
+			{
+				glm::vec4 c = level[i];
+				if (usage == TextureUsage::Normal)
+					c = glm::vec4(glm::vec3(c) * 0.5f + 0.5f, c.a);
+				else if (sRGB)
+					c = glm::vec4(LinearToSRGB(c.r), LinearToSRGB(c.g), LinearToSRGB(c.b), c.a);
+				c = glm::clamp(c, glm::vec4(0.0f), glm::vec4(1.0f));
+				for (int j = 0; j < 4; j++)
+					pixels[i * 4 + j] = (uint8_t)(c[j] * 255.0f + 0.5f);
+			}
+		}
+
+		CompressedTexture::Level info;
+		info.offset = out.data.size();
+		info.size = GetLevelSize(out.format, w, h);
+		info.width = w;
+		info.height = h;
+		out.levels.push_back(info);
+		out.data.resize(info.offset + info.size);
+		EncodeLevel(pixels.data(), w, h, out.format, usage, out.data.data() + info.offset);
+
+		if (l + 1 < numLevels)
+		{
+			Downsample(level, w, h, usage, next);
+			level.swap(next);
+			w = std::max(1u, w / 2);
+			h = std::max(1u, h / 2);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+CompressImage(uint8_t const* encoded, size_t bytes, TextureUsage usage, bool sRGB, CompressedTexture& out)
+{
+	int width, height, channels;
+	uint8_t* const pixels = stbi_load_from_memory(encoded, (int)bytes, &width, &height, &channels, 4);
+	if (pixels == nullptr)
+		return false;
+
+	Compress(pixels, (uint32_t)width, (uint32_t)height, usage, sRGB, out);
+	stbi_image_free(pixels);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+Append32(std::vector<uint8_t>& out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+Append64(std::vector<uint8_t>& out, uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+		out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static uint32_t
+Read32(uint8_t const* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static uint64_t
+Read64(uint8_t const* p)
+{
+	return Read32(p) | ((uint64_t)Read32(p + 4) << 32);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Builds the basic data format descriptor of a block compressed format.
+*/
+static void
+AppendDataFormatDescriptor(std::vector<uint8_t>& out, Format format)
+{
+	// color model, and the channel of each 64 bit sample
+	uint32_t model;
+	std::vector<uint32_t> channels;
+	bool srgb = false;
+	switch (format)
+	{
+	case FORMAT_BC1_RGB_SRGB: srgb = true; // fall through
+	case FORMAT_BC1_RGB_UNORM: model = 128; channels = { 0 }; break;
+	case FORMAT_BC3_SRGB: srgb = true; // fall through
+	case FORMAT_BC3_UNORM: model = 130; channels = { 15, 0 }; break;
+	case FORMAT_BC4_UNORM: model = 131; channels = { 0 }; break;
+	default: model = 132; channels = { 0, 1 }; break;
+	}
+
+	uint32_t const blockSize = 24 + 16 * (uint32_t)channels.size();
+	Append32(out, 4 + blockSize);
+	// vendor and descriptor type
+	Append32(out, 0);
+	// version and size
+	Append32(out, 2 | (blockSize << 16));
+	// model, BT.709 primaries, transfer function and flags
+	Append32(out, model | (1 << 8) | ((srgb ? 2 : 1) << 16));
+	// 4x4 texel blocks
+	Append32(out, 3 | (3 << 8));
+	// bytes per block
+	Append32(out, (uint32_t)GetBlockSize(format));
+	Append32(out, 0);
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		Append32(out, (uint32_t)(i * 64) | (63 << 16) | (channels[i] << 24));
+		Append32(out, 0);
+		Append32(out, 0);
+		Append32(out, UINT32_MAX);
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+AppendKeyValue(std::vector<uint8_t>& out, const char* key, const char* value)
+{
+	size_t const keyLength = strlen(key) + 1;
+	size_t const valueLength = strlen(value) + 1;
+	Append32(out, (uint32_t)(keyLength + valueLength));
+	out.insert(out.end(), key, key + keyLength);
+	out.insert(out.end(), value, value + valueLength);
+	while (out.size() % 4 != 0)
+		out.push_back(0);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Writes to a temporary file first, so readers never see a partial file.
+*/
+bool
+WriteKtx2(std::string const& path, CompressedTexture const& texture)
+{
+	N_PROFILE_SCOPE("TextureCompressor::WriteKtx2");
+	uint32_t const numLevels = (uint32_t)texture.levels.size();
+
+	std::vector<uint8_t> dfd;
+	AppendDataFormatDescriptor(dfd, texture.format);
+	std::vector<uint8_t> kvd;
+	std::string const swizzle(texture.swizzle, 4);
+	if (swizzle != "rgba")
+		AppendKeyValue(kvd, "KTXswizzle", swizzle.c_str());
+	AppendKeyValue(kvd, "KTXwriter", "S0012E texture cook");
+
+	size_t const dfdOffset = KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * numLevels;
+	size_t const kvdOffset = dfdOffset + dfd.size();
+	// levels are aligned to the block size, and stored smallest first
+	size_t offset = (kvdOffset + kvd.size() + 15) & ~(size_t)15;
+	std::vector<size_t> levelOffsets(numLevels);
+	for (uint32_t l = numLevels; l-- > 0;)
+	{
+		levelOffsets[l] = offset;
+		offset += texture.levels[l].size;
+	}
+
+	std::vector<uint8_t> file;
+	file.reserve(offset);
+	file.insert(file.end(), KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+	Append32(file, texture.format);
+	// type size
+	Append32(file, 1);
+	Append32(file, texture.levels[0].width);
+	Append32(file, texture.levels[0].height);
+	// depth, layers and faces
+	Append32(file, 0);
+	Append32(file, 0);
+	Append32(file, 1);
+	Append32(file, numLevels);
+	// no supercompression
+	Append32(file, 0);
+	Append32(file, (uint32_t)dfdOffset);
+	Append32(file, (uint32_t)dfd.size());
+	Append32(file, (uint32_t)kvdOffset);
+	Append32(file, (uint32_t)kvd.size());
+	Append64(file, 0);
+	Append64(file, 0);
+	for (uint32_t l = 0; l < numLevels; l++)
+	{
+		Append64(file, levelOffsets[l]);
+		Append64(file, texture.levels[l].size);
+		Append64(file, texture.levels[l].size);
+	}
+	file.insert(file.end(), dfd.begin(), dfd.end());
+	file.insert(file.end(), kvd.begin(), kvd.end());
+	for (uint32_t l = numLevels; l-- > 0;)
+	{
+		file.resize(levelOffsets[l], 0);
+		uint8_t const* level = texture.data.data() + texture.levels[l].offset;
+		file.insert(file.end(), level, level + texture.levels[l].size);
+	}
+
+	std::error_code error;
+	std::filesystem::path const target(path);
+	if (target.has_parent_path())
+		std::filesystem::create_directories(target.parent_path(), error);
+
+	std::string const temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream stream(temporary, std::ios::binary);
+		if (!stream.write((char const*)file.data(), file.size()))
+			return false;
+	}
+	std::filesystem::rename(temporary, target, error);
+	if (error)
+	{
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+ReadKtx2(std::string const& path, CompressedTexture& out)
+{
+	N_PROFILE_SCOPE("TextureCompressor::ReadKtx2");
+	std::ifstream stream(path, std::ios::binary | std::ios::ate);
+	if (!stream)
+		return false;
+
+	std::vector<uint8_t> file((size_t)stream.tellg());
+	stream.seekg(0);
+	if (!stream.read((char*)file.data(), file.size()) || file.size() < KTX2_HEADER_SIZE)
+		return false;
+	if (memcmp(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+		return false;
+
+	uint8_t const* header = file.data() + sizeof(KTX2_IDENTIFIER);
+	Format const format = (Format)Read32(header);
+	uint32_t const width = Read32(header + 8);
+	uint32_t const height = Read32(header + 12);
+	uint32_t const depth = Read32(header + 16);
+	uint32_t const layers = Read32(header + 20);
+	uint32_t const faces = Read32(header + 24);
+	uint32_t const numLevels = Read32(header + 28);
+	uint32_t const supercompression = Read32(header + 32);
+	uint32_t const kvdOffset = Read32(header + 44);
+	uint32_t const kvdLength = Read32(header + 48);
+
+	switch (format)
+	{
+	case FORMAT_BC1_RGB_UNORM:
+	case FORMAT_BC1_RGB_SRGB:
+	case FORMAT_BC3_UNORM:
+	case FORMAT_BC3_SRGB:
+	case FORMAT_BC4_UNORM:
+	case FORMAT_BC5_UNORM:
+		break;
+	default:
+		return false;
+	}
+	if (width == 0 || height == 0 || depth != 0 || layers > 1 || faces != 1 || numLevels == 0 || supercompression != 0)
+		return false;
+	if (file.size() < KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * (size_t)numLevels || (size_t)kvdOffset + kvdLength > file.size())
+		return false;
+
+	out.format = format;
+	memcpy(out.swizzle, "rgba", 4);
+	out.levels.clear();
+	out.data.clear();
+
+	// the only key we care about is the swizzle
+	size_t kv = kvdOffset;
+	while (kv + 4 <= (size_t)kvdOffset + kvdLength)
+	{
+		uint32_t const length = Read32(file.data() + kv);
+		if (kv + 4 + length > (size_t)kvdOffset + kvdLength)
+			return false;
+		char const* entry = (char const*)file.data() + kv + 4;
+		if (length >= 16 && memcmp(entry, "KTXswizzle", 11) == 0)
+			memcpy(out.swizzle, entry + 11, 4);
+		kv += (4 + length + 3) & ~(size_t)3;
+	}
+
+	uint8_t const* index = file.data() + KTX2_HEADER_SIZE;
+	for (uint32_t l = 0; l < numLevels; l++)
+	{
+		uint64_t const offset = Read64(index + KTX2_LEVEL_INDEX_SIZE * l);
+		uint64_t const size = Read64(index + KTX2_LEVEL_INDEX_SIZE * l + 8);
+
+		CompressedTexture::Level level;
+		level.width = std::max(1u, width >> l);
+		level.height = std::max(1u, height >> l);
+		level.offset = out.data.size();
+		level.size = GetLevelSize(format, level.width, level.height);
+		if (size != level.size || offset + size > file.size())
+			return false;
+
+		out.levels.push_back(level);
+		out.data.insert(out.data.end(), file.data() + offset, file.data() + offset + size);
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint64_t
+Hash(void const* data, size_t bytes)
+{
+	return Core::Hash64(data, bytes);
+}
+
+//------------------------------------------------------------------------------
+/**
+	The usage, color space and encoder version are part of the key, since they
+	change the output for the same source image.
+*/
+std::string
+GetCachePath(uint64_t sourceHash, TextureUsage usage, bool sRGB)
+{
+	uint8_t const key[] = { (uint8_t)usage, (uint8_t)sRGB, (uint8_t)ENCODER_VERSION };
+	uint64_t const hash = sourceHash ^ Hash(key, sizeof(key));
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ktx2", (unsigned long long)hash);
+	return std::string(CACHE_DIRECTORY) + "/" + name;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+LoadCached(uint8_t const* encoded, size_t bytes, TextureUsage usage, bool sRGB, bool cook, CompressedTexture& out)
+{
+	N_PROFILE_SCOPE("TextureCompressor::LoadCached");
+	std::string const path = GetCachePath(Hash(encoded, bytes), usage, sRGB);
+	if (ReadKtx2(path, out))
+		return true;
+	if (!cook || !CompressImage(encoded, bytes, usage, sRGB, out))
+		return false;
+
+	if (!WriteKtx2(path, out))
+		n_warning("Could not write '%s' to the texture cache!\n", path.c_str());
+	return true;
+}
+
+} // namespace TextureCompressor
+} // namespace Render
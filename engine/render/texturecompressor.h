@@ -0,0 +1,92 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file texturecompressor.h
+
+	Block compression of textures and the KTX2 texture cache.
+
+	Textures are cooked by compressing them to BCn with precomputed mips and
+	writing them to a KTX2 file in the texture cache. The file name is derived
+	from a hash of the encoded source image, so a changed image simply misses
+	the cache. Nothing in here touches GL, so textures can be cooked without a
+	window or context.
+
+	Color textures are stored as BC1, or BC3 if they use alpha. Normal maps are
+	stored as BC5 with only x and y, and z is reconstructed in the shader.
+	Metallic roughness textures keep roughness and metalness in a BC5 texture
+	and swizzle them back into g and b when sampled.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace Render
+{
+
+/// what a texture is used for, which decides how it is compressed
+enum class TextureUsage : uint8_t
+{
+	Color,
+	Normal,
+	MetallicRoughness
+};
+
+namespace TextureCompressor
+{
+
+/// Vulkan format enums, as used by KTX2
+enum Format : uint32_t
+{
+	FORMAT_UNDEFINED = 0,
+	FORMAT_BC1_RGB_UNORM = 131,
+	FORMAT_BC1_RGB_SRGB = 132,
+	FORMAT_BC3_UNORM = 137,
+	FORMAT_BC3_SRGB = 138,
+	FORMAT_BC4_UNORM = 139,
+	FORMAT_BC5_UNORM = 141
+};
+
+struct CompressedTexture
+{
+	struct Level
+	{
+		size_t offset;
+		size_t size;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	Format format = FORMAT_UNDEFINED;
+	/// KTXswizzle of the texture, rgba if nothing is swizzled
+	char swizzle[4] = { 'r', 'g', 'b', 'a' };
+	/// mip levels, largest first
+	std::vector<Level> levels;
+	/// block data of all levels
+	std::vector<uint8_t> data;
+};
+
+/// compress rgba8 pixels, including a full mip chain
+void Compress(uint8_t const* rgba, uint32_t width, uint32_t height, TextureUsage usage, bool sRGB, CompressedTexture& out);
+/// decode an encoded image file and compress it. Returns false if the image could not be decoded.
+bool CompressImage(uint8_t const* encoded, size_t bytes, TextureUsage usage, bool sRGB, CompressedTexture& out);
+
+/// write a texture to a KTX2 file
+bool WriteKtx2(std::string const& path, CompressedTexture const& texture);
+/// read a KTX2 file written by WriteKtx2. Returns false if the file is missing or in a format that is not supported.
+bool ReadKtx2(std::string const& path, CompressedTexture& out);
+
+/// hash encoded image data
+uint64_t Hash(void const* data, size_t bytes);
+/// path of the cached KTX2 file for an encoded image
+std::string GetCachePath(uint64_t sourceHash, TextureUsage usage, bool sRGB);
+
+/// load a texture from the cache. If cook is set, textures missing from the cache are compressed and written to it.
+bool LoadCached(uint8_t const* encoded, size_t bytes, TextureUsage usage, bool sRGB, bool cook, CompressedTexture& out);
+
+} // namespace TextureCompressor
+
+} // namespace Render
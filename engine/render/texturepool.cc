@@ -0,0 +1,209 @@
+//------------------------------------------------------------------------------
+//  @file texturepool.cc
+//  @copyright (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "texturepool.h"
+#include <algorithm>
+
+namespace Render
+{
+
+// chunks are sized to hold about this much, within the layer limits below
+static const size_t CHUNK_BYTES = 32 * 1024 * 1024;
+static const GLsizei MAX_CHUNK_LAYERS = 64;
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+TexturePool::Format::operator==(Format const& rhs) const
+{
+	return this->internalFormat == rhs.internalFormat &&
+		this->width == rhs.width &&
+		this->height == rhs.height &&
+		this->minFilter == rhs.minFilter &&
+		this->magFilter == rhs.magFilter &&
+		this->wrapS == rhs.wrapS &&
+		this->wrapT == rhs.wrapT &&
+		std::equal(this->swizzle, this->swizzle + 4, rhs.swizzle);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TexturePool::~TexturePool()
+{
+	this->Clear();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TextureLayer
+TexturePool::Allocate(Format const& format)
+{
+	for (Chunk& chunk : this->chunks)
+	{
+		if (!chunk.freeLayers.empty() && chunk.format == format)
+		{
+			TextureLayer layer;
+			layer.array = chunk.array;
+			layer.layer = chunk.freeLayers.back();
+			chunk.freeLayers.pop_back();
+			return layer;
+		}
+	}
+
+	GLint maxLayers;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+	Chunk chunk;
+	chunk.format = format;
+	chunk.numLayers = (GLsizei)std::clamp(CHUNK_BYTES / GetLayerBytes(format), (size_t)1, (size_t)std::min(MAX_CHUNK_LAYERS, maxLayers));
+	glGenTextures(1, &chunk.array);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, chunk.array);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, GetNumMips(format.width, format.height), format.internalFormat, format.width, format.height, chunk.numLayers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, format.minFilter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, format.magFilter);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, format.wrapS);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, format.wrapT);
+	glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// hand out the lowest layers first
+	for (GLint i = chunk.numLayers - 1; i > 0; i--)
+		chunk.freeLayers.push_back(i);
+	this->chunks.push_back(chunk);
+
+	TextureLayer layer;
+	layer.array = chunk.array;
+	layer.layer = 0;
+	return layer;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TexturePool::Free(TextureLayer const& layer)
+{
+	Chunk* const chunk = this->FindChunk(layer.array);
+	n_assert(chunk != nullptr);
+	chunk->freeLayers.push_back(layer.layer);
+	if ((GLsizei)chunk->freeLayers.size() == chunk->numLayers)
+	{
+		glDeleteTextures(1, &chunk->array);
+		*chunk = this->chunks.back();
+		this->chunks.pop_back();
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TexturePool::Format const&
+TexturePool::GetFormat(TextureLayer const& layer) const
+{
+	Chunk const* const chunk = const_cast<TexturePool*>(this)->FindChunk(layer.array);
+	n_assert(chunk != nullptr);
+	return chunk->format;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+TexturePool::Clear()
+{
+	for (Chunk const& chunk : this->chunks)
+		glDeleteTextures(1, &chunk.array);
+	this->chunks.clear();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+TexturePool::GetAllocatedBytes() const
+{
+	size_t bytes = 0;
+	for (Chunk const& chunk : this->chunks)
+		bytes += GetLayerBytes(chunk.format) * chunk.numLayers;
+	return bytes;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t
+TexturePool::GetNumArrays() const
+{
+	return (uint32_t)this->chunks.size();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+GLsizei
+TexturePool::GetNumMips(GLsizei width, GLsizei height)
+{
+	GLsizei numMips = 1;
+	while ((width >> numMips) > 0 || (height >> numMips) > 0)
+		numMips++;
+	return numMips;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+size_t
+TexturePool::GetLayerBytes(Format const& format)
+{
+	// bytes per 4x4 block for the compressed formats, per texel otherwise
+	size_t blockBytes = 0;
+	size_t texelBytes = 4;
+	switch (format.internalFormat)
+	{
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RED_RGTC1:
+		blockBytes = 8;
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_RG_RGTC2:
+		blockBytes = 16;
+		break;
+	case GL_RGB8:
+	case GL_SRGB8:
+		texelBytes = 3;
+		break;
+	}
+
+	size_t bytes = 0;
+	GLsizei const numMips = GetNumMips(format.width, format.height);
+	for (GLsizei l = 0; l < numMips; l++)
+	{
+		size_t const width = (size_t)std::max(1, format.width >> l);
+		size_t const height = (size_t)std::max(1, format.height >> l);
+		bytes += blockBytes > 0 ? ((width + 3) / 4) * ((height + 3) / 4) * blockBytes : width * height * texelBytes;
+	}
+	return bytes;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TexturePool::Chunk*
+TexturePool::FindChunk(GLuint array)
+{
+	for (Chunk& chunk : this->chunks)
+	{
+		if (chunk.array == array)
+			return &chunk;
+	}
+	return nullptr;
+}
+
+} // namespace Render
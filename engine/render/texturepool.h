@@ -0,0 +1,94 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file texturepool.h
+
+	Pools of 2D array textures for material textures.
+
+	Textures with the same format, size and sampler state share an array
+	texture, and a material texture is an array and a layer in it. Draws with
+	different materials can then run without binding textures, as long as their
+	textures live in the same arrays.
+
+	Arrays are allocated in chunks with a fixed number of layers, since growing
+	an array would change its handle under the frames in flight. A chunk is
+	deleted as soon as its last layer is freed.
+
+	Only use the pool from the thread owning the GL context.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include "GL/glew.h"
+#include <vector>
+
+namespace Render
+{
+
+/// a layer in a texture array
+struct TextureLayer
+{
+	// zero if there is no texture
+	GLuint array = 0;
+	GLint layer = 0;
+};
+
+class TexturePool
+{
+public:
+	/// everything that has to match for textures to share an array
+	struct Format
+	{
+		// sized or compressed internal format
+		GLenum internalFormat = GL_RGBA8;
+		GLsizei width = 1;
+		GLsizei height = 1;
+		GLenum minFilter = GL_LINEAR;
+		GLenum magFilter = GL_LINEAR;
+		GLenum wrapS = GL_REPEAT;
+		GLenum wrapT = GL_REPEAT;
+		GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+
+		bool operator==(Format const& rhs) const;
+	};
+
+	TexturePool() = default;
+	~TexturePool();
+	TexturePool(TexturePool const&) = delete;
+	void operator=(TexturePool const&) = delete;
+
+	/// allocate a layer with a full mip chain. The contents are undefined.
+	TextureLayer Allocate(Format const& format);
+	/// free a layer. The caller has to make sure no frame in flight still samples it.
+	void Free(TextureLayer const& layer);
+	/// get the format of the array a layer belongs to
+	Format const& GetFormat(TextureLayer const& layer) const;
+	/// delete all arrays
+	void Clear();
+
+	/// memory of all arrays, including free layers
+	size_t GetAllocatedBytes() const;
+	/// number of arrays
+	uint32_t GetNumArrays() const;
+
+	/// number of mips of a full chain
+	static GLsizei GetNumMips(GLsizei width, GLsizei height);
+	/// memory of one layer with all mips
+	static size_t GetLayerBytes(Format const& format);
+
+private:
+	struct Chunk
+	{
+		Format format;
+		GLuint array;
+		GLsizei numLayers;
+		std::vector<GLint> freeLayers;
+	};
+
+	Chunk* FindChunk(GLuint array);
+
+	std::vector<Chunk> chunks;
+};
+
+} // namespace Render
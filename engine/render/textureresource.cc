@@ -5,6 +5,13 @@
 #include "config.h"
 #include "textureresource.h"
 #include <cstring>
+#include <memory>
+#include <fstream>
+#include "core/profiler.h"
+#include "core/jobsystem.h"
+#include "core/cvar.h"
+#include "core/hash.h"
+#include "renderthread.h"
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
@@ -15,23 +22,147 @@ namespace Render
 {
 
 TextureResource* TextureResource::instance = nullptr;
+static Core::CVar* r_texture_upload_budget = nullptr;
+static Core::CVar* r_texture_compression = nullptr;
+static Core::CVar* r_texture_budget = nullptr;
+static Core::CVar* r_texture_evict_delay = nullptr;
+
+// textures are not reduced below this size, they are evicted instead
+static const uint32_t MIN_REDUCED_SIZE = 64;
+// frames until a replaced texture is deleted, so no frame in flight draws with it
+static const int RETIRE_FRAMES = RenderThread::NUM_PACKETS + 1;
+
+//------------------------------------------------------------------------------
+/**
+    Estimated memory of an uncompressed texture with a full mip chain.
+*/
+static size_t
+GetTextureBytes(int width, int height, int channels)
+{
+    return (size_t)width * height * channels * 4 / 3;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static bool
+ReadFile(const char* path, std::vector<uint8_t>& out)
+{
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream)
+        return false;
+    out.resize((size_t)stream.tellg());
+    stream.seekg(0);
+    return (bool)stream.read((char*)out.data(), out.size());
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static GLenum
+GetCompressedFormat(TextureCompressor::Format format)
+{
+    switch (format)
+    {
+    case TextureCompressor::FORMAT_BC1_RGB_UNORM: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureCompressor::FORMAT_BC1_RGB_SRGB: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+    case TextureCompressor::FORMAT_BC3_UNORM: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TextureCompressor::FORMAT_BC3_SRGB: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+    case TextureCompressor::FORMAT_BC4_UNORM: return GL_COMPRESSED_RED_RGTC1;
+    case TextureCompressor::FORMAT_BC5_UNORM: return GL_COMPRESSED_RG_RGTC2;
+    default: n_error("Unsupported compressed texture format %u!\n", format); return GL_NONE;
+    }
+}
+
+//------------------------------------------------------------------------------
+/**
+    Format of the pool a texture with the given size and sampler state goes into.
+*/
+static TexturePool::Format
+GetPoolFormat(GLenum internalFormat, uint32_t width, uint32_t height, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT)
+{
+    TexturePool::Format format;
+    format.internalFormat = internalFormat;
+    format.width = (GLsizei)width;
+    format.height = (GLsizei)height;
+    format.minFilter = (GLenum)min;
+    format.magFilter = (GLenum)mag;
+    format.wrapS = (GLenum)wrapModeS;
+    format.wrapT = (GLenum)wrapModeT;
+    return format;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static TexturePool::Format
+GetPoolFormat(TextureCompressor::CompressedTexture const& texture, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT)
+{
+    TexturePool::Format format = GetPoolFormat(GetCompressedFormat(texture.format), texture.levels[0].width, texture.levels[0].height, mag, min, wrapModeS, wrapModeT);
+    for (int i = 0; i < 4; i++)
+    {
+        switch (texture.swizzle[i])
+        {
+        case 'r': format.swizzle[i] = GL_RED; break;
+        case 'g': format.swizzle[i] = GL_GREEN; break;
+        case 'b': format.swizzle[i] = GL_BLUE; break;
+        case 'a': format.swizzle[i] = GL_ALPHA; break;
+        case '0': format.swizzle[i] = GL_ZERO; break;
+        default: format.swizzle[i] = GL_ONE; break;
+        }
+    }
+    return format;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Uploads all mips of a block compressed texture to a pool layer. base points
+    to the block data, or is an offset into the bound pixel unpack buffer.
+*/
+static void
+CompressedTexSubImage(TextureCompressor::CompressedTexture const& texture, unsigned char const* base, TextureLayer const& layer)
+{
+    GLenum const format = GetCompressedFormat(texture.format);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, layer.array);
+    for (size_t l = 0; l < texture.levels.size(); l++)
+    {
+        TextureCompressor::CompressedTexture::Level const& level = texture.levels[l];
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, 0, 0, layer.layer, level.width, level.height, 1, format, (GLsizei)level.size, base + level.offset);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+//------------------------------------------------------------------------------
+/**
+    Copies all mips of a 2D texture into a new pool layer and deletes the
+    texture. Uncompressed textures are uploaded to a 2D texture first, so the
+    driver can generate their mips.
+*/
+TextureLayer TextureResource::MoveToPool(GLuint texture, TexturePool::Format const& format)
+{
+    TextureLayer const layer = Instance()->pool.Allocate(format);
+    GLsizei const numMips = TexturePool::GetNumMips(format.width, format.height);
+    for (GLsizei l = 0; l < numMips; l++)
+    {
+        glCopyImageSubData(texture, GL_TEXTURE_2D, l, 0, 0, 0,
+                           layer.array, GL_TEXTURE_2D_ARRAY, l, 0, 0, layer.layer,
+                           std::max(1, format.width >> l), std::max(1, format.height >> l), 1);
+    }
+    glDeleteTextures(1, &texture);
+    return layer;
+}
 
 void TextureResource::Create()
 {
     assert(TextureResource::instance == nullptr);
     TextureResource::instance = new TextureResource();
     
-    // setup default textures
-    ImageCreateInfo info;
-    info.extents = { 1,1 };
-    info.type = Render::ImageType::TEXTURE_2D;
-    ImageId imageIds[4] =
-    {
-        AllocateImage(info),
-        AllocateImage(info),
-        AllocateImage(info),
-        AllocateImage(info)
-    };
+    // setup default textures, which share one array
+    TexturePool::Format format;
+    format.internalFormat = GL_RGBA8;
+    format.minFilter = GL_NEAREST;
+    format.magFilter = GL_NEAREST;
+    ImageId imageIds[4];
 
     byte colors[4][4] = {
         {255,255,255,255}, // white texture
@@ -42,34 +173,79 @@ void TextureResource::Create()
 
     for (int i = 0; i < 4; i++)
     {
-        Image& image = instance->images[imageIds[i]];
+        Image image;
+        image.handle = 0;
+        image.layer = instance->pool.Allocate(format);
+        image.extent = { 1, 1 };
+        image.type = ImageType::TEXTURE_2D;
+        imageIds[i] = AddImage(image);
 
-        glBindTexture(GL_TEXTURE_2D, image.handle);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        void* buffer = (void*)colors[i];
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.extent.w, image.extent.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, image.layer.array);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, image.layer.layer, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, colors[i]);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
     instance->whiteTexture = imageIds[0];
     instance->blackTexture = imageIds[1];
     instance->defaultMetallicRoughnessTexture = imageIds[2];
     instance->defaultNormalTexture = imageIds[3];
+
+    r_texture_upload_budget = Core::CVarCreate(Core::CVarType::CVar_Int, "r_texture_upload_budget", "16", "Megabytes of streamed texture data to upload per frame");
+    r_texture_budget = Core::CVarCreate(Core::CVarType::CVar_Int, "r_texture_budget", "1024", "Megabytes of texture memory before unused streamed textures are reduced or evicted");
+    r_texture_evict_delay = Core::CVarCreate(Core::CVarType::CVar_Int, "r_texture_evict_delay", "120", "Frames a streamed texture has to be unused before it can be reduced or evicted");
+    r_texture_compression = Core::CVarCreate(Core::CVarType::CVar_Int, "r_texture_compression", "1", "Block compressed textures. 0 = off, 1 = load from the texture cache, 2 = also compress textures missing from the cache");
 }
 
 void TextureResource::Destroy()
 {
     assert(TextureResource::instance != nullptr);
-    // TODO: Resource cleanup
+    Core::JobSystem::WaitForJobs();
+    for (StreamingTexture& texture : instance->decoded)
+    {
+        stbi_image_free(texture.pixels);
+        delete texture.compressed;
+    }
+    // material textures all live in the pool, the rest have their own handle
+    instance->pool.Clear();
+    for (Image const& image : instance->images)
+    {
+        if (image.handle != 0)
+            glDeleteTextures(1, &image.handle);
+    }
+    for (UploadBuffer& buffer : instance->uploadBuffers)
+    {
+        if (buffer.fence != nullptr)
+            glDeleteSync(buffer.fence);
+        glDeleteBuffers(1, &buffer.buffer);
+    }
     delete TextureResource::instance;
+    TextureResource::instance = nullptr;
 }
 
-TextureResourceId TextureResource::LoadTexture(const char * path, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB = false)
+TextureResourceId TextureResource::LoadTexture(const char * path, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB = false, TextureUsage usage)
 {
+    N_PROFILE_SCOPE("TextureResource::LoadTexture");
+    int const compression = Core::CVarReadInt(r_texture_compression);
+    if (compression > 0)
+    {
+        std::vector<uint8_t> file;
+        TextureCompressor::CompressedTexture compressed;
+        if (ReadFile(path, file) && TextureCompressor::LoadCached(file.data(), file.size(), usage, sRGB, compression > 1, compressed))
+        {
+            Image img;
+            img.handle = 0;
+            img.layer = Instance()->pool.Allocate(GetPoolFormat(compressed, mag, min, wrapModeS, wrapModeT));
+            img.extent = { compressed.levels[0].width, compressed.levels[0].height };
+            img.type = ImageType::TEXTURE_2D;
+            img.bytes = compressed.data.size();
+            CompressedTexSubImage(compressed, compressed.data.data(), img.layer);
+
+            ImageId const iid = AddImage(img);
+            Instance()->imageRegistry.emplace(path, iid);
+            return iid;
+        }
+    }
+
     int w, h, n; //Width, Height, components per pixel (ex. RGB = 3, RGBA = 4)
     unsigned char *image = stbi_load(path, &w, &h, &n, STBI_default);
 
@@ -90,13 +266,14 @@ TextureResourceId TextureResource::LoadTexture(const char * path, MagFilter mag,
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     // If there's no alpha channel, use RGB colors. else: use RGBA.
+    GLenum const internalFormat = n == 3 ? (sRGB ? GL_SRGB8 : GL_RGB8) : (sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8);
     if (n == 3)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, sRGB ? GL_SRGB : GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
     }
     else if (n == 4)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, sRGB ? GL_SRGB_ALPHA : GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
     }
 
     glGenerateMipmap(GL_TEXTURE_2D);
@@ -104,21 +281,40 @@ TextureResourceId TextureResource::LoadTexture(const char * path, MagFilter mag,
     stbi_image_free(image);
 
     Image img;
-    img.handle = handle;
+    img.handle = 0;
+    img.layer = MoveToPool(handle, GetPoolFormat(internalFormat, w, h, mag, min, wrapModeS, wrapModeT));
     img.extent = { (unsigned)w, (unsigned)h };
     img.type = ImageType::TEXTURE_2D;
+    img.bytes = GetTextureBytes(w, h, n);
 
-    ImageId iid = (ImageId)Instance()->images.size();
-    Instance()->images.push_back(img);
+    ImageId iid = AddImage(img);
     Instance()->imageRegistry.emplace(path, iid);
     return iid;
 }
 
-TextureResourceId TextureResource::LoadTextureFromMemory(std::string name, void* buffer, uint64_t bytes, ImageId imageId, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB = false)
+TextureResourceId TextureResource::LoadTextureFromMemory(std::string name, void* buffer, uint64_t bytes, ImageId imageId, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB = false, TextureUsage usage)
 {
+    N_PROFILE_SCOPE("TextureResource::LoadTextureFromMemory");
 	assert(Instance()->imageRegistry.count(name) == 0);
     int channels;
     Image& image = Instance()->images[imageId];
+
+    int const compression = Core::CVarReadInt(r_texture_compression);
+    TextureCompressor::CompressedTexture compressed;
+    if (compression > 0 && TextureCompressor::LoadCached((uint8_t const*)buffer, bytes, usage, sRGB, compression > 1, compressed))
+    {
+        // the texture goes into the pool instead of the allocated handle
+        glDeleteTextures(1, &image.handle);
+        image.handle = 0;
+        image.layer = Instance()->pool.Allocate(GetPoolFormat(compressed, mag, min, wrapModeS, wrapModeT));
+        image.extent = { compressed.levels[0].width, compressed.levels[0].height };
+        image.bytes = compressed.data.size();
+        Instance()->residentBytes += image.bytes;
+        CompressedTexSubImage(compressed, compressed.data.data(), image.layer);
+        Instance()->imageRegistry.emplace(name, imageId);
+        return imageId;
+    }
+
     void* decompressed = stbi_load_from_memory((uchar*)buffer, (int)bytes, (int*)&image.extent.w, (int*)&image.extent.h, (int*)&channels, 0);
     glBindTexture(GL_TEXTURE_2D, image.handle);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (GLenum)min);
@@ -129,39 +325,62 @@ TextureResourceId TextureResource::LoadTextureFromMemory(std::string name, void*
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     // If there's no alpha channel, use RGB colors. else: use RGBA.
+    GLenum const internalFormat = channels == 3 ? (sRGB ? GL_SRGB8 : GL_RGB8) : (sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8);
     if (channels == 3)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, sRGB ? GL_SRGB : GL_RGB, image.extent.w, image.extent.h, 0, GL_RGB, GL_UNSIGNED_BYTE, decompressed);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.extent.w, image.extent.h, 0, GL_RGB, GL_UNSIGNED_BYTE, decompressed);
     }
     else if (channels == 4)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, sRGB ? GL_SRGB_ALPHA : GL_RGBA, image.extent.w, image.extent.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, decompressed);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.extent.w, image.extent.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, decompressed);
     }
 
     stbi_image_free(decompressed);
     glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0);
+    image.layer = MoveToPool(image.handle, GetPoolFormat(internalFormat, image.extent.w, image.extent.h, mag, min, wrapModeS, wrapModeT));
+    image.handle = 0;
+    image.bytes = GetTextureBytes(image.extent.w, image.extent.h, channels);
+    Instance()->residentBytes += image.bytes;
     Instance()->imageRegistry.emplace(name, imageId);
     return imageId;
 }
 
+//------------------------------------------------------------------------------
+/**
+    Faces are decoded once per distinct file contents, since skyboxes often
+    use the same image for several faces.
+*/
 TextureResourceId TextureResource::LoadCubemap(std::string const& name, std::vector<const char*> const& paths, bool sRGB = false)
 {
+    N_PROFILE_SCOPE("TextureResource::LoadCubemap");
+    TextureResourceId const existing = AcquireTexture(name);
+    if (existing != InvalidResourceId)
+        return existing;
+
     GLuint handle;
     glGenTextures(1, &handle);
     glBindTexture(GL_TEXTURE_CUBE_MAP, handle);
 
+    // decoded faces by content hash
+    std::unordered_map<uint64_t, unsigned char*> decoded;
     int w, h, nrChannels;
     for (unsigned int i = 0; i < paths.size(); i++)
     {
-        unsigned char* data = stbi_load(paths[i], &w, &h, &nrChannels, 0);
+        std::vector<uint8_t> file;
+        ReadFile(paths[i], file);
+
+        unsigned char*& data = decoded[Core::Hash64(file.data(), file.size())];
+        if (data == nullptr)
+            data = stbi_load_from_memory(file.data(), (int)file.size(), &w, &h, &nrChannels, 3);
         assert(data);
         
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
             0, sRGB ? GL_SRGB : GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data
         );
-        stbi_image_free(data);
     }
+    for (auto const& face : decoded)
+        stbi_image_free(face.second);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -172,13 +391,569 @@ TextureResourceId TextureResource::LoadCubemap(std::string const& name, std::vec
     img.handle = handle;
     img.extent = { (unsigned)w, (unsigned)h };
     img.type = ImageType::TEXTURE_2D;
+    img.bytes = (size_t)w * h * 3 * paths.size();
+
+    ImageId iid = AddImage(img);
+    Instance()->imageRegistry.emplace(name, iid);
+    return iid;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Adds an image that shows the placeholder until streaming is done.
+*/
+TextureResourceId TextureResource::AllocateStreamingImage(std::string const& name, std::shared_ptr<TextureSource> const& source)
+{
+    Image const& placeholderImage = Instance()->images[source->placeholder];
+    Image img;
+    img.handle = 0;
+    img.layer = placeholderImage.layer;
+    img.extent = placeholderImage.extent;
+    img.type = ImageType::TEXTURE_2D;
+    img.resident = false;
+    img.source = source;
 
-    ImageId iid = (ImageId)Instance()->images.size();
-    Instance()->images.push_back(img);
+    ImageId iid = AddImage(img);
     Instance()->imageRegistry.emplace(name, iid);
     return iid;
 }
 
+//------------------------------------------------------------------------------
+/**
+    Queues a job that decodes the source of a streamed texture. Used both for
+    the first load and to bring back evicted or reduced textures.
+*/
+void TextureResource::StreamIn(TextureResourceId id)
+{
+    Image& image = Instance()->images[id];
+    image.pending = true;
+    Instance()->numStreaming++;
+
+    StreamingTexture texture;
+    texture.id = id;
+    texture.pixels = nullptr;
+    texture.compressed = nullptr;
+    texture.width = 0;
+    texture.height = 0;
+    texture.channels = 0;
+    texture.source = image.source;
+    Core::JobSystem::Submit([texture]()
+    {
+        DecodeStreamingTexture(texture);
+    });
+}
+
+//------------------------------------------------------------------------------
+/**
+    Runs on a job thread. Decodes from memory if the source has data, or from the file at path.
+    Textures found in the texture cache are uploaded compressed instead.
+*/
+void TextureResource::DecodeStreamingTexture(StreamingTexture texture)
+{
+    N_PROFILE_SCOPE("TextureResource::DecodeStreamingTexture");
+    TextureSource const& source = *texture.source;
+    unsigned char const* data = source.data.empty() ? nullptr : source.data.data();
+    size_t bytes = source.data.size();
+    const char* path = source.path.c_str();
+
+    // the cache is keyed by the contents of the file, so files are read to memory first
+    std::vector<uint8_t> file;
+    if (source.compression > 0)
+    {
+        if (data == nullptr && ReadFile(path, file))
+        {
+            data = file.data();
+            bytes = file.size();
+        }
+
+        TextureCompressor::CompressedTexture* const compressed = new TextureCompressor::CompressedTexture();
+        if (data != nullptr && TextureCompressor::LoadCached(data, bytes, source.usage, source.sRGB, source.compression > 1, *compressed))
+        {
+            texture.compressed = compressed;
+            texture.width = (int)compressed->levels[0].width;
+            texture.height = (int)compressed->levels[0].height;
+
+            std::lock_guard<std::mutex> guard(Instance()->streamingLock);
+            Instance()->decoded.push_back(texture);
+            return;
+        }
+        delete compressed;
+    }
+
+    // only rgb and rgba are uploaded, expand everything else to rgba
+    int channels = 0;
+    bool const valid = data != nullptr ?
+        stbi_info_from_memory(data, (int)bytes, &texture.width, &texture.height, &channels) != 0 :
+        stbi_info(path, &texture.width, &texture.height, &channels) != 0;
+    int const requested = channels == 3 ? 3 : 4;
+
+    if (valid)
+    {
+        texture.pixels = data != nullptr ?
+            stbi_load_from_memory(data, (int)bytes, &texture.width, &texture.height, &channels, requested) :
+            stbi_load(path, &texture.width, &texture.height, &channels, requested);
+    }
+    texture.channels = requested;
+
+    if (texture.pixels == nullptr)
+        n_warning("Could not decode streamed texture '%s'!\n", path);
+
+    std::lock_guard<std::mutex> guard(Instance()->streamingLock);
+    Instance()->decoded.push_back(texture);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TextureResourceId TextureResource::LoadTextureAsync(const char* path, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB, TextureUsage usage, TextureResourceId placeholder)
+{
+    N_PROFILE_SCOPE("TextureResource::LoadTextureAsync");
+    std::shared_ptr<TextureSource> const source = std::make_shared<TextureSource>();
+    source->path = path;
+    source->mag = mag;
+    source->min = min;
+    source->wrapModeS = wrapModeS;
+    source->wrapModeT = wrapModeT;
+    source->sRGB = sRGB;
+    source->usage = usage;
+    source->compression = Core::CVarReadInt(r_texture_compression);
+    source->placeholder = placeholder;
+
+    TextureResourceId const id = AllocateStreamingImage(path, source);
+    StreamIn(id);
+    return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+    The encoded data is kept, so the texture can be streamed in again after it
+    has been evicted.
+*/
+TextureResourceId TextureResource::LoadTextureFromMemoryAsync(std::string name, std::vector<uint8_t>&& data, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB, TextureUsage usage, TextureResourceId placeholder)
+{
+    N_PROFILE_SCOPE("TextureResource::LoadTextureFromMemoryAsync");
+    std::shared_ptr<TextureSource> const source = std::make_shared<TextureSource>();
+    source->path = name;
+    source->data = std::move(data);
+    source->mag = mag;
+    source->min = min;
+    source->wrapModeS = wrapModeS;
+    source->wrapModeT = wrapModeT;
+    source->sRGB = sRGB;
+    source->usage = usage;
+    source->compression = Core::CVarReadInt(r_texture_compression);
+    source->placeholder = placeholder;
+
+    TextureResourceId const id = AllocateStreamingImage(name, source);
+    StreamIn(id);
+    return id;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Bytes a decoded texture takes in the upload buffer.
+*/
+size_t TextureResource::GetUploadSize(StreamingTexture const& texture)
+{
+    if (texture.compressed != nullptr)
+        return texture.compressed->data.size();
+    if (texture.pixels != nullptr)
+        return (size_t)texture.width * texture.height * texture.channels;
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Copies a texture into new immutable storage without its top mips. Runs on
+    the thread owning the GL context, the old texture is retired by the game
+    thread once the copy is visible.
+*/
+void TextureResource::DropMips(MipDrop const& drop, std::vector<UploadedTexture>& done)
+{
+    N_PROFILE_SCOPE("TextureResource::DropMips");
+    uint32_t const numLevels = TexturePool::GetNumMips(drop.extent.w, drop.extent.h);
+    uint32_t const numMips = std::min(drop.numMips, numLevels - 1);
+    uint32_t const width = std::max(1u, drop.extent.w >> numMips);
+    uint32_t const height = std::max(1u, drop.extent.h >> numMips);
+
+    // the reduced texture goes into the pool of its new size
+    TexturePool::Format format = Instance()->pool.GetFormat(drop.layer);
+    format.width = (GLsizei)width;
+    format.height = (GLsizei)height;
+    TextureLayer const layer = Instance()->pool.Allocate(format);
+    for (uint32_t l = 0; l < numLevels - numMips; l++)
+    {
+        glCopyImageSubData(drop.layer.array, GL_TEXTURE_2D_ARRAY, l + numMips, 0, 0, drop.layer.layer,
+                           layer.array, GL_TEXTURE_2D_ARRAY, l, 0, 0, layer.layer,
+                           std::max(1u, width >> l), std::max(1u, height >> l), 1);
+    }
+
+    // every dropped level is a quarter of the one above
+    done.push_back({ drop.id, layer, { width, height }, drop.bytes >> (2 * numMips), drop.droppedMips + numMips });
+}
+
+//------------------------------------------------------------------------------
+/**
+    Copies as many decoded textures as fit in the budget into the next buffer of
+    the upload ring and creates the textures from it. At least one texture is
+    uploaded per frame, so textures larger than the budget still make progress.
+    A buffer is only written again once the GPU has signaled that it is done
+    with the uploads from the last time it was used.
+
+    Also executes the mip drops requested by the residency update, and deletes
+    retired textures once no frame in flight can use them anymore.
+*/
+void TextureResource::UploadStreamedTextures()
+{
+    TextureResource* const self = Instance();
+    size_t const budget = (size_t)std::max(0, Core::CVarReadInt(r_texture_upload_budget)) * 1024 * 1024;
+
+    std::vector<StreamingTexture> batch;
+    std::vector<MipDrop> drops;
+    std::vector<TextureLayer> deletes;
+    size_t batchBytes = 0;
+    {
+        std::lock_guard<std::mutex> guard(self->streamingLock);
+        while (!self->decoded.empty())
+        {
+            StreamingTexture const& texture = self->decoded.front();
+            size_t const bytes = GetUploadSize(texture);
+            if (!batch.empty() && batchBytes + bytes > budget)
+                break;
+
+            batch.push_back(texture);
+            batchBytes += bytes;
+            self->decoded.pop_front();
+        }
+
+        drops.swap(self->mipDrops);
+        for (size_t i = 0; i < self->retired.size();)
+        {
+            if (--self->retired[i].framesLeft > 0)
+            {
+                i++;
+                continue;
+            }
+            deletes.push_back(self->retired[i].layer);
+            self->retired[i] = self->retired.back();
+            self->retired.pop_back();
+        }
+    }
+
+    for (TextureLayer const& layer : deletes)
+        self->pool.Free(layer);
+
+    std::vector<UploadedTexture> done;
+    for (MipDrop const& drop : drops)
+        DropMips(drop, done);
+
+    if (!batch.empty())
+    {
+        N_PROFILE_SCOPE("TextureResource::UploadStreamedTextures");
+        UploadBuffer& upload = self->uploadBuffers[self->uploadBufferIndex];
+        self->uploadBufferIndex = (self->uploadBufferIndex + 1) % NUM_UPLOAD_BUFFERS;
+
+        if (upload.fence != nullptr)
+        {
+            glClientWaitSync(upload.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(upload.fence);
+            upload.fence = nullptr;
+        }
+
+        if (upload.buffer == 0)
+            glGenBuffers(1, &upload.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.buffer);
+        if (upload.size < (GLsizeiptr)batchBytes)
+        {
+            upload.size = (GLsizeiptr)batchBytes;
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, upload.size, nullptr, GL_STREAM_DRAW);
+        }
+
+        if (batchBytes > 0)
+        {
+            // the fence makes sure nothing is reading the buffer anymore
+            unsigned char* const mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)batchBytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            size_t offset = 0;
+            for (StreamingTexture const& texture : batch)
+            {
+                if (texture.compressed != nullptr)
+                    memcpy(mapped + offset, texture.compressed->data.data(), texture.compressed->data.size());
+                else if (texture.pixels != nullptr)
+                    memcpy(mapped + offset, texture.pixels, GetUploadSize(texture));
+                offset += GetUploadSize(texture);
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        size_t offset = 0;
+        for (StreamingTexture const& texture : batch)
+        {
+            if (texture.pixels == nullptr && texture.compressed == nullptr)
+            {
+                // keep the placeholder
+                done.push_back({ texture.id, TextureLayer(), {}, 0, 0 });
+                continue;
+            }
+
+            TextureSource const& source = *texture.source;
+            TextureLayer layer;
+            size_t bytes;
+            if (texture.compressed != nullptr)
+            {
+                layer = self->pool.Allocate(GetPoolFormat(*texture.compressed, source.mag, source.min, source.wrapModeS, source.wrapModeT));
+                CompressedTexSubImage(*texture.compressed, (unsigned char const*)(intptr_t)offset, layer);
+                bytes = texture.compressed->data.size();
+            }
+            else
+            {
+                // sized formats, so the mips can be copied into the pool
+                GLenum const internalFormat = texture.channels == 3 ? (source.sRGB ? GL_SRGB8 : GL_RGB8) : (source.sRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+                GLuint handle;
+                glGenTextures(1, &handle);
+                glBindTexture(GL_TEXTURE_2D, handle);
+                glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, texture.width, texture.height, 0, texture.channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, (void*)(intptr_t)offset);
+                glGenerateMipmap(GL_TEXTURE_2D);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                layer = MoveToPool(handle, GetPoolFormat(internalFormat, texture.width, texture.height, source.mag, source.min, source.wrapModeS, source.wrapModeT));
+                bytes = GetTextureBytes(texture.width, texture.height, texture.channels);
+            }
+
+            offset += GetUploadSize(texture);
+            stbi_image_free(texture.pixels);
+            delete texture.compressed;
+            done.push_back({ texture.id, layer, { (unsigned)texture.width, (unsigned)texture.height }, bytes, 0 });
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    if (done.empty())
+        return;
+
+    std::lock_guard<std::mutex> guard(self->streamingLock);
+    self->uploaded.insert(self->uploaded.end(), done.begin(), done.end());
+}
+
+//------------------------------------------------------------------------------
+/**
+    Swaps in textures that finished streaming or dropping mips, then runs the
+    residency update.
+*/
+void TextureResource::UpdateStreaming()
+{
+    TextureResource* const self = Instance();
+    self->frameIndex++;
+    {
+        std::lock_guard<std::mutex> guard(self->streamingLock);
+        for (UploadedTexture const& texture : self->uploaded)
+        {
+            Image& image = self->images[texture.id];
+            // mip drops keep the texture resident, everything else was streamed in
+            if (texture.droppedMips == 0)
+                self->numStreaming--;
+
+            image.pending = false;
+            if (texture.layer.array == 0)
+            {
+                // keep whatever is shown, and never try to stream it in again
+                image.resident = true;
+                image.source.reset();
+                if (image.refcount == 0)
+                    FreeImage(texture.id);
+                continue;
+            }
+
+            // frames in flight might still draw with the old texture
+            if (image.resident && image.bytes > 0)
+                self->retired.push_back({ image.layer, RETIRE_FRAMES });
+            self->residentBytes += texture.bytes;
+            self->residentBytes -= image.bytes;
+            image.layer = texture.layer;
+            image.extent = texture.extent;
+            image.bytes = texture.bytes;
+            image.droppedMips = texture.droppedMips;
+            image.resident = true;
+
+            // released while it was streaming
+            if (image.refcount == 0)
+                FreeImage(texture.id);
+        }
+        self->uploaded.clear();
+    }
+
+    UpdateResidency();
+}
+
+//------------------------------------------------------------------------------
+/**
+    Keeps the streamed textures within r_texture_budget. Textures that have not
+    been drawn for r_texture_evict_delay frames are candidates, least recently
+    used first. Their top mips are dropped first, down to MIN_REDUCED_SIZE, and
+    if that is not enough they are evicted completely and show their
+    placeholder again. Textures that are drawn are never touched, so the
+    budget can be exceeded if the visible set does not fit.
+
+    Evicted and reduced textures that are drawn again are streamed back in
+    from their source.
+*/
+void TextureResource::UpdateResidency()
+{
+    N_PROFILE_SCOPE("TextureResource::UpdateResidency");
+    TextureResource* const self = Instance();
+    size_t const budget = (size_t)std::max(0, Core::CVarReadInt(r_texture_budget)) * 1024 * 1024;
+    uint32_t const delay = (uint32_t)std::max(0, Core::CVarReadInt(r_texture_evict_delay));
+
+    std::vector<TextureResourceId> candidates;
+    for (TextureResourceId id = 0; id < (TextureResourceId)self->images.size(); id++)
+    {
+        Image const& image = self->images[id];
+        if (image.source == nullptr || image.pending)
+            continue;
+
+        uint32_t const lastUsed = self->lastUsedFrames[id].load(std::memory_order_relaxed);
+        uint32_t const unused = self->frameIndex - lastUsed;
+        if (unused <= 1 && (!image.resident || image.droppedMips > 0))
+            StreamIn(id);
+        else if (image.resident && unused > delay)
+            candidates.push_back(id);
+    }
+
+    if (self->residentBytes <= budget || candidates.empty())
+        return;
+
+    std::sort(candidates.begin(), candidates.end(), [self](TextureResourceId a, TextureResourceId b)
+    {
+        return self->lastUsedFrames[a].load(std::memory_order_relaxed) < self->lastUsedFrames[b].load(std::memory_order_relaxed);
+    });
+
+    // bytes freed by the requested drops are counted right away, so the next frames don't request more
+    size_t excess = self->residentBytes - budget;
+    std::vector<MipDrop> drops;
+    for (TextureResourceId id : candidates)
+    {
+        if (excess == 0)
+            break;
+
+        Image& image = self->images[id];
+        uint32_t numMips = 0;
+        size_t saved = 0;
+        while (saved < excess && (std::max(image.extent.w, image.extent.h) >> (numMips + 1)) >= MIN_REDUCED_SIZE)
+        {
+            numMips++;
+            saved = image.bytes - (image.bytes >> (2 * numMips));
+        }
+        if (numMips == 0)
+            continue;
+
+        drops.push_back({ id, image.layer, image.extent, image.bytes, image.droppedMips, numMips });
+        image.pending = true;
+        excess -= std::min(excess, saved);
+    }
+
+    std::vector<RetiredTexture> evicted;
+    for (TextureResourceId id : candidates)
+    {
+        if (excess == 0)
+            break;
+
+        Image& image = self->images[id];
+        if (image.pending || image.bytes == 0)
+            continue;
+
+        Image const& placeholder = self->images[image.source->placeholder];
+        evicted.push_back({ image.layer, RETIRE_FRAMES });
+        excess -= std::min(excess, image.bytes);
+        self->residentBytes -= image.bytes;
+        image.layer = placeholder.layer;
+        image.extent = placeholder.extent;
+        image.bytes = 0;
+        image.droppedMips = 0;
+        image.resident = false;
+    }
+
+    std::lock_guard<std::mutex> guard(self->streamingLock);
+    self->mipDrops.insert(self->mipDrops.end(), drops.begin(), drops.end());
+    self->retired.insert(self->retired.end(), evicted.begin(), evicted.end());
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool TextureResource::IsTextureResident(TextureResourceId tid)
+{
+    return Instance()->images[tid].resident;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+uint32_t TextureResource::GetNumStreamingTextures()
+{
+    return Instance()->numStreaming;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+TextureResource::ResidencyStats TextureResource::GetResidencyStats()
+{
+    TextureResource* const self = Instance();
+    ResidencyStats stats;
+    stats.residentBytes = self->residentBytes;
+    stats.budgetBytes = (size_t)std::max(0, Core::CVarReadInt(r_texture_budget)) * 1024 * 1024;
+    for (Image const& image : self->images)
+    {
+        if (image.source == nullptr || image.pending)
+            continue;
+        stats.numEvicted += !image.resident;
+        stats.numReduced += image.resident && image.droppedMips > 0;
+    }
+    return stats;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+ImageId TextureResource::AddImage(Image const& image)
+{
+    TextureResource* const self = Instance();
+    self->residentBytes += image.bytes;
+    if (!self->freeImages.empty())
+    {
+        ImageId const iid = self->freeImages.back();
+        self->freeImages.pop_back();
+        self->images[iid] = image;
+        self->lastUsedFrames[iid].store(self->frameIndex, std::memory_order_relaxed);
+        return iid;
+    }
+
+    ImageId iid = (ImageId)self->images.size();
+    self->images.push_back(image);
+    self->lastUsedFrames.emplace_back(self->frameIndex);
+    return iid;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Retires the layer of a released image like an evicted one, and makes the
+    slot available to AddImage. Images that are not resident show the layer of
+    their placeholder, which stays. Call with streamingLock held.
+*/
+void TextureResource::FreeImage(ImageId id)
+{
+    TextureResource* const self = Instance();
+    Image& image = self->images[id];
+    n_assert(image.handle == 0);
+    if (image.resident && image.bytes > 0)
+        self->retired.push_back({ image.layer, RETIRE_FRAMES });
+    self->residentBytes -= image.bytes;
+    image = Image();
+    image.handle = 0;
+    image.refcount = 0;
+    self->freeImages.push_back(id);
+}
+
 ImageId TextureResource::AllocateImage(ImageCreateInfo info)
 {
     GLuint handle;
@@ -189,9 +964,7 @@ ImageId TextureResource::AllocateImage(ImageCreateInfo info)
     img.extent = info.extents;
     img.type = info.type;
 
-    ImageId iid = (ImageId)Instance()->images.size();
-    Instance()->images.push_back(img);
-    return iid;
+    return AddImage(img);
 }
 
 ImageExtents TextureResource::GetImageExtents(ImageId id)
@@ -204,6 +977,15 @@ GLuint TextureResource::GetTextureHandle(TextureResourceId tid)
     return Instance()->images[tid].handle;
 }
 
+//------------------------------------------------------------------------------
+/**
+*/
+TextureLayer TextureResource::UseTexture(TextureResourceId tid)
+{
+    Instance()->lastUsedFrames[tid].store(Instance()->frameIndex, std::memory_order_relaxed);
+    return Instance()->images[tid].layer;
+}
+
 GLuint TextureResource::GetImageHandle(ImageId tid)
 {
     return Instance()->images[tid].handle;
@@ -219,6 +1001,47 @@ ImageId TextureResource::GetImageId(std::string name)
     return InvalidImageId;
 }
 
+//------------------------------------------------------------------------------
+/**
+*/
+TextureResourceId TextureResource::AcquireTexture(std::string const& name)
+{
+    auto index = Instance()->imageRegistry.find(name);
+    if (index == Instance()->imageRegistry.end())
+        return InvalidResourceId;
+
+    Instance()->images[index->second].refcount++;
+    return index->second;
+}
+
+//------------------------------------------------------------------------------
+/**
+    Textures that are still streaming in are freed when their upload arrives.
+*/
+void TextureResource::ReleaseTexture(TextureResourceId tid)
+{
+    TextureResource* const self = Instance();
+    Image& image = self->images[tid];
+    n_assert(image.refcount > 0);
+    if (--image.refcount > 0)
+        return;
+
+    for (auto iter = self->imageRegistry.begin(); iter != self->imageRegistry.end(); iter++)
+    {
+        if (iter->second == tid)
+        {
+            self->imageRegistry.erase(iter);
+            break;
+        }
+    }
+
+    if (!image.pending)
+    {
+        std::lock_guard<std::mutex> guard(self->streamingLock);
+        FreeImage(tid);
+    }
+}
+
 TextureResourceId TextureResource::GetWhiteTexture()
 {
     return Instance()->whiteTexture;
@@ -8,6 +8,12 @@
 //------------------------------------------------------------------------------
 #include "GL/glew.h"
 #include "renderdevice.h"
+#include "texturecompressor.h"
+#include "texturepool.h"
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
 
 namespace Render
 {
@@ -94,19 +100,53 @@ public:
     // destroy singleton
     static void Destroy();
 
-    static TextureResourceId LoadTexture(const char* path, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB);
-    static TextureResourceId LoadTextureFromMemory(std::string name, void* buffer, uint64_t bytes, ImageId imageId, MagFilter, MinFilter, WrappingMode, WrappingMode, bool sRGB);
+    static TextureResourceId LoadTexture(const char* path, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB, TextureUsage usage = TextureUsage::Color);
+    static TextureResourceId LoadTextureFromMemory(std::string name, void* buffer, uint64_t bytes, ImageId imageId, MagFilter, MinFilter, WrappingMode, WrappingMode, bool sRGB, TextureUsage usage = TextureUsage::Color);
     
     static TextureResourceId LoadCubemap(std::string const& name, std::vector<const char*> const& paths, bool sRGB);
 
+    /// start streaming a texture in. The returned id shows the placeholder texture until the image is resident.
+    static TextureResourceId LoadTextureAsync(const char* path, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB, TextureUsage usage, TextureResourceId placeholder);
+    /// same as LoadTextureAsync, for encoded image data in memory
+    static TextureResourceId LoadTextureFromMemoryAsync(std::string name, std::vector<uint8_t>&& data, MagFilter mag, MinFilter min, WrappingMode wrapModeS, WrappingMode wrapModeT, bool sRGB, TextureUsage usage, TextureResourceId placeholder);
+    /// upload decoded textures through the upload buffers, within r_texture_upload_budget bytes. Call once per frame on the thread owning the GL context.
+    static void UploadStreamedTextures();
+    /// make uploaded textures visible to GetTextureHandle. Call once per frame on the game thread.
+    static void UpdateStreaming();
+    /// returns false while a texture is still streaming in
+    static bool IsTextureResident(TextureResourceId tid);
+    /// number of textures that are still streaming in
+    static uint32_t GetNumStreamingTextures();
+
+    /// texture memory statistics
+    struct ResidencyStats
+    {
+        /// estimated memory of all textures
+        size_t residentBytes = 0;
+        /// value of r_texture_budget in bytes
+        size_t budgetBytes = 0;
+        /// streamed textures that are evicted and show their placeholder
+        uint32_t numEvicted = 0;
+        /// streamed textures with their top mips dropped
+        uint32_t numReduced = 0;
+    };
+    static ResidencyStats GetResidencyStats();
+
     static ImageId AllocateImage(ImageCreateInfo info);
 
     static ImageExtents GetImageExtents(ImageId id);
 
+    /// handle of a texture that is not pooled, like cubemaps and render targets
     static GLuint GetTextureHandle(TextureResourceId tid);
+    /// array layer of a 2D texture loaded from a file or memory, and marks the texture as used this frame. Safe to call from job threads.
+    static TextureLayer UseTexture(TextureResourceId tid);
     static GLuint GetImageHandle(ImageId tid);
 
     static ImageId GetImageId(std::string name);
+    /// returns a loaded texture and adds a reference to it, or InvalidResourceId if there is no texture with that name
+    static TextureResourceId AcquireTexture(std::string const& name);
+    /// drops a reference added by loading or AcquireTexture. The last one deletes the texture once no frame in flight uses it.
+    static void ReleaseTexture(TextureResourceId tid);
 
     static TextureResourceId GetWhiteTexture();
     static TextureResourceId GetBlackTexture();
@@ -114,20 +154,134 @@ public:
     static TextureResourceId GetDefaultNormalTexture();
 
 private:
+    /// where a streamed texture comes from, kept to stream it in again after eviction
+    struct TextureSource
+    {
+        // file to decode, if data is empty
+        std::string path;
+        // encoded image
+        std::vector<uint8_t> data;
+        MagFilter mag;
+        MinFilter min;
+        WrappingMode wrapModeS;
+        WrappingMode wrapModeT;
+        bool sRGB;
+        TextureUsage usage;
+        // value of r_texture_compression when the texture was requested
+        int compression;
+        TextureResourceId placeholder;
+    };
+
     struct Image
     {
+        // zero for textures that live in the pool
         GLuint handle;
+        TextureLayer layer;
         ImageExtents extent;
         ImageType type;
+        // false while the layer still points to a placeholder
+        bool resident = true;
+        // estimated memory of the texture and its mips, zero while not resident
+        size_t bytes = 0;
+        // number of top mips dropped to save memory
+        uint32_t droppedMips = 0;
+        // set while streaming in or dropping mips
+        bool pending = false;
+        // only set for streamed textures, which are the ones that can be evicted
+        std::shared_ptr<TextureSource> source;
+        // number of models sharing the texture
+        uint32_t refcount = 1;
+    };
+
+    /// a texture that has been decoded and is waiting for upload
+    struct StreamingTexture
+    {
+        TextureResourceId id;
+        unsigned char* pixels;
+        // set instead of pixels if the texture was found in the texture cache
+        TextureCompressor::CompressedTexture* compressed;
+        int width;
+        int height;
+        int channels;
+        std::shared_ptr<TextureSource> source;
+    };
+
+    /// a texture that has been uploaded and is waiting to be made visible
+    struct UploadedTexture
+    {
+        TextureResourceId id;
+        // no array if decoding failed
+        TextureLayer layer;
+        ImageExtents extent;
+        size_t bytes;
+        uint32_t droppedMips;
     };
 
+    /// a request to copy a texture without its top mips
+    struct MipDrop
+    {
+        TextureResourceId id;
+        TextureLayer layer;
+        ImageExtents extent;
+        size_t bytes;
+        uint32_t droppedMips;
+        // number of mips to drop
+        uint32_t numMips;
+    };
+
+    /// a texture that might still be used by frame packets in flight
+    struct RetiredTexture
+    {
+        TextureLayer layer;
+        int framesLeft;
+    };
+
+    /// a pixel buffer in the upload ring
+    struct UploadBuffer
+    {
+        GLuint buffer = 0;
+        GLsizeiptr size = 0;
+        // signaled when the GPU is done reading the previous uploads
+        GLsync fence = nullptr;
+    };
+
+    static TextureResourceId AllocateStreamingImage(std::string const& name, std::shared_ptr<TextureSource> const& source);
+    static void StreamIn(TextureResourceId id);
+    static void DecodeStreamingTexture(StreamingTexture texture);
+    static size_t GetUploadSize(StreamingTexture const& texture);
+    static void DropMips(MipDrop const& drop, std::vector<UploadedTexture>& done);
+    static TextureLayer MoveToPool(GLuint texture, TexturePool::Format const& format);
+    static void UpdateResidency();
+    static ImageId AddImage(Image const& image);
+    static void FreeImage(ImageId id);
+
     std::vector<Image> images;
+    // slots of released images, reused by AddImage
+    std::vector<ImageId> freeImages;
+    // frame each image was last drawn in. A deque, since atomics can not be moved.
+    std::deque<std::atomic<uint32_t>> lastUsedFrames;
+    uint32_t frameIndex = 0;
+    size_t residentBytes = 0;
+    // only used on the thread owning the GL context
+    TexturePool pool;
     std::unordered_map<std::string, ImageId> imageRegistry;
 
     TextureResourceId whiteTexture = InvalidResourceId;
     TextureResourceId blackTexture = InvalidResourceId;
     TextureResourceId defaultMetallicRoughnessTexture = InvalidResourceId;
     TextureResourceId defaultNormalTexture = InvalidResourceId;
+
+    static const int NUM_UPLOAD_BUFFERS = 3;
+    UploadBuffer uploadBuffers[NUM_UPLOAD_BUFFERS];
+    int uploadBufferIndex = 0;
+
+    // guards decoded, uploaded, mipDrops and retired, which are shared with the decode jobs and the render thread
+    std::mutex streamingLock;
+    std::deque<StreamingTexture> decoded;
+    std::vector<UploadedTexture> uploaded;
+    std::vector<MipDrop> mipDrops;
+    std::vector<RetiredTexture> retired;
+    uint32_t numStreaming = 0;
 };
 
 } // namespace Render
@@ -8,6 +8,8 @@
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_glfw.h"
 #include "render/input/inputserver.h"
+#include "core/profiler.h"
+#include "core/cvar.h"
 
 namespace Display
 {
@@ -66,7 +68,13 @@ Window::Window() :
 	window(nullptr),
 	width(1024),
 	height(768),
-	title("gscept Lab Environment")
+	title("gscept Lab Environment"),
+	headless(false),
+	framebuffer(0),
+	colorBuffer(0),
+	depthBuffer(0),
+	framebufferWidth(0),
+	framebufferHeight(0)
 {
 	// empty
 }
@@ -213,8 +221,13 @@ Window::Resize()
 	{
 		glfwSetWindowSize(this->window, this->width, this->height);
 
-		// setup viewport
-		glViewport(0, 0, this->width, this->height);
+		// setup viewport, unless the context belongs to the render thread. It picks
+		// up the new size from the next frame packet and calls UpdateFramebuffer.
+		if (glfwGetCurrentContext() == this->window)
+		{
+			glViewport(0, 0, this->width, this->height);
+			this->UpdateFramebuffer(this->width, this->height);
+		}
 	}
 }
 
@@ -229,6 +242,49 @@ Window::Retitle()
 
 //------------------------------------------------------------------------------
 /**
+	The pixels of a hidden window are undefined, so headless windows render to
+	renderbuffers of their own instead.
+*/
+void
+Window::SetupFramebuffer(int32 width, int32 height)
+{
+	if (this->framebuffer == 0)
+	{
+		glGenFramebuffers(1, &this->framebuffer);
+		glGenRenderbuffers(1, &this->colorBuffer);
+		glGenRenderbuffers(1, &this->depthBuffer);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, this->framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+	n_assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	this->framebufferWidth = width;
+	this->framebufferHeight = height;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Resizes that happen while the render thread owns the context can't touch the
+	framebuffer, so the render thread calls this with the size of every frame.
+*/
+void
+Window::UpdateFramebuffer(int32 width, int32 height)
+{
+	if (this->headless && (width != this->framebufferWidth || height != this->framebufferHeight))
+		this->SetupFramebuffer(width, height);
+}
+
+//------------------------------------------------------------------------------
+/**
+	Set r_headless to open a hidden window that renders offscreen, sized by
+	r_headless_width and r_headless_height if they are set. GLFW still needs a
+	display server to create the context, use Xvfb on machines without one.
 */
 bool
 Window::Open()
@@ -238,6 +294,18 @@ Window::Open()
 		if (!glfwInit()) return false;
 	}
 
+	Core::CVar* r_headless = Core::CVarCreate(Core::CVar_Int, "r_headless", "0", "Render offscreen to a hidden window");
+	Core::CVar* r_headless_width = Core::CVarCreate(Core::CVar_Int, "r_headless_width", "0", "Width of the offscreen backbuffer, 0 keeps the window size");
+	Core::CVar* r_headless_height = Core::CVarCreate(Core::CVar_Int, "r_headless_height", "0", "Height of the offscreen backbuffer, 0 keeps the window size");
+	this->headless = Core::CVarReadInt(r_headless) != 0;
+	if (this->headless)
+	{
+		if (Core::CVarReadInt(r_headless_width) > 0)
+			this->width = Core::CVarReadInt(r_headless_width);
+		if (Core::CVarReadInt(r_headless_height) > 0)
+			this->height = Core::CVarReadInt(r_headless_height);
+	}
+
 	// setup window
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 	glEnable(GL_DEBUG_OUTPUT);
@@ -246,6 +314,7 @@ Window::Open()
 	glfwWindowHint(GLFW_GREEN_BITS, 8);
 	glfwWindowHint(GLFW_BLUE_BITS, 8);
 	glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, this->headless ? GL_FALSE : GL_TRUE);
 
 	// open window
 	this->window = glfwCreateWindow(this->width, this->height, this->title.c_str(), nullptr, nullptr);
@@ -287,6 +356,11 @@ Window::Open()
 		glViewport(0, 0, this->width, this->height);
 	}
 
+	if (nullptr != this->window && this->headless)
+	{
+		this->SetupFramebuffer(this->width, this->height);
+		printf("Rendering headless at %dx%d\n", this->width, this->height);
+	}
 
 	glfwSetWindowUserPointer(this->window, this);
 	glfwSetKeyCallback(this->window, Window::StaticKeyPressCallback);
@@ -327,6 +401,9 @@ Window::Open()
 	int width, height, channels;
 	io.Fonts->GetTexDataAsRGBA32(&buffer, &width, &height, &channels);
 
+	// create the font texture and shaders now, the UI might be drawn on another thread later
+	ImGui_ImplOpenGL3_NewFrame();
+
 	glfwSetCharCallback(window, ImGui_ImplGlfw_CharCallback);
 
 	//glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -344,6 +421,13 @@ Window::Open()
 void
 Window::Close()
 {
+	if (this->framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &this->framebuffer);
+		glDeleteRenderbuffers(1, &this->colorBuffer);
+		glDeleteRenderbuffers(1, &this->depthBuffer);
+		this->framebuffer = 0;
+	}
 	if (nullptr != this->window) glfwDestroyWindow(this->window);
 	this->window = nullptr;
 	Window::WindowCount--;
@@ -365,14 +449,29 @@ Window::MakeCurrent()
 	glfwMakeContextCurrent(this->window);
 }
 
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Window::ReleaseCurrent()
+{
+	if (glfwGetCurrentContext() == this->window)
+		glfwMakeContextCurrent(nullptr);
+}
+
 //------------------------------------------------------------------------------
 /**
 */
 void
 Window::Update()
 {
+	N_PROFILE_SCOPE("Window::Update");
 	Input::InputHandler::BeginFrame();
-	glfwPollEvents();	
+	{
+		N_PROFILE_SCOPE("glfwPollEvents");
+		glfwPollEvents();
+	}
+	this->inputTime = std::chrono::steady_clock::now();
 }
 
 //------------------------------------------------------------------------------
@@ -383,17 +482,50 @@ Window::SwapBuffers()
 {
 	if (this->window)
 	{
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
+		this->DrawUi(this->BuildUi());
+		this->Present();
+	}
+}
 
-		ImGui::NewFrame();
-		if (nullptr != this->uiFunc)
-			this->uiFunc();
+//------------------------------------------------------------------------------
+/**
+	Only touches the ImGui context, so this can run on the game thread while the
+	render thread owns the GL context.
+*/
+ImDrawData*
+Window::BuildUi()
+{
+	ImGui_ImplGlfw_NewFrame();
+
+	ImGui::NewFrame();
+	if (nullptr != this->uiFunc)
+		this->uiFunc();
 
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	ImGui::Render();
+	return ImGui::GetDrawData();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Window::DrawUi(ImDrawData* drawData)
+{
+	ImGui_ImplOpenGL3_NewFrame();
+	ImGui_ImplOpenGL3_RenderDrawData(drawData);
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+Window::Present()
+{
+	// nothing to show, just make sure the frame gets submitted
+	if (this->headless)
+		glFlush();
+	else
 		glfwSwapBuffers(this->window);
-	}
 }
 
 //------------------------------------------------------------------------------
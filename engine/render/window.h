@@ -7,10 +7,13 @@
 */
 //------------------------------------------------------------------------------
 #include <functional>
+#include <chrono>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <string>
 
+struct ImDrawData;
+
 namespace Display
 {
 class Window
@@ -34,15 +37,32 @@ public:
 	void Close();
 	/// returns true if window is open
 	const bool IsOpen() const;
+	/// returns true if the window is hidden and renders to an offscreen framebuffer, see r_headless
+	const bool IsHeadless() const;
+	/// get the framebuffer presented by this window, 0 unless headless
+	GLuint GetFramebuffer() const;
+	/// reallocate the offscreen framebuffer of a headless window if it has another size. Needs the context.
+	void UpdateFramebuffer(int32 width, int32 height);
 
 	/// make this window current, meaning all draws will direct to this window context
 	void MakeCurrent();
+	/// release the context from the calling thread, so that another thread can make it current
+	void ReleaseCurrent();
 
 	/// update a tick
 	void Update();
-	/// swap buffers at end of frame
+	/// swap buffers at end of frame, same as BuildUi, DrawUi and Present in order
 	void SwapBuffers();
 
+	/// run the UI render function and return the result. Valid until the next call.
+	ImDrawData* BuildUi();
+	/// draw UI draw data to the current framebuffer. Needs the context.
+	void DrawUi(ImDrawData* drawData);
+	/// present the backbuffer. Needs the context.
+	void Present();
+	/// get the time input was last polled
+	std::chrono::steady_clock::time_point GetInputTime() const;
+
 	/// set key press function callback
 	void SetKeyPressFunction(const std::function<void(int32, int32, int32, int32)>& func);
 	/// set mouse press function callback
@@ -86,6 +106,8 @@ private:
 	void Resize();
 	/// title rename update
 	void Retitle(); 
+	/// (re)allocate the offscreen framebuffer of a headless window. Needs the context.
+	void SetupFramebuffer(int32 width, int32 height);
 
 	static int32 WindowCount;
 
@@ -108,6 +130,14 @@ private:
 	int32 height;
 	std::string title;
 	GLFWwindow* window;
+	std::chrono::steady_clock::time_point inputTime;
+	bool headless;
+	GLuint framebuffer;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+	/// size the offscreen framebuffer was allocated with
+	int32 framebufferWidth;
+	int32 framebufferHeight;
 };
 
 //------------------------------------------------------------------------------
@@ -151,6 +181,33 @@ Window::IsOpen() const
 	return nullptr != this->window;
 }
 
+//------------------------------------------------------------------------------
+/**
+*/
+inline const bool
+Window::IsHeadless() const
+{
+	return this->headless;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline GLuint
+Window::GetFramebuffer() const
+{
+	return this->framebuffer;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline std::chrono::steady_clock::time_point
+Window::GetInputTime() const
+{
+	return this->inputTime;
+}
+
 //------------------------------------------------------------------------------
 /**
 	parameters:
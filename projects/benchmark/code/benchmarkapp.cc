@@ -0,0 +1,551 @@
+//------------------------------------------------------------------------------
+// benchmarkapp.cc
+// (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "benchmarkapp.h"
+#include "report.h"
+#include "render/renderdevice.h"
+#include "render/renderthread.h"
+#include "render/model.h"
+#include "render/cameramanager.h"
+#include "render/lightserver.h"
+#include "render/textureresource.h"
+#include "render/gpuprofiler.h"
+#include "render/physics.h"
+#include "core/random.h"
+#include "core/cvar.h"
+#include "core/profiler.h"
+#include "core/jobsystem.h"
+#include "core/idpool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+using namespace Render;
+
+namespace Benchmark
+{
+
+/// how the camera moves during a scenario
+enum class CameraPath
+{
+	/// circle the field, looking at its center
+	Orbit,
+	/// fly through the field once over the run
+	Flythrough
+};
+
+/// what a scenario spawns and how it is looked at
+struct Scenario
+{
+	const char* name;
+	const char* description;
+	int numAsteroids;
+	int numLights;
+	/// Physics::Raycast calls per frame
+	int numRays;
+	/// models loaded and unloaded per frame, see CycleModels
+	int numModelCycles;
+	/// asteroids and lights are spread over a cube from -span to span
+	float span;
+	CameraPath cameraPath;
+	/// frames measured unless bm_frames is set
+	int numFrames;
+};
+
+static const Scenario scenarios[] = {
+	{ "default", "the space game field, orbited", 150, 40, 0, 0, 40.0f, CameraPath::Orbit, 600 },
+	{ "asteroids", "a large field, flown through", 3000, 40, 0, 0, 100.0f, CameraPath::Flythrough, 600 },
+	{ "lights", "many overlapping point lights", 150, 1000, 0, 0, 40.0f, CameraPath::Orbit, 600 },
+	{ "raycasts", "raycasts through a dense field", 1000, 40, 20000, 0, 60.0f, CameraPath::Orbit, 600 },
+	{ "streaming", "models loaded and unloaded every frame, checks for leaks", 0, 40, 0, 17, 40.0f, CameraPath::Orbit, 600 },
+};
+
+static const char* const asteroidModels[] = {
+	"assets/space/Asteroid_1.glb",
+	"assets/space/Asteroid_2.glb",
+	"assets/space/Asteroid_3.glb",
+	"assets/space/Asteroid_4.glb",
+	"assets/space/Asteroid_5.glb",
+	"assets/space/Asteroid_6.glb"
+};
+static const char* const asteroidColliders[] = {
+	"assets/space/Asteroid_1_physics.glb",
+	"assets/space/Asteroid_2_physics.glb",
+	"assets/space/Asteroid_3_physics.glb",
+	"assets/space/Asteroid_4_physics.glb",
+	"assets/space/Asteroid_5_physics.glb",
+	"assets/space/Asteroid_6_physics.glb"
+};
+static const int NUM_ASTEROID_MODELS = sizeof(asteroidModels) / sizeof(asteroidModels[0]);
+
+// frames rendered at most while waiting for streamed textures before the warm up
+static const int MAX_SETTLE_FRAMES = 600;
+// simulated time per frame, independent of how long frames take
+static const float FRAME_TIME = 1.0f / 60.0f;
+// frames rendered after the run, so the GPU profiler reads back the last measured ones
+static const int TRAILING_FRAMES = 8;
+// frames rendered at most after the run until unloaded models are deleted
+static const int MAX_RETIRE_FRAMES = 120;
+// model loads after which the pool of model slots has stopped growing, it keeps 1024 free slots before reusing one
+static const uint64_t SATURATED_CYCLES = 2048;
+
+/// state of the models loaded and unloaded during a run
+struct ModelCycles
+{
+	/// loaded in the last frame and drawn, unloaded in the next one
+	ModelId kept = ModelId::Invalid();
+	/// the most recently loaded model
+	ModelId previous = ModelId::Invalid();
+	/// model slots after SATURATED_CYCLES loads, 0 before
+	uint32_t numSaturatedSlots = 0;
+	uint64_t numCycles = 0;
+	int numErrors = 0;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+static Scenario const*
+FindScenario(const char* name)
+{
+	for (Scenario const& scenario : scenarios)
+	{
+		if (strcmp(scenario.name, name) == 0)
+			return &scenario;
+	}
+	return nullptr;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Camera view at a point of the run, from 0 at the first frame to 1 at the
+	last.
+*/
+static glm::mat4
+GetCameraView(Scenario const& scenario, float progress)
+{
+	float const time = progress * scenario.numFrames * FRAME_TIME;
+	if (scenario.cameraPath == CameraPath::Orbit)
+	{
+		float const angle = time * 0.3f;
+		glm::vec3 const position = glm::vec3(cosf(angle), 0.25f * sinf(time * 0.5f), sinf(angle)) * scenario.span;
+		return glm::lookAt(position, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	glm::vec3 const position = glm::vec3(0.2f * sinf(time * 0.7f), 0.1f * cosf(time * 0.5f), 2.0f * progress - 1.0f) * scenario.span;
+	return glm::lookAt(position, position + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+//------------------------------------------------------------------------------
+/**
+	Loads and unloads count models, round robin over the asteroid models, and
+	checks that every new id is valid and the id before it is not. The last
+	model stays loaded and is drawn, so it is unloaded in the next frame while
+	frames in flight still draw it.
+*/
+static void
+CycleModels(ModelCycles& cycles, int count)
+{
+	if (cycles.kept != ModelId::Invalid())
+	{
+		UnloadModel(cycles.kept);
+		cycles.kept = ModelId::Invalid();
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		ModelId const mid = LoadModel(asteroidModels[cycles.numCycles % NUM_ASTEROID_MODELS]);
+		cycles.numCycles++;
+		if (!IsModelValid(mid))
+		{
+			printf("Model %u:%u is not valid after loading it!\n", (uint32_t)mid.index, (uint32_t)mid.generation);
+			cycles.numErrors++;
+		}
+		if (cycles.previous != ModelId::Invalid() && IsModelValid(cycles.previous))
+		{
+			printf("Model %u:%u is still valid after unloading it!\n", (uint32_t)cycles.previous.index, (uint32_t)cycles.previous.generation);
+			cycles.numErrors++;
+		}
+
+		cycles.previous = mid;
+		if (cycles.numCycles == SATURATED_CYCLES)
+			cycles.numSaturatedSlots = GetModelStats().numSlots;
+
+		if (i + 1 < count)
+			UnloadModel(mid);
+		else
+			cycles.kept = mid;
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+	Model slots are only reused once 1024 of them are free, so a run would need
+	about a million loads to wrap a generation. This cycles ids through a pool
+	like the one models are allocated from until generations have wrapped, and
+	checks that every new id is valid, survives the conversion to and from
+	uint32_t, and that the id its slot had before is rejected. Returns the
+	number of errors.
+*/
+static int
+CheckModelIdWraps()
+{
+	Util::IdPool<ModelId> pool;
+	// the id each slot was given last
+	std::vector<ModelId> slotIds;
+	int numErrors = 0;
+	int numWraps = 0;
+	ModelId current;
+	pool.Allocate(current);
+	slotIds.push_back(current);
+	while (numWraps < 2 && numErrors == 0)
+	{
+		pool.Deallocate(current);
+		pool.Allocate(current);
+		if (current.index >= slotIds.size())
+		{
+			slotIds.push_back(current);
+			continue;
+		}
+
+		ModelId const stale = slotIds[current.index];
+		if (current.generation < stale.generation)
+			numWraps++;
+		if (!pool.IsValid(current) || pool.IsValid(stale) || ModelId::Create((uint32_t)current) != current || current == stale)
+		{
+			printf("Model id %u:%u is not handled correctly after %u:%u!\n", (uint32_t)current.index, (uint32_t)current.generation, (uint32_t)stale.index, (uint32_t)stale.generation);
+			numErrors++;
+		}
+		slotIds[current.index] = current;
+	}
+	return numErrors;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Compares the resources held by models before and after a run of
+	CycleModels, once every unloaded model is deleted. Returns the number of
+	differences.
+*/
+static int
+CheckModelLeaks(ModelStats const& before, ModelStats const& after, size_t textureBytesBefore, size_t textureBytesAfter)
+{
+	int numErrors = 0;
+	struct { const char* name; uint64_t before; uint64_t after; } const counts[] = {
+		{ "models", before.numModels, after.numModels },
+		{ "retired models", before.numRetired, after.numRetired },
+		{ "model buffers", before.numBuffers, after.numBuffers },
+		{ "texture bytes", textureBytesBefore, textureBytesAfter },
+	};
+	for (auto const& count : counts)
+	{
+		if (count.before != count.after)
+		{
+			printf("Leak: %s were %llu before the run and are %llu after it!\n", count.name, (unsigned long long)count.before, (unsigned long long)count.after);
+			numErrors++;
+		}
+	}
+	return numErrors;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+BenchmarkApp::BenchmarkApp() :
+	window(nullptr),
+	result(0)
+{
+	// empty
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+BenchmarkApp::~BenchmarkApp()
+{
+	// empty
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+BenchmarkApp::Open()
+{
+	App::Open();
+	Core::JobSystem::Create();
+	this->window = new Display::Window;
+	this->window->SetSize(1280, 720);
+	this->window->SetTitle("benchmark");
+
+	// dynamic resolution would change the work done between runs, it stays off unless asked for
+	Core::CVarCreate(Core::CVarType::CVar_Int, "r_dynamic_resolution", "0", "Adjust r_render_scale automatically to stay within r_dynamic_resolution_budget");
+
+	if (this->window->Open())
+	{
+		RenderDevice::Init();
+		return true;
+	}
+	this->result = 1;
+	return false;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+BenchmarkApp::Run()
+{
+	Core::CVar* bm_scenario = Core::CVarCreate(Core::CVarType::CVar_String, "bm_scenario", "default", "Scenario to run");
+	Core::CVar* bm_frames = Core::CVarCreate(Core::CVarType::CVar_Int, "bm_frames", "0", "Frames to measure, 0 uses the length of the scenario");
+	Core::CVar* bm_warmup = Core::CVarCreate(Core::CVarType::CVar_Int, "bm_warmup", "60", "Frames rendered before measuring");
+	Core::CVar* bm_output = Core::CVarCreate(Core::CVarType::CVar_String, "bm_output", "benchmark.json", "Path of the report");
+	Core::CVar* bm_baseline = Core::CVarCreate(Core::CVarType::CVar_String, "bm_baseline", "", "Report of an earlier run to compare against, empty to skip");
+	Core::CVar* bm_cpu_threshold = Core::CVarCreate(Core::CVarType::CVar_Float, "bm_cpu_threshold", "10", "Allowed increase of CPU times over the baseline, in percent");
+	Core::CVar* bm_gpu_threshold = Core::CVarCreate(Core::CVarType::CVar_Float, "bm_gpu_threshold", "10", "Allowed increase of GPU times over the baseline, in percent");
+	Core::CVar* r_render_thread = Core::CVarCreate(Core::CVarType::CVar_Int, "r_render_thread", "1", "Submit GL commands from a dedicated render thread");
+
+	Scenario scenario;
+	{
+		Scenario const* found = FindScenario(Core::CVarReadString(bm_scenario));
+		if (found == nullptr)
+		{
+			printf("Unknown scenario '%s', available scenarios:\n", Core::CVarReadString(bm_scenario));
+			for (Scenario const& s : scenarios)
+				printf("  %-12s %s\n", s.name, s.description);
+			this->result = 1;
+			return;
+		}
+		scenario = *found;
+	}
+	if (Core::CVarReadInt(bm_frames) > 0)
+		scenario.numFrames = Core::CVarReadInt(bm_frames);
+	int const warmupFrames = std::max(0, Core::CVarReadInt(bm_warmup));
+
+	int w;
+	int h;
+	this->window->GetSize(w, h);
+	Camera* cam = CameraManager::GetCamera(CAMERA_MAIN);
+	cam->projection = glm::perspective(glm::radians(90.0f), float(w) / float(h), 0.01f, 1000.f);
+	cam->view = GetCameraView(scenario, 0.0f);
+
+	// load the resources of the field up front, loading is only measured in model cycles
+	ModelId models[NUM_ASTEROID_MODELS];
+	Physics::ColliderMeshId colliderMeshes[NUM_ASTEROID_MODELS];
+	if (scenario.numAsteroids > 0)
+	{
+		for (int i = 0; i < NUM_ASTEROID_MODELS; i++)
+		{
+			models[i] = LoadModel(asteroidModels[i]);
+			colliderMeshes[i] = Physics::LoadColliderMesh(asteroidColliders[i]);
+		}
+	}
+	std::vector<const char*> skybox(6, "assets/space/bg.png");
+	RenderDevice::SetSkybox(TextureResource::LoadCubemap("skybox", skybox, true));
+
+	// spawn the scenario, the random sequence is the same on every run
+	std::vector<std::pair<ModelId, glm::mat4>> asteroids;
+	for (int i = 0; i < scenario.numAsteroids; i++)
+	{
+		size_t const resourceIndex = (size_t)(Core::FastRandom() % NUM_ASTEROID_MODELS);
+		glm::vec3 const translation = glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * scenario.span;
+		glm::mat4 const transform = glm::rotate(translation.x, normalize(translation)) * glm::translate(translation);
+		Physics::CreateCollider(colliderMeshes[resourceIndex], transform);
+		asteroids.push_back({ models[resourceIndex], transform });
+	}
+	for (int i = 0; i < scenario.numLights; i++)
+	{
+		glm::vec3 const translation = glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * scenario.span;
+		glm::vec3 const color = glm::vec3(Core::RandomFloat(), Core::RandomFloat(), Core::RandomFloat());
+		LightServer::CreatePointLight(translation, color, Core::RandomFloat() * 4.0f, 1.0f + (15 + Core::RandomFloat() * 10.0f));
+	}
+	// rays from outside the field towards points inside it
+	std::vector<std::pair<glm::vec3, glm::vec3>> rays;
+	for (int i = 0; i < scenario.numRays; i++)
+	{
+		glm::vec3 const start = normalize(glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) + glm::vec3(0.0f, 0.0f, 1e-3f)) * scenario.span * 1.5f;
+		glm::vec3 const target = glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * scenario.span * 0.5f;
+		rays.push_back({ start, normalize(target - start) });
+	}
+
+	N_PROFILE_THREAD("Main");
+	if (Core::CVarReadInt(r_render_thread) != 0)
+		RenderThread::Start(this->window);
+
+	int const numFrames = warmupFrames + scenario.numFrames;
+	// number the GPU profiler gives the next frame, it begins one per Render
+	uint64_t renderedFrames = 0;
+	ModelCycles modelCycles;
+	bool cycleModels = false;
+	auto RunFrame = [&](int frame) -> FrameSample
+	{
+		N_PROFILE_FRAME();
+		FrameSample sample;
+		auto const timeStart = std::chrono::steady_clock::now();
+
+		this->window->Update();
+		cam->view = GetCameraView(scenario, numFrames > 1 ? frame / float(numFrames - 1) : 0.0f);
+
+		if (!rays.empty())
+		{
+			N_PROFILE_SCOPE("Raycasts");
+			auto const raycastStart = std::chrono::steady_clock::now();
+			for (auto const& ray : rays)
+				Physics::Raycast(ray.first, ray.second, scenario.span * 3.0f);
+			sample.raycastMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - raycastStart).count();
+		}
+
+		if (cycleModels)
+		{
+			N_PROFILE_SCOPE("ModelCycles");
+			auto const cycleStart = std::chrono::steady_clock::now();
+			CycleModels(modelCycles, scenario.numModelCycles);
+			sample.modelCycleMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - cycleStart).count();
+		}
+
+		for (auto const& asteroid : asteroids)
+			RenderDevice::Draw(asteroid.first, asteroid.second);
+		if (modelCycles.kept != ModelId::Invalid())
+			RenderDevice::Draw(modelCycles.kept, glm::scale(glm::vec3(4.0f)));
+		RenderDevice::Render(this->window);
+		renderedFrames++;
+
+		sample.cpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+		RenderDevice::DrawStats const drawStats = RenderDevice::GetDrawStats();
+		sample.drawCalls = drawStats.drawCalls;
+		sample.triangles = drawStats.triangles;
+		sample.textureBytes = TextureResource::GetResidencyStats().residentBytes;
+		sample.renderTargetBytes = RenderDevice::GetFrameGraphStats().pooledBytes;
+		return sample;
+	};
+
+	// streamed textures would change the work of the first frames
+	int settleFrames = 0;
+	while (TextureResource::GetNumStreamingTextures() > 0 && settleFrames < MAX_SETTLE_FRAMES)
+	{
+		RunFrame(0);
+		settleFrames++;
+	}
+
+	printf("Running '%s' for %d frames after %d warm up frames at %dx%d\n", scenario.name, scenario.numFrames, warmupFrames, w, h);
+	std::vector<FrameSample> samples;
+	std::vector<uint64_t> sampleFrames;
+	samples.reserve(scenario.numFrames);
+	sampleFrames.reserve(scenario.numFrames);
+	ModelStats const modelsBefore = GetModelStats();
+	size_t const textureBytesBefore = TextureResource::GetResidencyStats().residentBytes;
+	GpuProfiler::BeginFrameLog();
+	cycleModels = scenario.numModelCycles > 0;
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		uint64_t const renderedFrame = renderedFrames;
+		FrameSample const sample = RunFrame(frame);
+		if (frame >= warmupFrames)
+		{
+			samples.push_back(sample);
+			sampleFrames.push_back(renderedFrame);
+		}
+	}
+	cycleModels = false;
+	if (modelCycles.kept != ModelId::Invalid())
+	{
+		UnloadModel(modelCycles.kept);
+		modelCycles.kept = ModelId::Invalid();
+	}
+	for (int i = 0; i < TRAILING_FRAMES; i++)
+		RunFrame(numFrames - 1);
+
+	if (scenario.numModelCycles > 0)
+	{
+		// unloaded models are deleted on the render thread once their fences have passed
+		for (int i = 0; i < MAX_RETIRE_FRAMES && GetNumRetiredModels() > 0; i++)
+			RunFrame(numFrames - 1);
+		ModelStats const modelsAfter = GetModelStats();
+		int numLeaks = CheckModelLeaks(modelsBefore, modelsAfter, textureBytesBefore, TextureResource::GetResidencyStats().residentBytes);
+		if (modelCycles.numSaturatedSlots != 0 && modelsAfter.numSlots != modelCycles.numSaturatedSlots)
+		{
+			printf("Leak: model slots grew from %u to %u after the pool was saturated!\n", modelCycles.numSaturatedSlots, modelsAfter.numSlots);
+			numLeaks++;
+		}
+		int const numIdErrors = modelCycles.numErrors + CheckModelIdWraps();
+		printf("Loaded and unloaded %llu models, %u model slots\n", (unsigned long long)modelCycles.numCycles, modelsAfter.numSlots);
+		if (numIdErrors > 0 || numLeaks > 0)
+		{
+			printf("%d model id errors and %d leaks\n", numIdErrors, numLeaks);
+			this->result = 1;
+		}
+	}
+	RenderThread::Stop();
+
+	// GPU times are read back a few frames late, match them to the frames they were measured in
+	std::vector<GpuProfiler::FrameTimes> const gpuFrames = GpuProfiler::EndFrameLog();
+	size_t gpuFrame = 0;
+	int numUnresolved = 0;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		while (gpuFrame < gpuFrames.size() && gpuFrames[gpuFrame].frame < sampleFrames[i])
+			gpuFrame++;
+		if (gpuFrame < gpuFrames.size() && gpuFrames[gpuFrame].frame == sampleFrames[i])
+		{
+			samples[i].gpuMs = gpuFrames[gpuFrame].GetZoneTime("Frame");
+			samples[i].sceneGpuMs = RenderDevice::GetRenderTime(gpuFrames[gpuFrame]);
+			samples[i].gpuResolved = true;
+		}
+		else
+			numUnresolved++;
+	}
+	if (numUnresolved > 0)
+		printf("%d of %zu frames have no GPU times, the GPU profiler dropped them\n", numUnresolved, samples.size());
+
+	std::vector<float> cpuTimes;
+	std::vector<float> gpuTimes;
+	for (FrameSample const& sample : samples)
+	{
+		cpuTimes.push_back(sample.cpuMs);
+		if (sample.gpuResolved)
+			gpuTimes.push_back(sample.gpuMs);
+	}
+	MetricStats const cpu = ComputeStats(cpuTimes);
+	MetricStats const gpu = ComputeStats(gpuTimes);
+	printf("CPU frame time: avg %.3f ms, p95 %.3f ms, max %.3f ms\n", cpu.avg, cpu.p95, cpu.max);
+	printf("GPU frame time: avg %.3f ms, p95 %.3f ms, max %.3f ms\n", gpu.avg, gpu.p95, gpu.max);
+
+	std::string const output = Core::CVarReadString(bm_output);
+	if (WriteReport(output, scenario.name, w, h, samples))
+		printf("Wrote report to '%s'\n", output.c_str());
+	else
+		this->result = 1;
+
+	std::string const baseline = Core::CVarReadString(bm_baseline);
+	if (!baseline.empty())
+	{
+		Thresholds thresholds;
+		thresholds.cpu = Core::CVarReadFloat(bm_cpu_threshold);
+		thresholds.gpu = Core::CVarReadFloat(bm_gpu_threshold);
+		int const regressions = CompareToBaseline(baseline, scenario.name, samples, thresholds);
+		if (regressions < 0)
+			this->result = 1;
+		else if (regressions > 0)
+		{
+			printf("%d timings regressed against '%s'\n", regressions, baseline.c_str());
+			this->result = 2;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+void
+BenchmarkApp::Exit()
+{
+	RenderThread::Stop();
+	if (this->window->IsOpen())
+		this->window->Close();
+	Core::JobSystem::Destroy();
+}
+
+} // namespace Benchmark
@@ -0,0 +1,53 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	Benchmark application
+
+	Replays a scripted scenario through the renderer, physics and lights for a
+	fixed number of frames, and writes the measurements of every frame to a
+	report. Everything the scenario spawns and every camera position is a
+	function of the frame number, so two runs render the same frames.
+
+	The run is set up with cvars, see main.cc.
+
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include "core/app.h"
+#include "render/window.h"
+
+namespace Benchmark
+{
+class BenchmarkApp : public Core::App
+{
+public:
+	/// constructor
+	BenchmarkApp();
+	/// destructor
+	~BenchmarkApp();
+
+	/// open app
+	bool Open();
+	/// run the scenario
+	void Run();
+	/// exit app
+	void Exit();
+
+	/// exit code of the run, non-zero if it failed or regressed against the baseline
+	int GetResult() const;
+
+private:
+	Display::Window* window;
+	int result;
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline int
+BenchmarkApp::GetResult() const
+{
+	return this->result;
+}
+
+} // namespace Benchmark
@@ -0,0 +1,33 @@
+//------------------------------------------------------------------------------
+// main.cc
+// Runs a benchmark scenario and writes a report of its frame times. Run it
+// from the bin directory, like the game. Runs are set up with cvars:
+//
+// usage: benchmark [+bm_scenario name] [+bm_frames n] [+bm_warmup n]
+//                  [+bm_output report.json] [+bm_baseline earlier.json]
+//                  [+bm_cpu_threshold percent] [+bm_gpu_threshold percent]
+//                  [+r_headless 1] [+cvar value ...]
+//
+// Exits with 1 if the run failed, or the streaming scenario found a leak or
+// a stale model id, and with 2 if a timing regressed by more
+// than its threshold against the baseline.
+//
+// (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "benchmarkapp.h"
+#include "core/cvar.h"
+
+int
+main(int argc, const char** argv)
+{
+	Core::CVarParseCommandLine(argc, argv);
+	Benchmark::BenchmarkApp app;
+	if (app.Open())
+	{
+		app.Run();
+		app.Close();
+	}
+	app.Exit();
+	return app.GetResult();
+}
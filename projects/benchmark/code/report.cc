@@ -0,0 +1,194 @@
+//------------------------------------------------------------------------------
+//  report.cc
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "report.h"
+#include "render/json.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace Benchmark
+{
+
+/// which threshold a metric is held to, counts are only reported
+enum class MetricKind
+{
+	CpuTime,
+	GpuTime,
+	Count
+};
+
+/// a metric of the report and how to read it from a sample
+struct Metric
+{
+	const char* name;
+	MetricKind kind;
+	float (*get)(FrameSample const& sample);
+};
+
+static const Metric metrics[] = {
+	{ "cpuMs", MetricKind::CpuTime, [](FrameSample const& s) { return s.cpuMs; } },
+	{ "raycastMs", MetricKind::CpuTime, [](FrameSample const& s) { return s.raycastMs; } },
+	{ "modelCycleMs", MetricKind::CpuTime, [](FrameSample const& s) { return s.modelCycleMs; } },
+	{ "gpuMs", MetricKind::GpuTime, [](FrameSample const& s) { return s.gpuMs; } },
+	{ "sceneGpuMs", MetricKind::GpuTime, [](FrameSample const& s) { return s.sceneGpuMs; } },
+	{ "drawCalls", MetricKind::Count, [](FrameSample const& s) { return (float)s.drawCalls; } },
+	{ "triangles", MetricKind::Count, [](FrameSample const& s) { return (float)s.triangles; } },
+	{ "textureMB", MetricKind::Count, [](FrameSample const& s) { return s.textureBytes / (1024.0f * 1024.0f); } },
+	{ "renderTargetMB", MetricKind::Count, [](FrameSample const& s) { return s.renderTargetBytes / (1024.0f * 1024.0f); } },
+};
+
+//------------------------------------------------------------------------------
+/**
+*/
+static MetricStats
+ComputeMetricStats(Metric const& metric, std::vector<FrameSample> const& samples)
+{
+	std::vector<float> values;
+	values.reserve(samples.size());
+	for (FrameSample const& sample : samples)
+	{
+		if (metric.kind != MetricKind::GpuTime || sample.gpuResolved)
+			values.push_back(metric.get(sample));
+	}
+	return ComputeStats(std::move(values));
+}
+
+//------------------------------------------------------------------------------
+/**
+	GPU times of frames the profiler dropped are written as null.
+*/
+static std::string
+FormatGpuTime(FrameSample const& sample, float time)
+{
+	if (!sample.gpuResolved)
+		return "null";
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%f", time);
+	return buffer;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+MetricStats
+ComputeStats(std::vector<float> values)
+{
+	MetricStats stats;
+	if (values.empty())
+		return stats;
+
+	std::sort(values.begin(), values.end());
+	double sum = 0.0;
+	for (float const value : values)
+		sum += value;
+
+	size_t const last = values.size() - 1;
+	stats.avg = (float)(sum / values.size());
+	stats.min = values.front();
+	stats.max = values.back();
+	stats.p50 = values[last / 2];
+	stats.p95 = values[(last * 95) / 100];
+	stats.p99 = values[(last * 99) / 100];
+	return stats;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+bool
+WriteReport(std::string const& path, std::string const& scenario, int width, int height, std::vector<FrameSample> const& samples)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+	{
+		printf("Could not open benchmark report '%s' for writing!\n", path.c_str());
+		return false;
+	}
+
+	size_t const numMetrics = sizeof(metrics) / sizeof(metrics[0]);
+	fprintf(file, "{\n");
+	fprintf(file, "  \"scenario\": \"%s\",\n", scenario.c_str());
+	fprintf(file, "  \"width\": %d, \"height\": %d,\n", width, height);
+	fprintf(file, "  \"frames\": %zu,\n", samples.size());
+	fprintf(file, "  \"summary\": {\n");
+	for (size_t m = 0; m < numMetrics; m++)
+	{
+		MetricStats const stats = ComputeMetricStats(metrics[m], samples);
+		fprintf(file, "    \"%s\": { \"avg\": %f, \"min\": %f, \"max\": %f, \"p50\": %f, \"p95\": %f, \"p99\": %f }%s\n",
+			metrics[m].name, stats.avg, stats.min, stats.max, stats.p50, stats.p95, stats.p99, m + 1 < numMetrics ? "," : "");
+	}
+	fprintf(file, "  },\n");
+	fprintf(file, "  \"samples\": [\n");
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		FrameSample const& s = samples[i];
+		fprintf(file, "    { \"cpuMs\": %f, \"raycastMs\": %f, \"modelCycleMs\": %f, \"gpuMs\": %s, \"sceneGpuMs\": %s, \"drawCalls\": %u, \"triangles\": %llu, \"textureBytes\": %llu, \"renderTargetBytes\": %llu }%s\n",
+			s.cpuMs, s.raycastMs, s.modelCycleMs, FormatGpuTime(s, s.gpuMs).c_str(), FormatGpuTime(s, s.sceneGpuMs).c_str(), s.drawCalls, (unsigned long long)s.triangles,
+			(unsigned long long)s.textureBytes, (unsigned long long)s.renderTargetBytes, i + 1 < samples.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+	bool const ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Timings are compared by their average and 95th percentile, the other
+	metrics are only printed.
+*/
+int
+CompareToBaseline(std::string const& path, std::string const& scenario, std::vector<FrameSample> const& samples, Thresholds const& thresholds)
+{
+	std::ifstream stream(path);
+	if (!stream)
+	{
+		printf("Could not open baseline '%s'!\n", path.c_str());
+		return -1;
+	}
+	nlohmann::json const baseline = nlohmann::json::parse(stream, nullptr, false);
+	if (baseline.is_discarded() || !baseline.is_object() || baseline.find("summary") == baseline.end())
+	{
+		printf("Baseline '%s' is not a benchmark report!\n", path.c_str());
+		return -1;
+	}
+	std::string const baselineScenario = baseline.value("scenario", "");
+	if (baselineScenario != scenario)
+	{
+		printf("Baseline '%s' is of scenario '%s', not '%s'!\n", path.c_str(), baselineScenario.c_str(), scenario.c_str());
+		return -1;
+	}
+
+	nlohmann::json const& summary = baseline["summary"];
+	int regressions = 0;
+	printf("%-16s %-4s %12s %12s %9s\n", "metric", "", "baseline", "current", "change");
+	for (Metric const& metric : metrics)
+	{
+		auto const entry = summary.find(metric.name);
+		if (entry == summary.end())
+			continue;
+
+		float threshold = -1.0f;
+		if (metric.kind == MetricKind::CpuTime)
+			threshold = thresholds.cpu;
+		else if (metric.kind == MetricKind::GpuTime)
+			threshold = thresholds.gpu;
+
+		MetricStats const stats = ComputeMetricStats(metric, samples);
+		struct { const char* name; float current; } const values[] = { { "avg", stats.avg }, { "p95", stats.p95 } };
+		for (auto const& value : values)
+		{
+			float const reference = entry->value(value.name, 0.0f);
+			float const change = reference > 0.0f ? (value.current / reference - 1.0f) * 100.0f : 0.0f;
+			bool const regressed = threshold >= 0.0f && change > threshold;
+			printf("%-16s %-4s %12.3f %12.3f %+8.1f%%%s\n", metric.name, value.name, reference, value.current, change, regressed ? "  REGRESSION" : "");
+			if (regressed)
+				regressions++;
+		}
+	}
+	return regressions;
+}
+
+} // namespace Benchmark
@@ -0,0 +1,85 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file report.h
+
+	Per frame measurements of a benchmark run, written to JSON and compared
+	against the report of an earlier run.
+
+	A report holds a summary of every metric, followed by the samples of
+	every measured frame:
+
+	{
+	  "scenario": "asteroids",
+	  "width": 1024, "height": 720,
+	  "frames": 600,
+	  "summary": {
+	    "cpuMs": { "avg": ..., "min": ..., "max": ..., "p50": ..., "p95": ..., "p99": ... },
+	    ...
+	  },
+	  "samples": [ { "cpuMs": ..., "gpuMs": ..., ... }, ... ]
+	}
+
+	GPU times are read back a few frames late and matched to their frames
+	after the run. Frames the GPU profiler dropped have no GPU times, they are
+	written as null and left out of the GPU statistics.
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <string>
+#include <vector>
+
+namespace Benchmark
+{
+
+/// measurements of one frame
+struct FrameSample
+{
+	/// game thread time of the whole frame, including waiting for the render thread
+	float cpuMs = 0.0f;
+	/// time spent in the raycasts of the scenario
+	float raycastMs = 0.0f;
+	/// time spent loading and unloading the models of the scenario
+	float modelCycleMs = 0.0f;
+	/// GPU time of the whole frame
+	float gpuMs = 0.0f;
+	/// GPU time of the resolution dependent passes, see RenderDevice::GetRenderTime
+	float sceneGpuMs = 0.0f;
+	/// false if the GPU profiler dropped the frame, gpuMs and sceneGpuMs are not valid then
+	bool gpuResolved = false;
+	uint32_t drawCalls = 0;
+	uint64_t triangles = 0;
+	/// estimated memory of all textures
+	uint64_t textureBytes = 0;
+	/// memory of the render targets pooled by the frame graph
+	uint64_t renderTargetBytes = 0;
+};
+
+/// distribution of one metric over all samples
+struct MetricStats
+{
+	float avg = 0.0f;
+	float min = 0.0f;
+	float max = 0.0f;
+	float p50 = 0.0f;
+	float p95 = 0.0f;
+	float p99 = 0.0f;
+};
+
+/// allowed increase of each timing over the baseline, in percent
+struct Thresholds
+{
+	float cpu = 10.0f;
+	float gpu = 10.0f;
+};
+
+/// compute the distribution of a metric
+MetricStats ComputeStats(std::vector<float> values);
+/// write a report of a run, returns false if the file could not be written
+bool WriteReport(std::string const& path, std::string const& scenario, int width, int height, std::vector<FrameSample> const& samples);
+/// compare a run against a report written earlier and print the differences. Returns the number of timings over their threshold, or -1 if the baseline could not be read.
+int CompareToBaseline(std::string const& path, std::string const& scenario, std::vector<FrameSample> const& samples, Thresholds const& thresholds);
+
+} // namespace Benchmark
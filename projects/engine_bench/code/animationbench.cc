@@ -0,0 +1,211 @@
+//------------------------------------------------------------------------------
+//  animationbench.cc
+//  Skeletal animation of many instances.
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "microbench.h"
+#include "render/animation.h"
+#include "render/gltf.h"
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+using namespace Render;
+
+/// joints of the test chain
+static const uint32_t CHAIN_JOINTS = 32;
+/// height of the test chain
+static const float CHAIN_HEIGHT = 4.0f;
+/// key rate and length of the test clip
+static const uint32_t CLIP_FPS = 30;
+static const float CLIP_DURATION = 2.0f;
+
+//------------------------------------------------------------------------------
+/**
+	Appends floats to the buffer of a document and adds an accessor for them.
+*/
+static int32_t
+AddAccessor(fx::gltf::Document& doc, std::vector<float> const& values, uint32_t components, fx::gltf::Accessor::Type type)
+{
+	fx::gltf::Buffer& buffer = doc.buffers.front();
+	fx::gltf::BufferView view;
+	view.buffer = 0;
+	view.byteOffset = (uint32_t)buffer.data.size();
+	view.byteLength = (uint32_t)(values.size() * sizeof(float));
+	buffer.data.resize(buffer.data.size() + view.byteLength);
+	std::memcpy(buffer.data.data() + view.byteOffset, values.data(), view.byteLength);
+	buffer.byteLength = (uint32_t)buffer.data.size();
+	doc.bufferViews.push_back(view);
+
+	fx::gltf::Accessor accessor;
+	accessor.bufferView = (int32_t)doc.bufferViews.size() - 1;
+	accessor.componentType = fx::gltf::Accessor::ComponentType::Float;
+	accessor.count = (uint32_t)(values.size() / components);
+	accessor.type = type;
+	doc.accessors.push_back(accessor);
+	return (int32_t)doc.accessors.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Writes a chain of CHAIN_JOINTS joints that sways back and forth, with a
+	rotation and a translation track per joint, and returns its path.
+*/
+static std::string
+WriteChain()
+{
+	fx::gltf::Document doc;
+	doc.buffers.resize(1);
+	float const segment = CHAIN_HEIGHT / CHAIN_JOINTS;
+
+	fx::gltf::Node root;
+	root.children.push_back(1);
+	doc.nodes.push_back(root);
+	std::vector<float> inverseBindMatrices;
+	fx::gltf::Skin skin;
+	for (uint32_t j = 0; j < CHAIN_JOINTS; j++)
+	{
+		fx::gltf::Node node;
+		node.translation = { 0.0f, j > 0 ? segment : 0.0f, 0.0f };
+		if (j + 1 < CHAIN_JOINTS)
+			node.children.push_back((int32_t)j + 2);
+		doc.nodes.push_back(node);
+		skin.joints.push_back((int32_t)j + 1);
+
+		glm::mat4 const inverseBind = glm::translate(glm::vec3(0.0f, -segment * j, 0.0f));
+		inverseBindMatrices.insert(inverseBindMatrices.end(), &inverseBind[0][0], &inverseBind[0][0] + 16);
+	}
+	skin.inverseBindMatrices = AddAccessor(doc, inverseBindMatrices, 16, fx::gltf::Accessor::Type::Mat4);
+	skin.skeleton = 1;
+	doc.skins.push_back(skin);
+
+	uint32_t const numKeys = (uint32_t)(CLIP_DURATION * CLIP_FPS) + 1;
+	std::vector<float> times;
+	for (uint32_t k = 0; k < numKeys; k++)
+		times.push_back((float)k / CLIP_FPS);
+	int32_t const input = AddAccessor(doc, times, 1, fx::gltf::Accessor::Type::Scalar);
+	doc.accessors[input].min = { 0.0f };
+	doc.accessors[input].max = { CLIP_DURATION };
+
+	fx::gltf::Animation animation;
+	for (uint32_t j = 0; j < CHAIN_JOINTS; j++)
+	{
+		std::vector<float> rotations, translations;
+		for (uint32_t k = 0; k < numKeys; k++)
+		{
+			float const angle = 0.15f * std::sin(2.0f * glm::pi<float>() * times[k] / CLIP_DURATION + j * 0.3f);
+			rotations.insert(rotations.end(), { 0.0f, 0.0f, std::sin(angle * 0.5f), std::cos(angle * 0.5f) });
+			translations.insert(translations.end(), { 0.0f, j > 0 ? segment : 0.0f, 0.0f });
+		}
+
+		fx::gltf::Animation::Sampler sampler;
+		sampler.input = input;
+		fx::gltf::Animation::Channel channel;
+		channel.target.node = (int32_t)j + 1;
+
+		sampler.output = AddAccessor(doc, rotations, 4, fx::gltf::Accessor::Type::Vec4);
+		channel.sampler = (int32_t)animation.samplers.size();
+		channel.target.path = "rotation";
+		animation.samplers.push_back(sampler);
+		animation.channels.push_back(channel);
+
+		sampler.output = AddAccessor(doc, translations, 3, fx::gltf::Accessor::Type::Vec3);
+		channel.sampler = (int32_t)animation.samplers.size();
+		channel.target.path = "translation";
+		animation.samplers.push_back(sampler);
+		animation.channels.push_back(channel);
+	}
+	doc.animations.push_back(animation);
+
+	std::string const path = (std::filesystem::temp_directory_path() / "engine_bench_chain.glb").string();
+	fx::gltf::Save(doc, path, true);
+	return path;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Loads the chain and its clip once and creates or destroys instances until
+	there are count of them, since Update animates all instances.
+*/
+static bool
+GetInstances(int64_t count, Animation::ClipId& clip, std::vector<Animation::InstanceId>*& instances)
+{
+	static Animation::ClipId chainClip = InvalidResourceId;
+	static std::vector<Animation::InstanceId> chainInstances;
+	static Animation::SkeletonId skeleton = InvalidResourceId;
+	if (skeleton == InvalidResourceId)
+	{
+		std::string const path = WriteChain();
+		skeleton = Animation::LoadSkeleton(path);
+		if (skeleton != InvalidResourceId)
+			chainClip = Animation::LoadClip(path, skeleton);
+	}
+	if (chainClip == InvalidResourceId)
+		return false;
+
+	while ((int64_t)chainInstances.size() < count)
+		chainInstances.push_back(Animation::CreateInstance(skeleton));
+	while ((int64_t)chainInstances.size() > count)
+	{
+		Animation::DestroyInstance(chainInstances.back());
+		chainInstances.pop_back();
+	}
+	clip = chainClip;
+	instances = &chainInstances;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Samples one clip on arg instances of a 32 joint chain and builds their
+	palettes. Items are instances.
+*/
+static void
+AnimationUpdate(MicroBench::State& state)
+{
+	Animation::ClipId clip;
+	std::vector<Animation::InstanceId>* instances;
+	if (!GetInstances(state.arg, clip, instances))
+	{
+		state.SkipWithError("could not write or load the test chain");
+		return;
+	}
+	for (int64_t i = 0; i < state.arg; i++)
+	{
+		Animation::SetLayer((*instances)[i], 0, clip, CLIP_DURATION * i / state.arg, 1.0f);
+		Animation::SetLayer((*instances)[i], 1, clip, 0.0f, 0.0f);
+	}
+	for (uint64_t i = 0; i < state.iterations; i++)
+		Animation::Update();
+	MicroBench::DoNotOptimize(Animation::GetPalettes().data());
+	state.itemsPerIteration = state.arg;
+}
+MICROBENCH(AnimationUpdate, 1, 1000);
+
+//------------------------------------------------------------------------------
+/**
+	Like AnimationUpdate, blending a second layer half a clip later.
+*/
+static void
+AnimationUpdateBlended(MicroBench::State& state)
+{
+	Animation::ClipId clip;
+	std::vector<Animation::InstanceId>* instances;
+	if (!GetInstances(state.arg, clip, instances))
+	{
+		state.SkipWithError("could not write or load the test chain");
+		return;
+	}
+	for (int64_t i = 0; i < state.arg; i++)
+	{
+		float const time = CLIP_DURATION * i / state.arg;
+		Animation::SetLayer((*instances)[i], 0, clip, time, 0.5f);
+		Animation::SetLayer((*instances)[i], 1, clip, time + CLIP_DURATION * 0.5f, 0.5f);
+	}
+	for (uint64_t i = 0; i < state.iterations; i++)
+		Animation::Update();
+	MicroBench::DoNotOptimize(Animation::GetPalettes().data());
+	state.itemsPerIteration = state.arg;
+}
+MICROBENCH(AnimationUpdateBlended, 1, 1000);
@@ -0,0 +1,133 @@
+//------------------------------------------------------------------------------
+//  corebench.cc
+//  Id pools, cvars and random numbers.
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "microbench.h"
+#include "core/idpool.h"
+#include "core/cvar.h"
+#include "core/random.h"
+
+/// id with the layout IdPool expects
+struct BenchId
+{
+	uint32_t index : 22;
+	uint32_t generation : 10;
+};
+
+//------------------------------------------------------------------------------
+/**
+	Allocates arg ids and frees them again. After the first iteration the pool
+	recycles freed ids.
+*/
+static void
+IdPoolAllocateDeallocate(MicroBench::State& state)
+{
+	Util::IdPool<BenchId> pool;
+	std::vector<BenchId> ids((size_t)state.arg);
+	for (uint64_t i = 0; i < state.iterations; i++)
+	{
+		for (BenchId& id : ids)
+			pool.Allocate(id);
+		for (BenchId const id : ids)
+			pool.Deallocate(id);
+	}
+	MicroBench::DoNotOptimize(pool.generations.data());
+	state.itemsPerIteration = ids.size() * 2;
+}
+MICROBENCH(IdPoolAllocateDeallocate, 1024, 65536);
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+IdPoolIsValid(MicroBench::State& state)
+{
+	Util::IdPool<BenchId> pool;
+	std::vector<BenchId> ids((size_t)state.arg);
+	for (BenchId& id : ids)
+		pool.Allocate(id);
+	for (uint64_t i = 0; i < state.iterations; i++)
+		MicroBench::DoNotOptimize(pool.IsValid(ids[i % ids.size()]));
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(IdPoolIsValid, 1024, 65536);
+
+//------------------------------------------------------------------------------
+/**
+	Creates arg cvars, as many as a game has, once.
+*/
+static std::vector<std::string> const&
+GetCVarNames(int64_t count)
+{
+	static std::vector<std::string> names;
+	while ((int64_t)names.size() < count)
+	{
+		names.push_back("bench_cvar_" + std::to_string(names.size()));
+		Core::CVarCreate(Core::CVar_Int, names.back().c_str(), "1");
+	}
+	return names;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+CVarGet(MicroBench::State& state)
+{
+	std::vector<std::string> const& names = GetCVarNames(state.arg);
+	for (uint64_t i = 0; i < state.iterations; i++)
+		MicroBench::DoNotOptimize(Core::CVarGet(names[i % state.arg].c_str()));
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(CVarGet, 16, 256);
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+CVarReadInt(MicroBench::State& state)
+{
+	Core::CVar* const cVar = Core::CVarGet(GetCVarNames(1)[0].c_str());
+	for (uint64_t i = 0; i < state.iterations; i++)
+		MicroBench::DoNotOptimize(Core::CVarReadInt(cVar));
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(CVarReadInt);
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+FastRandom(MicroBench::State& state)
+{
+	for (uint64_t i = 0; i < state.iterations; i++)
+		MicroBench::DoNotOptimize(Core::FastRandom());
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(FastRandom);
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+RandomFloat(MicroBench::State& state)
+{
+	for (uint64_t i = 0; i < state.iterations; i++)
+		MicroBench::DoNotOptimize(Core::RandomFloat());
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(RandomFloat);
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+RandomFloatNTP(MicroBench::State& state)
+{
+	for (uint64_t i = 0; i < state.iterations; i++)
+		MicroBench::DoNotOptimize(Core::RandomFloatNTP());
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(RandomFloatNTP);
@@ -0,0 +1,63 @@
+//------------------------------------------------------------------------------
+//  gltfbench.cc
+//  Parsing the .glb assets under assets/, one benchmark per file.
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "microbench.h"
+#include "render/gltf.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+//------------------------------------------------------------------------------
+/**
+	Parses a file from memory, so the numbers don't depend on the disk. Items
+	are bytes.
+*/
+static void
+GltfLoadFromBinary(MicroBench::State& state, std::string const& path)
+{
+	static std::string data;
+	static std::string loadedPath;
+	if (loadedPath != path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::stringstream contents;
+		contents << file.rdbuf();
+		data = contents.str();
+		loadedPath = path;
+	}
+
+	std::filesystem::path const root = std::filesystem::path(path).parent_path();
+	for (uint64_t i = 0; i < state.iterations; i++)
+	{
+		std::istringstream stream(data);
+		fx::gltf::Document const doc = fx::gltf::LoadFromBinary(stream, root);
+		MicroBench::DoNotOptimize(doc.buffers.data());
+	}
+	state.itemsPerIteration = data.size();
+}
+
+//------------------------------------------------------------------------------
+/**
+	The shipped assets differ between checkouts, so the benchmarks are found
+	when the program starts, relative to the bin directory.
+*/
+static int
+RegisterGltfBenchmarks()
+{
+	std::error_code error;
+	std::vector<std::string> paths;
+	for (auto const& entry : std::filesystem::recursive_directory_iterator("assets", error))
+	{
+		if (entry.is_regular_file() && entry.path().extension() == ".glb")
+			paths.push_back(entry.path().generic_string());
+	}
+	std::sort(paths.begin(), paths.end());
+	for (std::string const& path : paths)
+		MicroBench::Register("GltfLoadFromBinary/" + path, [path](MicroBench::State& state) { GltfLoadFromBinary(state, path); });
+	return 0;
+}
+static int const registered = RegisterGltfBenchmarks();
@@ -0,0 +1,47 @@
+//------------------------------------------------------------------------------
+// main.cc
+// Microbenchmarks of engine hot paths. Runs without a window or GL context.
+// Run it from the bin directory, like the game, so it finds the assets.
+//
+// usage: engine_bench [--filter substring] [--min-time seconds] [--repetitions n]
+//
+// (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "microbench.h"
+#include "render/cameramanager.h"
+#include "render/input/inputserver.h"
+#include <cstring>
+
+int
+main(int argc, const char** argv)
+{
+	std::string filter;
+	double minTime = 0.2;
+	int repetitions = 5;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+			minTime = atof(argv[++i]);
+		else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc)
+			repetitions = atoi(argv[++i]);
+		else
+		{
+			printf("usage: engine_bench [--filter substring] [--min-time seconds] [--repetitions n]\n");
+			return 1;
+		}
+	}
+
+	// singletons the benchmarked code expects, normally created by the render device and window
+	Render::CameraManager::Create();
+	Input::InputHandler::Create();
+
+	if (MicroBench::RunAll(filter, minTime, repetitions) == 0)
+	{
+		printf("No benchmark matches '%s'\n", filter.c_str());
+		return 1;
+	}
+	return 0;
+}
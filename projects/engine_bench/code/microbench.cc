@@ -0,0 +1,113 @@
+//------------------------------------------------------------------------------
+//  microbench.cc
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "microbench.h"
+#include <algorithm>
+
+namespace MicroBench
+{
+
+struct Benchmark
+{
+	std::string name;
+	Function function;
+	int64_t arg;
+	bool hasArg;
+};
+
+//------------------------------------------------------------------------------
+/**
+	Benchmarks register during static initialization, so the list is created
+	on first use.
+*/
+static std::vector<Benchmark>&
+GetBenchmarks()
+{
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+int
+Register(std::string const& name, Function const& function, std::vector<int64_t> const& args)
+{
+	if (args.empty())
+		GetBenchmarks().push_back({ name, function, 0, false });
+	for (int64_t const arg : args)
+		GetBenchmarks().push_back({ name, function, arg, true });
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Returns the measured time of one run, in seconds.
+*/
+static double
+Measure(Benchmark const& benchmark, uint64_t iterations, uint64_t& itemsPerIteration, std::string& error)
+{
+	State state;
+	state.arg = benchmark.arg;
+	state.iterations = iterations;
+	auto const start = std::chrono::steady_clock::now();
+	benchmark.function(state);
+	auto const end = std::chrono::steady_clock::now();
+	itemsPerIteration = state.itemsPerIteration;
+	error = state.error;
+	return std::chrono::duration<double>(end - start - state.paused).count();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+int
+RunAll(std::string const& filter, double minTime, int repetitions)
+{
+	printf("%-52s %14s %14s %14s %16s\n", "benchmark", "iterations", "median ns", "min ns", "items/s");
+	int numRun = 0;
+	for (Benchmark const& benchmark : GetBenchmarks())
+	{
+		std::string const name = benchmark.hasArg ? benchmark.name + "/" + std::to_string(benchmark.arg) : benchmark.name;
+		if (name.find(filter) == std::string::npos)
+			continue;
+
+		// grow the iteration count until a run takes long enough to time
+		uint64_t iterations = 1;
+		uint64_t itemsPerIteration = 0;
+		std::string error;
+		for (;;)
+		{
+			double const seconds = Measure(benchmark, iterations, itemsPerIteration, error);
+			if (!error.empty() || seconds >= minTime || iterations >= (1ull << 40))
+				break;
+			// aim a bit past the minimum time, but never grow more than tenfold at once
+			double const scale = seconds > 0.0 ? minTime * 1.4 / seconds : 10.0;
+			iterations = std::max(iterations + 1, (uint64_t)(iterations * std::min(scale, 10.0)));
+		}
+
+		if (!error.empty())
+		{
+			printf("%-52s skipped: %s\n", name.c_str(), error.c_str());
+			continue;
+		}
+
+		std::vector<double> times;
+		for (int i = 0; i < std::max(1, repetitions); i++)
+			times.push_back(Measure(benchmark, iterations, itemsPerIteration, error) / iterations);
+		std::sort(times.begin(), times.end());
+		double const median = times[times.size() / 2];
+
+		if (itemsPerIteration > 0)
+			printf("%-52s %14llu %14.2f %14.2f %16.4g\n", name.c_str(), (unsigned long long)iterations, median * 1e9, times[0] * 1e9, itemsPerIteration / median);
+		else
+			printf("%-52s %14llu %14.2f %14.2f %16s\n", name.c_str(), (unsigned long long)iterations, median * 1e9, times[0] * 1e9, "");
+		fflush(stdout);
+		numRun++;
+	}
+	return numRun;
+}
+
+} // namespace MicroBench
@@ -0,0 +1,116 @@
+#pragma once
+//------------------------------------------------------------------------------
+/**
+	@file microbench.h
+
+	A minimal microbenchmark runner.
+
+	A benchmark is a function that runs the measured code state.iterations
+	times. The runner first grows the iteration count until one run takes at
+	least the minimum time, then times a few runs of that many iterations and
+	reports the median and the fastest time per iteration.
+
+	Benchmarks registered with arguments run once per argument, which they
+	read from state.arg.
+
+		static void
+		BenchFoo(MicroBench::State& state)
+		{
+			for (uint64_t i = 0; i < state.iterations; i++)
+				MicroBench::DoNotOptimize(Foo(state.arg));
+		}
+		MICROBENCH(BenchFoo, 16, 256, 4096);
+
+	@copyright
+	(C) 2022 Individual contributors, see AUTHORS file
+*/
+//------------------------------------------------------------------------------
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#if _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace MicroBench
+{
+
+struct State
+{
+	/// argument of this run, 0 for benchmarks without arguments
+	int64_t arg = 0;
+	/// number of times to run the measured code
+	uint64_t iterations = 0;
+	/// work items per iteration, for the items per second column. 0 hides the column.
+	uint64_t itemsPerIteration = 0;
+
+	/// stop the clock, for setup that should not be measured
+	void PauseTiming();
+	/// start the clock again
+	void ResumeTiming();
+	/// give up on the benchmark, for example when its data is missing. Return right after.
+	void SkipWithError(std::string const& message);
+
+	std::string error;
+	std::chrono::steady_clock::duration paused = std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::time_point pauseStart;
+};
+
+typedef std::function<void(State& state)> Function;
+
+/// add a benchmark, once per argument. Returns a dummy so it can run during static initialization.
+int Register(std::string const& name, Function const& function, std::vector<int64_t> const& args = {});
+/// run every benchmark whose name contains the filter, each for at least minTime seconds per timed run. Returns the number of benchmarks run.
+int RunAll(std::string const& filter, double minTime, int repetitions);
+
+//------------------------------------------------------------------------------
+/**
+	Keeps the compiler from optimizing away a value that is never used.
+*/
+template<typename T>
+inline void
+DoNotOptimize(T const& value)
+{
+#if _MSC_VER
+	static volatile char sink;
+	sink = *reinterpret_cast<char const volatile*>(&value);
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void
+State::PauseTiming()
+{
+	this->pauseStart = std::chrono::steady_clock::now();
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void
+State::ResumeTiming()
+{
+	this->paused += std::chrono::steady_clock::now() - this->pauseStart;
+}
+
+//------------------------------------------------------------------------------
+/**
+*/
+inline void
+State::SkipWithError(std::string const& message)
+{
+	this->error = message;
+}
+
+} // namespace MicroBench
+
+#define N_MICROBENCH_CONCAT_IMPL(a, b) a##b
+#define N_MICROBENCH_CONCAT(a, b) N_MICROBENCH_CONCAT_IMPL(a, b)
+/// register a benchmark function, optionally followed by the arguments to run it with
+#define MICROBENCH(function, ...) static int const N_MICROBENCH_CONCAT(__microbench, __LINE__) = MicroBench::Register(#function, function, { __VA_ARGS__ })
@@ -0,0 +1,99 @@
+//------------------------------------------------------------------------------
+//  physicsbench.cc
+//  Raycasts and collider mesh loading.
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "microbench.h"
+#include "render/physics.h"
+#include "core/random.h"
+#include <filesystem>
+
+static const char* colliderMeshPath = "assets/system/icosphere.glb";
+// colliders are spread over a cube from -span to span
+static const float fieldSpan = 50.0f;
+static const int numRays = 1024;
+
+//------------------------------------------------------------------------------
+/**
+	Grows the synthetic field to at least count colliders. Colliders can't be
+	destroyed, so fields only grow and benchmarks must ask for them in
+	increasing order.
+*/
+static bool
+EnsureField(int64_t count)
+{
+	static Physics::ColliderMeshId mesh = Physics::ColliderMeshId::Invalid();
+	static int64_t numColliders = 0;
+	if (mesh == Physics::ColliderMeshId::Invalid())
+	{
+		if (!std::filesystem::exists(colliderMeshPath))
+			return false;
+		mesh = Physics::LoadColliderMesh(colliderMeshPath);
+	}
+	for (; numColliders < count; numColliders++)
+	{
+		glm::vec3 const translation = glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * fieldSpan;
+		float const scale = 0.5f + Core::RandomFloat() * 2.0f;
+		Physics::CreateCollider(mesh, glm::translate(translation) * glm::rotate(translation.x, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(scale)));
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Rays from outside the field towards points inside it, so about half of them
+	hit something.
+*/
+static std::vector<std::pair<glm::vec3, glm::vec3>> const&
+GetRays()
+{
+	static std::vector<std::pair<glm::vec3, glm::vec3>> rays;
+	while (rays.size() < numRays)
+	{
+		glm::vec3 const start = normalize(glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) + glm::vec3(0.0f, 0.0f, 1e-3f)) * fieldSpan * 2.0f;
+		glm::vec3 const target = glm::vec3(Core::RandomFloatNTP(), Core::RandomFloatNTP(), Core::RandomFloatNTP()) * fieldSpan * 0.5f;
+		rays.push_back({ start, normalize(target - start) });
+	}
+	return rays;
+}
+
+//------------------------------------------------------------------------------
+/**
+	Casts through a field of arg colliders.
+*/
+static void
+Raycast(MicroBench::State& state)
+{
+	if (!EnsureField(state.arg))
+	{
+		state.SkipWithError(std::string("missing ") + colliderMeshPath + ", run from the bin directory");
+		return;
+	}
+	std::vector<std::pair<glm::vec3, glm::vec3>> const& rays = GetRays();
+	for (uint64_t i = 0; i < state.iterations; i++)
+	{
+		auto const& ray = rays[i % numRays];
+		MicroBench::DoNotOptimize(Physics::Raycast(ray.first, ray.second, fieldSpan * 4.0f));
+	}
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(Raycast, 16, 128, 1024);
+
+//------------------------------------------------------------------------------
+/**
+	Every load adds a new mesh, they are never freed.
+*/
+static void
+LoadColliderMesh(MicroBench::State& state)
+{
+	if (!std::filesystem::exists(colliderMeshPath))
+	{
+		state.SkipWithError(std::string("missing ") + colliderMeshPath + ", run from the bin directory");
+		return;
+	}
+	for (uint64_t i = 0; i < state.iterations; i++)
+		MicroBench::DoNotOptimize(Physics::LoadColliderMesh(colliderMeshPath));
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(LoadColliderMesh);
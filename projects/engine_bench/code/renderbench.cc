@@ -0,0 +1,46 @@
+//------------------------------------------------------------------------------
+//  renderbench.cc
+//  Per frame work of the render and input modules that needs no GL context.
+//  (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "microbench.h"
+#include "render/cameramanager.h"
+#include "render/input/inputserver.h"
+
+//------------------------------------------------------------------------------
+/**
+	Updates the derived matrices of arg cameras. Cameras can't be destroyed,
+	so benchmarks must ask for them in increasing order.
+*/
+static void
+CameraManagerOnBeforeRender(MicroBench::State& state)
+{
+	static int64_t numCameras = 1;
+	for (; numCameras < state.arg; numCameras++)
+	{
+		Render::CameraCreateInfo info;
+		info.hash = uint32_t('BC00') + (uint32_t)numCameras;
+		info.projection = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.01f, 1000.0f);
+		info.view = glm::lookAt(glm::vec3((float)numCameras, 1.0f, -5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		Render::CameraManager::CreateCamera(info);
+	}
+	for (uint64_t i = 0; i < state.iterations; i++)
+		Render::CameraManager::OnBeforeRender();
+	MicroBench::DoNotOptimize(Render::CameraManager::GetCamera(CAMERA_MAIN)->viewProjection);
+	state.itemsPerIteration = state.arg;
+}
+MICROBENCH(CameraManagerOnBeforeRender, 1, 8, 16);
+
+//------------------------------------------------------------------------------
+/**
+*/
+static void
+InputHandlerBeginFrame(MicroBench::State& state)
+{
+	for (uint64_t i = 0; i < state.iterations; i++)
+		Input::InputHandler::BeginFrame();
+	MicroBench::DoNotOptimize(Input::GetDefaultKeyboard()->pressed[0]);
+	state.itemsPerIteration = 1;
+}
+MICROBENCH(InputHandlerBeginFrame);
@@ -4,10 +4,13 @@
 //------------------------------------------------------------------------------
 #include "config.h"
 #include "spacegameapp.h"
+#include "core/cvar.h"
 
 int
 main(int argc, const char** argv)
 {
+	// cvars can be set like spacegame +r_headless 1 +cl_frames 600
+	Core::CVarParseCommandLine(argc, argv);
 	Game::SpaceGameApp app;
 	if (app.Open())
 	{
@@ -14,11 +14,20 @@
 #include "render/cameramanager.h"
 #include "render/lightserver.h"
 #include "render/debugrender.h"
+#include "render/gpuprofiler.h"
+#include "render/renderthread.h"
 #include "core/random.h"
 #include "render/input/inputserver.h"
 #include "core/cvar.h"
+#include "core/profiler.h"
+#include "core/jobsystem.h"
 #include "render/physics.h"
+#include "render/particlesystem.h"
+#include "render/animation.h"
+#include "render/framecapture.h"
+#include <algorithm>
 #include <chrono>
+#include <filesystem>
 #include "spaceship.h"
 
 using namespace Display;
@@ -50,6 +59,7 @@ bool
 SpaceGameApp::Open()
 {
 	App::Open();
+	Core::JobSystem::Create();
 	this->window = new Display::Window;
     this->window->SetSize(1024, 720);
 
@@ -71,6 +81,34 @@ SpaceGameApp::Open()
 	return false;
 }
 
+//------------------------------------------------------------------------------
+/**
+    Prints CPU frame times and the renderer counters, for comparing runs.
+*/
+static void
+PrintFrameStats(std::vector<float> frameTimes, double totalRenderTime)
+{
+    if (frameTimes.empty())
+        return;
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+    double total = 0.0;
+    for (float const t : frameTimes)
+        total += t;
+    size_t const count = frameTimes.size();
+
+    printf("Frames: %zu\n", count);
+    printf("CPU frame time: avg %.3f ms, min %.3f ms, p95 %.3f ms, max %.3f ms\n",
+        total / count, frameTimes[0], frameTimes[(count * 95) / 100], frameTimes[count - 1]);
+    printf("Scene GPU time: avg %.3f ms\n", totalRenderTime / count);
+    FrameGraph::Stats const graphStats = RenderDevice::GetFrameGraphStats();
+    printf("Frame graph: %d passes, %d culled, peak transient memory %.1f MB\n",
+        graphStats.numPasses, graphStats.numCulledPasses, graphStats.peakTransientBytes / (1024.0f * 1024.0f));
+    printf("Particles: %u\n", ParticleSystem::GetNumParticles());
+    FrameCapture::Stats const captureStats = FrameCapture::GetStats();
+    printf("Captured frames: %u written, %u dropped, %u failed\n", captureStats.written, captureStats.dropped, captureStats.failed);
+}
+
 //------------------------------------------------------------------------------
 /**
 */
@@ -86,12 +124,12 @@ SpaceGameApp::Run()
 
     // load all resources
     ModelId models[6] = {
-        LoadModel("assets/space/Asteroid_1.glb"),
-        LoadModel("assets/space/Asteroid_2.glb"),
-        LoadModel("assets/space/Asteroid_3.glb"),
-        LoadModel("assets/space/Asteroid_4.glb"),
-        LoadModel("assets/space/Asteroid_5.glb"),
-        LoadModel("assets/space/Asteroid_6.glb")
+        LoadModelAsync("assets/space/Asteroid_1.glb"),
+        LoadModelAsync("assets/space/Asteroid_2.glb"),
+        LoadModelAsync("assets/space/Asteroid_3.glb"),
+        LoadModelAsync("assets/space/Asteroid_4.glb"),
+        LoadModelAsync("assets/space/Asteroid_5.glb"),
+        LoadModelAsync("assets/space/Asteroid_6.glb")
     };
     Physics::ColliderMeshId colliderMeshes[6] = {
         Physics::LoadColliderMesh("assets/space/Asteroid_1_physics.glb"),
@@ -178,29 +216,77 @@ SpaceGameApp::Run()
     }
 
     SpaceShip ship;
-    ship.model = LoadModel("assets/space/spaceship.glb");
+    ship.model = LoadModelAsync("assets/space/spaceship.glb");
+    {
+        ParticleSystem::EmitterCreateInfo trail;
+        trail.maxParticles = 2000;
+        trail.minLifetime = 0.4f;
+        trail.maxLifetime = 0.8f;
+        trail.direction = glm::vec3(0, 0, -1);
+        trail.spread = 0.15f;
+        trail.minSpeed = 1.0f;
+        trail.maxSpeed = 2.0f;
+        trail.drag = 2.0f;
+        trail.startSize = 0.15f;
+        trail.endSize = 0.02f;
+        trail.colors[0] = glm::vec4(0.9f, 0.95f, 1.0f, 1.0f);
+        trail.colors[1] = glm::vec4(0.3f, 0.6f, 1.0f, 0.8f);
+        trail.colors[2] = glm::vec4(0.1f, 0.2f, 0.8f, 0.4f);
+        trail.colors[3] = glm::vec4(0.0f, 0.0f, 0.5f, 0.0f);
+        ship.engineTrail = ParticleSystem::CreateEmitter(trail);
+    }
 
     std::clock_t c_start = std::clock();
     double dt = 0.01667f;
     //bruh
+    N_PROFILE_THREAD("Main");
+
+    // all resources are loaded, hand the GL context over to the render thread
+    Core::CVar* r_render_thread = Core::CVarCreate(Core::CVarType::CVar_Int, "r_render_thread", "1", "Submit GL commands from a dedicated render thread");
+
+    // fixed length runs with a fixed step replay the same frames every time
+    Core::CVar* cl_frames = Core::CVarCreate(Core::CVarType::CVar_Int, "cl_frames", "0", "Quit after this many frames, 0 runs until closed");
+    Core::CVar* cl_fixed_timestep = Core::CVarCreate(Core::CVarType::CVar_Float, "cl_fixed_timestep", "0", "Advance the game by this many seconds each frame, 0 uses the measured frame time");
+    std::vector<float> frameTimes;
+    double totalRenderTime = 0.0;
+
     // game loop
     while (this->window->IsOpen())
 	{
+        int const maxFrames = Core::CVarReadInt(cl_frames);
+        if (maxFrames > 0 && frameTimes.size() >= (size_t)maxFrames)
+            break;
+
+        N_PROFILE_FRAME();
         auto timeStart = std::chrono::steady_clock::now();
-		glClear(GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
+
+        if ((Core::CVarReadInt(r_render_thread) != 0) != RenderThread::IsRunning())
+        {
+            if (RenderThread::IsRunning())
+                RenderThread::Stop();
+            else
+                RenderThread::Start(this->window);
+        }
         
         this->window->Update();
 
         if (kbd->pressed[Input::Key::Code::End])
         {
-            ShaderResource::ReloadShaders();
+            RenderThread::Enqueue([]() { ShaderResource::ReloadShaders(); });
+        }
+        if (kbd->pressed[Input::Key::Code::F12])
+        {
+            FrameCapture::Screenshot("screenshot_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) + ".png");
         }
 
-        ship.Update(dt);
-        ship.CheckCollisions();
+        {
+            N_PROFILE_SCOPE("SpaceShip::Update");
+            ship.Update(dt);
+            ship.CheckCollisions();
+        }
+        ParticleSystem::Update(dt);
+        // poses of the animated instances for this frame's draws
+        Animation::Update();
 
         // Draw some debug text
         Debug::DrawDebugText("FOOBAR", glm::vec3(0), {1,0,0,1});
@@ -213,18 +299,21 @@ SpaceGameApp::Run()
 
         RenderDevice::Draw(ship.model, ship.transform);
 
-        // Execute the entire rendering pipeline
+        // Hand the frame over to the render thread, which executes the rendering pipeline and presents it
         RenderDevice::Render(this->window);
 
-		// transfer new frame to window
-		this->window->SwapBuffers();
-
         auto timeEnd = std::chrono::steady_clock::now();
-        dt = std::min(0.04, std::chrono::duration<double>(timeEnd - timeStart).count());
+        double const frameTime = std::chrono::duration<double>(timeEnd - timeStart).count();
+        frameTimes.push_back((float)(frameTime * 1000.0));
+        totalRenderTime += RenderDevice::GetRenderTime();
+        float const fixedTimestep = Core::CVarReadFloat(cl_fixed_timestep);
+        dt = fixedTimestep > 0.0f ? fixedTimestep : std::min(0.04, frameTime);
 
         if (kbd->pressed[Input::Key::Code::Escape])
             this->Exit();
 	}
+
+    PrintFrameStats(std::move(frameTimes), totalRenderTime);
 }
 
 //------------------------------------------------------------------------------
@@ -233,7 +322,10 @@ SpaceGameApp::Run()
 void
 SpaceGameApp::Exit()
 {
+    RenderThread::Stop();
+    FrameCapture::Flush();
     this->window->Close();
+    Core::JobSystem::Destroy();
 }
 
 //------------------------------------------------------------------------------
@@ -254,9 +346,65 @@ SpaceGameApp::RenderUI()
         int lightSphereId = Core::CVarReadInt(r_draw_light_sphere_id);
         if (ImGui::InputInt("LightSphereId", (int*)&lightSphereId))
             Core::CVarWriteInt(r_draw_light_sphere_id, lightSphereId);
+
+        Core::CVar* r_dynamic_resolution = Core::CVarGet("r_dynamic_resolution");
+        bool dynamicResolution = Core::CVarReadInt(r_dynamic_resolution) != 0;
+        if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolution))
+            Core::CVarWriteInt(r_dynamic_resolution, dynamicResolution ? 1 : 0);
+
+        Core::CVar* r_render_scale = Core::CVarGet("r_render_scale");
+        float renderScale = Core::CVarReadFloat(r_render_scale);
+        if (ImGui::SliderFloat("Render Scale", &renderScale, 0.25f, 1.0f))
+            Core::CVarWriteFloat(r_render_scale, renderScale);
+        ImGui::Text("Scene GPU time: %.2f ms", RenderDevice::GetRenderTime());
+
+        FrameGraph::Stats const graphStats = RenderDevice::GetFrameGraphStats();
+        ImGui::Text("Frame graph: %d passes, %d culled", graphStats.numPasses, graphStats.numCulledPasses);
+        ImGui::Text("Transient targets: %d in %d textures", graphStats.numTransientTextures, graphStats.numPhysicalTextures);
+        ImGui::Text("Peak transient memory: %.1f MB (%.1f MB unaliased, %.1f MB pooled)",
+            graphStats.peakTransientBytes / (1024.0f * 1024.0f),
+            graphStats.unaliasedTransientBytes / (1024.0f * 1024.0f),
+            graphStats.pooledBytes / (1024.0f * 1024.0f));
+
+        Core::CVar* r_render_thread = Core::CVarGet("r_render_thread");
+        bool renderThread = Core::CVarReadInt(r_render_thread) != 0;
+        if (ImGui::Checkbox("Render Thread", &renderThread))
+            Core::CVarWriteInt(r_render_thread, renderThread ? 1 : 0);
+        ImGui::Text("Input latency: %.1f ms (max %.1f ms)", RenderThread::GetInputLatency(), RenderThread::GetMaxInputLatency());
+        ImGui::Text("Streaming textures: %u", TextureResource::GetNumStreamingTextures());
+        TextureResource::ResidencyStats const residency = TextureResource::GetResidencyStats();
+        ImGui::Text("Texture memory: %.1f / %.1f MB (%u reduced, %u evicted)",
+            residency.residentBytes / (1024.0f * 1024.0f),
+            residency.budgetBytes / (1024.0f * 1024.0f),
+            residency.numReduced, residency.numEvicted);
+
+        Core::CVar* r_gpu_profiler = Core::CVarGet("r_gpu_profiler");
+        bool gpuProfiler = Core::CVarReadInt(r_gpu_profiler) != 0;
+        if (ImGui::Checkbox("GPU Profiler", &gpuProfiler))
+            Core::CVarWriteInt(r_gpu_profiler, gpuProfiler ? 1 : 0);
+        
+        if (Core::Profiler::IsCaptureActive())
+            ImGui::Text("Capturing CPU trace...");
+        else if (ImGui::Button("Capture CPU Trace"))
+            Core::Profiler::CaptureFrames(60, "cpu_trace.json");
+
+        if (FrameCapture::IsRecording())
+        {
+            if (ImGui::Button("Stop Recording"))
+                FrameCapture::StopRecording();
+        }
+        else if (ImGui::Button("Record Frames"))
+        {
+            std::filesystem::create_directories("recording");
+            FrameCapture::StartRecording("recording", FrameCapture::Format::Png);
+        }
+        FrameCapture::Stats const captureStats = FrameCapture::GetStats();
+        ImGui::Text("Captured frames: %u written, %u dropped, %u failed", captureStats.written, captureStats.dropped, captureStats.failed);
         
         ImGui::End();
 
+        GpuProfiler::DrawOverlay();
+
         Debug::DispatchDebugTextDrawing();
 	}
 }
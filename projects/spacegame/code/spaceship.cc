@@ -58,6 +58,12 @@ SpaceShip::Update(float dt)
     vec3 desiredCamPos = this->position + vec3(this->transform * vec4(0, camOffsetY, -4.0f, 0));
     this->camPos = mix(this->camPos, desiredCamPos, dt * cameraSmoothFactor);
     cam->view = lookAt(this->camPos, this->camPos + vec3(this->transform[2]), vec3(this->transform[1]));
+
+    if (this->engineTrail != InvalidResourceId)
+    {
+        ParticleSystem::SetTransform(this->engineTrail, this->transform * translate(vec3(0, -0.1f, -1.0f)));
+        ParticleSystem::SetRate(this->engineTrail, 100.0f + this->currentSpeed * 400.0f);
+    }
 }
 
 bool
@@ -1,4 +1,5 @@
 #include "render/model.h"
+#include "render/particlesystem.h"
 
 namespace Game
 {
@@ -25,6 +26,8 @@ struct SpaceShip
     float rotZSmooth = 0;
 
     Render::ModelId model;
+    /// exhaust of the engine, spawns faster with speed
+    Render::ParticleSystem::EmitterId engineTrail = Render::InvalidResourceId;
 
     void Update(float dt);
 
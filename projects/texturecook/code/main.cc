@@ -0,0 +1,115 @@
+//------------------------------------------------------------------------------
+// main.cc
+// Cooks glTF models into the model cache and their textures into the texture
+// cache. Runs without a window or GL context. Run it from the bin directory,
+// like the game.
+//
+// usage: texturecook model.gltf|model.glb ...
+//
+// (C) 2022 Individual contributors, see AUTHORS file
+//------------------------------------------------------------------------------
+#include "config.h"
+#include "render/modelfile.h"
+#include "render/texturecompressor.h"
+#include "core/jobsystem.h"
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+
+/// an encoded image and how it is used
+struct CookItem
+{
+	std::string name;
+	std::vector<uint8_t> data;
+	Render::TextureUsage usage = Render::TextureUsage::Color;
+	bool sRGB = false;
+};
+
+//------------------------------------------------------------------------------
+/**
+	Cooks a model and writes it to the model cache, then collects its images
+	with the same usage and color space that the model loads them with.
+*/
+static bool
+CollectImages(std::string const& uri, std::vector<CookItem>& items)
+{
+	std::vector<uint8_t> model;
+	if (!Render::ModelFile::Cook(uri, model))
+		return false;
+	if (!Render::ModelFile::Write(Render::ModelFile::GetCachePath(uri), model))
+		printf("%s: could not write the cooked model\n", uri.c_str());
+
+	Render::ModelFile::Header const& header = *(Render::ModelFile::Header const*)model.data();
+	Render::ModelFile::Texture const* const textures = Render::ModelFile::GetTable<Render::ModelFile::Texture>(model.data(), header.textures);
+	for (uint32_t i = 0; i < header.textures.count; i++)
+	{
+		Render::ModelFile::Texture const& texture = textures[i];
+		CookItem item;
+		item.usage = (Render::TextureUsage)texture.usage;
+		item.sRGB = texture.sRGB != 0;
+		if (!texture.external)
+		{
+			item.name = uri + " image " + std::to_string(i);
+			item.data.assign(model.data() + texture.offset, model.data() + texture.offset + texture.size);
+		}
+		else
+		{
+			item.name = std::filesystem::path(uri).parent_path().string() + "/" + std::string((char const*)model.data() + texture.offset, texture.size);
+			std::ifstream stream(item.name, std::ios::binary | std::ios::ate);
+			if (!stream)
+			{
+				printf("%s: could not open '%s'\n", uri.c_str(), item.name.c_str());
+				continue;
+			}
+			item.data.resize((size_t)stream.tellg());
+			stream.seekg(0);
+			stream.read((char*)item.data.data(), item.data.size());
+		}
+		items.push_back(std::move(item));
+	}
+	return true;
+}
+
+int
+main(int argc, const char** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: texturecook model.gltf|model.glb ...\n");
+		return 1;
+	}
+
+	std::vector<CookItem> items;
+	bool ok = true;
+	for (int i = 1; i < argc; i++)
+		ok &= CollectImages(argv[i], items);
+
+	auto const start = std::chrono::steady_clock::now();
+	Core::JobSystem::Create();
+	std::atomic<uint32_t> numFailed(0);
+	std::atomic<size_t> sourceBytes(0);
+	std::atomic<size_t> cookedBytes(0);
+	Core::JobSystem::ParallelFor((uint32_t)items.size(), 1, [&](uint32_t begin, uint32_t end, uint32_t)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			CookItem const& item = items[i];
+			Render::TextureCompressor::CompressedTexture texture;
+			if (!Render::TextureCompressor::LoadCached(item.data.data(), item.data.size(), item.usage, item.sRGB, true, texture))
+			{
+				printf("could not decode '%s'\n", item.name.c_str());
+				numFailed++;
+				continue;
+			}
+			sourceBytes += item.data.size();
+			cookedBytes += texture.data.size();
+		}
+	});
+	Core::JobSystem::Destroy();
+
+	double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("cooked %u textures in %.2f s, %.2f MB encoded images to %.2f MB of block data\n",
+		(uint32_t)items.size() - numFailed.load(), seconds, sourceBytes / (1024.0 * 1024.0), cookedBytes / (1024.0 * 1024.0));
+	return (ok && numFailed == 0) ? 0 : 1;
+}